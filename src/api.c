@@ -1,6 +1,7 @@
 #include "minisphere.h"
 #include "api.h"
 #include "color.h"
+#include "gc.h"
 #include "vector.h"
 
 static double const SPHERE_API_VERSION = 1.5;
@@ -701,16 +702,12 @@ js_Delay(duk_context* ctx)
 	double millisecs = floor(duk_require_number(ctx, 0));
 	
 	double end_time;
-	double time_left;
 
 	if (millisecs < 0)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Delay(): Time cannot be negative (%.0f)", millisecs);
 	end_time = al_get_time() + millisecs / 1000;
 	do {
-		time_left = al_get_time() - end_time;
-		if (time_left > 0.001)  // engine may stall with < 1ms timeout
-			al_wait_for_event_timed(g_events, NULL, time_left);
-		do_events();
+		wait_for_events(end_time);
 	} while (al_get_time() < end_time);
 	return 0;
 }
@@ -753,8 +750,8 @@ js_FlipScreen(duk_context* ctx)
 static duk_ret_t
 js_GarbageCollect(duk_context* ctx)
 {
-	duk_gc(ctx, 0x0);
-	duk_gc(ctx, 0x0);
+	collect_garbage();
+	collect_garbage();
 	return 0;
 }
 
@@ -0,0 +1,149 @@
+#include "minisphere.h"
+#include "image.h"
+
+#include "atlas.h"
+
+// note: an atlas packs images into shared pages, left to right in rows
+//       ("shelves") as tall as the tallest image placed in them. images
+//       handed out are sub-images of a page, so Allegro can batch draws
+//       from the same page under al_hold_bitmap_drawing(). the atlas only
+//       holds on to the page it's currently filling; full pages stay alive
+//       for as long as any of their sub-images do.
+//
+//       every image gets a transparent border, so that a sprite drawn
+//       scaled or rotated with filtering doesn't pick up the edge of its
+//       neighbour. pages aren't a fixed size: when a new one is needed, it's
+//       made just big enough for the images the caller has said are coming
+//       (see reserve_atlas_space()), up to the maximum page size.
+
+#define ATLAS_PADDING   1
+#define MIN_PAGE_SIZE   64
+
+static bool clear_page     (image_t* page);
+static int  get_page_size  (long area, int min_size, int max_size);
+
+struct atlas
+{
+	int      max_w, max_h;
+	int      num_pages;
+	image_t* page;
+	int      page_w, page_h;
+	long     pending_area;
+	int      shelf_x, shelf_y;
+	int      shelf_h;
+};
+
+atlas_t*
+create_atlas(int page_width, int page_height)
+{
+	atlas_t* atlas;
+	int      max_size;
+
+	if (!(atlas = calloc(1, sizeof(atlas_t))))
+		return NULL;
+	max_size = al_get_display_option(g_display, ALLEGRO_MAX_BITMAP_SIZE);
+	if (max_size > 0) {
+		page_width = fmin(page_width, max_size);
+		page_height = fmin(page_height, max_size);
+	}
+	atlas->max_w = page_width;
+	atlas->max_h = page_height;
+	return atlas;
+}
+
+void
+free_atlas(atlas_t* atlas)
+{
+	if (atlas == NULL)
+		return;
+	free_image(atlas->page);
+	free(atlas);
+}
+
+int
+get_atlas_page_count(const atlas_t* atlas)
+{
+	return atlas->num_pages;
+}
+
+void
+reserve_atlas_space(atlas_t* atlas, int width, int height, int count)
+{
+	atlas->pending_area += (long)(width + ATLAS_PADDING * 2) * (height + ATLAS_PADDING * 2) * count;
+}
+
+image_t*
+read_atlas_image(atlas_t* atlas, FILE* file, int width, int height)
+{
+	int      cell_w, cell_h;
+	image_t* page;
+
+	cell_w = width + ATLAS_PADDING * 2;
+	cell_h = height + ATLAS_PADDING * 2;
+	atlas->pending_area = fmax(atlas->pending_area - (long)cell_w * cell_h, 0);
+
+	// images too big for a page get their own bitmap
+	if (cell_w > atlas->max_w || cell_h > atlas->max_h)
+		return read_image(file, width, height);
+
+	if (atlas->page != NULL && atlas->shelf_x + cell_w > atlas->page_w) {
+		atlas->shelf_x = 0;
+		atlas->shelf_y += atlas->shelf_h;
+		atlas->shelf_h = 0;
+	}
+	if (atlas->page == NULL || atlas->shelf_x + cell_w > atlas->page_w
+		|| atlas->shelf_y + cell_h > atlas->page_h)
+	{
+		atlas->page_w = get_page_size(atlas->pending_area + (long)cell_w * cell_h, cell_w, atlas->max_w);
+		atlas->page_h = get_page_size(atlas->pending_area + (long)cell_w * cell_h, cell_h, atlas->max_h);
+		if (!(page = create_image(atlas->page_w, atlas->page_h)))
+			return read_image(file, width, height);
+		if (!clear_page(page)) {
+			free_image(page);
+			return read_image(file, width, height);
+		}
+		free_image(atlas->page);
+		atlas->page = page;
+		atlas->shelf_x = atlas->shelf_y = 0;
+		atlas->shelf_h = 0;
+		++atlas->num_pages;
+	}
+	atlas->shelf_x += cell_w;
+	atlas->shelf_h = fmax(atlas->shelf_h, cell_h);
+	return read_subimage(file, atlas->page,
+		atlas->shelf_x - cell_w + ATLAS_PADDING, atlas->shelf_y + ATLAS_PADDING,
+		width, height);
+}
+
+static bool
+clear_page(image_t* page)
+{
+	ALLEGRO_BITMAP*        bitmap;
+	ALLEGRO_LOCKED_REGION* lock;
+
+	int i_y;
+
+	// the padding has to be transparent, and a new bitmap's contents are
+	// undefined
+	if (!(bitmap = get_image_bitmap(page)))
+		return false;
+	if (!(lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_WRITEONLY)))
+		return false;
+	for (i_y = 0; i_y < get_image_height(page); ++i_y)
+		memset((uint8_t*)lock->data + i_y * lock->pitch, 0, get_image_width(page) * 4);
+	al_unlock_bitmap(bitmap);
+	return true;
+}
+
+static int
+get_page_size(long area, int min_size, int max_size)
+{
+	int size;
+
+	// shelf packing wastes some space at the end of each shelf, so allow
+	// a quarter more than the images strictly need
+	size = MIN_PAGE_SIZE;
+	while (size < max_size && ((long)size * size < area * 5 / 4 || size < min_size))
+		size *= 2;
+	return fmin(size, max_size);
+}
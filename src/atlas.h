@@ -0,0 +1,14 @@
+#ifndef MINISPHERE__ATLAS_H__INCLUDED
+#define MINISPHERE__ATLAS_H__INCLUDED
+
+#include "image.h"
+
+typedef struct atlas atlas_t;
+
+extern atlas_t* create_atlas         (int page_width, int page_height);
+extern void     free_atlas           (atlas_t* atlas);
+extern int      get_atlas_page_count (const atlas_t* atlas);
+extern void     reserve_atlas_space  (atlas_t* atlas, int width, int height, int count);
+extern image_t* read_atlas_image     (atlas_t* atlas, FILE* file, int width, int height);
+
+#endif // MINISPHERE__ATLAS_H__INCLUDED
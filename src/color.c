@@ -2,12 +2,15 @@
 #include "api.h"
 #include "color.h"
 
-static duk_ret_t js_BlendColors         (duk_context* ctx);
-static duk_ret_t js_BlendColorsWeighted (duk_context* ctx);
-static duk_ret_t js_CreateColor         (duk_context* ctx);
-static duk_ret_t js_new_Color           (duk_context* ctx);
-static duk_ret_t js_Color_toString      (duk_context* ctx);
-static duk_ret_t js_Color_clone         (duk_context* ctx);
+static duk_ret_t js_BlendColors          (duk_context* ctx);
+static duk_ret_t js_BlendColorsWeighted  (duk_context* ctx);
+static duk_ret_t js_CreateColor          (duk_context* ctx);
+static duk_ret_t js_CreateColorMatrix    (duk_context* ctx);
+static duk_ret_t js_new_Color            (duk_context* ctx);
+static duk_ret_t js_Color_toString       (duk_context* ctx);
+static duk_ret_t js_Color_clone          (duk_context* ctx);
+static duk_ret_t js_new_ColorMatrix      (duk_context* ctx);
+static duk_ret_t js_ColorMatrix_toString (duk_context* ctx);
 
 color_t
 rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t alpha)
@@ -41,17 +44,33 @@ blend_colors(color_t color1, color_t color2, float w1, float w2)
 	return blend;
 }
 
+colormatrix_t
+colormatrix(int rn, int rr, int rg, int rb, int gn, int gr, int gg, int gb, int bn, int br, int bg, int bb)
+{
+	colormatrix_t matrix = {
+		rn, rr, rg, rb,
+		gn, gr, gg, gb,
+		bn, br, bg, bb,
+	};
+	return matrix;
+}
+
 void
 init_color_api(void)
 {
 	register_api_function(g_duk, NULL, "BlendColors", js_BlendColors);
 	register_api_function(g_duk, NULL, "BlendColorsWeighted", js_BlendColorsWeighted);
 	register_api_function(g_duk, NULL, "CreateColor", js_CreateColor);
+	register_api_function(g_duk, NULL, "CreateColorMatrix", js_CreateColorMatrix);
 	
 	// register Color methods and properties
 	register_api_ctor(g_duk, "Color", js_new_Color, NULL);
 	register_api_function(g_duk, "Color", "toString", js_Color_toString);
 	register_api_function(g_duk, "Color", "clone", js_Color_clone);
+
+	// register ColorMatrix methods and properties
+	register_api_ctor(g_duk, "ColorMatrix", js_new_ColorMatrix, NULL);
+	register_api_function(g_duk, "ColorMatrix", "toString", js_ColorMatrix_toString);
 }
 
 void
@@ -67,6 +86,27 @@ duk_push_sphere_color(duk_context* ctx, color_t color)
 	duk_remove(ctx, -2);
 }
 
+void
+duk_push_sphere_colormatrix(duk_context* ctx, colormatrix_t matrix)
+{
+	duk_push_global_object(ctx);
+	duk_get_prop_string(ctx, -1, "ColorMatrix");
+	duk_push_int(ctx, matrix.rn);
+	duk_push_int(ctx, matrix.rr);
+	duk_push_int(ctx, matrix.rg);
+	duk_push_int(ctx, matrix.rb);
+	duk_push_int(ctx, matrix.gn);
+	duk_push_int(ctx, matrix.gr);
+	duk_push_int(ctx, matrix.gg);
+	duk_push_int(ctx, matrix.gb);
+	duk_push_int(ctx, matrix.bn);
+	duk_push_int(ctx, matrix.br);
+	duk_push_int(ctx, matrix.bg);
+	duk_push_int(ctx, matrix.bb);
+	duk_new(ctx, 12);
+	duk_remove(ctx, -2);
+}
+
 color_t
 duk_require_sphere_color(duk_context* ctx, duk_idx_t index)
 {
@@ -80,6 +120,27 @@ duk_require_sphere_color(duk_context* ctx, duk_idx_t index)
 	return color;
 }
 
+colormatrix_t
+duk_require_sphere_colormatrix(duk_context* ctx, duk_idx_t index)
+{
+	colormatrix_t matrix;
+	
+	duk_require_sphere_obj(ctx, index, "ColorMatrix");
+	duk_get_prop_string(ctx, index, "rn"); matrix.rn = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "rr"); matrix.rr = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "rg"); matrix.rg = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "rb"); matrix.rb = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "gn"); matrix.gn = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "gr"); matrix.gr = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "gg"); matrix.gg = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "gb"); matrix.gb = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "bn"); matrix.bn = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "br"); matrix.br = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "bg"); matrix.bg = duk_to_int(ctx, -1); duk_pop(ctx);
+	duk_get_prop_string(ctx, index, "bb"); matrix.bb = duk_to_int(ctx, -1); duk_pop(ctx);
+	return matrix;
+}
+
 static duk_ret_t
 js_BlendColors(duk_context* ctx)
 {
@@ -121,6 +182,26 @@ js_CreateColor(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_CreateColorMatrix(duk_context* ctx)
+{
+	int rn = duk_require_int(ctx, 0);
+	int rr = duk_require_int(ctx, 1);
+	int rg = duk_require_int(ctx, 2);
+	int rb = duk_require_int(ctx, 3);
+	int gn = duk_require_int(ctx, 4);
+	int gr = duk_require_int(ctx, 5);
+	int gg = duk_require_int(ctx, 6);
+	int gb = duk_require_int(ctx, 7);
+	int bn = duk_require_int(ctx, 8);
+	int br = duk_require_int(ctx, 9);
+	int bg = duk_require_int(ctx, 10);
+	int bb = duk_require_int(ctx, 11);
+
+	duk_push_sphere_colormatrix(ctx, colormatrix(rn, rr, rg, rb, gn, gr, gg, gb, bn, br, bg, bb));
+	return 1;
+}
+
 static duk_ret_t
 js_new_Color(duk_context* ctx)
 {
@@ -163,3 +244,43 @@ js_Color_clone(duk_context* ctx)
 	duk_push_sphere_color(ctx, color);
 	return 1;
 }
+
+static duk_ret_t
+js_new_ColorMatrix(duk_context* ctx)
+{
+	int rn = duk_require_int(ctx, 0);
+	int rr = duk_require_int(ctx, 1);
+	int rg = duk_require_int(ctx, 2);
+	int rb = duk_require_int(ctx, 3);
+	int gn = duk_require_int(ctx, 4);
+	int gr = duk_require_int(ctx, 5);
+	int gg = duk_require_int(ctx, 6);
+	int gb = duk_require_int(ctx, 7);
+	int bn = duk_require_int(ctx, 8);
+	int br = duk_require_int(ctx, 9);
+	int bg = duk_require_int(ctx, 10);
+	int bb = duk_require_int(ctx, 11);
+
+	// construct a ColorMatrix object
+	duk_push_sphere_obj(ctx, "ColorMatrix", NULL);
+	duk_push_int(ctx, rn); duk_put_prop_string(ctx, -2, "rn");
+	duk_push_int(ctx, rr); duk_put_prop_string(ctx, -2, "rr");
+	duk_push_int(ctx, rg); duk_put_prop_string(ctx, -2, "rg");
+	duk_push_int(ctx, rb); duk_put_prop_string(ctx, -2, "rb");
+	duk_push_int(ctx, gn); duk_put_prop_string(ctx, -2, "gn");
+	duk_push_int(ctx, gr); duk_put_prop_string(ctx, -2, "gr");
+	duk_push_int(ctx, gg); duk_put_prop_string(ctx, -2, "gg");
+	duk_push_int(ctx, gb); duk_put_prop_string(ctx, -2, "gb");
+	duk_push_int(ctx, bn); duk_put_prop_string(ctx, -2, "bn");
+	duk_push_int(ctx, br); duk_put_prop_string(ctx, -2, "br");
+	duk_push_int(ctx, bg); duk_put_prop_string(ctx, -2, "bg");
+	duk_push_int(ctx, bb); duk_put_prop_string(ctx, -2, "bb");
+	return 1;
+}
+
+static duk_ret_t
+js_ColorMatrix_toString(duk_context* ctx)
+{
+	duk_push_string(ctx, "[object colormatrix]");
+	return 1;
+}
@@ -1,15 +1,19 @@
 #ifndef MINISPHERE__COLOR_H__INCLUDED
 #define MINISPHERE__COLOR_H__INCLUDED
 
-typedef struct color color_t;
+typedef struct color       color_t;
+typedef struct colormatrix colormatrix_t;
 
 extern color_t       rgba         (uint8_t r, uint8_t g, uint8_t b, uint8_t alpha);
 extern ALLEGRO_COLOR nativecolor  (color_t color);
 extern color_t       blend_colors (color_t color1, color_t color2, float w1, float w2);
+extern colormatrix_t colormatrix  (int rn, int rr, int rg, int rb, int gn, int gr, int gg, int gb, int bn, int br, int bg, int bb);
 
-extern void    init_color_api           (void);
-extern void    duk_push_sphere_color    (duk_context* ctx, color_t color);
-extern color_t duk_require_sphere_color (duk_context* ctx, duk_idx_t index);
+extern void          init_color_api                 (void);
+extern void          duk_push_sphere_color          (duk_context* ctx, color_t color);
+extern void          duk_push_sphere_colormatrix    (duk_context* ctx, colormatrix_t matrix);
+extern color_t       duk_require_sphere_color       (duk_context* ctx, duk_idx_t index);
+extern colormatrix_t duk_require_sphere_colormatrix (duk_context* ctx, duk_idx_t index);
 
 struct color
 {
@@ -19,4 +23,11 @@ struct color
 	uint8_t alpha;
 };
 
+struct colormatrix
+{
+	int rn, rr, rg, rb;
+	int gn, gr, gg, gb;
+	int bn, br, bg, bb;
+};
+
 #endif // MINISPHERE__COLOR_H__INCLUDED
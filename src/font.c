@@ -2,49 +2,87 @@
 #include "api.h"
 #include "color.h"
 #include "image.h"
+#include "render.h"
+#include "ttf.h"
 
 #include "font.h"
 
-static duk_ret_t js_GetSystemFont          (duk_context* ctx);
-static duk_ret_t js_LoadFont               (duk_context* ctx);
-static duk_ret_t js_new_Font               (duk_context* ctx);
-static duk_ret_t js_Font_finalize          (duk_context* ctx);
-static duk_ret_t js_Font_toString          (duk_context* ctx);
-static duk_ret_t js_Font_get_colorMask     (duk_context* ctx);
-static duk_ret_t js_Font_set_colorMask     (duk_context* ctx);
-static duk_ret_t js_Font_get_height        (duk_context* ctx);
-static duk_ret_t js_Font_getCharacterImage (duk_context* ctx);
-static duk_ret_t js_Font_setCharacterImage (duk_context* ctx);
-static duk_ret_t js_Font_getStringHeight   (duk_context* ctx);
-static duk_ret_t js_Font_getStringWidth    (duk_context* ctx);
-static duk_ret_t js_Font_clone             (duk_context* ctx);
-static duk_ret_t js_Font_drawText          (duk_context* ctx);
-static duk_ret_t js_Font_drawTextBox       (duk_context* ctx);
-static duk_ret_t js_Font_drawZoomedText    (duk_context* ctx);
-static duk_ret_t js_Font_wordWrapString    (duk_context* ctx);
+static duk_ret_t js_GetSystemFont           (duk_context* ctx);
+static duk_ret_t js_LoadFont                (duk_context* ctx);
+static duk_ret_t js_new_Font                (duk_context* ctx);
+static duk_ret_t js_Font_finalize           (duk_context* ctx);
+static duk_ret_t js_Font_toString           (duk_context* ctx);
+static duk_ret_t js_Font_get_colorMask      (duk_context* ctx);
+static duk_ret_t js_Font_set_colorMask      (duk_context* ctx);
+static duk_ret_t js_Font_get_height         (duk_context* ctx);
+static duk_ret_t js_Font_getCharacterImage  (duk_context* ctx);
+static duk_ret_t js_Font_setCharacterImage  (duk_context* ctx);
+static duk_ret_t js_Font_getStringHeight    (duk_context* ctx);
+static duk_ret_t js_Font_getStringWidth     (duk_context* ctx);
+static duk_ret_t js_Font_clone              (duk_context* ctx);
+static duk_ret_t js_Font_getGlyphCacheStats (duk_context* ctx);
+static duk_ret_t js_Font_drawText           (duk_context* ctx);
+static duk_ret_t js_Font_drawTextBox        (duk_context* ctx);
+static duk_ret_t js_Font_drawZoomedText     (duk_context* ctx);
+static duk_ret_t js_Font_wordWrapString     (duk_context* ctx);
+static duk_ret_t js_new_TextRun             (duk_context* ctx);
+static duk_ret_t js_TextRun_finalize        (duk_context* ctx);
+static duk_ret_t js_TextRun_get_color       (duk_context* ctx);
+static duk_ret_t js_TextRun_set_color       (duk_context* ctx);
+static duk_ret_t js_TextRun_get_text        (duk_context* ctx);
+static duk_ret_t js_TextRun_set_text        (duk_context* ctx);
+static duk_ret_t js_TextRun_get_width       (duk_context* ctx);
+static duk_ret_t js_TextRun_draw            (duk_context* ctx);
 
 struct font
 {
 	int                refcount;
+	image_t*           atlas;
+	bool               has_loose_glyphs;
+	unsigned int       layout_id;
 	int                height;
 	int                min_width;
 	int                max_width;
 	int                pitch;
 	int                num_glyphs;
 	struct font_glyph* glyphs;
+	ttf_t*             ttf;
 };
 
 struct font_glyph
 {
 	int      width, height;
+	int      atlas_x, atlas_y;
 	image_t* image;
 };
 
+struct text_run
+{
+	color_t         color;
+	font_t*         font;
+	unsigned int    layout_id;
+	int             num_vertices;
+	char*           text;
+	ALLEGRO_VERTEX* vertices;
+};
+
 struct wraptext
 {
+	int    refcount;
 	int    num_lines;
 	char*  buffer;
-	size_t pitch;
+	char** lines;
+};
+
+struct wrap_cache_entry
+{
+	const font_t* font;
+	unsigned int  layout_id;
+	int           width;
+	uint32_t      hash;
+	char*         text;
+	wraptext_t*   wraptext;
+	unsigned int  last_used;
 };
 
 #pragma pack(push, 1)
@@ -64,6 +102,56 @@ struct rfn_glyph_header
 };
 #pragma pack(pop)
 
+static int         advance_char     (const font_t* font, const char* text, int* inout_width);
+static bool        can_batch_text   (const font_t* font);
+static int         build_glyph_run  (const font_t* font, ALLEGRO_COLOR color, float x, float y, const char* text, ALLEGRO_VERTEX* vertices);
+static bool        update_text_run  (struct text_run* run);
+static wraptext_t* wrap_text_lines  (const font_t* font, const char* text, int width);
+
+// word wrapping the same text over and over (dialogue boxes redraw every
+// frame) is common enough to be worth caching. entries are keyed on the
+// font's layout ID rather than the font itself, which changes whenever a
+// glyph does, so a stale or reused font pointer can never match.
+#define WRAP_CACHE_SIZE 64
+
+// note: text is drawn from the glyph atlas load_font() builds, as one run
+//       of textured quads per string submitted in a single al_draw_prim()
+//       call. a glyph replaced with setCharacterImage() isn't in the atlas
+//       anymore, so a font with any of those goes back to drawing one glyph
+//       at a time. TrueType fonts (see ttf.c) keep an atlas of their own.
+
+static int             s_max_run_verts = 0;
+static ALLEGRO_VERTEX* s_run_verts = NULL;
+
+static unsigned int            s_next_layout_id = 1;
+static unsigned int            s_wrap_clock = 0;
+static struct wrap_cache_entry s_wrap_cache[WRAP_CACHE_SIZE];
+
+void
+initialize_fonts(void)
+{
+	printf("Initializing font manager\n");
+	memset(s_wrap_cache, 0, sizeof(s_wrap_cache));
+	s_wrap_clock = 0;
+}
+
+void
+shutdown_fonts(void)
+{
+	int i;
+
+	printf("Shutting down font manager\n");
+	for (i = 0; i < WRAP_CACHE_SIZE; ++i) {
+		free_wraptext(s_wrap_cache[i].wraptext);
+		free(s_wrap_cache[i].text);
+	}
+	memset(s_wrap_cache, 0, sizeof(s_wrap_cache));
+	free(s_run_verts);
+	s_run_verts = NULL;
+	s_max_run_verts = 0;
+	shutdown_ttf();
+}
+
 font_t*
 load_font(const char* path)
 {
@@ -127,8 +215,9 @@ load_font(const char* path)
 		size_t data_size = glyph_hdr.width * glyph_hdr.height * pixel_size;
 		void* data = malloc(data_size);
 		if (fread(data, 1, data_size, file) != data_size) goto on_error;
-		glyph->image = create_subimage(atlas,
-			i % n_glyphs_per_row * max_x, i / n_glyphs_per_row * max_y,
+		glyph->atlas_x = i % n_glyphs_per_row * max_x;
+		glyph->atlas_y = i / n_glyphs_per_row * max_y;
+		glyph->image = create_subimage(atlas, glyph->atlas_x, glyph->atlas_y,
 			glyph_hdr.width, glyph_hdr.height);
 		if (glyph->image == NULL) goto on_error;
 		if ((bitmap_lock = al_lock_bitmap(get_image_bitmap(glyph->image), ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_WRITEONLY)) == NULL)
@@ -160,7 +249,8 @@ load_font(const char* path)
 		free(data);
 	}
 	fclose(file);
-	free_image(atlas);
+	font->atlas = atlas;
+	font->layout_id = s_next_layout_id++;
 	return ref_font(font);
 
 on_error:
@@ -175,6 +265,34 @@ on_error:
 	return NULL;
 }
 
+font_t*
+load_ttf_font(const char* path, int size)
+{
+	font_t* font;
+	char    text[2];
+	int     width;
+
+	int i;
+
+	if (!(font = calloc(1, sizeof(font_t))))
+		return NULL;
+	if (!(font->ttf = load_ttf(path, size))) {
+		free(font);
+		return NULL;
+	}
+	font->height = get_ttf_line_height(font->ttf);
+	font->min_width = INT_MAX;
+	for (i = 32; i < 127; ++i) {
+		text[0] = i; text[1] = '\0';
+		width = 0;
+		advance_char(font, text, &width);
+		font->min_width = fmin(font->min_width, width);
+		font->max_width = fmax(font->max_width, width);
+	}
+	font->layout_id = s_next_layout_id++;
+	return ref_font(font);
+}
+
 font_t*
 ref_font(font_t* font)
 {
@@ -192,6 +310,8 @@ free_font(font_t* font)
 	for (i = 0; i < font->num_glyphs; ++i) {
 		free_image(font->glyphs[i].image);
 	}
+	free_image(font->atlas);
+	free_ttf(font->ttf);
 	free(font->glyphs);
 	free(font);
 }
@@ -210,43 +330,100 @@ get_font_metrics(const font_t* font, int* out_min_width, int* out_max_width, int
 	if (out_line_height) *out_line_height = font->height;
 }
 
+bool
+get_font_cache_stats(const font_t* font, ttf_stats_t* out_stats)
+{
+	if (font->ttf == NULL)
+		return false;
+	get_ttf_stats(font->ttf, out_stats);
+	return true;
+}
+
 image_t*
 get_glyph_image(const font_t* font, int codepoint)
 {
+	// TrueType glyphs only exist as cells in the glyph cache
+	if (font->glyphs == NULL)
+		return NULL;
 	return font->glyphs[codepoint].image;
 }
 
 int
 get_text_width(const font_t* font, const char* text)
 {
-	int cp;
 	int width = 0;
 	
-	while ((cp = *text++) != '\0') {
-		width += font->glyphs[cp].width;
-	}
+	while (*text != '\0')
+		text += advance_char(font, text, &width);
 	return width;
 }
 
-void
+bool
 set_glyph_image(font_t* font, int codepoint, image_t* image)
 {
 	image_t*           old_image;
 	struct font_glyph* p_glyph;
 	
+	if (font->glyphs == NULL)
+		return false;
 	p_glyph = &font->glyphs[codepoint];
 	old_image = p_glyph->image;
 	p_glyph->image = ref_image(image);
 	p_glyph->width = get_image_width(image);
 	p_glyph->height = get_image_height(image);
+	font->has_loose_glyphs = true;
+	font->layout_id = s_next_layout_id++;
 	free_image(old_image);
+	return true;
 }
 
 void
 draw_text(const font_t* font, color_t color, int x, int y, text_align_t alignment, const char* text)
 {
-	bool is_draw_held;
-	int  cp;
+	bool            is_draw_held;
+	int             cp;
+	ALLEGRO_VERTEX* new_verts;
+	int             new_max;
+	int             num_verts;
+	int             shift;
+	size_t          length;
+	
+	int i;
+
+	if (font->ttf != NULL) {
+		if (alignment == TEXT_ALIGN_CENTER)
+			x -= get_text_width(font, text) / 2;
+		else if (alignment == TEXT_ALIGN_RIGHT)
+			x -= get_text_width(font, text);
+		draw_ttf_text(font->ttf, color, x, y, text);
+		return;
+	}
+	if (can_batch_text(font)) {
+		length = strlen(text);
+		if (length == 0)
+			return;
+		if (length * 6 > (size_t)s_max_run_verts) {
+			new_max = length * 6;
+			if (!(new_verts = realloc(s_run_verts, new_max * sizeof(ALLEGRO_VERTEX))))
+				return;
+			s_run_verts = new_verts;
+			s_max_run_verts = new_max;
+		}
+		num_verts = build_glyph_run(font, nativecolor(color), x, y, text, s_run_verts);
+		
+		// the run is measured as it's built, so alignment is applied after
+		// the fact instead of walking the string twice
+		shift = alignment == TEXT_ALIGN_CENTER ? (int)(s_run_verts[num_verts - 2].x - x) / 2
+			: alignment == TEXT_ALIGN_RIGHT ? (int)(s_run_verts[num_verts - 2].x - x)
+			: 0;
+		if (shift != 0) {
+			for (i = 0; i < num_verts; ++i)
+				s_run_verts[i].x -= shift;
+		}
+		flush_render_batch();
+		al_draw_prim(s_run_verts, NULL, get_image_bitmap(font->atlas), 0, num_verts, ALLEGRO_PRIM_TRIANGLE_LIST);
+		return;
+	}
 	
 	if (alignment == TEXT_ALIGN_CENTER)
 		x -= get_text_width(font, text) / 2;
@@ -264,69 +441,64 @@ draw_text(const font_t* font, color_t color, int x, int y, text_align_t alignmen
 wraptext_t*
 word_wrap_text(const font_t* font, const char* text, int width)
 {
-	char*       buffer = NULL;
-	int         glyph_width;
-	int         line_idx;
-	int         line_width;
-	int         max_lines = 10;
-	char*       line_buffer;
-	char*       new_buffer;
-	size_t      pitch;
-	int         space_width = get_text_width(font, " ");
-	char*       string = NULL;
-	char*       word;
-	wraptext_t* wraptext;
+	struct wrap_cache_entry* entry;
+	uint32_t                 hash;
+	const char*              p;
+	struct wrap_cache_entry* victim;
+	wraptext_t*              wraptext;
 
-	if (!(wraptext = calloc(1, sizeof(wraptext_t)))) goto on_error;
-	
-	// allocate initial buffer
-	get_font_metrics(font, &glyph_width, NULL, NULL);
-	pitch = glyph_width > 0 ? width / glyph_width + 2 : width;
-	if (!(buffer = malloc(max_lines * pitch))) goto on_error;
+	int i;
+
+	// FNV-1a
+	hash = 2166136261U;
+	for (p = text; *p != '\0'; ++p)
+		hash = (hash ^ (uint8_t)*p) * 16777619U;
 	
-	// run through string one word at a time, wrapping as necessary
-	line_buffer = buffer; line_buffer[0] = '\0';
-	line_idx = 0; line_width = 0;
-	string = strdup(text);
-	word = strtok(string, " ");
-	while (word != NULL) {
-		line_width += get_text_width(font, word);
-		if (line_width > width) {  // time for a new line?
-			if (++line_idx >= max_lines) {  // enlarge the buffer?
-				max_lines *= 2;
-				if (!(new_buffer = realloc(buffer, max_lines * pitch)))
-					goto on_error;
-				buffer = new_buffer;
-				line_buffer = buffer + line_idx * pitch;
-			}
-			else
-				line_buffer += pitch;
-			line_width = get_text_width(font, word);
-			line_buffer[0] = '\0';
-		}
-		strcat(line_buffer, word);
-		word = strtok(NULL, " ");
-		if (word != NULL) {
-			strcat(line_buffer, " ");
-			line_width += space_width;
+	victim = &s_wrap_cache[0];
+	for (i = 0; i < WRAP_CACHE_SIZE; ++i) {
+		entry = &s_wrap_cache[i];
+		if (entry->wraptext != NULL && entry->hash == hash && entry->font == font
+			&& entry->layout_id == font->layout_id && entry->width == width
+			&& strcmp(entry->text, text) == 0)
+		{
+			entry->last_used = s_wrap_clock++;
+			return ref_wraptext(entry->wraptext);
 		}
+		if (entry->wraptext == NULL || (victim->wraptext != NULL && entry->last_used < victim->last_used))
+			victim = entry;
+	}
+	
+	if (!(wraptext = wrap_text_lines(font, text, width)))
+		return NULL;
+	if (victim->wraptext != NULL) {
+		free_wraptext(victim->wraptext);
+		free(victim->text);
+		victim->wraptext = NULL;
+	}
+	if ((victim->text = strdup(text)) != NULL) {
+		victim->font = font;
+		victim->layout_id = font->layout_id;
+		victim->width = width;
+		victim->hash = hash;
+		victim->wraptext = ref_wraptext(wraptext);
+		victim->last_used = s_wrap_clock++;
 	}
-	free(string);
-	wraptext->num_lines = line_idx + 1;
-	wraptext->buffer = buffer;
-	wraptext->pitch = pitch;
 	return wraptext;
+}
 
-on_error:
-	free(string);
-	free(buffer);
-	free(wraptext);
-	return NULL;
+wraptext_t*
+ref_wraptext(wraptext_t* wraptext)
+{
+	++wraptext->refcount;
+	return wraptext;
 }
 
 void
 free_wraptext(wraptext_t* wraptext)
 {
+	if (wraptext == NULL || --wraptext->refcount > 0)
+		return;
+	free(wraptext->lines);
 	free(wraptext->buffer);
 	free(wraptext);
 }
@@ -334,7 +506,7 @@ free_wraptext(wraptext_t* wraptext)
 const char*
 get_wraptext_line(const wraptext_t* wraptext, int line_index)
 {
-	return wraptext->buffer + line_index * wraptext->pitch;
+	return wraptext->lines[line_index];
 }
 
 int
@@ -343,6 +515,132 @@ get_wraptext_line_count(const wraptext_t* wraptext)
 	return wraptext->num_lines;
 }
 
+static int
+advance_char(const font_t* font, const char* text, int* inout_width)
+{
+	// RFN fonts map each byte to a glyph; TrueType text is UTF-8
+	if (font->ttf != NULL)
+		return read_ttf_char(font->ttf, text, inout_width);
+	*inout_width += font->glyphs[(uint8_t)*text].width;
+	return 1;
+}
+
+static bool
+can_batch_text(const font_t* font)
+{
+	return font->atlas != NULL && !font->has_loose_glyphs;
+}
+
+static int
+build_glyph_run(const font_t* font, ALLEGRO_COLOR color, float x, float y, const char* text, ALLEGRO_VERTEX* vertices)
+{
+	const struct font_glyph* glyph;
+	ALLEGRO_VERTEX*          v;
+	float                    x1, y1;
+	float                    u0, v0, u1, v1;
+
+	v = vertices;
+	while (*text != '\0') {
+		glyph = &font->glyphs[(uint8_t)*text++];
+		x1 = x + glyph->width; y1 = y + glyph->height;
+		u0 = glyph->atlas_x; u1 = u0 + glyph->width;
+		v0 = glyph->atlas_y; v1 = v0 + glyph->height;
+		v[0].x = x; v[0].y = y; v[0].u = u0; v[0].v = v0;
+		v[1].x = x1; v[1].y = y; v[1].u = u1; v[1].v = v0;
+		v[2].x = x; v[2].y = y1; v[2].u = u0; v[2].v = v1;
+		v[3] = v[1];
+		v[4].x = x1; v[4].y = y1; v[4].u = u1; v[4].v = v1;
+		v[5] = v[2];
+		v[0].z = v[1].z = v[2].z = v[3].z = v[4].z = v[5].z = 0.0;
+		v[0].color = v[1].color = v[2].color = v[3].color = v[4].color = v[5].color = color;
+		x = x1;
+		v += 6;
+	}
+	return v - vertices;
+}
+
+static bool
+update_text_run(struct text_run* run)
+{
+	ALLEGRO_VERTEX* new_verts;
+	int             num_verts;
+
+	if (run->vertices != NULL && run->layout_id == run->font->layout_id)
+		return true;
+	num_verts = strlen(run->text) * 6;
+	if (!(new_verts = realloc(run->vertices, (num_verts > 0 ? num_verts : 1) * sizeof(ALLEGRO_VERTEX))))
+		return false;
+	run->vertices = new_verts;
+	run->num_vertices = build_glyph_run(run->font, nativecolor(run->color), 0, 0, run->text, run->vertices);
+	run->layout_id = run->font->layout_id;
+	return true;
+}
+
+static wraptext_t*
+wrap_text_lines(const font_t* font, const char* text, int width)
+{
+	char*       buffer = NULL;
+	int         gap_width = 0;
+	char*       line_end = NULL;
+	int         line_width = 0;
+	char**      lines = NULL;
+	int         max_lines = 8;
+	char**      new_lines;
+	char*       p;
+	char*       word;
+	int         word_width;
+	wraptext_t* wraptext = NULL;
+
+	// this is a single pass over the text: each word is measured once and
+	// either goes on the current line or starts a new one. lines are left
+	// in place in a copy of the text, with the space at each break turned
+	// into a terminator, instead of being copied out.
+	if (!(wraptext = calloc(1, sizeof(wraptext_t)))) goto on_error;
+	if (!(buffer = strdup(text))) goto on_error;
+	if (!(lines = malloc(max_lines * sizeof(char*)))) goto on_error;
+	wraptext->num_lines = 1;
+	p = buffer;
+	while (*p == ' ') ++p;
+	lines[0] = p;
+	while (*p != '\0') {
+		word = p;
+		word_width = 0;
+		while (*p != ' ' && *p != '\0')
+			p += advance_char(font, p, &word_width);
+		if (line_end != NULL && line_width + gap_width + word_width > width) {
+			// time for a new line. a word too long to fit on any line still
+			// gets one to itself.
+			if (wraptext->num_lines >= max_lines) {
+				max_lines *= 2;
+				if (!(new_lines = realloc(lines, max_lines * sizeof(char*))))
+					goto on_error;
+				lines = new_lines;
+			}
+			*line_end = '\0';
+			lines[wraptext->num_lines++] = word;
+			line_width = word_width;
+		}
+		else
+			line_width += gap_width + word_width;
+		line_end = p;
+		gap_width = 0;
+		while (*p == ' ')
+			p += advance_char(font, p, &gap_width);
+	}
+	if (line_end != NULL)
+		*line_end = '\0';  // drop trailing spaces
+	wraptext->refcount = 1;
+	wraptext->buffer = buffer;
+	wraptext->lines = lines;
+	return wraptext;
+
+on_error:
+	free(lines);
+	free(buffer);
+	free(wraptext);
+	return NULL;
+}
+
 void
 init_font_api(duk_context* ctx)
 {
@@ -356,6 +654,7 @@ init_font_api(duk_context* ctx)
 	register_api_prop(ctx, "Font", "height", js_Font_get_height, NULL);
 	register_api_function(ctx, "Font", "getCharacterImage", js_Font_getCharacterImage);
 	register_api_function(ctx, "Font", "getColorMask", js_Font_get_colorMask);
+	register_api_function(ctx, "Font", "getGlyphCacheStats", js_Font_getGlyphCacheStats);
 	register_api_function(ctx, "Font", "getHeight", js_Font_get_height);
 	register_api_function(ctx, "Font", "getStringHeight", js_Font_getStringHeight);
 	register_api_function(ctx, "Font", "getStringWidth", js_Font_getStringWidth);
@@ -367,6 +666,13 @@ init_font_api(duk_context* ctx)
 	register_api_function(ctx, "Font", "drawTextBox", js_Font_drawTextBox);
 	register_api_function(ctx, "Font", "drawZoomedText", js_Font_drawZoomedText);
 	register_api_function(ctx, "Font", "wordWrapString", js_Font_wordWrapString);
+
+	// TextRun object
+	register_api_ctor(ctx, "TextRun", js_new_TextRun, js_TextRun_finalize);
+	register_api_prop(ctx, "TextRun", "color", js_TextRun_get_color, js_TextRun_set_color);
+	register_api_prop(ctx, "TextRun", "text", js_TextRun_get_text, js_TextRun_set_text);
+	register_api_prop(ctx, "TextRun", "width", js_TextRun_get_width, NULL);
+	register_api_function(ctx, "TextRun", "draw", js_TextRun_draw);
 }
 
 void
@@ -396,12 +702,22 @@ js_LoadFont(duk_context* ctx)
 static duk_ret_t
 js_new_Font(duk_context* ctx)
 {
+	int n_args = duk_get_top(ctx);
 	const char* filename = duk_require_string(ctx, 0);
+	int size = n_args >= 2 ? duk_require_int(ctx, 1) : 16;
 
-	font_t* font;
-
-	char* path = get_asset_path(filename, "fonts", false);
-	font = load_font(path);
+	const char* extension;
+	font_t*     font;
+	char*       path;
+
+	if (size <= 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Font(): Font size must be greater than zero (%i)", size);
+	path = get_asset_path(filename, "fonts", false);
+	extension = strrchr(filename, '.');
+	if (extension != NULL && (strcasecmp(extension, ".ttf") == 0 || strcasecmp(extension, ".otf") == 0))
+		font = load_ttf_font(path, size);
+	else
+		font = load_font(path);
 	free(path);
 	if (font == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Font(): Failed to load font file '%s'", filename);
@@ -432,12 +748,15 @@ js_Font_getCharacterImage(duk_context* ctx)
 {
 	int cp = duk_require_int(ctx, 0);
 
-	font_t* font;
+	font_t*  font;
+	image_t* image;
 	
 	duk_push_this(ctx);
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_pop(ctx);
-	duk_push_sphere_image(ctx, get_glyph_image(font, cp));
+	if (!(image = get_glyph_image(font, cp)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Font:getCharacterImage(): Font has no character images");
+	duk_push_sphere_image(ctx, image);
 	return 1;
 }
 
@@ -485,10 +804,36 @@ js_Font_setCharacterImage(duk_context* ctx)
 	duk_push_this(ctx);
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_pop(ctx);
-	set_glyph_image(font, cp, image);
+	if (!set_glyph_image(font, cp, image))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Font:setCharacterImage(): Font has no character images");
 	return 0;
 }
 
+static duk_ret_t
+js_Font_getGlyphCacheStats(duk_context* ctx)
+{
+	font_t*     font;
+	int64_t     lookups;
+	ttf_stats_t stats;
+
+	duk_push_this(ctx);
+	font = duk_require_sphere_obj(ctx, -1, "Font");
+	duk_pop(ctx);
+	if (!get_font_cache_stats(font, &stats)) {
+		duk_push_null(ctx);
+		return 1;
+	}
+	lookups = stats.hits + stats.misses;
+	duk_push_object(ctx);
+	duk_push_number(ctx, stats.hits); duk_put_prop_string(ctx, -2, "hits");
+	duk_push_number(ctx, stats.misses); duk_put_prop_string(ctx, -2, "misses");
+	duk_push_number(ctx, stats.evictions); duk_put_prop_string(ctx, -2, "evictions");
+	duk_push_number(ctx, lookups > 0 ? (double)stats.hits / lookups : 0.0); duk_put_prop_string(ctx, -2, "hitRate");
+	duk_push_int(ctx, stats.num_glyphs); duk_put_prop_string(ctx, -2, "glyphs");
+	duk_push_int(ctx, stats.num_pages); duk_put_prop_string(ctx, -2, "pages");
+	return 1;
+}
+
 static duk_ret_t
 js_Font_clone(duk_context* ctx)
 {
@@ -516,6 +861,7 @@ js_Font_drawText(duk_context* ctx)
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_get_prop_string(ctx, -1, "\xFF" "color_mask"); mask = duk_require_sphere_color(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame()) draw_text(font, mask, x, y, TEXT_ALIGN_LEFT, text);
 	return 0;
 }
@@ -537,13 +883,14 @@ js_Font_drawZoomedText(duk_context* ctx)
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_get_prop_string(ctx, -1, "\xFF" "color_mask"); mask = duk_require_sphere_color(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame()) {
 		text_w = get_text_width(font, text);
 		text_h = get_font_line_height(font);
 		bitmap = al_create_bitmap(text_w, text_h);
-		al_set_target_bitmap(bitmap);
+		set_render_target(bitmap);
 		draw_text(font, mask, 0, 0, TEXT_ALIGN_LEFT, text);
-		al_set_target_backbuffer(g_display);
+		reset_render_state();
 		al_draw_scaled_bitmap(bitmap, 0, 0, text_w, text_h, x, y, text_w * scale, text_h * scale, 0x0);
 		al_destroy_bitmap(bitmap);
 	}
@@ -562,9 +909,9 @@ js_Font_drawTextBox(duk_context* ctx)
 
 	font_t*     font;
 	int         line_height;
-	const char* line_text;
 	color_t     mask;
 	int         num_lines;
+	wraptext_t* wraptext;
 
 	int i;
 
@@ -572,20 +919,17 @@ js_Font_drawTextBox(duk_context* ctx)
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_get_prop_string(ctx, -1, "\xFF" "color_mask"); mask = duk_require_sphere_color(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame()) {
-		duk_push_c_function(ctx, js_Font_wordWrapString, DUK_VARARGS);
-		duk_push_this(ctx);
-		duk_push_string(ctx, text);
-		duk_push_int(ctx, w);
-		duk_call_method(ctx, 2);
-		duk_get_prop_string(ctx, -1, "length"); num_lines = duk_get_int(ctx, -1); duk_pop(ctx);
+		if (!(wraptext = word_wrap_text(font, text, w)))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Font:drawTextBox(): Failed to wrap text");
+		num_lines = get_wraptext_line_count(wraptext);
 		line_height = get_font_line_height(font);
 		for (i = 0; i < num_lines; ++i) {
-			duk_get_prop_index(ctx, -1, i); line_text = duk_get_string(ctx, -1); duk_pop(ctx);
-			draw_text(font, mask, x + offset, y, TEXT_ALIGN_LEFT, line_text);
+			draw_text(font, mask, x + offset, y, TEXT_ALIGN_LEFT, get_wraptext_line(wraptext, i));
 			y += line_height;
 		}
-		duk_pop(ctx);
+		free_wraptext(wraptext);
 	}
 	return 0;
 }
@@ -596,19 +940,17 @@ js_Font_getStringHeight(duk_context* ctx)
 	const char* text = duk_to_string(ctx, 0);
 	int width = duk_require_int(ctx, 1);
 	
-	font_t* font;
-	int     num_lines;
+	font_t*     font;
+	int         num_lines;
+	wraptext_t* wraptext;
 
 	duk_push_this(ctx);
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_pop(ctx);
-	duk_push_c_function(ctx, js_Font_wordWrapString, DUK_VARARGS);
-	duk_push_this(ctx);
-	duk_push_string(ctx, text);
-	duk_push_int(ctx, width);
-	duk_call_method(ctx, 2);
-	duk_get_prop_string(ctx, -1, "length"); num_lines = duk_get_int(ctx, -1); duk_pop(ctx);
-	duk_pop(ctx);
+	if (!(wraptext = word_wrap_text(font, text, width)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Font:getStringHeight(): Failed to wrap text");
+	num_lines = get_wraptext_line_count(wraptext);
+	free_wraptext(wraptext);
 	duk_push_int(ctx, get_font_line_height(font) * num_lines);
 	return 1;
 }
@@ -642,7 +984,8 @@ js_Font_wordWrapString(duk_context* ctx)
 	duk_push_this(ctx);
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_pop(ctx);
-	wraptext = word_wrap_text(font, text, width);
+	if (!(wraptext = word_wrap_text(font, text, width)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Font:wordWrapString(): Failed to wrap text");
 	num_lines = get_wraptext_line_count(wraptext);
 	duk_push_array(ctx);
 	for (i = 0; i < num_lines; ++i) {
@@ -652,3 +995,151 @@ js_Font_wordWrapString(duk_context* ctx)
 	free_wraptext(wraptext);
 	return 1;
 }
+
+static duk_ret_t
+js_new_TextRun(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	font_t* font = duk_require_sphere_obj(ctx, 0, "Font");
+	const char* text = duk_to_string(ctx, 1);
+	color_t color = n_args >= 3 ? duk_require_sphere_color(ctx, 2) : rgba(255, 255, 255, 255);
+
+	struct text_run* run;
+
+	if (!(run = calloc(1, sizeof(struct text_run))))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "TextRun(): Failed to create text run");
+	if (!(run->text = strdup(text))) {
+		free(run);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "TextRun(): Failed to create text run");
+	}
+	run->font = ref_font(font);
+	run->color = color;
+	duk_push_sphere_obj(ctx, "TextRun", run);
+	return 1;
+}
+
+static duk_ret_t
+js_TextRun_finalize(duk_context* ctx)
+{
+	struct text_run* run;
+
+	run = duk_require_sphere_obj(ctx, 0, "TextRun");
+	free_font(run->font);
+	free(run->text);
+	free(run->vertices);
+	free(run);
+	return 0;
+}
+
+static duk_ret_t
+js_TextRun_get_color(duk_context* ctx)
+{
+	struct text_run* run;
+
+	duk_push_this(ctx);
+	run = duk_require_sphere_obj(ctx, -1, "TextRun");
+	duk_pop(ctx);
+	duk_push_sphere_color(ctx, run->color);
+	return 1;
+}
+
+static duk_ret_t
+js_TextRun_set_color(duk_context* ctx)
+{
+	color_t color = duk_require_sphere_color(ctx, 0);
+
+	struct text_run* run;
+
+	duk_push_this(ctx);
+	run = duk_require_sphere_obj(ctx, -1, "TextRun");
+	duk_pop(ctx);
+	if (color.r != run->color.r || color.g != run->color.g || color.b != run->color.b
+		|| color.alpha != run->color.alpha)
+	{
+		run->color = color;
+		run->layout_id = 0;
+	}
+	return 0;
+}
+
+static duk_ret_t
+js_TextRun_get_text(duk_context* ctx)
+{
+	struct text_run* run;
+
+	duk_push_this(ctx);
+	run = duk_require_sphere_obj(ctx, -1, "TextRun");
+	duk_pop(ctx);
+	duk_push_string(ctx, run->text);
+	return 1;
+}
+
+static duk_ret_t
+js_TextRun_set_text(duk_context* ctx)
+{
+	const char* text = duk_to_string(ctx, 0);
+
+	char*            new_text;
+	struct text_run* run;
+
+	duk_push_this(ctx);
+	run = duk_require_sphere_obj(ctx, -1, "TextRun");
+	duk_pop(ctx);
+	if (strcmp(text, run->text) == 0)
+		return 0;
+	if (!(new_text = strdup(text)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "TextRun:text: Failed to set text");
+	free(run->text);
+	run->text = new_text;
+	run->layout_id = 0;
+	return 0;
+}
+
+static duk_ret_t
+js_TextRun_get_width(duk_context* ctx)
+{
+	struct text_run* run;
+
+	duk_push_this(ctx);
+	run = duk_require_sphere_obj(ctx, -1, "TextRun");
+	duk_pop(ctx);
+	duk_push_int(ctx, get_text_width(run->font, run->text));
+	return 1;
+}
+
+static duk_ret_t
+js_TextRun_draw(duk_context* ctx)
+{
+	int x = duk_require_int(ctx, 0);
+	int y = duk_require_int(ctx, 1);
+
+	ALLEGRO_TRANSFORM old_transform;
+	struct text_run*  run;
+	ALLEGRO_TRANSFORM transform;
+
+	duk_push_this(ctx);
+	run = duk_require_sphere_obj(ctx, -1, "TextRun");
+	duk_pop(ctx);
+	reset_render_state();
+	if (is_skipped_frame())
+		return 0;
+	if (!can_batch_text(run->font)) {
+		draw_text(run->font, run->color, x, y, TEXT_ALIGN_LEFT, run->text);
+		return 0;
+	}
+	if (!update_text_run(run))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "TextRun:draw(): Failed to build vertices");
+	if (run->num_vertices == 0)
+		return 0;
+
+	// the vertices are built at the origin and reused as-is; the position
+	// goes into the transform instead
+	al_copy_transform(&old_transform, al_get_current_transform());
+	al_identity_transform(&transform);
+	al_translate_transform(&transform, x, y);
+	al_compose_transform(&transform, &old_transform);
+	al_use_transform(&transform);
+	al_draw_prim(run->vertices, NULL, get_image_bitmap(run->font->atlas), 0, run->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+	al_use_transform(&old_transform);
+	return 0;
+}
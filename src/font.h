@@ -3,22 +3,29 @@
 
 #include "color.h"
 #include "image.h"
+#include "ttf.h"
 
 typedef struct font     font_t;
 typedef enum text_align text_align_t;
 typedef struct wraptext wraptext_t;
 
+extern void initialize_fonts (void);
+extern void shutdown_fonts   (void);
+
 font_t*     load_font            (const char* path);
+font_t*     load_ttf_font        (const char* path, int size);
 font_t*     ref_font             (font_t* font);
 void        free_font            (font_t* font);
 int         get_font_line_height (const font_t* font);
 void        get_font_metrics     (const font_t* font, int* min_width, int* max_width, int* out_line_height);
+bool        get_font_cache_stats (const font_t* font, ttf_stats_t* out_stats);
 image_t*    get_glyph_image      (const font_t* font, int codepoint);
 int         get_text_width       (const font_t* font, const char* text);
-void        set_glyph_image      (font_t* font, int codepoint, image_t* image);
+bool        set_glyph_image      (font_t* font, int codepoint, image_t* image);
 void        draw_text            (const font_t* font, color_t mask, int x, int y, text_align_t alignment, const char* text);
 
 wraptext_t* word_wrap_text          (const font_t* font, const char* text, int width);
+wraptext_t* ref_wraptext            (wraptext_t* wraptext);
 void        free_wraptext           (wraptext_t* wraptext);
 const char* get_wraptext_line       (const wraptext_t* wraptext, int line_index);
 int         get_wraptext_line_count (const wraptext_t* wraptext);
@@ -1,6 +1,7 @@
 #include "minisphere.h"
 #include "api.h"
 #include "color.h"
+#include "render.h"
 #include "vector.h"
 
 #include "galileo.h"
@@ -20,24 +21,115 @@ static duk_ret_t js_Group_set_rotY          (duk_context* ctx);
 static duk_ret_t js_Group_set_shader        (duk_context* ctx);
 static duk_ret_t js_Group_set_x             (duk_context* ctx);
 static duk_ret_t js_Group_set_y             (duk_context* ctx);
+static duk_ret_t js_Group_addChild          (duk_context* ctx);
 static duk_ret_t js_Group_draw              (duk_context* ctx);
+static duk_ret_t js_Group_removeChild       (duk_context* ctx);
 static duk_ret_t js_new_ShaderProgram       (duk_context* ctx);
 static duk_ret_t js_new_Shape               (duk_context* ctx);
 static duk_ret_t js_Shape_finalize          (duk_context* ctx);
 static duk_ret_t js_Shape_get_image         (duk_context* ctx);
 static duk_ret_t js_Shape_set_image         (duk_context* ctx);
+static duk_ret_t js_Shape_get_usage         (duk_context* ctx);
+static duk_ret_t js_Shape_set_usage         (duk_context* ctx);
+static duk_ret_t js_Shape_getVertex         (duk_context* ctx);
+static duk_ret_t js_Shape_setVertex         (duk_context* ctx);
 static duk_ret_t js_new_Vertex              (duk_context* ctx);
 
-static void assign_default_uv  (shape_t* shape);
-static void refresh_shape_vbuf (shape_t* shape);
+static void            assign_default_uv    (shape_t* shape);
+static bool            compile_group        (group_t* group);
+static int             count_shape_vertices (const shape_t* shape);
+static bool            does_group_contain   (const group_t* group, const group_t* other);
+static void            draw_group_node      (group_t* group, const ALLEGRO_TRANSFORM* parent_matrix, unsigned int parent_stamp, rect_t clip);
+static void            draw_group_vertices  (group_t* group, ALLEGRO_BITMAP* bitmap, int start, int end, int draw_mode);
+static int             get_buffer_flags     (shape_usage_t usage);
+static int             get_shape_class      (const shape_t* shape);
+static int             get_shape_mode       (const shape_t* shape);
+static bool            is_bounds_in_clip    (float_rect_t bounds, rect_t clip);
+static ALLEGRO_VERTEX* put_shape_vertices   (const shape_t* shape, ALLEGRO_VERTEX* v);
+static ALLEGRO_VERTEX* put_vertex           (ALLEGRO_VERTEX* v, const vertex_t* vertex, int w_texture, int h_texture);
+static void            touch_shape          (shape_t* shape, int start, int end);
+static float_rect_t    transform_bounds     (float_rect_t bounds, const ALLEGRO_TRANSFORM* matrix);
+static bool            update_group         (group_t* group);
+static void            update_group_bounds  (group_t* group);
+static void            update_group_matrix  (group_t* group, const ALLEGRO_TRANSFORM* parent_matrix, unsigned int parent_stamp);
+static void            update_shape_vbuf    (shape_t* shape);
+
+// note: drawing a group shape by shape is one draw call per shape, which
+//       for a scene made of hundreds of small quads is what limits the frame
+//       rate. instead, a group is compiled into as few batches as possible:
+//       consecutive shapes with the same texture whose primitives can be
+//       merged (points with points, lines with lines, any kind of triangles
+//       with triangles, fans and strips being unrolled into lists) share a
+//       vertex buffer range and are drawn together. only consecutive shapes
+//       are merged, so the drawing order doesn't change.
+//
+//       shapes can be in any number of groups, so instead of a dirty flag
+//       each shape is stamped from a global counter whenever it changes. a
+//       group is recompiled when it changes itself or when one of its shapes
+//       has a newer stamp than the compiled batches.
+
+// note: vertex buffers are kept and updated in place rather than recreated
+//       on every change. each shape tracks the range of vertices changed
+//       since its buffer was last written and only that range is locked and
+//       rewritten, the next time the shape is drawn. likewise, a group whose
+//       shapes only had vertices moved (same count, type and texture) just
+//       rewrites those shapes' ranges of its buffer. the usage hint picks
+//       the kind of buffer Allegro creates: static for shapes that never
+//       change, dynamic for ones that change now and then, stream for ones
+//       that change every frame. buffers for dynamic and stream shapes are
+//       made with room to grow.
+
+// note: groups can be nested, a child group being drawn relative to its
+//       parent. each group caches its local matrix, rebuilt only when one of
+//       its transform properties changes, and its world matrix, rebuilt when
+//       the local matrix or the parent's world matrix changes. world
+//       matrices get their own stamps so a child can tell whether its parent
+//       moved; a group that's in more than one parent simply rebuilds its
+//       world matrix whenever it's drawn under a different one.
+//
+//       shapes cache their bounding box, recomputed only after their
+//       vertices change. when a group is drawn, the bounds of each of its
+//       shapes are transformed to world space (again only when the shape or
+//       the world matrix changed) and anything entirely outside the clipping
+//       rectangle is skipped, the whole group at once if none of its shapes
+//       are visible. visible shapes in a batch are still drawn together, so
+//       culling splits a batch only where a shape in the middle is skipped.
+
+struct batch
+{
+	image_t* texture;
+	int      draw_mode;
+	int      start;
+	int      num_vertices;
+	int      first_slot;
+	int      num_slots;
+};
+
+struct group_slot
+{
+	image_t*     texture;
+	int          draw_mode;
+	int          num_source_vertices;
+	int          start;
+	int          num_vertices;
+	float_rect_t bounds;
+	unsigned int bounds_stamp;
+	unsigned int bounds_world_stamp;
+};
 
 struct shape
 {
 	unsigned int           refcount;
+	unsigned int           stamp;
 	image_t*               texture;
 	shape_type_t           type;
+	shape_usage_t          usage;
 	ALLEGRO_VERTEX*        sw_vbuf;
 	ALLEGRO_VERTEX_BUFFER* vbuf;
+	int                    vbuf_size;
+	int                    dirty_start, dirty_end;
+	float_rect_t           bounds;
+	bool                   is_bounds_dirty;
 	int                    max_vertices;
 	int                    num_vertices;
 	vertex_t               *vertices;
@@ -45,12 +137,34 @@ struct shape
 
 struct group
 {
-	unsigned int refcount;
-	float        x, y, rot_x, rot_y;
-	double       theta;
-	vector_t*    shapes;
+	unsigned int           refcount;
+	float                  x, y, rot_x, rot_y;
+	double                 theta;
+	vector_t*              shapes;
+	vector_t*              children;
+	bool                   is_matrix_dirty;
+	ALLEGRO_TRANSFORM      local_matrix;
+	ALLEGRO_TRANSFORM      world_matrix;
+	unsigned int           world_stamp;
+	unsigned int           parent_stamp;
+	float_rect_t           bounds;
+	bool                   is_bounds_dirty;
+	unsigned int           bounds_world_stamp;
+	bool                   is_dirty;
+	unsigned int           stamp;
+	int                    num_batches;
+	struct batch*          batches;
+	struct group_slot*     slots;
+	int                    num_vertices;
+	ALLEGRO_VERTEX*        sw_vbuf;
+	ALLEGRO_VERTEX_BUFFER* vbuf;
+	int                    vbuf_size;
+	shape_usage_t          vbuf_usage;
 };
 
+static unsigned int s_next_stamp = 1;
+static unsigned int s_next_world_stamp = 1;
+
 void
 initialize_galileo(void)
 {
@@ -82,6 +196,10 @@ new_group(void)
 	if (!(group = calloc(1, sizeof(group_t))))
 		goto on_error;
 	group->shapes = new_vector(sizeof(shape_t*));
+	group->children = new_vector(sizeof(group_t*));
+	group->is_matrix_dirty = true;
+	group->is_bounds_dirty = true;
+	group->is_dirty = true;
 	return ref_group(group);
 
 on_error:
@@ -100,6 +218,7 @@ ref_group(group_t* group)
 void
 free_group(group_t* group)
 {
+	group_t** i_child;
 	shape_t** i_shape;
 	
 	iter_t iter;
@@ -111,9 +230,61 @@ free_group(group_t* group)
 	while (i_shape = next_vector_item(&iter))
 		free_shape(*i_shape);
 	free_vector(group->shapes);
+	iter = iterate_vector(group->children);
+	while (i_child = next_vector_item(&iter))
+		free_group(*i_child);
+	free_vector(group->children);
+	if (group->vbuf != NULL)
+		al_destroy_vertex_buffer(group->vbuf);
+	free(group->sw_vbuf);
+	free(group->batches);
+	free(group->slots);
 	free(group);
 }
 
+double
+get_group_angle(const group_t* group)
+{
+	return group->theta;
+}
+
+void
+get_group_rot_xy(const group_t* group, float* out_x, float* out_y)
+{
+	if (out_x) *out_x = group->rot_x;
+	if (out_y) *out_y = group->rot_y;
+}
+
+void
+get_group_xy(const group_t* group, float* out_x, float* out_y)
+{
+	if (out_x) *out_x = group->x;
+	if (out_y) *out_y = group->y;
+}
+
+void
+set_group_angle(group_t* group, double theta)
+{
+	group->theta = theta;
+	group->is_matrix_dirty = true;
+}
+
+void
+set_group_rot_xy(group_t* group, float x, float y)
+{
+	group->rot_x = x;
+	group->rot_y = y;
+	group->is_matrix_dirty = true;
+}
+
+void
+set_group_xy(group_t* group, float x, float y)
+{
+	group->x = x;
+	group->y = y;
+	group->is_matrix_dirty = true;
+}
+
 shape_t*
 get_group_shape(const group_t* group, int index)
 {
@@ -132,6 +303,7 @@ set_group_shape(group_t* group, int index, shape_t* shape)
 	get_vector_item(group->shapes, index, &old_shape);
 	set_vector_item(group->shapes, index, &shape);
 	free_shape(old_shape);
+	group->is_dirty = true;
 }
 
 bool
@@ -139,6 +311,7 @@ add_group_shape(group_t* group, shape_t* shape)
 {
 	shape = ref_shape(shape);
 	push_back_vector(group->shapes, &shape);
+	group->is_dirty = true;
 	return true;
 }
 
@@ -146,6 +319,38 @@ void
 remove_group_shape(group_t* group, int index)
 {
 	remove_vector_item(group->shapes, index);
+	group->is_dirty = true;
+}
+
+bool
+add_group_child(group_t* group, group_t* child)
+{
+	// a group can't be drawn inside itself
+	if (child == group || does_group_contain(child, group))
+		return false;
+	child = ref_group(child);
+	if (!push_back_vector(group->children, &child)) {
+		free_group(child);
+		return false;
+	}
+	return true;
+}
+
+void
+remove_group_child(group_t* group, group_t* child)
+{
+	group_t* item;
+
+	int i;
+
+	for (i = 0; i < (int)get_vector_size(group->children); ++i) {
+		get_vector_item(group->children, i, &item);
+		if (item == child) {
+			remove_vector_item(group->children, i);
+			free_group(child);
+			return;
+		}
+	}
 }
 
 void
@@ -159,28 +364,20 @@ clear_group(group_t* group)
 	while (i_shape = next_vector_item(&iter))
 		free_shape(*i_shape);
 	clear_vector(group->shapes);
+	group->is_dirty = true;
 }
 
 void
-draw_group(const group_t* group)
+draw_group(group_t* group)
 {
-	ALLEGRO_TRANSFORM matrix;
+	ALLEGRO_TRANSFORM identity;
 	ALLEGRO_TRANSFORM old_matrix;
 
-	shape_t** i_shape;
-	
-	iter_t iter;
-
+	// a group drawn on its own has no parent; stamp 0 is never given to a
+	// world matrix, so it always means the identity
 	al_copy_transform(&old_matrix, al_get_current_transform());
-	al_identity_transform(&matrix);
-	al_translate_transform(&matrix, group->rot_x, group->rot_y);
-	al_rotate_transform(&matrix, group->theta);
-	al_translate_transform(&matrix, group->x, group->y);
-	al_scale_transform(&matrix, g_scale_x, g_scale_y);
-	al_use_transform(&matrix);
-	iter = iterate_vector(group->shapes);
-	while (i_shape = next_vector_item(&iter))
-		draw_shape(*i_shape);
+	al_identity_transform(&identity);
+	draw_group_node(group, &identity, 0, get_clip_rectangle());
 	al_use_transform(&old_matrix);
 }
 
@@ -193,6 +390,9 @@ new_shape(shape_type_t type, image_t* texture)
 		goto on_error;
 	shape->texture = ref_image(texture);
 	shape->type = type;
+	shape->usage = USAGE_STATIC;
+	shape->is_bounds_dirty = true;
+	touch_shape(shape, 0, 0);
 	return ref_shape(shape);
 
 on_error:
@@ -217,27 +417,34 @@ free_shape(shape_t* shape)
 	if (shape->vbuf != NULL)
 		al_destroy_vertex_buffer(shape->vbuf);
 	free(shape->sw_vbuf);
+	free(shape->vertices);
 	free(shape);
 }
 
 float_rect_t
-get_shape_bounds(const shape_t* shape)
+get_shape_bounds(shape_t* shape)
 {
 	float_rect_t bounds;
 
 	int i;
 
+	if (!shape->is_bounds_dirty)
+		return shape->bounds;
 	if (shape->num_vertices < 1)
-		return new_float_rect(0.0, 0.0, 0.0, 0.0);
-	bounds = new_float_rect(
-		shape->vertices[0].x, shape->vertices[0].y,
-		shape->vertices[0].x, shape->vertices[0].y);
-	for (i = 1; i < shape->num_vertices; ++i) {
-		bounds.x1 = fmin(shape->vertices[i].x, bounds.x1);
-		bounds.y1 = fmin(shape->vertices[i].y, bounds.y1);
-		bounds.x2 = fmax(shape->vertices[i].x, bounds.x2);
-		bounds.y2 = fmax(shape->vertices[i].y, bounds.y2);
+		bounds = new_float_rect(0.0, 0.0, 0.0, 0.0);
+	else {
+		bounds = new_float_rect(
+			shape->vertices[0].x, shape->vertices[0].y,
+			shape->vertices[0].x, shape->vertices[0].y);
+		for (i = 1; i < shape->num_vertices; ++i) {
+			bounds.x1 = fmin(shape->vertices[i].x, bounds.x1);
+			bounds.y1 = fmin(shape->vertices[i].y, bounds.y1);
+			bounds.x2 = fmax(shape->vertices[i].x, bounds.x2);
+			bounds.y2 = fmax(shape->vertices[i].y, bounds.y2);
+		}
 	}
+	shape->bounds = bounds;
+	shape->is_bounds_dirty = false;
 	return bounds;
 }
 
@@ -247,16 +454,47 @@ get_shape_texture(const shape_t* shape)
 	return shape->texture;
 }
 
+shape_usage_t
+get_shape_usage(const shape_t* shape)
+{
+	return shape->usage;
+}
+
+int
+get_shape_vertex_count(const shape_t* shape)
+{
+	return shape->num_vertices;
+}
+
 vertex_t
-get_shape_vertex(shape_t* shape, int index)
+get_shape_vertex(const shape_t* shape, int index)
 {
 	return shape->vertices[index];
 }
 
+void
+set_shape_usage(shape_t* shape, shape_usage_t usage)
+{
+	if (usage == shape->usage)
+		return;
+	
+	// the buffer is recreated with the new flags the next time the shape
+	// is drawn
+	shape->usage = usage;
+	if (shape->vbuf != NULL)
+		al_destroy_vertex_buffer(shape->vbuf);
+	free(shape->sw_vbuf);
+	shape->vbuf = NULL;
+	shape->sw_vbuf = NULL;
+	shape->vbuf_size = 0;
+	touch_shape(shape, 0, shape->num_vertices);
+}
+
 void
 set_shape_vertex(shape_t* shape, int index, vertex_t vertex)
 {
 	shape->vertices[index] = vertex;
+	touch_shape(shape, index, index + 1);
 }
 
 void
@@ -267,7 +505,9 @@ set_shape_texture(shape_t* shape, image_t* texture)
 	old_texture = shape->texture;
 	shape->texture = ref_image(texture);
 	free_image(old_texture);
-	refresh_shape_vbuf(shape);
+	
+	// texture coordinates are scaled to the texture size, so they all change
+	touch_shape(shape, 0, shape->num_vertices);
 }
 
 bool
@@ -285,6 +525,7 @@ add_shape_vertex(shape_t* shape, vertex_t vertex)
 	}
 	++shape->num_vertices;
 	shape->vertices[shape->num_vertices - 1] = vertex;
+	touch_shape(shape, shape->num_vertices - 1, shape->num_vertices);
 	return true;
 }
 
@@ -296,25 +537,19 @@ remove_shape_vertex(shape_t* shape, int index)
 	--shape->num_vertices;
 	for (i = index; i < shape->num_vertices; ++i)
 		shape->vertices[i] = shape->vertices[i + 1];
+	touch_shape(shape, index, shape->num_vertices);
 }
 
 void
-draw_shape(const shape_t* shape)
+draw_shape(shape_t* shape)
 {
 	ALLEGRO_BITMAP* bitmap;
 	int             draw_mode;
 
-	if (shape->type == SHAPE_AUTO)
-		draw_mode = shape->num_vertices == 1 ? ALLEGRO_PRIM_POINT_LIST
-		: shape->num_vertices == 2 ? ALLEGRO_PRIM_LINE_LIST
-		: shape->num_vertices == 4 ? ALLEGRO_PRIM_TRIANGLE_FAN
-		: ALLEGRO_PRIM_TRIANGLE_STRIP;
-	else
-		draw_mode = shape->type == SHAPE_LINE_LIST ? ALLEGRO_PRIM_LINE_LIST
-		: shape->type == SHAPE_TRIANGLE_LIST ? ALLEGRO_PRIM_TRIANGLE_LIST
-		: shape->type == SHAPE_TRIANGLE_STRIP ? ALLEGRO_PRIM_TRIANGLE_STRIP
-		: shape->type == SHAPE_TRIANGLE_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
-		: ALLEGRO_PRIM_POINT_LIST;
+	update_shape_vbuf(shape);
+	if (shape->vbuf == NULL && shape->sw_vbuf == NULL)
+		return;
+	draw_mode = get_shape_mode(shape);
 	bitmap = shape->texture != NULL ? get_image_bitmap(shape->texture) : NULL;
 	if (shape->vbuf != NULL)
 		al_draw_vertex_buffer(shape->vbuf, bitmap, 0, shape->num_vertices, draw_mode);
@@ -342,44 +577,488 @@ assign_default_uv(shape_t* shape)
 		shape->vertices[i].u = cos(phi) * M_SQRT1_2 + 0.5;
 		shape->vertices[i].v = sin(phi) * M_SQRT1_2 + 0.5;
 	}
+	touch_shape(shape, 0, shape->num_vertices);
+}
+
+static bool
+compile_group(group_t* group)
+{
+	struct batch*      batch;
+	int                draw_class;
+	int                flags;
+	struct batch*      new_batches;
+	struct group_slot* new_slots;
+	ALLEGRO_VERTEX*    new_vbuf;
+	int                num_shapes;
+	int                num_vertices = 0;
+	shape_t*           shape;
+	struct group_slot* slot;
+	shape_usage_t      usage = USAGE_STATIC;
+	ALLEGRO_VERTEX*    v;
+	ALLEGRO_VERTEX*    vertices;
+
+	int i;
+
+	// pass 1: count vertices once fans and strips are unrolled, and allocate
+	num_shapes = get_vector_size(group->shapes);
+	for (i = 0; i < num_shapes; ++i) {
+		get_vector_item(group->shapes, i, &shape);
+		num_vertices += count_shape_vertices(shape);
+		if (shape->usage > usage)
+			usage = shape->usage;
+	}
+	if (!(new_batches = realloc(group->batches, (num_shapes > 0 ? num_shapes : 1) * sizeof(struct batch))))
+		return false;
+	group->batches = new_batches;
+	if (!(new_slots = realloc(group->slots, (num_shapes > 0 ? num_shapes : 1) * sizeof(struct group_slot))))
+		return false;
+	group->slots = new_slots;
+	if (!(new_vbuf = realloc(group->sw_vbuf, (num_vertices > 0 ? num_vertices : 1) * sizeof(ALLEGRO_VERTEX))))
+		return false;
+	group->sw_vbuf = new_vbuf;
+	
+	// pass 2: build the batches. a shape goes into the last batch if the
+	// texture and primitive class match, otherwise it starts a new one.
+	group->num_batches = 0;
+	batch = NULL;
+	v = group->sw_vbuf;
+	for (i = 0; i < num_shapes; ++i) {
+		get_vector_item(group->shapes, i, &shape);
+		draw_class = get_shape_class(shape);
+		if (batch == NULL || batch->texture != shape->texture || batch->draw_mode != draw_class) {
+			batch = &group->batches[group->num_batches++];
+			batch->texture = shape->texture;
+			batch->draw_mode = draw_class;
+			batch->start = v - group->sw_vbuf;
+			batch->first_slot = i;
+		}
+		slot = &group->slots[i];
+		slot->texture = shape->texture;
+		slot->draw_mode = get_shape_mode(shape);
+		slot->num_source_vertices = shape->num_vertices;
+		slot->start = v - group->sw_vbuf;
+		v = put_shape_vertices(shape, v);
+		slot->num_vertices = (v - group->sw_vbuf) - slot->start;
+		slot->bounds_world_stamp = 0;
+		batch->num_vertices = (v - group->sw_vbuf) - batch->start;
+		batch->num_slots = i - batch->first_slot + 1;
+	}
+	group->num_vertices = v - group->sw_vbuf;
+
+	// pass 3: upload the vertices, into the existing buffer if it's big
+	// enough. if there's no vertex buffer, batches are drawn from the
+	// software copy instead.
+	if (group->vbuf != NULL && (group->num_vertices > group->vbuf_size || usage != group->vbuf_usage)) {
+		al_destroy_vertex_buffer(group->vbuf);
+		group->vbuf = NULL;
+	}
+	if (group->vbuf == NULL && group->num_vertices > 0) {
+		flags = get_buffer_flags(usage);
+		group->vbuf_size = usage == USAGE_STATIC ? group->num_vertices : group->num_vertices * 2;
+		group->vbuf_usage = usage;
+		group->vbuf = al_create_vertex_buffer(NULL, NULL, group->vbuf_size, flags);
+	}
+	if (group->vbuf != NULL && group->num_vertices > 0) {
+		if ((vertices = al_lock_vertex_buffer(group->vbuf, 0, group->num_vertices, ALLEGRO_LOCK_WRITEONLY))) {
+			memcpy(vertices, group->sw_vbuf, group->num_vertices * sizeof(ALLEGRO_VERTEX));
+			al_unlock_vertex_buffer(group->vbuf);
+		}
+		else {
+			al_destroy_vertex_buffer(group->vbuf);
+			group->vbuf = NULL;
+		}
+	}
+	group->stamp = s_next_stamp;
+	group->is_dirty = false;
+	group->is_bounds_dirty = true;
+	return true;
+}
+
+static int
+count_shape_vertices(const shape_t* shape)
+{
+	int draw_mode;
+
+	draw_mode = get_shape_mode(shape);
+	return draw_mode == ALLEGRO_PRIM_TRIANGLE_LIST ? shape->num_vertices / 3 * 3
+		: draw_mode == ALLEGRO_PRIM_TRIANGLE_STRIP || draw_mode == ALLEGRO_PRIM_TRIANGLE_FAN
+			? (shape->num_vertices >= 3 ? (shape->num_vertices - 2) * 3 : 0)
+		: draw_mode == ALLEGRO_PRIM_LINE_LIST ? shape->num_vertices / 2 * 2
+		: shape->num_vertices;
+}
+
+static bool
+does_group_contain(const group_t* group, const group_t* other)
+{
+	group_t** i_child;
+
+	iter_t iter;
+
+	iter = iterate_vector(group->children);
+	while (i_child = next_vector_item(&iter)) {
+		if (*i_child == other || does_group_contain(*i_child, other))
+			return true;
+	}
+	return false;
 }
 
 static void
-refresh_shape_vbuf(shape_t* shape)
+draw_group_node(group_t* group, const ALLEGRO_TRANSFORM* parent_matrix, unsigned int parent_stamp, rect_t clip)
 {
-	ALLEGRO_BITMAP* bitmap;
-	ALLEGRO_VERTEX* vertices = NULL;
-	int             w_texture, h_texture;
+	ALLEGRO_BITMAP*    bitmap;
+	struct batch*      batch;
+	bool               is_compiled;
+	ALLEGRO_TRANSFORM  matrix;
+	int                num_batches;
+	int                run_start, run_end;
+	struct group_slot* slot;
+
+	group_t** i_child;
+	shape_t** i_shape;
+	
+	iter_t iter;
+	int    i, j;
+
+	is_compiled = update_group(group);
+	update_group_matrix(group, parent_matrix, parent_stamp);
+	al_copy_transform(&matrix, &group->world_matrix);
+	al_scale_transform(&matrix, g_scale_x, g_scale_y);
+	al_use_transform(&matrix);
+	if (is_compiled) {
+		update_group_bounds(group);
+		num_batches = is_bounds_in_clip(group->bounds, clip) ? group->num_batches : 0;
+		for (i = 0; i < num_batches; ++i) {
+			// draw the batch in runs of consecutive visible shapes
+			batch = &group->batches[i];
+			bitmap = batch->texture != NULL ? get_image_bitmap(batch->texture) : NULL;
+			run_start = run_end = batch->start;
+			for (j = batch->first_slot; j < batch->first_slot + batch->num_slots; ++j) {
+				slot = &group->slots[j];
+				if (slot->num_vertices > 0 && !is_bounds_in_clip(slot->bounds, clip)) {
+					draw_group_vertices(group, bitmap, run_start, run_end, batch->draw_mode);
+					run_start = slot->start + slot->num_vertices;
+				}
+				run_end = slot->start + slot->num_vertices;
+			}
+			draw_group_vertices(group, bitmap, run_start, run_end, batch->draw_mode);
+		}
+	}
+	else {
+		// out of memory compiling the group, fall back on drawing each shape
+		// on its own
+		iter = iterate_vector(group->shapes);
+		while (i_shape = next_vector_item(&iter))
+			draw_shape(*i_shape);
+	}
+	iter = iterate_vector(group->children);
+	while (i_child = next_vector_item(&iter))
+		draw_group_node(*i_child, &group->world_matrix, group->world_stamp, clip);
+}
+
+static void
+draw_group_vertices(group_t* group, ALLEGRO_BITMAP* bitmap, int start, int end, int draw_mode)
+{
+	if (start >= end)
+		return;
+	if (group->vbuf != NULL)
+		al_draw_vertex_buffer(group->vbuf, bitmap, start, end, draw_mode);
+	else
+		al_draw_prim(group->sw_vbuf, NULL, bitmap, start, end, draw_mode);
+}
+
+static int
+get_buffer_flags(shape_usage_t usage)
+{
+	return usage == USAGE_STREAM ? ALLEGRO_PRIM_BUFFER_STREAM
+		: usage == USAGE_DYNAMIC ? ALLEGRO_PRIM_BUFFER_DYNAMIC
+		: ALLEGRO_PRIM_BUFFER_STATIC;
+}
+static int
+get_shape_class(const shape_t* shape)
+{
+	int draw_mode;
+
+	// triangles of all kinds can be merged into a triangle list
+	draw_mode = get_shape_mode(shape);
+	return draw_mode == ALLEGRO_PRIM_TRIANGLE_STRIP || draw_mode == ALLEGRO_PRIM_TRIANGLE_FAN
+		? ALLEGRO_PRIM_TRIANGLE_LIST : draw_mode;
+}
+
+static int
+get_shape_mode(const shape_t* shape)
+{
+	if (shape->type == SHAPE_AUTO)
+		return shape->num_vertices == 1 ? ALLEGRO_PRIM_POINT_LIST
+			: shape->num_vertices == 2 ? ALLEGRO_PRIM_LINE_LIST
+			: shape->num_vertices == 4 ? ALLEGRO_PRIM_TRIANGLE_FAN
+			: ALLEGRO_PRIM_TRIANGLE_STRIP;
+	else
+		return shape->type == SHAPE_LINE_LIST ? ALLEGRO_PRIM_LINE_LIST
+			: shape->type == SHAPE_TRIANGLE_LIST ? ALLEGRO_PRIM_TRIANGLE_LIST
+			: shape->type == SHAPE_TRIANGLE_STRIP ? ALLEGRO_PRIM_TRIANGLE_STRIP
+			: shape->type == SHAPE_TRIANGLE_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
+			: ALLEGRO_PRIM_POINT_LIST;
+}
+
+static bool
+is_bounds_in_clip(float_rect_t bounds, rect_t clip)
+{
+	// points and lines have no area but still cover a pixel, so allow
+	// a pixel's worth of slack
+	return bounds.x2 >= clip.x1 - 1 && bounds.x1 <= clip.x2 + 1
+		&& bounds.y2 >= clip.y1 - 1 && bounds.y1 <= clip.y2 + 1;
+}
+
+static ALLEGRO_VERTEX*
+put_shape_vertices(const shape_t* shape, ALLEGRO_VERTEX* v)
+{
+	int draw_mode;
+	int num_copied;
+	int w_texture, h_texture;
 
 	int i;
+
+	draw_mode = get_shape_mode(shape);
+	w_texture = shape->texture != NULL ? get_image_width(shape->texture) : 0;
+	h_texture = shape->texture != NULL ? get_image_height(shape->texture) : 0;
+	switch (draw_mode) {
+	case ALLEGRO_PRIM_TRIANGLE_STRIP:
+		// every other triangle comes out with reversed winding, which
+		// doesn't matter without culling
+		for (i = 2; i < shape->num_vertices; ++i) {
+			v = put_vertex(v, &shape->vertices[i - 2], w_texture, h_texture);
+			v = put_vertex(v, &shape->vertices[i - 1], w_texture, h_texture);
+			v = put_vertex(v, &shape->vertices[i], w_texture, h_texture);
+		}
+		break;
+	case ALLEGRO_PRIM_TRIANGLE_FAN:
+		for (i = 2; i < shape->num_vertices; ++i) {
+			v = put_vertex(v, &shape->vertices[0], w_texture, h_texture);
+			v = put_vertex(v, &shape->vertices[i - 1], w_texture, h_texture);
+			v = put_vertex(v, &shape->vertices[i], w_texture, h_texture);
+		}
+		break;
+	default:
+		// lists are copied as-is, minus any incomplete primitive at the end
+		num_copied = count_shape_vertices(shape);
+		for (i = 0; i < num_copied; ++i)
+			v = put_vertex(v, &shape->vertices[i], w_texture, h_texture);
+	}
+	return v;
+}
+
+static ALLEGRO_VERTEX*
+put_vertex(ALLEGRO_VERTEX* v, const vertex_t* vertex, int w_texture, int h_texture)
+{
+	v->x = vertex->x; v->y = vertex->y; v->z = 0;
+	v->color = nativecolor(vertex->color);
+	v->u = vertex->u * w_texture;
+	v->v = vertex->v * h_texture;
+	return v + 1;
+}
+
+static void
+touch_shape(shape_t* shape, int start, int end)
+{
+	shape->stamp = s_next_stamp++;
+	shape->is_bounds_dirty = true;
+	if (start >= end)
+		return;
+	if (shape->dirty_start < shape->dirty_end) {
+		shape->dirty_start = fmin(shape->dirty_start, start);
+		shape->dirty_end = fmax(shape->dirty_end, end);
+	}
+	else {
+		shape->dirty_start = start;
+		shape->dirty_end = end;
+	}
+}
+
+static float_rect_t
+transform_bounds(float_rect_t bounds, const ALLEGRO_TRANSFORM* matrix)
+{
+	float_rect_t new_bounds;
+	float        x[4], y[4];
+
+	int i;
+
+	x[0] = bounds.x1; y[0] = bounds.y1;
+	x[1] = bounds.x2; y[1] = bounds.y1;
+	x[2] = bounds.x1; y[2] = bounds.y2;
+	x[3] = bounds.x2; y[3] = bounds.y2;
+	for (i = 0; i < 4; ++i)
+		al_transform_coordinates(matrix, &x[i], &y[i]);
+	new_bounds = new_float_rect(x[0], y[0], x[0], y[0]);
+	for (i = 1; i < 4; ++i) {
+		new_bounds.x1 = fmin(x[i], new_bounds.x1);
+		new_bounds.y1 = fmin(y[i], new_bounds.y1);
+		new_bounds.x2 = fmax(x[i], new_bounds.x2);
+		new_bounds.y2 = fmax(y[i], new_bounds.y2);
+	}
+	return new_bounds;
+}
+
+static bool
+update_group(group_t* group)
+{
+	int                dirty_start = INT_MAX;
+	int                dirty_end = 0;
+	shape_t*           shape;
+	struct group_slot* slot;
+	ALLEGRO_VERTEX*    vertices;
+
+	int i;
+
+	if (group->is_dirty)
+		return compile_group(group);
 	
-	if (shape->vbuf != NULL)
-		al_destroy_vertex_buffer(shape->vbuf);
-	free(shape->sw_vbuf); shape->sw_vbuf = NULL;
-	bitmap = shape->texture != NULL ? get_image_bitmap(shape->texture) : NULL;
-	w_texture = bitmap != NULL ? al_get_bitmap_width(bitmap) : 0;
-	h_texture = bitmap != NULL ? al_get_bitmap_height(bitmap) : 0;
-	if (shape->vbuf = al_create_vertex_buffer(NULL, NULL, shape->num_vertices, ALLEGRO_PRIM_BUFFER_STATIC))
-		vertices = al_lock_vertex_buffer(shape->vbuf, 0, shape->num_vertices, ALLEGRO_LOCK_WRITEONLY);
-	if (vertices == NULL) {
-		if (!(shape->sw_vbuf = malloc(shape->num_vertices * sizeof(ALLEGRO_VERTEX))))
-			return;
-		vertices = shape->sw_vbuf;
+	// shapes changed since the last update are rewritten in place as long
+	// as they still take up the same vertices in the same batch; anything
+	// else means the batches have to be rebuilt
+	for (i = 0; i < (int)get_vector_size(group->shapes); ++i) {
+		get_vector_item(group->shapes, i, &shape);
+		if (shape->stamp < group->stamp)
+			continue;
+		slot = &group->slots[i];
+		if (shape->texture != slot->texture || get_shape_mode(shape) != slot->draw_mode
+			|| shape->num_vertices != slot->num_source_vertices || shape->usage > group->vbuf_usage)
+		{
+			return compile_group(group);
+		}
+		put_shape_vertices(shape, group->sw_vbuf + slot->start);
+		dirty_start = fmin(dirty_start, slot->start);
+		dirty_end = fmax(dirty_end, slot->start + slot->num_vertices);
 	}
-	for (i = 0; i < shape->num_vertices; ++i) {
-		vertices[i].x = shape->vertices[i].x;
-		vertices[i].y = shape->vertices[i].y;
-		vertices[i].z = 0;
-		vertices[i].color = nativecolor(shape->vertices[i].color);
-		vertices[i].u = shape->vertices[i].u * w_texture;
-		vertices[i].v = shape->vertices[i].v * h_texture;
+	if (dirty_start < dirty_end)
+		group->is_bounds_dirty = true;
+	if (dirty_start < dirty_end && group->vbuf != NULL) {
+		if ((vertices = al_lock_vertex_buffer(group->vbuf, dirty_start, dirty_end - dirty_start, ALLEGRO_LOCK_WRITEONLY))) {
+			memcpy(vertices, group->sw_vbuf + dirty_start, (dirty_end - dirty_start) * sizeof(ALLEGRO_VERTEX));
+			al_unlock_vertex_buffer(group->vbuf);
+		}
+		else {
+			al_destroy_vertex_buffer(group->vbuf);
+			group->vbuf = NULL;
+		}
 	}
-	if (vertices != shape->sw_vbuf)
-		al_unlock_vertex_buffer(shape->vbuf);
-	else if (shape->vbuf != NULL)
-		al_destroy_vertex_buffer(shape->vbuf);
+	group->stamp = s_next_stamp;
+	return true;
 }
 
+static void
+update_group_bounds(group_t* group)
+{
+	bool               has_bounds = false;
+	shape_t*           shape;
+	struct group_slot* slot;
+
+	int i;
+
+	if (!group->is_bounds_dirty && group->bounds_world_stamp == group->world_stamp)
+		return;
+	group->bounds = new_float_rect(0.0, 0.0, 0.0, 0.0);
+	for (i = 0; i < (int)get_vector_size(group->shapes); ++i) {
+		get_vector_item(group->shapes, i, &shape);
+		slot = &group->slots[i];
+		if (slot->num_vertices == 0)
+			continue;
+		if (slot->bounds_world_stamp != group->world_stamp || slot->bounds_stamp != shape->stamp) {
+			slot->bounds = transform_bounds(get_shape_bounds(shape), &group->world_matrix);
+			slot->bounds_stamp = shape->stamp;
+			slot->bounds_world_stamp = group->world_stamp;
+		}
+		if (has_bounds) {
+			group->bounds.x1 = fmin(slot->bounds.x1, group->bounds.x1);
+			group->bounds.y1 = fmin(slot->bounds.y1, group->bounds.y1);
+			group->bounds.x2 = fmax(slot->bounds.x2, group->bounds.x2);
+			group->bounds.y2 = fmax(slot->bounds.y2, group->bounds.y2);
+		}
+		else
+			group->bounds = slot->bounds;
+		has_bounds = true;
+	}
+	group->bounds_world_stamp = group->world_stamp;
+	group->is_bounds_dirty = false;
+}
+
+static void
+update_group_matrix(group_t* group, const ALLEGRO_TRANSFORM* parent_matrix, unsigned int parent_stamp)
+{
+	if (group->is_matrix_dirty) {
+		al_identity_transform(&group->local_matrix);
+		al_translate_transform(&group->local_matrix, group->rot_x, group->rot_y);
+		al_rotate_transform(&group->local_matrix, group->theta);
+		al_translate_transform(&group->local_matrix, group->x, group->y);
+	}
+	if (group->is_matrix_dirty || parent_stamp != group->parent_stamp) {
+		al_copy_transform(&group->world_matrix, &group->local_matrix);
+		al_compose_transform(&group->world_matrix, parent_matrix);
+		group->world_stamp = s_next_world_stamp++;
+		group->parent_stamp = parent_stamp;
+		group->is_matrix_dirty = false;
+	}
+}
+
+static void
+update_shape_vbuf(shape_t* shape)
+{
+	ALLEGRO_VERTEX* new_sw_vbuf;
+	int             new_size;
+	int             num_written;
+	int             start;
+	ALLEGRO_VERTEX* vertices = NULL;
+	int             w_texture, h_texture;
+
+	int i;
+
+	if (shape->num_vertices > shape->vbuf_size) {
+		// the buffer has to grow. static shapes get a buffer just big enough,
+		// anything else some room to add vertices without doing this again.
+		new_size = shape->usage == USAGE_STATIC ? shape->num_vertices : shape->num_vertices * 2;
+		if (shape->vbuf != NULL)
+			al_destroy_vertex_buffer(shape->vbuf);
+		free(shape->sw_vbuf);
+		shape->sw_vbuf = NULL;
+		shape->vbuf_size = 0;
+		if (!(shape->vbuf = al_create_vertex_buffer(NULL, NULL, new_size, get_buffer_flags(shape->usage)))) {
+			if (!(shape->sw_vbuf = malloc(new_size * sizeof(ALLEGRO_VERTEX))))
+				return;
+		}
+		shape->vbuf_size = new_size;
+		shape->dirty_start = 0;
+		shape->dirty_end = shape->num_vertices;
+	}
+	if (shape->dirty_start >= shape->dirty_end)
+		return;
+	
+	// fans and strips aren't unrolled here, so a shape's vertices map one to
+	// one onto its buffer
+	start = shape->dirty_start;
+	num_written = fmin(shape->dirty_end, shape->num_vertices) - start;
+	if (num_written > 0) {
+		if (shape->vbuf != NULL)
+			vertices = al_lock_vertex_buffer(shape->vbuf, start, num_written, ALLEGRO_LOCK_WRITEONLY);
+		if (vertices == NULL && shape->vbuf != NULL) {
+			// can't lock the buffer, switch to drawing from memory
+			if (!(new_sw_vbuf = malloc(shape->vbuf_size * sizeof(ALLEGRO_VERTEX))))
+				return;
+			al_destroy_vertex_buffer(shape->vbuf);
+			shape->vbuf = NULL;
+			shape->sw_vbuf = new_sw_vbuf;
+			start = 0;
+			num_written = shape->num_vertices;
+		}
+		if (vertices == NULL)
+			vertices = shape->sw_vbuf + start;
+		w_texture = shape->texture != NULL ? get_image_width(shape->texture) : 0;
+		h_texture = shape->texture != NULL ? get_image_height(shape->texture) : 0;
+		for (i = 0; i < num_written; ++i)
+			put_vertex(&vertices[i], &shape->vertices[start + i], w_texture, h_texture);
+		if (shape->vbuf != NULL)
+			al_unlock_vertex_buffer(shape->vbuf);
+	}
+	shape->dirty_start = shape->dirty_end = 0;
+}
 void
 init_galileo_api(void)
 {
@@ -390,6 +1069,9 @@ init_galileo_api(void)
 	register_api_const(g_duk, "SHAPE_TRIANGLE_LIST", SHAPE_TRIANGLE_LIST);
 	register_api_const(g_duk, "SHAPE_TRIANGLE_STRIP", SHAPE_TRIANGLE_STRIP);
 	register_api_const(g_duk, "SHAPE_TRIANGLE_FAN", SHAPE_TRIANGLE_FAN);
+	register_api_const(g_duk, "USAGE_STATIC", USAGE_STATIC);
+	register_api_const(g_duk, "USAGE_DYNAMIC", USAGE_DYNAMIC);
+	register_api_const(g_duk, "USAGE_STREAM", USAGE_STREAM);
 
 	// Vertex object
 	register_api_ctor(g_duk, "Vertex", js_new_Vertex, NULL);
@@ -397,6 +1079,9 @@ init_galileo_api(void)
 	// Shape object
 	register_api_ctor(g_duk, "Shape", js_new_Shape, js_Shape_finalize);
 	register_api_prop(g_duk, "Shape", "image", js_Shape_get_image, js_Shape_set_image);
+	register_api_prop(g_duk, "Shape", "usage", js_Shape_get_usage, js_Shape_set_usage);
+	register_api_function(g_duk, "Shape", "getVertex", js_Shape_getVertex);
+	register_api_function(g_duk, "Shape", "setVertex", js_Shape_setVertex);
 
 	// ShaderProgram object
 	register_api_function(g_duk, NULL, "GetDefaultShaderProgram", js_GetDefaultShaderProgram);
@@ -410,7 +1095,9 @@ init_galileo_api(void)
 	register_api_prop(g_duk, "Group", "shader", js_Group_get_shader, js_Group_set_shader);
 	register_api_prop(g_duk, "Group", "x", js_Group_get_x, js_Group_set_x);
 	register_api_prop(g_duk, "Group", "y", js_Group_get_y, js_Group_set_y);
+	register_api_function(g_duk, "Group", "addChild", js_Group_addChild);
 	register_api_function(g_duk, "Group", "draw", js_Group_draw);
+	register_api_function(g_duk, "Group", "removeChild", js_Group_removeChild);
 }
 
 static duk_ret_t
@@ -472,6 +1159,7 @@ js_Group_set_angle(duk_context* ctx)
 	group = duk_require_sphere_obj(ctx, -1, "Group");
 	duk_pop(ctx);
 	group->theta = theta;
+	group->is_matrix_dirty = true;
 	return 0;
 }
 
@@ -510,6 +1198,7 @@ js_Group_set_rotX(duk_context* ctx)
 	group = duk_require_sphere_obj(ctx, -1, "Group");
 	duk_pop(ctx);
 	group->rot_x = value;
+	group->is_matrix_dirty = true;
 	return 0;
 }
 
@@ -535,6 +1224,7 @@ js_Group_set_rotY(duk_context* ctx)
 	group = duk_require_sphere_obj(ctx, -1, "Group");
 	duk_pop(ctx);
 	group->rot_y = value;
+	group->is_matrix_dirty = true;
 	return 0;
 }
 
@@ -560,6 +1250,7 @@ js_Group_set_x(duk_context* ctx)
 	group = duk_require_sphere_obj(ctx, -1, "Group");
 	duk_pop(ctx);
 	group->x = value;
+	group->is_matrix_dirty = true;
 	return 0;
 }
 
@@ -585,6 +1276,24 @@ js_Group_set_y(duk_context* ctx)
 	group = duk_require_sphere_obj(ctx, -1, "Group");
 	duk_pop(ctx);
 	group->y = value;
+	group->is_matrix_dirty = true;
+	return 0;
+}
+
+static duk_ret_t
+js_Group_addChild(duk_context* ctx)
+{
+	group_t* child = duk_require_sphere_obj(ctx, 0, "Group");
+	
+	group_t* group;
+
+	duk_push_this(ctx);
+	group = duk_require_sphere_obj(ctx, -1, "Group");
+	duk_pop(ctx);
+	if (child == group || does_group_contain(child, group))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Group:addChild(): Group can't contain itself");
+	if (!add_group_child(group, child))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Group:addChild(): Child list allocation failure");
 	return 0;
 }
 
@@ -596,10 +1305,25 @@ js_Group_draw(duk_context* ctx)
 	duk_push_this(ctx);
 	group = duk_require_sphere_obj(ctx, -1, "Group");
 	duk_pop(ctx);
+	reset_render_state();
 	draw_group(group);
 	return 0;
 }
 
+static duk_ret_t
+js_Group_removeChild(duk_context* ctx)
+{
+	group_t* child = duk_require_sphere_obj(ctx, 0, "Group");
+	
+	group_t* group;
+
+	duk_push_this(ctx);
+	group = duk_require_sphere_obj(ctx, -1, "Group");
+	duk_pop(ctx);
+	remove_group_child(group, child);
+	return 0;
+}
+
 static duk_ret_t
 js_GetDefaultShaderProgram(duk_context* ctx)
 {
@@ -657,7 +1381,6 @@ js_new_Shape(duk_context* ctx)
 	}
 	if (is_missing_uv)
 		assign_default_uv(shape);
-	refresh_shape_vbuf(shape);
 	duk_push_sphere_obj(ctx, "Shape", shape);
 	return 1;
 }
@@ -697,6 +1420,84 @@ js_Shape_set_image(duk_context* ctx)
 	return 0;
 }
 
+static duk_ret_t
+js_Shape_get_usage(duk_context* ctx)
+{
+	shape_t* shape;
+
+	duk_push_this(ctx);
+	shape = duk_require_sphere_obj(ctx, -1, "Shape");
+	duk_pop(ctx);
+	duk_push_int(ctx, get_shape_usage(shape));
+	return 1;
+}
+
+static duk_ret_t
+js_Shape_set_usage(duk_context* ctx)
+{
+	shape_t* shape;
+	int usage = duk_require_int(ctx, 0);
+
+	duk_push_this(ctx);
+	shape = duk_require_sphere_obj(ctx, -1, "Shape");
+	duk_pop(ctx);
+	if (usage < 0 || usage >= USAGE_MAX)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Shape:usage: Invalid usage constant");
+	set_shape_usage(shape, usage);
+	return 0;
+}
+
+static duk_ret_t
+js_Shape_getVertex(duk_context* ctx)
+{
+	int index = duk_require_int(ctx, 0);
+	
+	shape_t* shape;
+	vertex_t vertex;
+
+	duk_push_this(ctx);
+	shape = duk_require_sphere_obj(ctx, -1, "Shape");
+	duk_pop(ctx);
+	if (index < 0 || index >= get_shape_vertex_count(shape))
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Shape:getVertex(): Vertex index out of range (%i)", index);
+	vertex = get_shape_vertex(shape, index);
+	duk_push_object(ctx);
+	duk_push_number(ctx, vertex.x); duk_put_prop_string(ctx, -2, "x");
+	duk_push_number(ctx, vertex.y); duk_put_prop_string(ctx, -2, "y");
+	duk_push_number(ctx, vertex.u); duk_put_prop_string(ctx, -2, "u");
+	duk_push_number(ctx, vertex.v); duk_put_prop_string(ctx, -2, "v");
+	duk_push_sphere_color(ctx, vertex.color); duk_put_prop_string(ctx, -2, "color");
+	return 1;
+}
+
+static duk_ret_t
+js_Shape_setVertex(duk_context* ctx)
+{
+	int index = duk_require_int(ctx, 0);
+	duk_require_object_coercible(ctx, 1);
+
+	shape_t* shape;
+	vertex_t vertex;
+
+	duk_push_this(ctx);
+	shape = duk_require_sphere_obj(ctx, -1, "Shape");
+	duk_pop(ctx);
+	if (index < 0 || index >= get_shape_vertex_count(shape))
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Shape:setVertex(): Vertex index out of range (%i)", index);
+	
+	// properties left out keep their current values, so moving a vertex
+	// doesn't lose its texture coordinates or color
+	vertex = get_shape_vertex(shape, index);
+	if (duk_get_prop_string(ctx, 1, "x")) vertex.x = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, 1, "y")) vertex.y = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, 1, "u")) vertex.u = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, 1, "v")) vertex.v = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, 1, "color")) vertex.color = duk_require_sphere_color(ctx, -1);
+	duk_pop_n(ctx, 5);
+	set_shape_vertex(shape, index, vertex);
+	return 0;
+}
+
 static duk_ret_t
 js_new_Vertex(duk_context* ctx)
 {
@@ -5,7 +5,8 @@ typedef struct vertex vertex_t;
 typedef struct shape  shape_t;
 typedef struct group  group_t;
 
-typedef enum shape_type shape_type_t;
+typedef enum shape_type  shape_type_t;
+typedef enum shape_usage shape_usage_t;
 
 struct vertex
 {
@@ -22,20 +23,33 @@ extern vertex_t vertex (float x, float y, float u, float v, color_t color);
 extern group_t* new_group          (void);
 extern group_t* ref_group          (group_t* group);
 extern void     free_group         (group_t* group);
+extern double   get_group_angle    (const group_t* group);
+extern void     get_group_rot_xy   (const group_t* group, float* out_x, float* out_y);
+extern void     get_group_xy       (const group_t* group, float* out_x, float* out_y);
+extern void     set_group_angle    (group_t* group, double theta);
+extern void     set_group_rot_xy   (group_t* group, float x, float y);
+extern void     set_group_xy       (group_t* group, float x, float y);
 extern bool     add_group_shape    (group_t* group, shape_t* shape);
 extern void     remove_group_shape (group_t* group, int index);
+extern bool     add_group_child    (group_t* group, group_t* child);
+extern void     remove_group_child (group_t* group, group_t* child);
 extern void     clear_group        (group_t* group);
-extern void     draw_group         (const group_t* group);
-
-extern shape_t*     new_shape           (shape_type_t type, image_t* texture);
-extern shape_t*     ref_shape           (shape_t* shape);
-extern void         free_shape          (shape_t* shape);
-extern float_rect_t get_shape_bounds    (const shape_t* shape);
-extern image_t*     get_shape_texture   (const shape_t* shape);
-extern void         set_shape_texture   (shape_t* shape, image_t* texture);
-extern bool         add_shape_vertex    (shape_t* shape, vertex_t vertex);
-extern void         remove_shape_vertex (shape_t* shape, int index);
-extern void         draw_shape          (const shape_t* shape);
+extern void     draw_group         (group_t* group);
+
+extern shape_t*      new_shape              (shape_type_t type, image_t* texture);
+extern shape_t*      ref_shape              (shape_t* shape);
+extern void          free_shape             (shape_t* shape);
+extern float_rect_t  get_shape_bounds       (shape_t* shape);
+extern image_t*      get_shape_texture      (const shape_t* shape);
+extern shape_usage_t get_shape_usage        (const shape_t* shape);
+extern int           get_shape_vertex_count (const shape_t* shape);
+extern vertex_t      get_shape_vertex       (const shape_t* shape, int index);
+extern void          set_shape_texture      (shape_t* shape, image_t* texture);
+extern void          set_shape_usage        (shape_t* shape, shape_usage_t usage);
+extern void          set_shape_vertex       (shape_t* shape, int index, vertex_t vertex);
+extern bool          add_shape_vertex       (shape_t* shape, vertex_t vertex);
+extern void          remove_shape_vertex    (shape_t* shape, int index);
+extern void          draw_shape             (shape_t* shape);
 
 extern void init_galileo_api (void);
 
@@ -50,4 +64,12 @@ enum shape_type
 	SHAPE_MAX
 };
 
+enum shape_usage
+{
+	USAGE_STATIC,
+	USAGE_DYNAMIC,
+	USAGE_STREAM,
+	USAGE_MAX
+};
+
 #endif // MINISPHERE__GALILEO_H__INCLUDED
@@ -0,0 +1,229 @@
+#include "minisphere.h"
+#include "api.h"
+#include "pool.h"
+
+#include "gc.h"
+
+// note: refcounting frees most garbage the moment it's dropped, but
+//       cycles (which include every function object) wait for a
+//       mark-and-sweep pass. Duktape starts one on its own once enough
+//       allocations have happened since the last, wherever that may be,
+//       which is how we get hitches in the middle of a frame.
+//
+//       Duktape 1.x can't collect incrementally, so a pass always walks the
+//       whole heap; what we can control is when it happens. "pressure" is
+//       how close the heap is to Duktape's own trigger (1.0) or to doubling
+//       in size since the last pass, whichever is closer. once it's halfway
+//       there, a pass is run in the idle part of a frame if its estimated
+//       cost (measured per byte of heap on earlier passes) fits in the time
+//       left. any pass resets Duktape's counter, so its own trigger only
+//       fires if a script allocates heavily without flipping the screen. if
+//       the idle time never fits, the pass is forced between frames.
+
+// allocations carry their size in front so the heap can be tallied and
+// the pool allocator knows which size class a block came from. 16 bytes
+// keeps the memory handed to Duktape aligned for any type.
+#define HEADER_SIZE 16
+
+#define IDLE_PRESSURE   0.5
+#define FORCE_PRESSURE  0.8
+#define LOOKAHEAD_TIME  0.5
+#define MIN_HEAP_BYTES  (512 * 1024)
+
+// Duktape's voluntary trigger, from DUK_HEAP_MARK_AND_SWEEP_TRIGGER_MULT
+// and _ADD in duktape.c. the multiplier is in 1/256ths of the number of
+// objects and strings kept by the last pass, and is far larger when
+// refcounting is on, since most garbage never needs mark-and-sweep then.
+#ifdef DUK_USE_REFERENCE_COUNTING
+#define DUK_TRIGGER_MULT  (12800.0 / 256)
+#else
+#define DUK_TRIGGER_MULT  (256.0 / 256)
+#endif
+#define DUK_TRIGGER_ADD   1024
+
+static duk_ret_t js_GetHeapStats (duk_context* ctx);
+
+static double get_gc_pressure (double lookahead);
+
+static double s_alloc_rate;
+static size_t s_alloc_total;
+static int    s_allocs_since_gc;
+static size_t s_heap_bytes;
+static size_t s_last_alloc_total;
+static double s_last_gc_pause;
+static int    s_last_live_allocs;
+static size_t s_last_live_bytes;
+static double s_last_rate_time;
+static int    s_num_allocs;
+static int    s_num_gcs;
+static double s_pause_per_byte;
+
+void
+initialize_gc(void)
+{
+	printf("Initializing garbage collector\n");
+	s_alloc_rate = 0.0;
+	s_alloc_total = 0;
+	s_allocs_since_gc = 0;
+	s_heap_bytes = 0;
+	s_last_alloc_total = 0;
+	s_last_gc_pause = 0.0;
+	s_last_live_allocs = 0;
+	s_last_live_bytes = 0;
+	s_last_rate_time = al_get_time();
+	s_num_allocs = 0;
+	s_num_gcs = 0;
+	s_pause_per_byte = 0.0;
+}
+
+void*
+gc_alloc(void* udata, duk_size_t size)
+{
+	uint8_t* block;
+
+	if (size == 0)
+		return NULL;
+	if (!(block = pool_alloc(size + HEADER_SIZE)))
+		return NULL;
+	*(size_t*)block = size;
+	s_heap_bytes += size;
+	s_alloc_total += size;
+	++s_allocs_since_gc;
+	++s_num_allocs;
+	return block + HEADER_SIZE;
+}
+
+void*
+gc_realloc(void* udata, void* ptr, duk_size_t size)
+{
+	uint8_t* block;
+	size_t   old_size;
+
+	if (ptr == NULL)
+		return gc_alloc(udata, size);
+	if (size == 0) {
+		gc_free(udata, ptr);
+		return NULL;
+	}
+	block = (uint8_t*)ptr - HEADER_SIZE;
+	old_size = *(size_t*)block;
+	if (!(block = pool_realloc(block, old_size + HEADER_SIZE, size + HEADER_SIZE)))
+		return NULL;
+	*(size_t*)block = size;
+	s_heap_bytes = s_heap_bytes - old_size + size;
+	++s_allocs_since_gc;
+	if (size > old_size)
+		s_alloc_total += size - old_size;
+	return block + HEADER_SIZE;
+}
+
+void
+gc_free(void* udata, void* ptr)
+{
+	uint8_t* block;
+
+	if (ptr == NULL)
+		return;
+	block = (uint8_t*)ptr - HEADER_SIZE;
+	s_heap_bytes -= *(size_t*)block;
+	--s_num_allocs;
+	pool_free(block, *(size_t*)block + HEADER_SIZE);
+}
+
+void
+get_gc_stats(size_t* out_bytes, int* out_num_allocs, double* out_last_pause)
+{
+	if (out_bytes) *out_bytes = s_heap_bytes;
+	if (out_num_allocs) *out_num_allocs = s_num_allocs;
+	if (out_last_pause) *out_last_pause = s_last_gc_pause;
+}
+
+void
+collect_garbage(void)
+{
+	size_t heap_bytes;
+	double pause;
+	double start_time;
+
+	if (g_duk == NULL)
+		return;
+	heap_bytes = s_heap_bytes;
+	start_time = al_get_time();
+	duk_gc(g_duk, 0x0);
+	pause = al_get_time() - start_time;
+	s_last_gc_pause = pause;
+	s_last_live_allocs = s_num_allocs;
+	s_last_live_bytes = s_heap_bytes;
+	s_allocs_since_gc = 0;
+	++s_num_gcs;
+	if (heap_bytes > 0) {
+		s_pause_per_byte = s_num_gcs > 1
+			? s_pause_per_byte * 0.75 + pause / heap_bytes * 0.25
+			: pause / heap_bytes;
+	}
+}
+
+bool
+do_idle_gc(void* udata, double deadline)
+{
+	// look ahead at the current allocation rate: if the heap is on pace to
+	// need a pass soon anyway, better to do it now while there's room
+	if (get_gc_pressure(LOOKAHEAD_TIME) < IDLE_PRESSURE)
+		return false;
+	if (s_pause_per_byte * s_heap_bytes > deadline - al_get_time())
+		return false;
+	collect_garbage();
+	return false;
+}
+
+void
+update_gc(void)
+{
+	double now;
+	double time_delta;
+
+	now = al_get_time();
+	time_delta = now - s_last_rate_time;
+	if (time_delta >= 0.25) {
+		s_alloc_rate = s_alloc_rate * 0.5 + (s_alloc_total - s_last_alloc_total) / time_delta * 0.5;
+		s_last_alloc_total = s_alloc_total;
+		s_last_rate_time = now;
+	}
+	if (get_gc_pressure(0.0) >= FORCE_PRESSURE)
+		collect_garbage();
+}
+
+static double
+get_gc_pressure(double lookahead)
+{
+	double alloc_pressure;
+	double byte_pressure;
+	double growth;
+
+	// Duktape counts down its trigger once per allocation or reallocation.
+	// objects usually take two allocations (header and property table), so
+	// live allocations are counted at half to estimate what it kept.
+	growth = (double)s_heap_bytes - s_last_live_bytes + s_alloc_rate * lookahead;
+	byte_pressure = growth / fmax(s_last_live_bytes, MIN_HEAP_BYTES);
+	alloc_pressure = (double)s_allocs_since_gc
+		/ (s_last_live_allocs / 2 * DUK_TRIGGER_MULT + DUK_TRIGGER_ADD);
+	return fmax(byte_pressure, alloc_pressure);
+}
+
+void
+init_gc_api(void)
+{
+	register_api_function(g_duk, NULL, "GetHeapStats", js_GetHeapStats);
+}
+
+static duk_ret_t
+js_GetHeapStats(duk_context* ctx)
+{
+	duk_push_object(ctx);
+	duk_push_number(ctx, s_heap_bytes); duk_put_prop_string(ctx, -2, "bytes");
+	duk_push_int(ctx, s_num_allocs); duk_put_prop_string(ctx, -2, "objects");
+	duk_push_int(ctx, s_num_gcs); duk_put_prop_string(ctx, -2, "collections");
+	duk_push_number(ctx, s_last_gc_pause * 1000.0); duk_put_prop_string(ctx, -2, "lastPause");
+	duk_push_number(ctx, s_alloc_rate); duk_put_prop_string(ctx, -2, "allocRate");
+	return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef MINISPHERE__GC_H__INCLUDED
+#define MINISPHERE__GC_H__INCLUDED
+
+extern void   initialize_gc   (void);
+extern void*  gc_alloc        (void* udata, duk_size_t size);
+extern void*  gc_realloc      (void* udata, void* ptr, duk_size_t size);
+extern void   gc_free         (void* udata, void* ptr);
+extern void   get_gc_stats    (size_t* out_bytes, int* out_num_allocs, double* out_last_pause);
+extern void   collect_garbage (void);
+extern bool   do_idle_gc      (void* udata, double deadline);
+extern void   update_gc       (void);
+
+extern void init_gc_api (void);
+
+#endif // MINISPHERE__GC_H__INCLUDED
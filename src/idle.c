@@ -0,0 +1,107 @@
+#include "minisphere.h"
+
+#include "idle.h"
+
+// note: idle jobs are low-priority work (garbage collection, decoding,
+//       cache writes) run by flip_screen() with whatever is left of the
+//       frame once the game has drawn it. a job is handed the time it has
+//       to finish by and returns true if it still has work to do right
+//       now; the engine only sleeps once every job is caught up. jobs take
+//       turns going first so a greedy one can't starve the rest.
+
+struct idle_job
+{
+	idle_job_t job;
+	void*      udata;
+};
+
+static bool             s_is_running = false;
+static int              s_max_jobs = 0;
+static int              s_next_job = 0;
+static int              s_num_jobs = 0;
+static struct idle_job* s_jobs = NULL;
+
+void
+initialize_idle(void)
+{
+	printf("Initializing idle-time scheduler\n");
+	s_num_jobs = 0;
+	s_next_job = 0;
+}
+
+void
+shutdown_idle(void)
+{
+	printf("Shutting down idle-time scheduler\n");
+	free(s_jobs);
+	s_jobs = NULL;
+	s_max_jobs = s_num_jobs = 0;
+}
+
+bool
+add_idle_job(idle_job_t job, void* udata)
+{
+	int              new_max;
+	struct idle_job* new_jobs;
+
+	if (s_num_jobs >= s_max_jobs) {
+		new_max = s_max_jobs > 0 ? s_max_jobs * 2 : 8;
+		if (!(new_jobs = realloc(s_jobs, new_max * sizeof(struct idle_job))))
+			return false;
+		s_jobs = new_jobs;
+		s_max_jobs = new_max;
+	}
+	s_jobs[s_num_jobs].job = job;
+	s_jobs[s_num_jobs].udata = udata;
+	++s_num_jobs;
+	return true;
+}
+
+void
+remove_idle_job(idle_job_t job, void* udata)
+{
+	int i, j;
+
+	for (i = 0; i < s_num_jobs; ++i) {
+		if (s_jobs[i].job != job || s_jobs[i].udata != udata)
+			continue;
+		if (s_is_running)  // run_idle_jobs() cleans up after itself
+			s_jobs[i].job = NULL;
+		else {
+			for (j = i; j < s_num_jobs - 1; ++j)
+				s_jobs[j] = s_jobs[j + 1];
+			--s_num_jobs;
+		}
+		return;
+	}
+}
+
+bool
+run_idle_jobs(double deadline)
+{
+	bool            has_more_work = false;
+	struct idle_job job;
+	int             num_jobs;
+
+	int i, j;
+
+	if (s_is_running || s_num_jobs == 0)
+		return false;
+	s_is_running = true;
+	num_jobs = s_num_jobs;
+	for (i = 0; i < num_jobs && al_get_time() < deadline; ++i) {
+		job = s_jobs[(s_next_job + i) % num_jobs];
+		if (job.job != NULL && job.job(job.udata, deadline))
+			has_more_work = true;
+	}
+	s_next_job = num_jobs > 0 ? (s_next_job + 1) % num_jobs : 0;
+	s_is_running = false;
+
+	// sweep out any jobs removed while they were running
+	for (i = j = 0; i < s_num_jobs; ++i) {
+		if (s_jobs[i].job != NULL)
+			s_jobs[j++] = s_jobs[i];
+	}
+	s_num_jobs = j;
+	return has_more_work;
+}
@@ -0,0 +1,12 @@
+#ifndef MINISPHERE__IDLE_H__INCLUDED
+#define MINISPHERE__IDLE_H__INCLUDED
+
+typedef bool (*idle_job_t)(void* udata, double deadline);
+
+extern void initialize_idle (void);
+extern void shutdown_idle   (void);
+extern bool add_idle_job    (idle_job_t job, void* udata);
+extern void remove_idle_job (idle_job_t job, void* udata);
+extern bool run_idle_jobs   (double deadline);
+
+#endif // MINISPHERE__IDLE_H__INCLUDED
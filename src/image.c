@@ -1,6 +1,8 @@
 #include "minisphere.h"
 #include "api.h"
 #include "color.h"
+#include "pixels.h"
+#include "render.h"
 #include "surface.h"
 
 #include "image.h"
@@ -10,11 +12,19 @@ struct image
 	int             refcount;
 	ALLEGRO_BITMAP* bitmap;
 	uint32_t*       pixel_cache;
+	rect_t          dirty_rect;
 	int             width;
 	int             height;
 	image_t*        parent;
 };
 
+// note: an image's pixels can live on the GPU (`bitmap`), in system memory
+//       (`pixel_cache`), or both. when both are present and `dirty_rect` is
+//       non-empty, the CPU copy is newer and that region gets uploaded the next
+//       time the bitmap is needed. a software image starts out with no bitmap
+//       at all, so Surfaces which are only ever touched by the software
+//       rasterizer never need a display.
+
 static duk_ret_t js_GetSystemArrow          (duk_context* ctx);
 static duk_ret_t js_GetSystemDownArrow      (duk_context* ctx);
 static duk_ret_t js_GetSystemUpArrow        (duk_context* ctx);
@@ -35,8 +45,10 @@ static duk_ret_t js_Image_transformBlitMask (duk_context* ctx);
 static duk_ret_t js_Image_zoomBlit          (duk_context* ctx);
 static duk_ret_t js_Image_zoomBlitMask      (duk_context* ctx);
 
-static void cache_pixels   (image_t* image);
-static void uncache_pixels (image_t* image);
+static bool cache_pixels      (image_t* image);
+static bool clip_image_region (const image_t* image, int* inout_x, int* inout_y, int* inout_width, int* inout_height);
+static bool flush_pixels      (image_t* image);
+static bool uncache_pixels    (image_t* image);
 
 static image_t* s_sys_arrow    = NULL;
 static image_t* s_sys_dn_arrow = NULL;
@@ -60,12 +72,32 @@ on_error:
 	return NULL;
 }
 
+image_t*
+create_soft_image(int width, int height)
+{
+	image_t* image;
+
+	if ((image = calloc(1, sizeof(image_t))) == NULL)
+		goto on_error;
+	if ((image->pixel_cache = calloc(width * height, sizeof(uint32_t))) == NULL)
+		goto on_error;
+	image->width = width;
+	image->height = height;
+	image->dirty_rect = new_rect(0, 0, width, height);
+	return ref_image(image);
+
+on_error:
+	free(image);
+	return NULL;
+}
+
 image_t*
 create_subimage(image_t* parent, int x, int y, int width, int height)
 {
 	image_t* image;
 
 	if ((image = calloc(1, sizeof(image_t))) == NULL) goto on_error;
+	if (get_image_bitmap(parent) == NULL) goto on_error;
 	if ((image->bitmap = al_create_sub_bitmap(parent->bitmap, x, y, width, height)) == NULL)
 		goto on_error;
 	image->width = al_get_bitmap_width(image->bitmap);
@@ -83,6 +115,14 @@ clone_image(const image_t* src_image)
 {
 	image_t* image;
 
+	// if the source has a CPU-side copy, it's always complete and at least as
+	// new as the bitmap, so cloning it avoids a round trip through the GPU.
+	if (src_image->pixel_cache != NULL) {
+		if ((image = create_soft_image(src_image->width, src_image->height)) == NULL)
+			return NULL;
+		memcpy(image->pixel_cache, src_image->pixel_cache, src_image->width * src_image->height * 4);
+		return image;
+	}
 	if ((image = calloc(1, sizeof(image_t))) == NULL)
 		goto on_error;
 	if ((image->bitmap = al_clone_bitmap(src_image->bitmap)) == NULL)
@@ -195,7 +235,12 @@ free_image(image_t* image)
 {
 	if (image == NULL || --image->refcount > 0)
 		return;
-	al_destroy_bitmap(image->bitmap);
+	free(image->pixel_cache);
+	if (image->bitmap != NULL) {
+		if (al_get_target_bitmap() == image->bitmap)
+			reset_render_state();
+		al_destroy_bitmap(image->bitmap);
+	}
 	free_image(image->parent);
 	free(image);
 }
@@ -203,7 +248,12 @@ free_image(image_t* image)
 ALLEGRO_BITMAP*
 get_image_bitmap(image_t* image)
 {
-	uncache_pixels(image);
+	// a subimage shares its parent's bitmap, so pixels set on the parent
+	// have to be uploaded before it's drawn
+	if (image->parent != NULL && !flush_pixels(image->parent))
+		return NULL;
+	if (!flush_pixels(image))
+		return NULL;
 	return image->bitmap;
 }
 
@@ -213,24 +263,35 @@ get_image_height(const image_t* image)
 	return image->height;
 }
 
+ALLEGRO_BITMAP*
+get_image_target(image_t* image)
+{
+	// drawing to the bitmap makes the CPU-side copy stale, so write back any
+	// pending changes and throw it away. for a subimage, that goes for the
+	// parent's copy too.
+	if (image->parent != NULL && !uncache_pixels(image->parent))
+		return NULL;
+	if (!uncache_pixels(image))
+		return NULL;
+	return image->bitmap;
+}
+
 color_t
 get_image_pixel(image_t* image, int x, int y)
 {
-	uint32_t      pixel;
+	uint8_t*      pixel;
 	unsigned char r, g, b, alpha;
 	
-	cache_pixels(image);
-	if (image->pixel_cache == NULL) {
+	if (!cache_pixels(image)) {
 		al_unmap_rgba(al_get_pixel(image->bitmap, x, y),
 			&r, &g, &b, &alpha);
 	}
 	else {
-		// note: AA BB GG RR
-		pixel = image->pixel_cache[x + y * image->width];
-		r = pixel >> 16 & 0xFF;
-		g = pixel >> 8 & 0xFF;
-		b = pixel & 0xFF;
-		alpha = pixel >> 24 & 0xFF;
+		pixel = (uint8_t*)&image->pixel_cache[x + y * image->width];
+		r = pixel[0];
+		g = pixel[1];
+		b = pixel[2];
+		alpha = pixel[3];
 	}
 	return rgba(r, g, b, alpha);
 }
@@ -241,56 +302,88 @@ get_image_width(const image_t* image)
 	return image->width;
 }
 
+uint32_t*
+lock_image_pixels(image_t* image)
+{
+	return cache_pixels(image) ? image->pixel_cache : NULL;
+}
+
 void
 set_image_pixel(image_t* image, int x, int y, color_t color)
 {
-	ALLEGRO_BITMAP* old_target;
+	uint32_t* pixels;
+
+	if (x < 0 || y < 0 || x >= image->width || y >= image->height)
+		return;
+	if (!(pixels = lock_image_pixels(image)))
+		return;
+	memcpy(&pixels[x + y * image->width], &color, sizeof(uint32_t));
+	unlock_image_pixels(image, new_rect(x, y, x + 1, y + 1));
+}
+
+void
+unlock_image_pixels(image_t* image, rect_t dirty_rect)
+{
+	rect_t* rect = &image->dirty_rect;
+
+	if (dirty_rect.x2 <= dirty_rect.x1 || dirty_rect.y2 <= dirty_rect.y1)
+		return;
+	if (rect->x2 <= rect->x1 || rect->y2 <= rect->y1)
+		*rect = dirty_rect;
+	else {
+		rect->x1 = fmin(rect->x1, dirty_rect.x1);
+		rect->y1 = fmin(rect->y1, dirty_rect.y1);
+		rect->x2 = fmax(rect->x2, dirty_rect.x2);
+		rect->y2 = fmax(rect->y2, dirty_rect.y2);
+	}
+}
+
+bool
+apply_image_colormat(image_t* image, int x, int y, int width, int height, colormatrix_t matrix)
+{
+	uint32_t* pixels;
 
-	uncache_pixels(image);
-	old_target = al_get_target_bitmap();
-	al_set_target_bitmap(image->bitmap);
-	al_put_pixel(x, y, nativecolor(color));
-	al_set_target_bitmap(old_target);
+	if (!clip_image_region(image, &x, &y, &width, &height))
+		return true;
+	if (!(pixels = lock_image_pixels(image)))
+		return false;
+	transform_pixels(pixels + x + y * image->width, image->width * 4, width, height, &matrix);
+	unlock_image_pixels(image, new_rect(x, y, x + width, y + height));
+	return true;
 }
 
 bool
 apply_image_lookup(image_t* image, int x, int y, int width, int height, uint8_t red_lu[256], uint8_t green_lu[256], uint8_t blue_lu[256], uint8_t alpha_lu[256])
 {
-	ALLEGRO_BITMAP*        bitmap = get_image_bitmap(image);
-	uint8_t*               pixel;
-	ALLEGRO_LOCKED_REGION* lock;
+	uint32_t* pixels;
 
-	int i_x, i_y;
-
-	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
+	if (!clip_image_region(image, &x, &y, &width, &height))
+		return true;
+	if (!(pixels = lock_image_pixels(image)))
 		return false;
-	uncache_pixels(image);
-	for (i_x = x; i_x < x + width; ++i_x) for (i_y = y; i_y < y + height; ++i_y) {
-		pixel = (uint8_t*)lock->data + i_x * 4 + i_y * lock->pitch;
-		pixel[0] = red_lu[pixel[0]];
-		pixel[1] = green_lu[pixel[1]];
-		pixel[2] = blue_lu[pixel[2]];
-		pixel[3] = alpha_lu[pixel[3]];
-	}
-	al_unlock_bitmap(bitmap);
+	lookup_pixels(pixels + x + y * image->width, image->width * 4, width, height, red_lu, green_lu, blue_lu, alpha_lu);
+	unlock_image_pixels(image, new_rect(x, y, x + width, y + height));
 	return true;
 }
 
 void
 draw_image(image_t* image, int x, int y)
 {
+	if (get_image_bitmap(image) == NULL) return;
 	al_draw_bitmap(image->bitmap, x, y, 0x0);
 }
 
 void
 draw_image_masked(image_t* image, color_t mask, int x, int y)
 {
+	if (get_image_bitmap(image) == NULL) return;
 	al_draw_tinted_bitmap(image->bitmap, al_map_rgba(mask.r, mask.g, mask.b, mask.alpha), x, y, 0x0);
 }
 
 void
 draw_image_scaled(image_t* image, int x, int y, int width, int height)
 {
+	if (get_image_bitmap(image) == NULL) return;
 	al_draw_scaled_bitmap(image->bitmap,
 		0, 0, al_get_bitmap_width(image->bitmap), al_get_bitmap_height(image->bitmap),
 		x, y, width, height, 0x0);
@@ -299,6 +392,7 @@ draw_image_scaled(image_t* image, int x, int y, int width, int height)
 void
 draw_image_scaled_masked(image_t* image, color_t mask, int x, int y, int width, int height)
 {
+	if (get_image_bitmap(image) == NULL) return;
 	al_draw_tinted_scaled_bitmap(image->bitmap, nativecolor(mask),
 		0, 0, al_get_bitmap_width(image->bitmap), al_get_bitmap_height(image->bitmap),
 		x, y, width, height, 0x0);
@@ -321,76 +415,76 @@ draw_image_tiled_masked(image_t* image, color_t mask, int x, int y, int width, i
 		{ x, y + height, 0, 0, height, vtx_color },
 		{ x + width, y + height, 0, width, height, vtx_color }
 	};
+	if (get_image_bitmap(image) == NULL) return;
 	al_draw_prim(vbuf, NULL, image->bitmap, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
 }
 
 void
 fill_image(image_t* image, color_t color)
 {
-	int             clip_x, clip_y, clip_w, clip_h;
-	ALLEGRO_BITMAP* last_target;
+	uint32_t value;
+
+	int i;
 
-	uncache_pixels(image);
-	al_get_clipping_rectangle(&clip_x, &clip_y, &clip_w, &clip_h);
-	al_reset_clipping_rectangle();
-	last_target = al_get_target_bitmap();
-	al_set_target_bitmap(image->bitmap);
+	if (image->pixel_cache != NULL) {
+		memcpy(&value, &color, sizeof(uint32_t));
+		for (i = 0; i < image->width * image->height; ++i)
+			image->pixel_cache[i] = value;
+		unlock_image_pixels(image, new_rect(0, 0, image->width, image->height));
+		return;
+	}
+	set_render_target(image->bitmap);
 	al_clear_to_color(al_map_rgba(color.r, color.g, color.b, color.alpha));
-	al_set_target_bitmap(last_target);
-	al_set_clipping_rectangle(clip_x, clip_y, clip_w, clip_h);
 }
 
 bool
 flip_image(image_t* image, bool is_h_flip, bool is_v_flip)
 {
-	int             draw_flags = 0x0;
-	ALLEGRO_BITMAP* new_bitmap;
-	ALLEGRO_BITMAP* old_target;
+	uint32_t* pixels;
+	uint32_t* row_1;
+	uint32_t* row_2;
+	uint32_t  temp;
+
+	int i_x, i_y;
 
 	if (!is_h_flip && !is_v_flip)  // this really shouldn't happen...
 		return true;
-	uncache_pixels(image);
-	if (!(new_bitmap = al_create_bitmap(image->width, image->height))) return false;
-	old_target = al_get_target_bitmap();
-	al_set_target_bitmap(new_bitmap);
-	if (is_h_flip) draw_flags &= ALLEGRO_FLIP_HORIZONTAL;
-	if (is_v_flip) draw_flags &= ALLEGRO_FLIP_VERTICAL;
-	al_draw_bitmap(image->bitmap, 0, 0, draw_flags);
-	al_set_target_bitmap(old_target);
-	al_destroy_bitmap(image->bitmap);
-	image->bitmap = new_bitmap;
+	if (!(pixels = lock_image_pixels(image)))
+		return false;
+	if (is_h_flip) {
+		for (i_y = 0; i_y < image->height; ++i_y) {
+			row_1 = pixels + i_y * image->width;
+			for (i_x = 0; i_x < image->width / 2; ++i_x) {
+				temp = row_1[i_x];
+				row_1[i_x] = row_1[image->width - 1 - i_x];
+				row_1[image->width - 1 - i_x] = temp;
+			}
+		}
+	}
+	if (is_v_flip) {
+		for (i_y = 0; i_y < image->height / 2; ++i_y) {
+			row_1 = pixels + i_y * image->width;
+			row_2 = pixels + (image->height - 1 - i_y) * image->width;
+			for (i_x = 0; i_x < image->width; ++i_x) {
+				temp = row_1[i_x];
+				row_1[i_x] = row_2[i_x];
+				row_2[i_x] = temp;
+			}
+		}
+	}
+	unlock_image_pixels(image, new_rect(0, 0, image->width, image->height));
 	return true;
 }
 
 bool
 replace_image_color(image_t* image, color_t color, color_t new_color)
 {
-	ALLEGRO_BITMAP*        bitmap = get_image_bitmap(image);
-	uint8_t*               pixel;
-	ALLEGRO_LOCKED_REGION* lock;
-	int                    w, h;
+	uint32_t* pixels;
 
-	int i_x, i_y;
-
-	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
+	if (!(pixels = lock_image_pixels(image)))
 		return false;
-	uncache_pixels(image);
-	w = al_get_bitmap_width(bitmap);
-	h = al_get_bitmap_height(bitmap);
-	for (i_x = 0; i_x < w; ++i_x) for (i_y = 0; i_y < h; ++i_y) {
-		pixel = (uint8_t*)lock->data + i_x * 4 + i_y * lock->pitch;
-		if (pixel[0] == color.r &&
-		    pixel[1] == color.g &&
-		    pixel[2] == color.b &&
-		    pixel[3] == color.alpha)
-		{
-			pixel[0] = new_color.r;
-			pixel[1] = new_color.g;
-			pixel[2] = new_color.b;
-			pixel[3] = new_color.alpha;
-		}
-	}
-	al_unlock_bitmap(bitmap);
+	replace_pixels(pixels, image->width * 4, image->width, image->height, color, new_color);
+	unlock_image_pixels(image, new_rect(0, 0, image->width, image->height));
 	return true;
 }
 
@@ -398,16 +492,14 @@ bool
 rescale_image(image_t* image, int width, int height)
 {
 	ALLEGRO_BITMAP* new_bitmap;
-	ALLEGRO_BITMAP* old_target;
 
 	if (width == image->width && height == image->height)
 		return true;
+	if (!uncache_pixels(image)) return false;
 	if (!(new_bitmap = al_create_bitmap(width, height))) return false;
-	uncache_pixels(image);
-	old_target = al_get_target_bitmap();
-	al_set_target_bitmap(new_bitmap);
+	set_render_target(new_bitmap);
+	set_render_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
 	al_draw_scaled_bitmap(image->bitmap, 0, 0, image->width, image->height, 0, 0, width, height, 0x0);
-	al_set_target_bitmap(old_target);
 	al_destroy_bitmap(image->bitmap);
 	image->bitmap = new_bitmap;
 	image->width = al_get_bitmap_width(image->bitmap);
@@ -415,11 +507,11 @@ rescale_image(image_t* image, int width, int height)
 	return true;
 }
 
-static void
+static bool
 cache_pixels(image_t* image)
 {
 	uint32_t*              cache;
-	ALLEGRO_LOCKED_REGION* lock;
+	ALLEGRO_LOCKED_REGION* lock = NULL;
 	void                   *psrc, *pdest;
 
 	int i;
@@ -438,20 +530,74 @@ cache_pixels(image_t* image)
 			memcpy(pdest, psrc, image->width * 4);
 		}
 		image->pixel_cache = cache;
+		image->dirty_rect = new_rect(0, 0, 0, 0);
 		al_unlock_bitmap(image->bitmap);
 	}
-	return;
+	return true;
 	
 on_error:
 	if (lock != NULL)
 		al_unlock_bitmap(image->bitmap);
+	return false;
 }
 
-static void
+static bool
+clip_image_region(const image_t* image, int* inout_x, int* inout_y, int* inout_width, int* inout_height)
+{
+	int x1, y1, x2, y2;
+
+	x1 = fmax(*inout_x, 0);
+	y1 = fmax(*inout_y, 0);
+	x2 = fmin(*inout_x + *inout_width, image->width);
+	y2 = fmin(*inout_y + *inout_height, image->height);
+	if (x2 <= x1 || y2 <= y1)
+		return false;
+	*inout_x = x1; *inout_y = y1;
+	*inout_width = x2 - x1;
+	*inout_height = y2 - y1;
+	return true;
+}
+
+static bool
+flush_pixels(image_t* image)
+{
+	ALLEGRO_LOCKED_REGION* lock;
+	rect_t                 rect;
+	void                   *psrc, *pdest;
+
+	int i_y;
+
+	if (image->bitmap == NULL) {
+		if (!(image->bitmap = al_create_bitmap(image->width, image->height)))
+			return false;
+		image->dirty_rect = new_rect(0, 0, image->width, image->height);
+	}
+	rect = image->dirty_rect;
+	if (image->pixel_cache == NULL || rect.x2 <= rect.x1 || rect.y2 <= rect.y1)
+		return true;
+	if (!(lock = al_lock_bitmap_region(image->bitmap, rect.x1, rect.y1, rect.x2 - rect.x1, rect.y2 - rect.y1,
+		ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_WRITEONLY)))
+	{
+		return false;
+	}
+	for (i_y = rect.y1; i_y < rect.y2; ++i_y) {
+		psrc = image->pixel_cache + rect.x1 + i_y * image->width;
+		pdest = (uint8_t*)lock->data + (i_y - rect.y1) * lock->pitch;
+		memcpy(pdest, psrc, (rect.x2 - rect.x1) * 4);
+	}
+	al_unlock_bitmap(image->bitmap);
+	image->dirty_rect = new_rect(0, 0, 0, 0);
+	return true;
+}
+
+static bool
 uncache_pixels(image_t* image)
 {
+	if (!flush_pixels(image))
+		return false;
 	free(image->pixel_cache);
 	image->pixel_cache = NULL;
+	return true;
 }
 
 void
@@ -558,15 +704,22 @@ js_GrabImage(duk_context* ctx)
 
 	ALLEGRO_BITMAP* backbuffer;
 	image_t*        image;
+	ALLEGRO_BITMAP* target;
 
 	backbuffer = al_get_backbuffer(g_display);
 	if ((image = create_image(w, h)) == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GrabImage(): Failed to create new image");
-	al_set_target_bitmap(get_image_bitmap(image));
+	if (!(target = get_image_target(image))) {
+		free_image(image);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GrabImage(): Failed to upload image to GPU");
+	}
+	set_render_target(target);
+	set_render_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
 	al_draw_bitmap_region(backbuffer, x, y, w, h, 0, 0, 0x0);
-	al_set_target_backbuffer(g_display);
-	if (!rescale_image(image, g_res_x, g_res_y))
+	if (!rescale_image(image, g_res_x, g_res_y)) {
+		free_image(image);
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GrabImage(): Failed to rescale grabbed image");
+	}
 	duk_push_sphere_image(ctx, image);
 	free_image(image);
 	return 1;
@@ -662,6 +815,7 @@ js_Image_blit(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_image(ctx, -1);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame()) al_draw_bitmap(get_image_bitmap(image), x, y, 0x0);
 	return 0;
 }
@@ -678,6 +832,7 @@ js_Image_blitMask(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_image(ctx, -1);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame()) al_draw_tinted_bitmap(get_image_bitmap(image), al_map_rgba(mask.r, mask.g, mask.b, mask.alpha), x, y, 0x0);
 	return 0;
 }
@@ -710,6 +865,7 @@ js_Image_rotateBlit(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_image(ctx, -1);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_rotated_bitmap(get_image_bitmap(image),
 			image->width / 2, image->height / 2, x + image->width / 2, y + image->height / 2,
@@ -730,6 +886,7 @@ js_Image_rotateBlitMask(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_image(ctx, -1);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_tinted_rotated_bitmap(get_image_bitmap(image), al_map_rgba(mask.r, mask.g, mask.b, mask.alpha),
 			image->width / 2, image->height / 2, x + image->width / 2, y + image->height / 2,
@@ -762,6 +919,7 @@ js_Image_transformBlit(duk_context* ctx)
 		{ x4, y4, 0, 0, image->height, vertex_color },
 		{ x3, y3, 0, image->width, image->height, vertex_color }
 	};
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_prim(v, NULL, get_image_bitmap(image), 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
 	return 0;
@@ -793,6 +951,7 @@ js_Image_transformBlitMask(duk_context* ctx)
 		{ x4, y4, 0, 0, image->height, vtx_color },
 		{ x3, y3, 0, image->width, image->height, vtx_color }
 	};
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_prim(v, NULL, get_image_bitmap(image), 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
 	return 0;
@@ -810,6 +969,7 @@ js_Image_zoomBlit(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_image(ctx, -1);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_scaled_bitmap(get_image_bitmap(image), 0, 0, image->width, image->height, x, y, image->width * scale, image->height * scale, 0x0);
 	return 0;
@@ -828,6 +988,7 @@ js_Image_zoomBlitMask(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_image(ctx, -1);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_tinted_scaled_bitmap(get_image_bitmap(image), al_map_rgba(mask.r, mask.g, mask.b, mask.alpha),
 			0, 0, image->width, image->height, x, y, image->width * scale, image->height * scale, 0x0);
@@ -1,9 +1,12 @@
 #ifndef MINISPHERE__IMAGE_H__INCLUDED
 #define MINISPHERE__IMAGE_H__INCLUDED
 
+#include "geometry.h"
+
 typedef struct image image_t;
 
 extern image_t*        create_image             (int width, int height);
+extern image_t*        create_soft_image        (int width, int height);
 extern image_t*        create_subimage          (image_t* parent, int x, int y, int width, int height);
 extern image_t*        clone_image              (const image_t* image);
 extern image_t*        load_image               (const char* path);
@@ -14,8 +17,12 @@ extern void            free_image               (image_t* image);
 extern ALLEGRO_BITMAP* get_image_bitmap         (image_t* image);
 extern int             get_image_height         (const image_t* image);
 extern color_t         get_image_pixel          (image_t* image, int x, int y);
+extern ALLEGRO_BITMAP* get_image_target         (image_t* image);
 extern int             get_image_width          (const image_t* image);
 extern void            set_image_pixel          (image_t* image, int x, int y, color_t color);
+extern uint32_t*       lock_image_pixels        (image_t* image);
+extern void            unlock_image_pixels      (image_t* image, rect_t dirty_rect);
+extern bool            apply_image_colormat     (image_t* image, int x, int y, int width, int height, colormatrix_t matrix);
 extern bool            apply_image_lookup       (image_t* image, int x, int y, int width, int height, uint8_t red_lu[256], uint8_t green_lu[256], uint8_t blue_lu[256], uint8_t alpha_lu[256]);
 extern void            draw_image               (image_t* image, int x, int y);
 extern void            draw_image_masked        (image_t* image, color_t mask, int x, int y);
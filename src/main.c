@@ -6,17 +6,26 @@
 #include "file.h"
 #include "font.h"
 #include "galileo.h"
+#include "gc.h"
+#include "idle.h"
 #include "image.h"
 #include "input.h"
 #include "logger.h"
 #include "map_engine.h"
+#include "persons.h"
+#include "pool.h"
 #include "primitives.h"
 #include "rawfile.h"
+#include "render.h"
 #include "rng.h"
 #include "sockets.h"
 #include "sound.h"
+#include "spritebatch.h"
 #include "spriteset.h"
 #include "surface.h"
+#include "task.h"
+#include "timer.h"
+#include "tween.h"
 #include "windowstyle.h"
 
 // enable Windows visual styles (MSVC)
@@ -53,6 +62,7 @@ static bool    s_conserve_cpu = true;
 static int     s_current_fps;
 static int     s_current_game_fps;
 static int     s_frame_skips;
+static bool    s_heap_stats = false;
 static bool    s_is_fullscreen = false;
 static jmp_buf s_jmp_exit;
 static jmp_buf s_jmp_restart;
@@ -146,6 +156,9 @@ main(int argc, char* argv[])
 			else if (strcmp(argv[i], "--windowed") == 0) {
 				s_is_fullscreen = false;
 			}
+			else if (strcmp(argv[i], "--heap-stats") == 0) {
+				s_heap_stats = true;
+			}
 		}
 	}
 	
@@ -154,6 +167,7 @@ main(int argc, char* argv[])
 	printf("  Game path: %s\n", al_path_cstr(g_game_path, ALLEGRO_NATIVE_PATH_SEP));
 	printf("  Maximum consecutive frame skips: %i\n", s_max_frameskip);
 	printf("  CPU throttle: %s\n", s_conserve_cpu ? "ON" : "OFF");
+	printf("  Heap statistics: %s\n", s_heap_stats ? "ON" : "OFF");
 	
 	// set up jump points for script bailout
 	printf("Setting up jump points for longjmp\n");
@@ -234,6 +248,9 @@ main(int argc, char* argv[])
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
 	g_events = al_create_event_queue();
 	al_register_event_source(g_events, al_get_display_event_source(g_display));
+	al_register_event_source(g_events, al_get_keyboard_event_source());
+	al_register_event_source(g_events, al_get_mouse_event_source());
+	al_register_event_source(g_events, al_get_joystick_event_source());
 	
 	// attempt to locate and load system font
 	printf("Loading system font\n");
@@ -382,6 +399,7 @@ void
 set_clip_rectangle(rect_t clip)
 {
 	s_clip_rect = clip;
+	reset_render_state();
 	clip.x1 *= g_scale_x; clip.y1 *= g_scale_y;
 	clip.x2 *= g_scale_x; clip.y2 *= g_scale_y;
 	al_set_clipping_rectangle(clip.x1, clip.y1, clip.x2 - clip.x1, clip.y2 - clip.y1);
@@ -398,7 +416,8 @@ do_events(void)
 {
 	ALLEGRO_EVENT event;
 
-	dyad_update();
+	if (dyad_getStreamCount() > 0)
+		dyad_update();
 	update_input();
 	update_sounds();
 
@@ -411,6 +430,29 @@ do_events(void)
 	}
 }
 
+void
+wait_for_events(double end_time)
+{
+	double time_left;
+
+	// input is registered with g_events too, so this sleeps until end_time
+	// or until there's something to respond to, whichever comes first.
+	// sockets can't be waited on alongside Allegro events; while any are
+	// open, select() does the sleeping instead, in short enough slices
+	// to keep input responsive.
+	time_left = end_time - al_get_time();
+	if (s_conserve_cpu && time_left > 0.001) {  // engine may stall with < 1ms timeout
+		if (dyad_getStreamCount() > 0) {
+			dyad_setUpdateTimeout(fmin(time_left, 0.005));
+			dyad_update();
+			dyad_setUpdateTimeout(0.0);
+		}
+		else
+			al_wait_for_event_timed(g_events, NULL, time_left);
+	}
+	do_events();
+}
+
 noreturn
 exit_game(bool is_shutdown)
 {
@@ -425,11 +467,21 @@ void
 flip_screen(int framerate)
 {
 	char              filename[50];
-	char              fps_text[20];
+	char              fps_text[40];
+	size_t            heap_bytes;
+	double            gc_pause;
+	int               num_blenders;
+	int               num_culled;
+	int               num_drawn;
+	int               num_flushes;
+	int               num_prims;
+	int               num_skipped;
+	int               num_targets;
+	int               num_updated;
 	bool              is_backbuffer_valid;
 	char*             path;
 	ALLEGRO_BITMAP*   snapshot;
-	double            time_left;
+	bool              has_idle_work;
 	ALLEGRO_TRANSFORM trans;
 	int               x, y;
 
@@ -440,6 +492,7 @@ flip_screen(int framerate)
 		s_num_frames = 0;
 		s_next_fps_poll_time = al_get_time() + 1.0;
 	}
+	end_render_frame();
 	is_backbuffer_valid = !s_skipping_frame;
 	if (is_backbuffer_valid) {
 		if (s_take_snapshot) {
@@ -458,9 +511,28 @@ flip_screen(int framerate)
 			al_use_transform(&trans);
 			x = al_get_display_width(g_display) - 108;
 			y = 8;
-			al_draw_filled_rounded_rectangle(x, y, x + 100, y + 16, 4, 4, al_map_rgba(0, 0, 0, 128));
+			al_draw_filled_rounded_rectangle(x, y, x + 100, y + 76, 4, 4, al_map_rgba(0, 0, 0, 128));
 			draw_text(g_sys_font, rgba(0, 0, 0, 128), x + 51, y + 3, TEXT_ALIGN_CENTER, fps_text);
 			draw_text(g_sys_font, rgba(255, 255, 255, 128), x + 50, y + 2, TEXT_ALIGN_CENTER, fps_text);
+			get_render_stats(&num_targets, &num_blenders, &num_prims, &num_flushes);
+			sprintf(fps_text, "%i tgt %i bld", num_targets, num_blenders);
+			draw_text(g_sys_font, rgba(0, 0, 0, 128), x + 51, y + 15, TEXT_ALIGN_CENTER, fps_text);
+			draw_text(g_sys_font, rgba(255, 255, 255, 128), x + 50, y + 14, TEXT_ALIGN_CENTER, fps_text);
+			sprintf(fps_text, "%i prim %i draw", num_prims, num_flushes);
+			draw_text(g_sys_font, rgba(0, 0, 0, 128), x + 51, y + 27, TEXT_ALIGN_CENTER, fps_text);
+			draw_text(g_sys_font, rgba(255, 255, 255, 128), x + 50, y + 26, TEXT_ALIGN_CENTER, fps_text);
+			get_person_render_stats(&num_drawn, &num_culled);
+			sprintf(fps_text, "%i spr %i cull", num_drawn, num_culled);
+			draw_text(g_sys_font, rgba(0, 0, 0, 128), x + 51, y + 39, TEXT_ALIGN_CENTER, fps_text);
+			draw_text(g_sys_font, rgba(255, 255, 255, 128), x + 50, y + 38, TEXT_ALIGN_CENTER, fps_text);
+			get_person_update_stats(&num_updated, &num_skipped);
+			sprintf(fps_text, "%i upd %i skip", num_updated, num_skipped);
+			draw_text(g_sys_font, rgba(0, 0, 0, 128), x + 51, y + 51, TEXT_ALIGN_CENTER, fps_text);
+			draw_text(g_sys_font, rgba(255, 255, 255, 128), x + 50, y + 50, TEXT_ALIGN_CENTER, fps_text);
+			get_gc_stats(&heap_bytes, NULL, &gc_pause);
+			sprintf(fps_text, "%.1fM gc %.1fms", heap_bytes / 1048576.0, gc_pause * 1000.0);
+			draw_text(g_sys_font, rgba(0, 0, 0, 128), x + 51, y + 63, TEXT_ALIGN_CENTER, fps_text);
+			draw_text(g_sys_font, rgba(255, 255, 255, 128), x + 50, y + 62, TEXT_ALIGN_CENTER, fps_text);
 			al_scale_transform(&trans, g_scale_x, g_scale_y);
 			al_use_transform(&trans);
 		}
@@ -475,10 +547,13 @@ flip_screen(int framerate)
 	if (framerate > 0) {
 		s_skipping_frame = s_frame_skips < s_max_frameskip && s_last_flip_time > s_next_frame_time;
 		do {
-			time_left = s_next_frame_time - al_get_time();
-			if (s_conserve_cpu && time_left > 0.001)  // engine may stall with < 1ms timeout
-				al_wait_for_event_timed(g_events, NULL, time_left);
-			do_events();
+			// whatever's left of the frame goes to idle jobs first. stop a
+			// little early so a job running long doesn't make the frame late.
+			has_idle_work = !s_skipping_frame && run_idle_jobs(s_next_frame_time - 0.002);
+			if (has_idle_work)
+				do_events();
+			else
+				wait_for_events(s_next_frame_time);
 		} while (al_get_time() < s_next_frame_time);
 		if (!is_backbuffer_valid && !s_skipping_frame)  // did we just finish skipping frames?
 			s_next_frame_time = al_get_time() + 1.0 / framerate;
@@ -492,6 +567,10 @@ flip_screen(int framerate)
 	}
 	++s_num_frames;
 	if (!s_skipping_frame) al_clear_to_color(al_map_rgba(0, 0, 0, 255));
+	update_timers();
+	end_tween_frame();
+	update_tasks();
+	update_gc();
 }
 
 noreturn
@@ -541,6 +620,7 @@ toggle_fullscreen(void)
 		g_scale_x = al_get_display_width(g_display) / (float)g_res_x;
 		g_scale_y = al_get_display_height(g_display) / (float)g_res_y;
 	}
+	reset_render_state();
 	al_identity_transform(&transform);
 	al_scale_transform(&transform, g_scale_x, g_scale_y);
 	al_use_transform(&transform);
@@ -550,6 +630,7 @@ void
 unskip_frame(void)
 {
 	s_skipping_frame = false;
+	reset_render_state();
 	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 }
 
@@ -637,11 +718,13 @@ initialize_engine(void)
 	if (!al_init_native_dialog_addon()) goto on_error;
 	if (!al_init_primitives_addon()) goto on_error;
 	if (!al_init_image_addon()) goto on_error;
+	al_init_font_addon();
+	if (!al_init_ttf_addon()) goto on_error;
 
 	// initialize networking
 	printf("Initializing Dyad\n");
 	dyad_init();
-	dyad_setUpdateTimeout(0.001);
+	dyad_setUpdateTimeout(0.0);
 
 	// load system configuraton
 	printf("Loading system configuration\n");
@@ -650,21 +733,31 @@ initialize_engine(void)
 	free(path);
 
 	initialize_rng();
+	initialize_fonts();
 	initialize_galileo();
+	initialize_gc();
+	initialize_idle();
 	initialize_input();
 	initialize_map_engine();
+	initialize_render();
 	initialize_sound();
+	initialize_spritesets();
+	initialize_tasks();
+	initialize_timers();
+	initialize_tweens();
 
 	// initialize JavaScript API
 	printf("Creating Duktape context\n");
-	if (!(g_duk = duk_create_heap(NULL, NULL, NULL, NULL, &on_duk_fatal)))
+	if (!(g_duk = duk_create_heap(gc_alloc, gc_realloc, gc_free, NULL, &on_duk_fatal)))
 		goto on_error;
 	initialize_api(g_duk);
+	add_idle_job(do_idle_gc, NULL);
 	init_bytearray_api();
 	init_color_api();
 	init_file_api();
 	init_font_api(g_duk);
 	init_galileo_api();
+	init_gc_api();
 	init_image_api(g_duk);
 	init_input_api();
 	init_logging_api();
@@ -674,8 +767,12 @@ initialize_engine(void)
 	init_rng_api();
 	init_sockets_api();
 	init_sound_api();
+	init_spritebatch_api();
 	init_spriteset_api(g_duk);
 	init_surface_api();
+	init_task_api();
+	init_timer_api();
+	init_tween_api();
 	init_windowstyle_api();
 	return true;
 
@@ -689,17 +786,27 @@ on_error:
 static void
 shutdown_engine(void)
 {
+	shutdown_tweens();
 	shutdown_map_engine();
 	shutdown_input();
+	shutdown_tasks();
+	shutdown_timers();
+	shutdown_idle();
 	
 	printf("Shutting down Duktape\n");
 	duk_destroy_heap(g_duk);
+	if (s_heap_stats)
+		print_pool_stats();
+	free_pools();
 	
 	printf("Shutting down Dyad\n");
 	dyad_shutdown();
 	
+	shutdown_fonts();
 	shutdown_galileo();
+	shutdown_render();
 	shutdown_sound();
+	shutdown_spritesets();
 	
 	printf("Shutting down Allegro\n");
 	al_destroy_display(g_display);
@@ -720,6 +827,7 @@ draw_status_message(const char* text)
 	int               w_screen = al_get_display_width(g_display);
 	int               h_screen = al_get_display_height(g_display);
 
+	reset_render_state();
 	al_copy_transform(&old_transform, al_get_current_transform());
 	al_identity_transform(&transform);
 	al_use_transform(&transform);
@@ -729,4 +837,4 @@ draw_status_message(const char* text)
 	draw_text(g_sys_font, rgba(0, 0, 0, 255), w_screen - 16 - width / 2 + 1, h_screen - 16 - height + 6, TEXT_ALIGN_CENTER, text);
 	draw_text(g_sys_font, rgba(255, 255, 255, 255), w_screen - 16 - width / 2, h_screen - 16 - height + 5, TEXT_ALIGN_CENTER, text);
 	al_use_transform(&old_transform);
-}
\ No newline at end of file
+}
@@ -1,13 +1,20 @@
 #include "minisphere.h"
 #include "api.h"
+#include "bytearray.h"
 #include "color.h"
 #include "image.h"
 #include "input.h"
 #include "obsmap.h"
+#include "particles.h"
+#include "pathfind.h"
 #include "persons.h"
+#include "render.h"
 #include "script.h"
 #include "surface.h"
+#include "task.h"
 #include "tileset.h"
+#include "timer.h"
+#include "tween.h"
 
 #include "map_engine.h"
 
@@ -24,6 +31,7 @@ enum map_script_type
 
 static struct map*         load_map            (const char* path);
 static void                free_map            (struct map* map);
+static int*                plan_tile_order     (const struct map* map, int num_layers, int* out_count);
 static bool                are_zones_at        (int x, int y, int layer, int* out_count);
 static struct map_trigger* get_trigger_at      (int x, int y, int layer, int* out_index);
 static struct map_zone*    get_zone_at         (int x, int y, int layer, int which, int* out_index);
@@ -51,6 +59,7 @@ static duk_ret_t js_GetCurrentZone          (duk_context* ctx);
 static duk_ret_t js_GetInputPerson          (duk_context* ctx);
 static duk_ret_t js_GetLayerHeight          (duk_context* ctx);
 static duk_ret_t js_GetLayerMask            (duk_context* ctx);
+static duk_ret_t js_GetLayerPassability     (duk_context* ctx);
 static duk_ret_t js_GetLayerWidth           (duk_context* ctx);
 static duk_ret_t js_GetMapEngineFrameRate   (duk_context* ctx);
 static duk_ret_t js_GetNextAnimatedTile     (duk_context* ctx);
@@ -137,15 +146,8 @@ static script_t*           s_render_script     = 0;
 static int                 s_talk_button       = 0;
 static int                 s_talk_key          = ALLEGRO_KEY_SPACE;
 static script_t*           s_update_script     = 0;
-static int                 s_num_delay_scripts = 0;
-static int                 s_max_delay_scripts = 0;
-static struct delay_script *s_delay_scripts    = NULL;
-
-struct delay_script
-{
-	script_t* script;
-	int       frames_left;
-};
+static int64_t             s_delay_ticks       = 0;
+static timer_wheel_t*      s_delay_timers      = NULL;
 
 struct map
 {
@@ -176,6 +178,7 @@ struct map_layer
 	float            parallax_x;
 	float            parallax_y;
 	struct map_tile* tilemap;
+	uint8_t*         passmap;
 	obsmap_t*        obsmap;
 	color_t          color_mask;
 	script_t*        render_script;
@@ -275,6 +278,8 @@ initialize_map_engine(void)
 	printf("Initializing map engine\n");
 	
 	initialize_persons_manager();
+	initialize_pathfinding();
+	initialize_particles();
 	memset(s_def_scripts, 0, MAP_SCRIPT_MAX * sizeof(int));
 	s_map = NULL; s_map_filename = NULL;
 	s_input_person = s_camera_person = NULL;
@@ -282,8 +287,8 @@ initialize_map_engine(void)
 	s_current_zone = -1;
 	s_render_script = 0;
 	s_update_script = 0;
-	s_num_delay_scripts = s_max_delay_scripts = 0;
-	s_delay_scripts = NULL;
+	s_delay_ticks = 0;
+	s_delay_timers = create_timer_wheel(0x0, 0);
 	s_talk_key = ALLEGRO_KEY_SPACE;
 	s_talk_button = 0;
 	s_is_map_running = false;
@@ -294,14 +299,12 @@ initialize_map_engine(void)
 void
 shutdown_map_engine(void)
 {
-	int i;
-
 	printf("Shutting down map engine\n");
 	
-	for (i = 0; i < s_num_delay_scripts; ++i)
-		free_script(s_delay_scripts[i].script);
-	free(s_delay_scripts);
+	free_timer_wheel(s_delay_timers);
 	free_map(s_map);
+	shutdown_particles();
+	shutdown_pathfinding();
 	shutdown_persons_manager();
 }
 
@@ -324,6 +327,34 @@ get_map_bounds(void)
 	return bounds;
 }
 
+void
+get_map_camera_xy(int* out_x, int* out_y)
+{
+	if (out_x) *out_x = s_cam_x;
+	if (out_y) *out_y = s_cam_y;
+}
+
+person_t*
+get_map_input_person(void)
+{
+	return s_input_person;
+}
+
+int
+get_map_passability(int x, int y, int layer)
+{
+	int layer_h = s_map->layers[layer].height;
+	int layer_w = s_map->layers[layer].width;
+
+	if (s_map->is_repeating || s_map->layers[layer].is_parallax) {
+		x = (x % layer_w + layer_w) % layer_w;
+		y = (y % layer_h + layer_h) % layer_h;
+	}
+	if (x < 0 || y < 0 || x >= layer_w || y >= layer_h)
+		return PASS_OPEN;
+	return s_map->layers[layer].passmap[x + y * layer_w];
+}
+
 point3_t
 get_map_origin(void)
 {
@@ -366,6 +397,8 @@ detach_person(const person_t* person)
 		s_camera_person = NULL;
 	if (s_input_person == person)
 		s_input_person = NULL;
+	detach_person_emitters(person);
+	detach_person_tweens(person);
 }
 
 void
@@ -410,6 +443,8 @@ load_map(const char* path)
 	rect_t                   segment;
 	int16_t*                 tile_data = NULL;
 	ALLEGRO_PATH*            tileset_path;
+	int*                     tile_order = NULL;
+	int                      tile_order_len = 0;
 	tileset_t*               tileset;
 	struct map_trigger*      trigger;
 	struct rmp_zone_header   zone_hdr;
@@ -539,16 +574,19 @@ load_map(const char* path)
 			free_lstring(script);
 		}
 
-		// load tileset
+		// load tileset. the layers are already loaded at this point, so the
+		// tileset can be packed with tiles that appear together sharing pages.
+		tile_order = plan_tile_order(map, rmp.num_layers, &tile_order_len);
 		if (strcmp(lstring_cstr(strings[0]), "") != 0) {
 			tileset_path = al_create_path(path);
 			al_set_path_filename(tileset_path, lstring_cstr(strings[0]));
-			tileset = load_tileset(al_path_cstr(tileset_path, ALLEGRO_NATIVE_PATH_SEP));
+			tileset = load_tileset(al_path_cstr(tileset_path, ALLEGRO_NATIVE_PATH_SEP), tile_order, tile_order_len);
 			al_destroy_path(tileset_path);
 		}
 		else {
-			tileset = read_tileset(file);
+			tileset = read_tileset(file, tile_order, tile_order_len);
 		}
+		free(tile_order); tile_order = NULL;
 		if (tileset == NULL) goto on_error;
 
 		// initialize tile animation
@@ -561,6 +599,16 @@ load_map(const char* path)
 			}
 		}
 
+		// classify cells for obstruction testing. open cells can be skipped
+		// and solid ones tested in constant time, see is_person_obstructed_at().
+		for (z = 0; z < rmp.num_layers; ++z) {
+			layer = &map->layers[z];
+			if (!(layer->passmap = malloc(layer->width * layer->height)))
+				goto on_error;
+			for (i = 0; i < layer->width * layer->height; ++i)
+				layer->passmap[i] = get_tile_passability(tileset, layer->tilemap[i].tile_index);
+		}
+
 		// wrap things up
 		map->num_layers = rmp.num_layers;
 		map->num_zones = rmp.num_zones;
@@ -591,6 +639,7 @@ load_map(const char* path)
 on_error:
 	if (file != NULL) fclose(file);
 	free(tile_data);
+	free(tile_order);
 	if (strings != NULL) {
 		for (i = 0; i < rmp.num_strings; ++i) free_lstring(strings[i]);
 		free(strings);
@@ -600,6 +649,7 @@ on_error:
 			for (i = 0; i < rmp.num_layers; ++i) {
 				free_lstring(map->layers[i].name);
 				free(map->layers[i].tilemap);
+				free(map->layers[i].passmap);
 				free_obsmap(map->layers[i].obsmap);
 			}
 			free(map->layers);
@@ -635,6 +685,7 @@ free_map(struct map* map)
 			free_script(map->layers[i].render_script);
 			free_lstring(map->layers[i].name);
 			free(map->layers[i].tilemap);
+			free(map->layers[i].passmap);
 			free_obsmap(map->layers[i].obsmap);
 		}
 		for (i = 0; i < map->num_persons; ++i) {
@@ -658,6 +709,59 @@ free_map(struct map* map)
 	}
 }
 
+static int*
+plan_tile_order(const struct map* map, int num_layers, int* out_count)
+{
+	// lists tile indices in order of first appearance, scanning the map in
+	// screen-sized blocks so that tiles which are on screen together end up
+	// close together in the list.
+	
+	const int BLOCK_SIZE = 16;
+	
+	int                     block_x, block_y;
+	const struct map_layer* layer;
+	int                     max_index = -1;
+	int                     num_tiles = 0;
+	bool*                   seen;
+	int                     tile_index;
+	int*                    tile_order;
+	int                     width = 0, height = 0;
+
+	int i, x, y, z;
+
+	*out_count = 0;
+	for (z = 0; z < num_layers; ++z) {
+		layer = &map->layers[z];
+		width = fmax(width, layer->width);
+		height = fmax(height, layer->height);
+		for (i = 0; i < layer->width * layer->height; ++i)
+			max_index = fmax(max_index, layer->tilemap[i].tile_index);
+	}
+	if (max_index < 0)
+		return NULL;
+	if (!(seen = calloc(max_index + 1, sizeof(bool))))
+		return NULL;
+	if (!(tile_order = malloc((max_index + 1) * sizeof(int)))) {
+		free(seen);
+		return NULL;
+	}
+	for (block_y = 0; block_y < height; block_y += BLOCK_SIZE) for (block_x = 0; block_x < width; block_x += BLOCK_SIZE) {
+		for (z = 0; z < num_layers; ++z) {
+			layer = &map->layers[z];
+			for (y = block_y; y < fmin(block_y + BLOCK_SIZE, layer->height); ++y) for (x = block_x; x < fmin(block_x + BLOCK_SIZE, layer->width); ++x) {
+				tile_index = layer->tilemap[x + y * layer->width].tile_index;
+				if (tile_index >= 0 && !seen[tile_index]) {
+					seen[tile_index] = true;
+					tile_order[num_tiles++] = tile_index;
+				}
+			}
+		}
+	}
+	free(seen);
+	*out_count = num_tiles;
+	return tile_order;
+}
+
 static bool
 are_zones_at(int x, int y, int layer, int* out_count)
 {
@@ -752,11 +856,11 @@ change_map(const char* filename, bool preserve_persons)
 	
 	// close out old map and prep for new one
 	free_map(s_map); free(s_map_filename);
-	for (i = 0; i < s_num_delay_scripts; ++i)
-		free_script(s_delay_scripts[i].script);
-	s_num_delay_scripts = 0;
+	clear_timers(s_delay_timers);
 	s_map = map; s_map_filename = strdup(filename);
+	reset_pathfinding();
 	reset_persons(preserve_persons);
+	reset_particles();
 
 	// populate persons
 	for (i = 0; i < s_map->num_persons; ++i) {
@@ -909,20 +1013,23 @@ render_map(void)
 	bool              is_repeating;
 	struct map_layer* layer;
 	int               layer_w, layer_h;
+	int               num_pages;
 	ALLEGRO_COLOR     overlay_color;
 	int               tile_w, tile_h;
 	int               off_x, off_y;
 	int               tile_index;
 	
-	int x, y, z;
+	int page, x, y, z;
 	
 	if (is_skipped_frame())
 		return;
 	get_tile_size(s_map->tileset, &tile_w, &tile_h);
+	num_pages = get_tileset_page_count(s_map->tileset);
 	for (z = 0; z < s_map->num_layers; ++z) {
 		layer = &s_map->layers[z];
 		if (!layer->is_visible)
 			continue;
+		reset_render_state();  // layer render scripts may leave a Surface targeted
 		is_repeating = s_map->is_repeating || layer->is_parallax;
 		layer_w = layer->width * tile_w;
 		layer_h = layer->height * tile_h;
@@ -930,39 +1037,37 @@ render_map(void)
 		map_screen_to_layer(z, s_cam_x, s_cam_y, &off_x, &off_y);
 		al_hold_bitmap_drawing(true);
 		if (layer->is_reflective) {
-			if (is_repeating) {
-				// for small repeating maps, persons need to be repeated as well
-				for (y = 0; y < g_res_y / layer_h + 2; ++y) for (x = 0; x < g_res_x / layer_w + 2; ++x)
-					render_persons(z, true, off_x - x * layer_w, off_y - y * layer_h);
-			}
-			else {
-				render_persons(z, true, off_x, off_y);
-			}
+			// for small repeating maps, persons need to be repeated as well
+			render_persons(z, true, off_x, off_y, is_repeating ? layer_w : 0, is_repeating ? layer_h : 0);
 		}
 		first_cell_x = off_x / tile_w;
 		first_cell_y = off_y / tile_h;
-		for (y = 0; y < g_res_y / tile_h + 2; ++y) for (x = 0; x < g_res_x / tile_w + 2; ++x) {
-			cell_x = is_repeating ? (x + first_cell_x) % layer->width : x + first_cell_x;
-			cell_y = is_repeating ? (y + first_cell_y) % layer->height : y + first_cell_y;
-			if (cell_x < 0 || cell_x >= layer->width || cell_y < 0 || cell_y >= layer->height)
-				continue;
-			tile_index = layer->tilemap[cell_x + cell_y * layer->width].tile_index;
-			draw_tile(s_map->tileset, layer->color_mask, x * tile_w - off_x % tile_w, y * tile_h - off_y % tile_h, tile_index);
-		}
-		if (is_repeating) {
-			// for small repeating maps, persons need to be repeated as well
-			for (y = 0; y < g_res_y / layer_h + 2; ++y) for (x = 0; x < g_res_x / layer_w + 2; ++x)
-				render_persons(z, false, off_x - x * layer_w, off_y - y * layer_h);
-		}
-		else {
-			render_persons(z, false, off_x, off_y);
+		
+		// tiles don't overlap, so they can be drawn one atlas page at a time
+		// without changing the result. page -1 holds any tiles which were
+		// replaced with SetTileImage().
+		for (page = num_pages > 1 ? -1 : 0; page < num_pages; ++page) {
+			for (y = 0; y < g_res_y / tile_h + 2; ++y) for (x = 0; x < g_res_x / tile_w + 2; ++x) {
+				cell_x = is_repeating ? (x + first_cell_x) % layer->width : x + first_cell_x;
+				cell_y = is_repeating ? (y + first_cell_y) % layer->height : y + first_cell_y;
+				if (cell_x < 0 || cell_x >= layer->width || cell_y < 0 || cell_y >= layer->height)
+					continue;
+				tile_index = layer->tilemap[cell_x + cell_y * layer->width].tile_index;
+				if (num_pages > 1 && get_tile_page(s_map->tileset, tile_index) != page)
+					continue;
+				draw_tile(s_map->tileset, layer->color_mask, x * tile_w - off_x % tile_w, y * tile_h - off_y % tile_h, tile_index);
+			}
 		}
+		render_persons(z, false, off_x, off_y, is_repeating ? layer_w : 0, is_repeating ? layer_h : 0);
 		al_hold_bitmap_drawing(false);
+		render_particles(z, off_x, off_y);
 		run_script(layer->render_script, false);
 	}
 	overlay_color = al_map_rgba(s_color_mask.r, s_color_mask.g, s_color_mask.b, s_color_mask.alpha);
+	reset_render_state();
 	al_draw_filled_rectangle(0, 0, g_res_x, g_res_y, overlay_color);
 	run_script(s_render_script, false);
+	raise_task_event("map_render", true);
 }
 
 static void
@@ -979,14 +1084,17 @@ update_map_engine(bool is_main_loop)
 	double              x, y;
 	struct map_zone*    zone;
 
-	int i, j;
+	int i;
 	
 	++s_frames;
 	get_tile_size(s_map->tileset, &tile_w, &tile_h);
 	map_w = s_map->width * tile_w;
 	map_h = s_map->height * tile_h;
 	
+	update_pathfinding();
 	update_persons();
+	update_particles();
+	update_tweens();
 	animate_tileset(s_map->tileset);
 
 	// update color mask fade level
@@ -1043,17 +1151,10 @@ update_map_engine(bool is_main_loop)
 	}
 	
 	run_script(s_update_script, false);
+	raise_task_event("map_update", true);
 	
 	// run delay scripts, if applicable
-	for (i = 0; i < s_num_delay_scripts; ++i) {
-		if (s_delay_scripts[i].frames_left-- <= 0) {
-			run_script(s_delay_scripts[i].script, false);
-			free_script(s_delay_scripts[i].script);
-			for (j = i; j < s_num_delay_scripts - 1; ++j)
-				s_delay_scripts[j] = s_delay_scripts[j + 1];
-			--s_num_delay_scripts; --i;
-		}
-	}
+	advance_timer_wheel(s_delay_timers, s_delay_ticks++);
 }
 
 void
@@ -1076,6 +1177,7 @@ init_map_engine_api(duk_context* ctx)
 	register_api_function(ctx, NULL, "GetInputPerson", js_GetInputPerson);
 	register_api_function(ctx, NULL, "GetLayerHeight", js_GetLayerHeight);
 	register_api_function(ctx, NULL, "GetLayerMask", js_GetLayerMask);
+	register_api_function(ctx, NULL, "GetLayerPassability", js_GetLayerPassability);
 	register_api_function(ctx, NULL, "GetLayerWidth", js_GetLayerWidth);
 	register_api_function(ctx, NULL, "GetMapEngineFrameRate", js_GetMapEngineFrameRate);
 	register_api_function(ctx, NULL, "GetNextAnimatedTile", js_GetNextAnimatedTile);
@@ -1144,8 +1246,15 @@ init_map_engine_api(duk_context* ctx)
 	register_api_const(ctx, "SCRIPT_ON_LEAVE_MAP_SOUTH", MAP_SCRIPT_ON_LEAVE_SOUTH);
 	register_api_const(ctx, "SCRIPT_ON_LEAVE_MAP_WEST", MAP_SCRIPT_ON_LEAVE_WEST);
 
+	// tile passability classes
+	register_api_const(ctx, "PASS_OPEN", PASS_OPEN);
+	register_api_const(ctx, "PASS_SOLID", PASS_SOLID);
+	register_api_const(ctx, "PASS_SEGMENTS", PASS_SEGMENTS);
+
 	// initialize subcomponent APIs (persons, etc.)
 	init_persons_api();
+	init_pathfinding_api();
+	init_particles_api();
 }
 
 int
@@ -1176,6 +1285,7 @@ js_MapEngine(duk_context* ctx)
 	s_color_mask = rgba(0, 0, 0, 0);
 	s_fade_color_to = s_fade_color_from = s_color_mask;
 	s_fade_progress = s_fade_frames = 0;
+	reset_render_state();
 	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 	s_framerate = framerate;
 	if (!change_map(filename, true))
@@ -1186,7 +1296,9 @@ js_MapEngine(duk_context* ctx)
 		render_map();
 		flip_screen(s_framerate);
 	}
+	reset_pathfinding();
 	reset_persons(false);
+	reset_particles();
 	s_is_map_running = false;
 	return 0;
 }
@@ -1370,6 +1482,23 @@ js_GetLayerName(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_GetLayerPassability(duk_context* ctx)
+{
+	int layer = duk_require_map_layer(ctx, 0);
+
+	bytearray_t* array;
+	
+	if (!is_map_engine_running())
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GetLayerPassability(): Map engine must be running");
+	if (layer < 0 || layer >= s_map->num_layers)
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GetLayerPassability(): Invalid layer index (%i)", layer);
+	if (!(array = bytearray_from_buffer(s_map->layers[layer].passmap, s_map->layers[layer].width * s_map->layers[layer].height)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GetLayerPassability(): Failed to create byte array");
+	duk_push_sphere_bytearray(ctx, array);
+	return 1;
+}
+
 static duk_ret_t
 js_GetLayerWidth(duk_context* ctx)
 {
@@ -1695,20 +1824,14 @@ js_SetDelayScript(duk_context* ctx)
 	int frames = duk_require_int(ctx, 0);
 	script_t* script = duk_require_sphere_script(ctx, 1, "[delay script]");
 
-	struct delay_script* delay;
-
 	if (!is_map_engine_running())
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "SetDelayScript(): Map engine is not running");
 	if (frames < 0)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "SetDelayScript(): Delay frames cannot be negative");
-	if (++s_num_delay_scripts > s_max_delay_scripts) {
-		s_max_delay_scripts = s_num_delay_scripts * 2;
-		if (!(s_delay_scripts = realloc(s_delay_scripts, s_max_delay_scripts * sizeof(struct delay_script))))
-			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "SetDelayScript(): Failed to enlarge delay script queue");
+	if (!add_timer(s_delay_timers, frames, 0, script)) {
+		free_script(script);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "SetDelayScript(): Failed to enlarge delay script queue");
 	}
-	delay = &s_delay_scripts[s_num_delay_scripts - 1];
-	delay->script = script;
-	delay->frames_left = frames;
 	return 0;
 }
 
@@ -1840,6 +1963,8 @@ js_SetTile(duk_context* ctx)
 	struct map_tile* tilemap = s_map->layers[layer].tilemap;
 	tilemap[x + y * layer_w].tile_index = tile_index;
 	tilemap[x + y * layer_w].frames_left = get_tile_delay(s_map->tileset, tile_index);
+	s_map->layers[layer].passmap[x + y * layer_w] = get_tile_passability(s_map->tileset, tile_index);
+	clear_path_cache();
 	return 0;
 }
 
@@ -2142,6 +2267,7 @@ js_ReplaceTilesOnLayer(duk_context* ctx)
 	int new_index = duk_require_int(ctx, 2);
 
 	int              layer_w, layer_h;
+	int              new_pass;
 	struct map_tile* p_tile;
 
 	int i_x, i_y;
@@ -2154,10 +2280,15 @@ js_ReplaceTilesOnLayer(duk_context* ctx)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "ReplaceTilesOnLayer(): New tile index out of range (%i)", new_index);
 	layer_w = s_map->layers[layer].width;
 	layer_h = s_map->layers[layer].height;
+	new_pass = get_tile_passability(s_map->tileset, new_index);
 	for (i_x = 0; i_x < layer_w; ++i_x) for (i_y = 0; i_y < layer_h; ++i_y) {
 		p_tile = &s_map->layers[layer].tilemap[i_x + i_y * layer_w];
-		if (p_tile->tile_index == old_index) p_tile->tile_index = new_index;
+		if (p_tile->tile_index == old_index) {
+			p_tile->tile_index = new_index;
+			s_map->layers[layer].passmap[i_x + i_y * layer_w] = new_pass;
+		}
 	}
+	clear_path_cache();
 	return 0;
 }
 
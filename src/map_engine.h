@@ -9,8 +9,11 @@ extern void             initialize_map_engine   (void);
 extern void             shutdown_map_engine     (void);
 extern bool             is_map_engine_running   (void);
 extern rect_t           get_map_bounds          (void);
+extern void             get_map_camera_xy       (int* out_x, int* out_y);
+extern person_t*        get_map_input_person    (void);
 extern const obsmap_t*  get_map_layer_obsmap    (int layer);
 extern point3_t         get_map_origin          (void);
+extern int              get_map_passability     (int x, int y, int layer);
 extern int              get_map_tile            (int x, int y, int layer);
 extern const tileset_t* get_map_tileset         (void);
 extern void             detach_person           (const person_t* person);
@@ -18,9 +18,11 @@
 #include <time.h>
 
 #include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
 #include <allegro5/allegro_image.h>
 #include <allegro5/allegro_native_dialog.h>
 #include <allegro5/allegro_primitives.h>
+#include <allegro5/allegro_ttf.h>
 #include "duktape.h"
 #include "dyad.h"
 #include "font.h"
@@ -67,3 +69,4 @@ extern void     take_screenshot    (void);
 extern void     toggle_fps_display (void);
 extern void     toggle_fullscreen  (void);
 extern void     unskip_frame       (void);
+extern void     wait_for_events    (double end_time);
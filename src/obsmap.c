@@ -2,8 +2,11 @@
 
 #include "obsmap.h"
 
+static bool is_edge_covered (const obsmap_t* obsmap, rect_t edge);
+
 struct obsmap
 {
+	rect_t bounds;
 	int    num_lines;
 	int    max_lines;
 	rect_t *lines;
@@ -30,6 +33,29 @@ free_obsmap(obsmap_t* obsmap)
 	free(obsmap);
 }
 
+int
+get_obsmap_passability(const obsmap_t* obsmap)
+{
+	// an obsmap is solid if its lines trace the whole outline of their
+	// bounding box. test_solid_obsmap_rect() can then tell in O(1) whether
+	// a rectangle crosses it. this is slow-ish, so callers should classify
+	// an obsmap once and keep the result.
+	rect_t b;
+	
+	if (obsmap == NULL || obsmap->num_lines == 0)
+		return PASS_OPEN;
+	b = obsmap->bounds;
+	if (b.x1 < b.x2 && b.y1 < b.y2
+		&& is_edge_covered(obsmap, new_rect(b.x1, b.y1, b.x2, b.y1))
+		&& is_edge_covered(obsmap, new_rect(b.x2, b.y1, b.x2, b.y2))
+		&& is_edge_covered(obsmap, new_rect(b.x1, b.y2, b.x2, b.y2))
+		&& is_edge_covered(obsmap, new_rect(b.x1, b.y1, b.x1, b.y2)))
+	{
+		return PASS_SOLID;
+	}
+	return PASS_SEGMENTS;
+}
+
 bool
 add_obsmap_line(obsmap_t* obsmap, rect_t line)
 {
@@ -44,6 +70,14 @@ add_obsmap_line(obsmap_t* obsmap, rect_t line)
 		obsmap->lines = line_list;
 	}
 	obsmap->lines[obsmap->num_lines] = line;
+	if (obsmap->num_lines == 0)
+		obsmap->bounds = new_rect(fmin(line.x1, line.x2), fmin(line.y1, line.y2), fmax(line.x1, line.x2), fmax(line.y1, line.y2));
+	else {
+		obsmap->bounds.x1 = fmin(obsmap->bounds.x1, fmin(line.x1, line.x2));
+		obsmap->bounds.y1 = fmin(obsmap->bounds.y1, fmin(line.y1, line.y2));
+		obsmap->bounds.x2 = fmax(obsmap->bounds.x2, fmax(line.x1, line.x2));
+		obsmap->bounds.y2 = fmax(obsmap->bounds.y2, fmax(line.y1, line.y2));
+	}
 	++obsmap->num_lines;
 	return true;
 }
@@ -63,8 +97,70 @@ test_obsmap_line(const obsmap_t* obsmap, rect_t line)
 bool
 test_obsmap_rect(const obsmap_t* obsmap, rect_t rect)
 {
+	// a rectangle that doesn't touch the bounding box can't cross any lines
+	if (obsmap->num_lines == 0
+		|| fmax(rect.x1, rect.x2) < obsmap->bounds.x1 || fmin(rect.x1, rect.x2) > obsmap->bounds.x2
+		|| fmax(rect.y1, rect.y2) < obsmap->bounds.y1 || fmin(rect.y1, rect.y2) > obsmap->bounds.y2)
+	{
+		return false;
+	}
 	return test_obsmap_line(obsmap, new_rect(rect.x1, rect.y1, rect.x2, rect.y1))
 		|| test_obsmap_line(obsmap, new_rect(rect.x2, rect.y1, rect.x2, rect.y2))
 		|| test_obsmap_line(obsmap, new_rect(rect.x1, rect.y2, rect.x2, rect.y2))
 		|| test_obsmap_line(obsmap, new_rect(rect.x1, rect.y1, rect.x1, rect.y2));
 }
+
+bool
+test_solid_obsmap_rect(const obsmap_t* obsmap, rect_t rect)
+{
+	// same result as test_obsmap_rect() for an obsmap classified PASS_SOLID.
+	// the rectangle crosses the outline unless it misses the box entirely or
+	// one of the two lies strictly inside the other. only in the last case
+	// can lines inside the box matter, so those still get tested.
+	rect_t b = obsmap->bounds;
+	rect_t r;
+
+	r = new_rect(fmin(rect.x1, rect.x2), fmin(rect.y1, rect.y2), fmax(rect.x1, rect.x2), fmax(rect.y1, rect.y2));
+	if (r.x1 == r.x2 || r.y1 == r.y2)
+		return test_obsmap_rect(obsmap, rect);  // flat rectangles have no area to reason about
+	if (r.x2 < b.x1 || r.x1 > b.x2 || r.y2 < b.y1 || r.y1 > b.y2)
+		return false;
+	if (r.x1 < b.x1 && r.x2 > b.x2 && r.y1 < b.y1 && r.y2 > b.y2)
+		return false;
+	if (r.x1 > b.x1 && r.x2 < b.x2 && r.y1 > b.y1 && r.y2 < b.y2)
+		return test_obsmap_rect(obsmap, rect);
+	return true;
+}
+
+static bool
+is_edge_covered(const obsmap_t* obsmap, rect_t edge)
+{
+	// walks along an axis-aligned edge, hopping from line to line as long as
+	// there's one collinear with the edge that extends past the current spot
+	bool   is_vertical = edge.x1 == edge.x2;
+	int    end, pos;
+	int    start_p, end_p;
+	rect_t line;
+
+	int i;
+
+	pos = is_vertical ? edge.y1 : edge.x1;
+	end = is_vertical ? edge.y2 : edge.x2;
+	while (pos < end) {
+		for (i = 0; i < obsmap->num_lines; ++i) {
+			line = obsmap->lines[i];
+			if (is_vertical && (line.x1 != edge.x1 || line.x2 != edge.x1))
+				continue;
+			if (!is_vertical && (line.y1 != edge.y1 || line.y2 != edge.y1))
+				continue;
+			start_p = is_vertical ? fmin(line.y1, line.y2) : fmin(line.x1, line.x2);
+			end_p = is_vertical ? fmax(line.y1, line.y2) : fmax(line.x1, line.x2);
+			if (start_p <= pos && end_p > pos)
+				break;
+		}
+		if (i == obsmap->num_lines)
+			return false;
+		pos = end_p;
+	}
+	return true;
+}
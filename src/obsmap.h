@@ -3,10 +3,19 @@
 
 typedef struct obsmap obsmap_t;
 
-obsmap_t* new_obsmap       (void);
-void      free_obsmap      (obsmap_t* obsmap);
-bool      add_obsmap_line  (obsmap_t* obsmap, rect_t line);
-bool      test_obsmap_line (const obsmap_t* obsmap, rect_t line);
-bool      test_obsmap_rect (const obsmap_t* obsmap, rect_t rect);
+obsmap_t* new_obsmap             (void);
+void      free_obsmap            (obsmap_t* obsmap);
+int       get_obsmap_passability (const obsmap_t* obsmap);
+bool      add_obsmap_line        (obsmap_t* obsmap, rect_t line);
+bool      test_obsmap_line       (const obsmap_t* obsmap, rect_t line);
+bool      test_obsmap_rect       (const obsmap_t* obsmap, rect_t rect);
+bool      test_solid_obsmap_rect (const obsmap_t* obsmap, rect_t rect);
+
+enum passability
+{
+	PASS_OPEN,
+	PASS_SOLID,
+	PASS_SEGMENTS
+};
 
 #endif // MINISPHERE__OBSMAP_H__INCLUDED
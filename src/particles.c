@@ -0,0 +1,798 @@
+#include "minisphere.h"
+#include "api.h"
+#include "color.h"
+#include "image.h"
+#include "map_engine.h"
+#include "persons.h"
+#include "render.h"
+#include "rng.h"
+#include "spritebatch.h"
+
+#include "particles.h"
+
+// note: particles live in a fixed-size pool per emitter, stored as a
+//       structure of arrays so the update loop walks each attribute
+//       linearly. live particles are always packed at the front of the
+//       pool: a particle that dies is replaced by the last live one, so
+//       nothing is ever searched for or shifted. all units are per frame,
+//       like person speeds: velocity in pixels per frame, gravity in pixels
+//       per frame per frame, lifetime in frames.
+//
+//       particles are drawn through a SpriteBatch, so an emitter is one
+//       draw call however many particles it has. emitters attached to the
+//       map engine, either at a map position or following a person, are
+//       updated along with the map and drawn on their layer right after the
+//       persons. particles are left behind where they were emitted, so a
+//       moving person leaves a trail. on repeating maps they aren't wrapped.
+
+#define DEFAULT_MAX_PARTICLES 1000
+
+static duk_ret_t js_GetParticleStats             (duk_context* ctx);
+static duk_ret_t js_new_ParticleEmitter          (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_finalize     (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_get_active   (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_get_count    (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_get_image    (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_get_x        (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_get_y        (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_set_active   (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_set_image    (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_set_x        (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_set_y        (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_attachToMap    (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_attachToPerson (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_burst        (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_configure    (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_detach       (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_draw         (duk_context* ctx);
+static duk_ret_t js_ParticleEmitter_update       (duk_context* ctx);
+
+static void duk_require_emitter_config (duk_context* ctx, duk_idx_t index, emitter_config_t* inout_config);
+
+static void get_emitter_origin  (const emitter_t* emitter, double* out_x, double* out_y);
+static void init_emitter_config (emitter_config_t* config);
+static void spawn_particle      (emitter_t* emitter, double x, double y);
+
+struct emitter
+{
+	unsigned int     refcount;
+	spritebatch_t*   batch;
+	emitter_config_t config;
+	bool             is_active;
+	bool             is_attached;
+	float            emit_debt;
+	int              layer;
+	person_t*        person;
+	double           x, y;
+	int              max_particles;
+	int              num_particles;
+	float*           pos_x;
+	float*           pos_y;
+	float*           vel_x;
+	float*           vel_y;
+	int*             age;
+	int*             life;
+};
+
+static int         s_max_attached = 0;
+static int         s_num_attached = 0;
+static int         s_num_emitters = 0;
+static int         s_num_particles = 0;
+static emitter_t** s_attached = NULL;
+
+void
+initialize_particles(void)
+{
+	printf("Initializing particle engine\n");
+	s_attached = NULL;
+	s_max_attached = s_num_attached = 0;
+	s_num_emitters = s_num_particles = 0;
+}
+
+void
+shutdown_particles(void)
+{
+	int i;
+
+	printf("Shutting down particle engine\n");
+	for (i = 0; i < s_num_attached; ++i)
+		free_emitter(s_attached[i]);
+	free(s_attached);
+	s_attached = NULL;
+	s_max_attached = s_num_attached = 0;
+}
+
+emitter_t*
+new_emitter(image_t* image, int max_particles)
+{
+	emitter_t* emitter;
+
+	if (!(emitter = calloc(1, sizeof(emitter_t))))
+		goto on_error;
+	if (!(emitter->batch = new_spritebatch(image)))
+		goto on_error;
+	emitter->max_particles = max_particles;
+	if (!(emitter->pos_x = malloc(max_particles * sizeof(float)))) goto on_error;
+	if (!(emitter->pos_y = malloc(max_particles * sizeof(float)))) goto on_error;
+	if (!(emitter->vel_x = malloc(max_particles * sizeof(float)))) goto on_error;
+	if (!(emitter->vel_y = malloc(max_particles * sizeof(float)))) goto on_error;
+	if (!(emitter->age = malloc(max_particles * sizeof(int)))) goto on_error;
+	if (!(emitter->life = malloc(max_particles * sizeof(int)))) goto on_error;
+	init_emitter_config(&emitter->config);
+	emitter->is_active = true;
+	++s_num_emitters;
+	return ref_emitter(emitter);
+
+on_error:
+	if (emitter != NULL) {
+		free_spritebatch(emitter->batch);
+		free(emitter->pos_x); free(emitter->pos_y);
+		free(emitter->vel_x); free(emitter->vel_y);
+		free(emitter->age); free(emitter->life);
+	}
+	free(emitter);
+	return NULL;
+}
+
+emitter_t*
+ref_emitter(emitter_t* emitter)
+{
+	if (emitter != NULL)
+		++emitter->refcount;
+	return emitter;
+}
+
+void
+free_emitter(emitter_t* emitter)
+{
+	if (emitter == NULL || --emitter->refcount > 0)
+		return;
+	s_num_particles -= emitter->num_particles;
+	--s_num_emitters;
+	free_spritebatch(emitter->batch);
+	free(emitter->pos_x); free(emitter->pos_y);
+	free(emitter->vel_x); free(emitter->vel_y);
+	free(emitter->age); free(emitter->life);
+	free(emitter);
+}
+
+bool
+is_emitter_active(const emitter_t* emitter)
+{
+	return emitter->is_active;
+}
+
+void
+get_emitter_config(const emitter_t* emitter, emitter_config_t* out_config)
+{
+	*out_config = emitter->config;
+}
+
+int
+get_emitter_count(const emitter_t* emitter)
+{
+	return emitter->num_particles;
+}
+
+image_t*
+get_emitter_image(const emitter_t* emitter)
+{
+	return get_spritebatch_image(emitter->batch);
+}
+
+void
+get_emitter_xy(const emitter_t* emitter, double* out_x, double* out_y)
+{
+	if (out_x) *out_x = emitter->x;
+	if (out_y) *out_y = emitter->y;
+}
+
+void
+get_particle_stats(int* out_num_emitters, int* out_num_particles)
+{
+	if (out_num_emitters) *out_num_emitters = s_num_emitters;
+	if (out_num_particles) *out_num_particles = s_num_particles;
+}
+
+void
+set_emitter_active(emitter_t* emitter, bool is_active)
+{
+	emitter->is_active = is_active;
+	emitter->emit_debt = 0.0;
+}
+
+void
+set_emitter_config(emitter_t* emitter, const emitter_config_t* config)
+{
+	emitter->config = *config;
+}
+
+void
+set_emitter_image(emitter_t* emitter, image_t* image)
+{
+	set_spritebatch_image(emitter->batch, image);
+}
+
+void
+set_emitter_xy(emitter_t* emitter, double x, double y)
+{
+	emitter->x = x;
+	emitter->y = y;
+}
+
+bool
+attach_emitter(emitter_t* emitter, person_t* person, int layer)
+{
+	emitter_t** new_list;
+	int         new_max;
+
+	// with a person, the emitter follows them and its position is an offset
+	// from theirs; otherwise it's a fixed position on the given layer
+	if (!emitter->is_attached) {
+		if (s_num_attached + 1 > s_max_attached) {
+			new_max = (s_num_attached + 1) * 2;
+			if (!(new_list = realloc(s_attached, new_max * sizeof(emitter_t*))))
+				return false;
+			s_attached = new_list;
+			s_max_attached = new_max;
+		}
+		s_attached[s_num_attached++] = ref_emitter(emitter);
+		emitter->is_attached = true;
+	}
+	emitter->person = person;
+	emitter->layer = layer;
+	return true;
+}
+
+void
+detach_emitter(emitter_t* emitter)
+{
+	int i;
+
+	if (!emitter->is_attached)
+		return;
+	for (i = 0; i < s_num_attached; ++i) {
+		if (s_attached[i] == emitter) {
+			s_attached[i] = s_attached[--s_num_attached];
+			break;
+		}
+	}
+	emitter->is_attached = false;
+	emitter->person = NULL;
+	free_emitter(emitter);
+}
+
+void
+detach_person_emitters(const person_t* person)
+{
+	emitter_t* emitter;
+	double     x, y;
+
+	int i;
+
+	// an emitter whose person goes away stays where the person was and
+	// stops emitting, so the particles already out there can finish
+	for (i = 0; i < s_num_attached; ++i) {
+		emitter = s_attached[i];
+		if (emitter->person != person)
+			continue;
+		get_emitter_origin(emitter, &x, &y);
+		emitter->person = NULL;
+		emitter->x = x;
+		emitter->y = y;
+		emitter->is_active = false;
+	}
+}
+
+void
+burst_emitter(emitter_t* emitter, int num_particles)
+{
+	double x, y;
+
+	int i;
+
+	get_emitter_origin(emitter, &x, &y);
+	for (i = 0; i < num_particles && emitter->num_particles < emitter->max_particles; ++i)
+		spawn_particle(emitter, x, y);
+}
+
+void
+update_emitter(emitter_t* emitter)
+{
+	float  gravity_x, gravity_y;
+	int    last;
+	double x, y;
+
+	int i;
+
+	// age and move the live particles, replacing dead ones with the last
+	gravity_x = emitter->config.gravity_x;
+	gravity_y = emitter->config.gravity_y;
+	i = 0;
+	while (i < emitter->num_particles) {
+		if (++emitter->age[i] >= emitter->life[i]) {
+			last = --emitter->num_particles;
+			emitter->pos_x[i] = emitter->pos_x[last];
+			emitter->pos_y[i] = emitter->pos_y[last];
+			emitter->vel_x[i] = emitter->vel_x[last];
+			emitter->vel_y[i] = emitter->vel_y[last];
+			emitter->age[i] = emitter->age[last];
+			emitter->life[i] = emitter->life[last];
+			--s_num_particles;
+			continue;
+		}
+		emitter->vel_x[i] += gravity_x;
+		emitter->vel_y[i] += gravity_y;
+		emitter->pos_x[i] += emitter->vel_x[i];
+		emitter->pos_y[i] += emitter->vel_y[i];
+		++i;
+	}
+
+	// emit new particles. fractional rates carry over to the next frame;
+	// when the pool is full, the excess is dropped rather than saved up.
+	if (emitter->is_active) {
+		get_emitter_origin(emitter, &x, &y);
+		emitter->emit_debt += emitter->config.rate;
+		while (emitter->emit_debt >= 1.0 && emitter->num_particles < emitter->max_particles) {
+			spawn_particle(emitter, x, y);
+			emitter->emit_debt -= 1.0;
+		}
+		emitter->emit_debt = fmin(emitter->emit_debt, 1.0);
+	}
+}
+
+void
+draw_emitter(emitter_t* emitter, int cam_x, int cam_y)
+{
+	emitter_config_t* config;
+	image_t*          image;
+	float             w_half, h_half;
+	float             scale;
+	sprite_t          sprite;
+	float             t;
+
+	int i;
+
+	if (emitter->num_particles == 0 || (image = get_emitter_image(emitter)) == NULL)
+		return;
+	config = &emitter->config;
+	clear_spritebatch(emitter->batch);
+	sprite.angle = 0.0;
+	sprite.src_x = sprite.src_y = 0.0;
+	sprite.src_width = sprite.src_height = 0.0;
+	for (i = 0; i < emitter->num_particles; ++i) {
+		// particles are centered on their position and fade between the
+		// start and end colors and scales over their lifetime
+		t = (float)emitter->age[i] / emitter->life[i];
+		scale = config->start_scale + (config->end_scale - config->start_scale) * t;
+		w_half = get_image_width(image) * scale / 2;
+		h_half = get_image_height(image) * scale / 2;
+		sprite.x = emitter->pos_x[i] - cam_x - w_half;
+		sprite.y = emitter->pos_y[i] - cam_y - h_half;
+		if (sprite.x + w_half * 2 < 0 || sprite.x >= g_res_x || sprite.y + h_half * 2 < 0 || sprite.y >= g_res_y)
+			continue;
+		sprite.scale = scale;
+		sprite.color = blend_colors(config->start_color, config->end_color, 1.0 - t, t);
+		if (!add_sprite(emitter->batch, &sprite))
+			break;
+	}
+	draw_spritebatch(emitter->batch);
+}
+
+void
+reset_particles(void)
+{
+	emitter_t* emitter;
+
+	int i;
+
+	// emitters placed on the old map go away with it. emitters following a
+	// persistent person carry over, but their particles don't.
+	for (i = 0; i < s_num_attached; ++i) {
+		emitter = s_attached[i];
+		s_num_particles -= emitter->num_particles;
+		emitter->num_particles = 0;
+		if (emitter->person == NULL) {
+			detach_emitter(emitter);
+			--i;
+		}
+	}
+}
+
+void
+update_particles(void)
+{
+	emitter_t* emitter;
+	double     x, y;
+
+	int i;
+
+	for (i = 0; i < s_num_attached; ++i) {
+		// emitters following a person are drawn on whatever layer they're on
+		emitter = s_attached[i];
+		if (emitter->person != NULL)
+			get_person_xyz(emitter->person, &x, &y, &emitter->layer, false);
+		update_emitter(emitter);
+	}
+}
+
+void
+render_particles(int layer, int cam_x, int cam_y)
+{
+	int i;
+
+	for (i = 0; i < s_num_attached; ++i) {
+		if (s_attached[i]->layer == layer)
+			draw_emitter(s_attached[i], cam_x, cam_y);
+	}
+}
+
+static void
+get_emitter_origin(const emitter_t* emitter, double* out_x, double* out_y)
+{
+	double x, y;
+
+	if (emitter->person != NULL) {
+		get_person_xy(emitter->person, &x, &y, true);
+		*out_x = x + emitter->x;
+		*out_y = y + emitter->y;
+	}
+	else {
+		*out_x = emitter->x;
+		*out_y = emitter->y;
+	}
+}
+
+static void
+init_emitter_config(emitter_config_t* config)
+{
+	memset(config, 0, sizeof(emitter_config_t));
+	config->rate = 1.0;
+	config->life = 60;
+	config->speed = 1.0;
+	config->angle = -M_PI_2;
+	config->spread = M_PI;
+	config->start_color = rgba(255, 255, 255, 255);
+	config->end_color = rgba(255, 255, 255, 0);
+	config->start_scale = 1.0;
+	config->end_scale = 1.0;
+}
+
+static void
+spawn_particle(emitter_t* emitter, double x, double y)
+{
+	emitter_config_t* config;
+	double            angle;
+	int               i;
+	double            speed;
+
+	config = &emitter->config;
+	i = emitter->num_particles++;
+	angle = rng_uniform(config->angle, config->spread);
+	speed = rng_uniform(config->speed, config->speed_variance);
+	emitter->pos_x[i] = x;
+	emitter->pos_y[i] = y;
+	emitter->vel_x[i] = cos(angle) * speed;
+	emitter->vel_y[i] = sin(angle) * speed;
+	emitter->age[i] = 0;
+	emitter->life[i] = fmax(rng_uniform(config->life, config->life_variance), 1);
+	++s_num_particles;
+}
+
+void
+init_particles_api(void)
+{
+	register_api_function(g_duk, NULL, "GetParticleStats", js_GetParticleStats);
+	register_api_ctor(g_duk, "ParticleEmitter", js_new_ParticleEmitter, js_ParticleEmitter_finalize);
+	register_api_prop(g_duk, "ParticleEmitter", "active", js_ParticleEmitter_get_active, js_ParticleEmitter_set_active);
+	register_api_prop(g_duk, "ParticleEmitter", "count", js_ParticleEmitter_get_count, NULL);
+	register_api_prop(g_duk, "ParticleEmitter", "image", js_ParticleEmitter_get_image, js_ParticleEmitter_set_image);
+	register_api_prop(g_duk, "ParticleEmitter", "x", js_ParticleEmitter_get_x, js_ParticleEmitter_set_x);
+	register_api_prop(g_duk, "ParticleEmitter", "y", js_ParticleEmitter_get_y, js_ParticleEmitter_set_y);
+	register_api_function(g_duk, "ParticleEmitter", "attachToMap", js_ParticleEmitter_attachToMap);
+	register_api_function(g_duk, "ParticleEmitter", "attachToPerson", js_ParticleEmitter_attachToPerson);
+	register_api_function(g_duk, "ParticleEmitter", "burst", js_ParticleEmitter_burst);
+	register_api_function(g_duk, "ParticleEmitter", "configure", js_ParticleEmitter_configure);
+	register_api_function(g_duk, "ParticleEmitter", "detach", js_ParticleEmitter_detach);
+	register_api_function(g_duk, "ParticleEmitter", "draw", js_ParticleEmitter_draw);
+	register_api_function(g_duk, "ParticleEmitter", "update", js_ParticleEmitter_update);
+}
+
+static void
+duk_require_emitter_config(duk_context* ctx, duk_idx_t index, emitter_config_t* inout_config)
+{
+	// properties left out of the object keep their current values
+	index = duk_require_normalize_index(ctx, index);
+	duk_require_object_coercible(ctx, index);
+	if (duk_get_prop_string(ctx, index, "rate")) inout_config->rate = fmax(duk_require_number(ctx, -1), 0.0);
+	if (duk_get_prop_string(ctx, index, "life")) inout_config->life = duk_require_int(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "lifeVariance")) inout_config->life_variance = duk_require_int(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "speed")) inout_config->speed = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "speedVariance")) inout_config->speed_variance = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "angle")) inout_config->angle = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "spread")) inout_config->spread = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "gravityX")) inout_config->gravity_x = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "gravityY")) inout_config->gravity_y = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "startColor")) inout_config->start_color = duk_require_sphere_color(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "endColor")) inout_config->end_color = duk_require_sphere_color(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "startScale")) inout_config->start_scale = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "endScale")) inout_config->end_scale = duk_require_number(ctx, -1);
+	duk_pop_n(ctx, 13);
+}
+
+static duk_ret_t
+js_GetParticleStats(duk_context* ctx)
+{
+	duk_push_object(ctx);
+	duk_push_int(ctx, s_num_emitters); duk_put_prop_string(ctx, -2, "emitters");
+	duk_push_int(ctx, s_num_attached); duk_put_prop_string(ctx, -2, "attached");
+	duk_push_int(ctx, s_num_particles); duk_put_prop_string(ctx, -2, "particles");
+	return 1;
+}
+
+static duk_ret_t
+js_new_ParticleEmitter(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	image_t* image = duk_require_sphere_image(ctx, 0);
+
+	emitter_config_t config;
+	emitter_t*       emitter;
+	int              max_particles = DEFAULT_MAX_PARTICLES;
+
+	if (n_args >= 2 && duk_get_prop_string(ctx, 1, "maxParticles"))
+		max_particles = duk_require_int(ctx, -1);
+	if (max_particles <= 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "ParticleEmitter(): maxParticles must be greater than zero (%i)", max_particles);
+
+	// read the options before creating the emitter, so that a bad option
+	// doesn't leak it
+	init_emitter_config(&config);
+	if (n_args >= 2)
+		duk_require_emitter_config(ctx, 1, &config);
+	if (!(emitter = new_emitter(image, max_particles)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "ParticleEmitter(): Failed to create particle emitter");
+	set_emitter_config(emitter, &config);
+	duk_push_sphere_obj(ctx, "ParticleEmitter", emitter);
+	return 1;
+}
+
+static duk_ret_t
+js_ParticleEmitter_finalize(duk_context* ctx)
+{
+	emitter_t* emitter;
+
+	emitter = duk_require_sphere_obj(ctx, 0, "ParticleEmitter");
+	free_emitter(emitter);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_get_active(duk_context* ctx)
+{
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	duk_push_boolean(ctx, is_emitter_active(emitter));
+	return 1;
+}
+
+static duk_ret_t
+js_ParticleEmitter_get_count(duk_context* ctx)
+{
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	duk_push_int(ctx, get_emitter_count(emitter));
+	return 1;
+}
+
+static duk_ret_t
+js_ParticleEmitter_get_image(duk_context* ctx)
+{
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	duk_push_sphere_image(ctx, get_emitter_image(emitter));
+	return 1;
+}
+
+static duk_ret_t
+js_ParticleEmitter_get_x(duk_context* ctx)
+{
+	emitter_t* emitter;
+	double     x;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	get_emitter_xy(emitter, &x, NULL);
+	duk_push_number(ctx, x);
+	return 1;
+}
+
+static duk_ret_t
+js_ParticleEmitter_get_y(duk_context* ctx)
+{
+	emitter_t* emitter;
+	double     y;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	get_emitter_xy(emitter, NULL, &y);
+	duk_push_number(ctx, y);
+	return 1;
+}
+
+static duk_ret_t
+js_ParticleEmitter_set_active(duk_context* ctx)
+{
+	bool is_active = duk_require_boolean(ctx, 0);
+
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	set_emitter_active(emitter, is_active);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_set_image(duk_context* ctx)
+{
+	image_t* image = duk_require_sphere_image(ctx, 0);
+
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	set_emitter_image(emitter, image);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_set_x(duk_context* ctx)
+{
+	double value = duk_require_number(ctx, 0);
+
+	emitter_t* emitter;
+	double     y;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	get_emitter_xy(emitter, NULL, &y);
+	set_emitter_xy(emitter, value, y);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_set_y(duk_context* ctx)
+{
+	double value = duk_require_number(ctx, 0);
+
+	emitter_t* emitter;
+	double     x;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	get_emitter_xy(emitter, &x, NULL);
+	set_emitter_xy(emitter, x, value);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_attachToMap(duk_context* ctx)
+{
+	double x = duk_require_number(ctx, 0);
+	double y = duk_require_number(ctx, 1);
+	int layer = duk_require_map_layer(ctx, 2);
+
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	if (!is_map_engine_running())
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "ParticleEmitter:attachToMap(): Map engine is not running");
+	set_emitter_xy(emitter, x, y);
+	if (!attach_emitter(emitter, NULL, layer))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "ParticleEmitter:attachToMap(): Emitter list allocation failure");
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_attachToPerson(duk_context* ctx)
+{
+	const char* name = duk_require_string(ctx, 0);
+
+	emitter_t* emitter;
+	person_t*  person;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	if (!(person = find_person(name)))
+		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "ParticleEmitter:attachToPerson(): Person '%s' doesn't exist", name);
+	if (!attach_emitter(emitter, person, 0))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "ParticleEmitter:attachToPerson(): Emitter list allocation failure");
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_burst(duk_context* ctx)
+{
+	int num_particles = duk_require_int(ctx, 0);
+
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	burst_emitter(emitter, num_particles);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_configure(duk_context* ctx)
+{
+	emitter_config_t config;
+	emitter_t*       emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	get_emitter_config(emitter, &config);
+	duk_require_emitter_config(ctx, 0, &config);
+	set_emitter_config(emitter, &config);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_detach(duk_context* ctx)
+{
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	detach_emitter(emitter);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_draw(duk_context* ctx)
+{
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	if (is_skipped_frame())
+		return 0;
+	reset_render_state();
+	draw_emitter(emitter, 0, 0);
+	return 0;
+}
+
+static duk_ret_t
+js_ParticleEmitter_update(duk_context* ctx)
+{
+	emitter_t* emitter;
+
+	duk_push_this(ctx);
+	emitter = duk_require_sphere_obj(ctx, -1, "ParticleEmitter");
+	duk_pop(ctx);
+	update_emitter(emitter);
+	return 0;
+}
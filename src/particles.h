@@ -0,0 +1,49 @@
+#ifndef MINISPHERE__PARTICLES_H__INCLUDED
+#define MINISPHERE__PARTICLES_H__INCLUDED
+
+#include "color.h"
+#include "image.h"
+#include "persons.h"
+
+typedef struct emitter        emitter_t;
+typedef struct emitter_config emitter_config_t;
+
+struct emitter_config
+{
+	float   rate;
+	int     life, life_variance;
+	float   speed, speed_variance;
+	float   angle, spread;
+	float   gravity_x, gravity_y;
+	color_t start_color, end_color;
+	float   start_scale, end_scale;
+};
+
+extern void       initialize_particles    (void);
+extern void       shutdown_particles      (void);
+extern emitter_t* new_emitter             (image_t* image, int max_particles);
+extern emitter_t* ref_emitter             (emitter_t* emitter);
+extern void       free_emitter            (emitter_t* emitter);
+extern bool       is_emitter_active       (const emitter_t* emitter);
+extern void       get_emitter_config      (const emitter_t* emitter, emitter_config_t* out_config);
+extern int        get_emitter_count       (const emitter_t* emitter);
+extern image_t*   get_emitter_image       (const emitter_t* emitter);
+extern void       get_emitter_xy          (const emitter_t* emitter, double* out_x, double* out_y);
+extern void       get_particle_stats      (int* out_num_emitters, int* out_num_particles);
+extern void       set_emitter_active      (emitter_t* emitter, bool is_active);
+extern void       set_emitter_config      (emitter_t* emitter, const emitter_config_t* config);
+extern void       set_emitter_image       (emitter_t* emitter, image_t* image);
+extern void       set_emitter_xy          (emitter_t* emitter, double x, double y);
+extern bool       attach_emitter          (emitter_t* emitter, person_t* person, int layer);
+extern void       detach_emitter          (emitter_t* emitter);
+extern void       detach_person_emitters  (const person_t* person);
+extern void       burst_emitter           (emitter_t* emitter, int num_particles);
+extern void       update_emitter          (emitter_t* emitter);
+extern void       draw_emitter            (emitter_t* emitter, int cam_x, int cam_y);
+extern void       reset_particles         (void);
+extern void       update_particles        (void);
+extern void       render_particles        (int layer, int cam_x, int cam_y);
+
+extern void init_particles_api (void);
+
+#endif // MINISPHERE__PARTICLES_H__INCLUDED
@@ -0,0 +1,844 @@
+#include "minisphere.h"
+#include "api.h"
+#include "map_engine.h"
+#include "persons.h"
+
+#include "pathfind.h"
+
+// note: paths are searched on a grid of tile-sized steps anchored at the
+//       person's position, so a path can be walked using nothing but whole
+//       steps. each step is checked by moving the person's base along it in
+//       increments of half its size and asking is_person_obstructed_at(), so
+//       a path obeys the same tile, map and person obstructions as walking.
+//       searches can be run all at once (find_path()) or spread out over
+//       several frames (request_path()), in which case update_pathfinding()
+//       hands out a fixed number of node expansions per frame.
+
+#define PATH_CACHE_SIZE 32
+#define PATH_CACHE_LIFE 60
+
+static duk_ret_t js_IsPersonPathPending   (duk_context* ctx);
+static duk_ret_t js_SetPathfindingBudget  (duk_context* ctx);
+static duk_ret_t js_FindPath              (duk_context* ctx);
+static duk_ret_t js_RequestPersonPath     (duk_context* ctx);
+
+struct path
+{
+	int             refcount;
+	int             num_commands;
+	int             max_commands;
+	struct path_cmd *commands;
+};
+
+struct path_cmd
+{
+	int  type;
+	bool is_immediate;
+};
+
+struct path_node
+{
+	int  i, j;
+	int  g, f;
+	int  parent;
+	bool is_closed;
+};
+
+struct search
+{
+	bool              allow_diagonals;
+	rect_t            bounds;
+	int               goal_i, goal_j;
+	int               goal_x, goal_y;
+	int*              heap;
+	int               heap_len;
+	int               max_heap;
+	bool              is_done;
+	int               max_expanded;
+	int               max_nodes;
+	int               num_expanded;
+	int               num_nodes;
+	struct path_node* nodes;
+	path_t*           path;
+	int               sample_dist;
+	double            speed_x, speed_y;
+	double            start_x, start_y;
+	int               step_w, step_h;
+	int*              table;
+	int               table_size;
+};
+
+struct cache_entry
+{
+	char*   person_name;
+	bool    allow_diagonals;
+	int     frame;
+	int     goal_x, goal_y;
+	int     layer;
+	int     max_nodes;
+	path_t* path;
+	int     start_x, start_y;
+};
+
+struct request
+{
+	struct cache_entry key;
+	struct search*     search;
+};
+
+static bool           add_path_command (path_t* path, int type, bool is_immediate);
+static bool           add_path_moves   (path_t* path, int dx, int dy, int num_x, int num_y, int* inout_last_dir);
+static struct search* begin_search     (person_t* person, int x, int y, bool allow_diagonals, int max_nodes);
+static path_t*        build_path       (struct search* search, person_t* person, int goal_node);
+static bool           can_move         (const struct search* search, person_t* person, double x1, double y1, double x2, double y2);
+static void           free_search      (struct search* search);
+static bool           cache_path       (const struct cache_entry* key, path_t* path);
+static int            get_direction    (int dx, int dy);
+static int            get_node         (struct search* search, int i, int j, bool want_create);
+static bool           lookup_path      (const struct cache_entry* key, path_t** out_path);
+static void           make_key         (struct cache_entry* key, const person_t* person, int x, int y, bool allow_diagonals, int max_nodes);
+static int            pop_heap         (struct search* search);
+static bool           push_heap        (struct search* search, int node_index);
+static bool           step_search      (struct search* search, person_t* person, int num_steps);
+
+static int                s_budget = 512;
+static struct cache_entry s_cache[PATH_CACHE_SIZE];
+static int                s_frame = 0;
+static int                s_max_requests = 0;
+static int                s_num_requests = 0;
+static struct request*    s_requests = NULL;
+
+void
+initialize_pathfinding(void)
+{
+	printf("Initializing pathfinding\n");
+	memset(s_cache, 0, sizeof(s_cache));
+	s_budget = 512;
+	s_frame = 0;
+	s_num_requests = s_max_requests = 0;
+	s_requests = NULL;
+}
+
+void
+shutdown_pathfinding(void)
+{
+	printf("Shutting down pathfinding\n");
+	reset_pathfinding();
+	free(s_requests);
+}
+
+path_t*
+find_path(person_t* person, int x, int y, bool allow_diagonals, int max_nodes)
+{
+	struct cache_entry key;
+	path_t*            path;
+	struct search*     search;
+
+	make_key(&key, person, x, y, allow_diagonals, max_nodes);
+	if (lookup_path(&key, &path))
+		return ref_path(path);
+	if (!(search = begin_search(person, x, y, allow_diagonals, max_nodes)))
+		return NULL;
+	step_search(search, person, INT_MAX);
+	path = ref_path(search->path);
+	cache_path(&key, path);
+	free_search(search);
+	return path;
+}
+
+path_t*
+ref_path(path_t* path)
+{
+	if (path != NULL)
+		++path->refcount;
+	return path;
+}
+
+void
+free_path(path_t* path)
+{
+	if (path == NULL || --path->refcount > 0)
+		return;
+	free(path->commands);
+	free(path);
+}
+
+bool
+is_path_pending(const person_t* person)
+{
+	int i;
+
+	for (i = 0; i < s_num_requests; ++i) {
+		if (strcmp(s_requests[i].key.person_name, get_person_name(person)) == 0)
+			return true;
+	}
+	return false;
+}
+
+int
+get_path_command(const path_t* path, int index, bool* out_is_immediate)
+{
+	if (out_is_immediate) *out_is_immediate = path->commands[index].is_immediate;
+	return path->commands[index].type;
+}
+
+int
+get_path_length(const path_t* path)
+{
+	return path->num_commands;
+}
+
+void
+set_pathfinding_budget(int num_nodes)
+{
+	s_budget = num_nodes;
+}
+
+void
+clear_path_cache(void)
+{
+	int i;
+
+	for (i = 0; i < PATH_CACHE_SIZE; ++i) {
+		free(s_cache[i].person_name);
+		free_path(s_cache[i].path);
+	}
+	memset(s_cache, 0, sizeof(s_cache));
+}
+
+bool
+queue_path(person_t* person, const path_t* path)
+{
+	int i;
+
+	for (i = 0; i < path->num_commands; ++i) {
+		if (!queue_person_command(person, path->commands[i].type, path->commands[i].is_immediate))
+			return false;
+	}
+	return true;
+}
+
+bool
+request_path(person_t* person, int x, int y, bool allow_diagonals, int max_nodes)
+{
+	struct cache_entry key;
+	struct request*    new_requests;
+	int                new_size;
+	path_t*            path;
+	struct request*    request;
+	struct search*     search;
+
+	int i;
+
+	// a new request replaces one already pending for the same person
+	for (i = 0; i < s_num_requests; ++i) {
+		if (strcmp(s_requests[i].key.person_name, get_person_name(person)) != 0)
+			continue;
+		free(s_requests[i].key.person_name);
+		free_search(s_requests[i].search);
+		s_requests[i--] = s_requests[--s_num_requests];
+	}
+
+	make_key(&key, person, x, y, allow_diagonals, max_nodes);
+	if (lookup_path(&key, &path))
+		return path == NULL || queue_path(person, path);
+	if (!(search = begin_search(person, x, y, allow_diagonals, max_nodes)))
+		return false;
+	if (s_num_requests >= s_max_requests) {
+		new_size = (s_num_requests + 1) * 2;
+		if (!(new_requests = realloc(s_requests, new_size * sizeof(struct request)))) {
+			free_search(search);
+			return false;
+		}
+		s_requests = new_requests;
+		s_max_requests = new_size;
+	}
+	if (!(key.person_name = strdup(key.person_name))) {
+		free_search(search);
+		return false;
+	}
+	request = &s_requests[s_num_requests++];
+	request->key = key;
+	request->search = search;
+	return true;
+}
+
+void
+reset_pathfinding(void)
+{
+	int i;
+
+	for (i = 0; i < s_num_requests; ++i) {
+		free(s_requests[i].key.person_name);
+		free_search(s_requests[i].search);
+	}
+	s_num_requests = 0;
+	clear_path_cache();
+}
+
+void
+update_pathfinding(void)
+{
+	person_t*       person;
+	struct request* request;
+	int             share;
+
+	int i;
+
+	++s_frame;
+	if (s_num_requests == 0)
+		return;
+
+	// the budget is split evenly, so one long search can't starve the others
+	share = fmax(s_budget / s_num_requests, 1);
+	for (i = 0; i < s_num_requests; ++i) {
+		request = &s_requests[i];
+		if ((person = find_person(request->key.person_name)) != NULL) {
+			if (!step_search(request->search, person, share))
+				continue;
+			cache_path(&request->key, request->search->path);
+			if (request->search->path != NULL)
+				queue_path(person, request->search->path);
+		}
+		free(request->key.person_name);
+		free_search(request->search);
+		s_requests[i--] = s_requests[--s_num_requests];
+	}
+}
+
+static bool
+add_path_command(path_t* path, int type, bool is_immediate)
+{
+	int              new_size;
+	struct path_cmd* new_commands;
+
+	if (path->num_commands >= path->max_commands) {
+		new_size = (path->num_commands + 1) * 2;
+		if (!(new_commands = realloc(path->commands, new_size * sizeof(struct path_cmd))))
+			return false;
+		path->commands = new_commands;
+		path->max_commands = new_size;
+	}
+	path->commands[path->num_commands].type = type;
+	path->commands[path->num_commands].is_immediate = is_immediate;
+	++path->num_commands;
+	return true;
+}
+
+static bool
+add_path_moves(path_t* path, int dx, int dy, int num_x, int num_y, int* inout_last_dir)
+{
+	// the person command queue has no diagonal moves, so a diagonal step
+	// becomes a vertical move immediately followed by a horizontal one
+	int direction;
+
+	int i;
+
+	direction = get_direction(dx, dy);
+	if (direction != *inout_last_dir) {
+		if (!add_path_command(path, COMMAND_FACE_NORTH + direction, true))
+			return false;
+		*inout_last_dir = direction;
+	}
+	for (i = 0; i < num_x || i < num_y; ++i) {
+		if (i < num_y && !add_path_command(path, dy < 0 ? COMMAND_MOVE_NORTH : COMMAND_MOVE_SOUTH, i < num_x))
+			return false;
+		if (i < num_x && !add_path_command(path, dx < 0 ? COMMAND_MOVE_WEST : COMMAND_MOVE_EAST, false))
+			return false;
+	}
+	return true;
+}
+
+static struct search*
+begin_search(person_t* person, int x, int y, bool allow_diagonals, int max_nodes)
+{
+	rect_t         base;
+	int            layer;
+	struct search* search;
+
+	if (!(search = calloc(1, sizeof(struct search))))
+		return NULL;
+	get_person_xyz(person, &search->start_x, &search->start_y, &layer, true);
+	get_person_speed(person, &search->speed_x, &search->speed_y);
+	
+	// moves are counted in steps of the person's speed, so a person that
+	// can't move can't follow a path either
+	if (!(search->speed_x > 0.0 && search->speed_y > 0.0)) {
+		free(search);
+		return NULL;
+	}
+	get_tile_size(get_map_tileset(), &search->step_w, &search->step_h);
+	base = get_person_base(person);
+	search->sample_dist = fmax(fmin(abs(base.x2 - base.x1), abs(base.y2 - base.y1)) / 2, 1);
+	search->allow_diagonals = allow_diagonals;
+	search->bounds = get_map_bounds();
+	search->goal_x = x;
+	search->goal_y = y;
+	search->goal_i = floor((x - search->start_x) / search->step_w + 0.5);
+	search->goal_j = floor((y - search->start_y) / search->step_h + 0.5);
+	search->max_expanded = max_nodes;
+	if (get_node(search, 0, 0, true) < 0 || !push_heap(search, 0)) {
+		free_search(search);
+		return NULL;
+	}
+	return search;
+}
+
+static path_t*
+build_path(struct search* search, person_t* person, int goal_node)
+{
+	int               dx, dy;
+	int               index;
+	int               last_dir = -1;
+	int               length;
+	struct path_node* node;
+	struct path_node* next;
+	path_t*           path;
+	int*              route;
+	double            rest_x, rest_y;
+	double            x, y;
+
+	int i;
+
+	for (length = 0, index = goal_node; index >= 0; index = search->nodes[index].parent)
+		++length;
+	if (!(route = malloc(length * sizeof(int))))
+		return NULL;
+	for (i = length - 1, index = goal_node; index >= 0; index = search->nodes[index].parent)
+		route[i--] = index;
+	if (!(path = calloc(1, sizeof(path_t))))
+		goto on_error;
+	path->refcount = 1;
+	for (i = 0; i < length - 1; ++i) {
+		node = &search->nodes[route[i]];
+		next = &search->nodes[route[i + 1]];
+		dx = next->i - node->i;
+		dy = next->j - node->j;
+		if (!add_path_moves(path, dx, dy,
+			dx != 0 ? fmax(floor(search->step_w / search->speed_x + 0.5), 1) : 0,
+			dy != 0 ? fmax(floor(search->step_h / search->speed_y + 0.5), 1) : 0,
+			&last_dir))
+		{
+			goto on_error;
+		}
+	}
+
+	// the goal may not fall exactly on the grid. if the rest of the way is
+	// clear, walk it.
+	node = &search->nodes[goal_node];
+	x = search->start_x + node->i * search->step_w;
+	y = search->start_y + node->j * search->step_h;
+	rest_x = floor(fabs(search->goal_x - x) / search->speed_x + 0.5);
+	rest_y = floor(fabs(search->goal_y - y) / search->speed_y + 0.5);
+	if ((rest_x > 0 || rest_y > 0) && can_move(search, person, x, y, search->goal_x, search->goal_y)) {
+		dx = rest_x > 0 ? (search->goal_x > x ? 1 : -1) : 0;
+		dy = rest_y > 0 ? (search->goal_y > y ? 1 : -1) : 0;
+		if (!add_path_moves(path, dx, dy, rest_x, rest_y, &last_dir))
+			goto on_error;
+	}
+	free(route);
+	return path;
+
+on_error:
+	free(route);
+	free_path(path);
+	return NULL;
+}
+
+static bool
+can_move(const struct search* search, person_t* person, double x1, double y1, double x2, double y2)
+{
+	int num_samples;
+
+	int i;
+
+	num_samples = ceil(fmax(fabs(x2 - x1), fabs(y2 - y1)) / search->sample_dist);
+	for (i = 1; i <= num_samples; ++i) {
+		if (is_person_obstructed_at(person, x1 + (x2 - x1) * i / num_samples, y1 + (y2 - y1) * i / num_samples, NULL, NULL))
+			return false;
+	}
+	return true;
+}
+
+static void
+free_search(struct search* search)
+{
+	if (search == NULL)
+		return;
+	free_path(search->path);
+	free(search->heap);
+	free(search->nodes);
+	free(search->table);
+	free(search);
+}
+
+static bool
+cache_path(const struct cache_entry* key, path_t* path)
+{
+	struct cache_entry* entry;
+
+	int i;
+
+	// take a free slot if there is one, otherwise evict the oldest entry
+	entry = NULL;
+	for (i = 0; i < PATH_CACHE_SIZE; ++i) {
+		if (s_cache[i].person_name == NULL) {
+			entry = &s_cache[i];
+			break;
+		}
+		if (entry == NULL || s_cache[i].frame < entry->frame)
+			entry = &s_cache[i];
+	}
+	free(entry->person_name);
+	free_path(entry->path);
+	*entry = *key;
+	entry->frame = s_frame;
+	entry->path = ref_path(path);
+	if (!(entry->person_name = strdup(key->person_name))) {
+		free_path(entry->path);
+		memset(entry, 0, sizeof(struct cache_entry));
+		return false;
+	}
+	return true;
+}
+
+static int
+get_direction(int dx, int dy)
+{
+	// same order as the COMMAND_FACE_* constants, clockwise from north
+	static const int directions[3][3] = {
+		{ 7, 0, 1 },
+		{ 6, -1, 2 },
+		{ 5, 4, 3 },
+	};
+
+	return directions[dy + 1][dx + 1];
+}
+
+static int
+get_node(struct search* search, int i, int j, bool want_create)
+{
+	// nodes are kept in an open-addressed hash table keyed on their
+	// position, which grows whenever it gets more than half full
+	struct path_node* new_nodes;
+	int*              new_table;
+	int               new_size;
+	unsigned int      hash;
+	int               index;
+	struct path_node* node;
+
+	int k;
+
+	if (search->num_nodes * 2 >= search->table_size) {
+		new_size = search->table_size > 0 ? search->table_size * 2 : 256;
+		if (!(new_table = malloc(new_size * sizeof(int))))
+			return -1;
+		for (k = 0; k < new_size; ++k)
+			new_table[k] = -1;
+		for (k = 0; k < search->num_nodes; ++k) {
+			node = &search->nodes[k];
+			hash = ((unsigned int)node->i * 73856093U ^ (unsigned int)node->j * 19349663U) & (new_size - 1);
+			while (new_table[hash] >= 0)
+				hash = (hash + 1) & (new_size - 1);
+			new_table[hash] = k;
+		}
+		free(search->table);
+		search->table = new_table;
+		search->table_size = new_size;
+	}
+	hash = ((unsigned int)i * 73856093U ^ (unsigned int)j * 19349663U) & (search->table_size - 1);
+	while ((index = search->table[hash]) >= 0) {
+		if (search->nodes[index].i == i && search->nodes[index].j == j)
+			return index;
+		hash = (hash + 1) & (search->table_size - 1);
+	}
+	if (!want_create)
+		return -1;
+	if (search->num_nodes >= search->max_nodes) {
+		new_size = search->max_nodes > 0 ? search->max_nodes * 2 : 64;
+		if (!(new_nodes = realloc(search->nodes, new_size * sizeof(struct path_node))))
+			return -1;
+		search->nodes = new_nodes;
+		search->max_nodes = new_size;
+	}
+	index = search->num_nodes++;
+	node = &search->nodes[index];
+	node->i = i; node->j = j;
+	node->g = 0;
+	node->f = 0;
+	node->parent = -1;
+	node->is_closed = false;
+	search->table[hash] = index;
+	return index;
+}
+
+static bool
+lookup_path(const struct cache_entry* key, path_t** out_path)
+{
+	struct cache_entry* entry;
+
+	int i;
+
+	for (i = 0; i < PATH_CACHE_SIZE; ++i) {
+		entry = &s_cache[i];
+		if (entry->person_name == NULL || s_frame - entry->frame > PATH_CACHE_LIFE)
+			continue;
+		if (strcmp(entry->person_name, key->person_name) == 0
+			&& entry->layer == key->layer && entry->allow_diagonals == key->allow_diagonals
+			&& entry->start_x == key->start_x && entry->start_y == key->start_y
+			&& entry->goal_x == key->goal_x && entry->goal_y == key->goal_y
+			&& entry->max_nodes == key->max_nodes)
+		{
+			*out_path = entry->path;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+make_key(struct cache_entry* key, const person_t* person, int x, int y, bool allow_diagonals, int max_nodes)
+{
+	double start_x, start_y;
+
+	memset(key, 0, sizeof(struct cache_entry));
+	get_person_xyz(person, &start_x, &start_y, &key->layer, true);
+	key->person_name = (char*)get_person_name(person);
+	key->allow_diagonals = allow_diagonals;
+	key->goal_x = x;
+	key->goal_y = y;
+	key->max_nodes = max_nodes;
+	key->start_x = start_x;
+	key->start_y = start_y;
+}
+
+static int
+pop_heap(struct search* search)
+{
+	int*              heap = search->heap;
+	int               index;
+	int               child, parent;
+	struct path_node* nodes = search->nodes;
+	int               top;
+
+	top = heap[0];
+	index = heap[--search->heap_len];
+	parent = 0;
+	while ((child = parent * 2 + 1) < search->heap_len) {
+		if (child + 1 < search->heap_len && nodes[heap[child + 1]].f < nodes[heap[child]].f)
+			++child;
+		if (nodes[heap[child]].f >= nodes[index].f)
+			break;
+		heap[parent] = heap[child];
+		parent = child;
+	}
+	heap[parent] = index;
+	return top;
+}
+
+static bool
+push_heap(struct search* search, int node_index)
+{
+	int*              new_heap;
+	int               new_size;
+	int               child, parent;
+	struct path_node* nodes = search->nodes;
+
+	if (search->heap_len >= search->max_heap) {
+		new_size = search->max_heap > 0 ? search->max_heap * 2 : 64;
+		if (!(new_heap = realloc(search->heap, new_size * sizeof(int))))
+			return false;
+		search->heap = new_heap;
+		search->max_heap = new_size;
+	}
+	child = search->heap_len++;
+	while (child > 0 && nodes[search->heap[parent = (child - 1) / 2]].f > nodes[node_index].f) {
+		search->heap[child] = search->heap[parent];
+		child = parent;
+	}
+	search->heap[child] = node_index;
+	return true;
+}
+
+static bool
+step_search(struct search* search, person_t* person, int num_steps)
+{
+	// runs up to num_steps node expansions. returns true once the search is
+	// finished, successful or not; search->path is NULL if it failed.
+	int               cost;
+	int               dist_i, dist_j;
+	int               dx, dy;
+	int               g;
+	int               index;
+	struct path_node* neighbor;
+	int               n_index;
+	struct path_node* node;
+	double            x, y;
+	double            new_x, new_y;
+
+	int i_step;
+
+	for (i_step = 0; i_step < num_steps && !search->is_done; ++i_step) {
+		if (search->heap_len == 0 || search->num_expanded >= search->max_expanded) {
+			search->is_done = true;
+			break;
+		}
+		index = pop_heap(search);
+		node = &search->nodes[index];
+		if (node->is_closed)
+			continue;
+		node->is_closed = true;
+		++search->num_expanded;
+		if (node->i == search->goal_i && node->j == search->goal_j) {
+			search->path = build_path(search, person, index);
+			search->is_done = true;
+			break;
+		}
+		x = search->start_x + node->i * search->step_w;
+		y = search->start_y + node->j * search->step_h;
+		for (dy = -1; dy <= 1; ++dy) for (dx = -1; dx <= 1; ++dx) {
+			if ((dx == 0 && dy == 0) || (dx != 0 && dy != 0 && !search->allow_diagonals))
+				continue;
+			new_x = x + dx * search->step_w;
+			new_y = y + dy * search->step_h;
+			if (new_x < search->bounds.x1 || new_y < search->bounds.y1
+				|| new_x >= search->bounds.x2 || new_y >= search->bounds.y2)
+			{
+				continue;
+			}
+			cost = dx != 0 && dy != 0 ? 14 : 10;
+			g = search->nodes[index].g + cost;
+			n_index = get_node(search, search->nodes[index].i + dx, search->nodes[index].j + dy, false);
+			if (n_index >= 0 && (search->nodes[n_index].is_closed || g >= search->nodes[n_index].g))
+				continue;
+
+			// diagonal steps may not cut corners
+			if (!can_move(search, person, x, y, new_x, new_y))
+				continue;
+			if (dx != 0 && dy != 0) {
+				if (!can_move(search, person, x, y, new_x, y) || !can_move(search, person, x, y, x, new_y))
+					continue;
+			}
+			if (n_index < 0 && (n_index = get_node(search, search->nodes[index].i + dx, search->nodes[index].j + dy, true)) < 0) {
+				search->is_done = true;
+				break;
+			}
+			neighbor = &search->nodes[n_index];
+			dist_i = abs(search->goal_i - neighbor->i);
+			dist_j = abs(search->goal_j - neighbor->j);
+			neighbor->g = g;
+			neighbor->f = g + (search->allow_diagonals
+				? 10 * fmax(dist_i, dist_j) + 4 * fmin(dist_i, dist_j)
+				: 10 * (dist_i + dist_j));
+			neighbor->parent = index;
+			if (!push_heap(search, n_index)) {
+				search->is_done = true;
+				break;
+			}
+		}
+	}
+	return search->is_done;
+}
+
+void
+init_pathfinding_api(void)
+{
+	register_api_function(g_duk, NULL, "IsPersonPathPending", js_IsPersonPathPending);
+	register_api_function(g_duk, NULL, "SetPathfindingBudget", js_SetPathfindingBudget);
+	register_api_function(g_duk, NULL, "FindPath", js_FindPath);
+	register_api_function(g_duk, NULL, "RequestPersonPath", js_RequestPersonPath);
+}
+
+static duk_ret_t
+js_IsPersonPathPending(duk_context* ctx)
+{
+	const char* name = duk_require_string(ctx, 0);
+
+	person_t* person;
+
+	if ((person = find_person(name)) == NULL)
+		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "IsPersonPathPending(): Person '%s' doesn't exist", name);
+	duk_push_boolean(ctx, is_path_pending(person));
+	return 1;
+}
+
+static duk_ret_t
+js_SetPathfindingBudget(duk_context* ctx)
+{
+	int num_nodes = duk_require_int(ctx, 0);
+
+	if (num_nodes <= 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "SetPathfindingBudget(): Budget must be greater than zero (%i)", num_nodes);
+	set_pathfinding_budget(num_nodes);
+	return 0;
+}
+
+static duk_ret_t
+js_FindPath(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	const char* name = duk_require_string(ctx, 0);
+	int x = duk_require_int(ctx, 1);
+	int y = duk_require_int(ctx, 2);
+	bool allow_diagonals = n_args >= 4 ? duk_require_boolean(ctx, 3) : false;
+	int max_nodes = n_args >= 5 ? duk_require_int(ctx, 4) : 2048;
+
+	int       command;
+	bool      is_immediate;
+	path_t*   path;
+	person_t* person;
+	double    speed_x, speed_y;
+
+	int i;
+
+	if (!is_map_engine_running())
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "FindPath(): Map engine must be running");
+	if ((person = find_person(name)) == NULL)
+		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "FindPath(): Person '%s' doesn't exist", name);
+	if (max_nodes <= 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "FindPath(): Node limit must be greater than zero (%i)", max_nodes);
+	get_person_speed(person, &speed_x, &speed_y);
+	if (!(speed_x > 0.0 && speed_y > 0.0))
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "FindPath(): Person '%s' has zero or negative speed", name);
+	if (!(path = find_path(person, x, y, allow_diagonals, max_nodes))) {
+		duk_push_null(ctx);
+		return 1;
+	}
+	duk_push_array(ctx);
+	for (i = 0; i < get_path_length(path); ++i) {
+		command = get_path_command(path, i, &is_immediate);
+		duk_push_object(ctx);
+		duk_push_int(ctx, command); duk_put_prop_string(ctx, -2, "command");
+		duk_push_boolean(ctx, is_immediate); duk_put_prop_string(ctx, -2, "immediate");
+		duk_put_prop_index(ctx, -2, i);
+	}
+	free_path(path);
+	return 1;
+}
+
+static duk_ret_t
+js_RequestPersonPath(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	const char* name = duk_require_string(ctx, 0);
+	int x = duk_require_int(ctx, 1);
+	int y = duk_require_int(ctx, 2);
+	bool allow_diagonals = n_args >= 4 ? duk_require_boolean(ctx, 3) : false;
+	int max_nodes = n_args >= 5 ? duk_require_int(ctx, 4) : 2048;
+
+	person_t* person;
+	double    speed_x, speed_y;
+
+	if (!is_map_engine_running())
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "RequestPersonPath(): Map engine must be running");
+	if ((person = find_person(name)) == NULL)
+		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "RequestPersonPath(): Person '%s' doesn't exist", name);
+	if (max_nodes <= 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "RequestPersonPath(): Node limit must be greater than zero (%i)", max_nodes);
+	get_person_speed(person, &speed_x, &speed_y);
+	if (!(speed_x > 0.0 && speed_y > 0.0))
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "RequestPersonPath(): Person '%s' has zero or negative speed", name);
+	if (!request_path(person, x, y, allow_diagonals, max_nodes))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "RequestPersonPath(): Failed to start path search");
+	return 0;
+}
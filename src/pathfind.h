@@ -0,0 +1,25 @@
+#ifndef MINISPHERE__PATHFIND_H__INCLUDED
+#define MINISPHERE__PATHFIND_H__INCLUDED
+
+#include "persons.h"
+
+typedef struct path path_t;
+
+extern void    initialize_pathfinding (void);
+extern void    shutdown_pathfinding   (void);
+extern path_t* find_path              (person_t* person, int x, int y, bool allow_diagonals, int max_nodes);
+extern path_t* ref_path               (path_t* path);
+extern void    free_path              (path_t* path);
+extern bool    is_path_pending        (const person_t* person);
+extern int     get_path_command       (const path_t* path, int index, bool* out_is_immediate);
+extern int     get_path_length        (const path_t* path);
+extern void    set_pathfinding_budget (int num_nodes);
+extern void    clear_path_cache       (void);
+extern bool    queue_path             (person_t* person, const path_t* path);
+extern bool    request_path           (person_t* person, int x, int y, bool allow_diagonals, int max_nodes);
+extern void    reset_pathfinding      (void);
+extern void    update_pathfinding     (void);
+
+extern void init_pathfinding_api (void);
+
+#endif // MINISPHERE__PATHFIND_H__INCLUDED
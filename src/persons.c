@@ -31,6 +31,11 @@ struct person
 	double          speed_x, speed_y;
 	spriteset_t*    sprite;
 	double          theta;
+	bool            update_catch_up;
+	int             update_frames;
+	int             update_interval;
+	int             update_policy;
+	double          update_radius;
 	double          x, y;
 	int             x_offset, y_offset;
 	int             max_commands;
@@ -110,6 +115,7 @@ static duk_ret_t js_SetPersonScript              (duk_context* ctx);
 static duk_ret_t js_SetPersonSpeed               (duk_context* ctx);
 static duk_ret_t js_SetPersonSpeedXY             (duk_context* ctx);
 static duk_ret_t js_SetPersonSpriteset           (duk_context* ctx);
+static duk_ret_t js_SetPersonUpdatePolicy        (duk_context* ctx);
 static duk_ret_t js_SetPersonValue               (duk_context* ctx);
 static duk_ret_t js_SetPersonVisible             (duk_context* ctx);
 static duk_ret_t js_SetPersonX                   (duk_context* ctx);
@@ -133,17 +139,24 @@ static int  compare_persons      (const void* a, const void* b);
 static bool enlarge_step_history (person_t* person, int new_size);
 static bool follow_person        (person_t* person, person_t* leader, int distance);
 static void free_person          (person_t* person);
+static int  get_update_steps     (person_t* person);
 static void record_step          (person_t* person);
 static void sort_persons         (void);
 static void update_person        (person_t* person);
 
-static const person_t*   s_current_person = NULL;
+static const person_t*   s_current_person   = NULL;
 static script_t*         s_def_scripts[PERSON_SCRIPT_MAX];
-static int               s_talk_distance  = 8;
-static int               s_max_persons    = 0;
-static unsigned int      s_next_person_id = 0;
-static int               s_num_persons    = 0;
-static person_t*         *s_persons       = NULL;
+static int               s_talk_distance    = 8;
+static int               s_last_num_culled  = 0;
+static int               s_last_num_drawn   = 0;
+static int               s_last_num_skipped = 0;
+static int               s_last_num_updated = 0;
+static int               s_max_persons      = 0;
+static unsigned int      s_next_person_id   = 0;
+static int               s_num_culled       = 0;
+static int               s_num_drawn        = 0;
+static int               s_num_persons      = 0;
+static person_t*         *s_persons         = NULL;
 
 void
 initialize_persons_manager(void)
@@ -164,8 +177,10 @@ shutdown_persons_manager(void)
 	
 	printf("Shutting down persons manager\n");
 	
-	for (i = 0; i < s_num_persons; ++i)
+	for (i = 0; i < s_num_persons; ++i) {
+		detach_person(s_persons[i]);
 		free_person(s_persons[i]);
+	}
 	free(s_persons);
 }
 
@@ -277,6 +292,7 @@ is_person_obstructed_at(const person_t* person, double x, double y, person_t** o
 	bool             is_obstructed = false;
 	int              layer;
 	const obsmap_t*  obsmap;
+	int              passability;
 	int              tile_w, tile_h;
 	const tileset_t* tileset;
 
@@ -319,9 +335,13 @@ is_person_obstructed_at(const person_t* person, double x, double y, person_t** o
 		area.x2 = area.x1 + (my_base.x2 - my_base.x1) / tile_w + 2;
 		area.y2 = area.y1 + (my_base.y2 - my_base.y1) / tile_h + 2;
 		for (i_x = area.x1; i_x < area.x2; ++i_x) for (i_y = area.y1; i_y < area.y2; ++i_y) {
+			if ((passability = get_map_passability(i_x, i_y, layer)) == PASS_OPEN)
+				continue;
 			base = translate_rect(my_base, -(i_x * tile_w), -(i_y * tile_h));
 			obsmap = get_tile_obsmap(tileset, get_map_tile(i_x, i_y, layer));
-			if (obsmap != NULL && test_obsmap_rect(obsmap, base)) {
+			if (passability == PASS_SOLID ? test_solid_obsmap_rect(obsmap, base)
+				: test_obsmap_rect(obsmap, base))
+			{
 				is_obstructed = true;
 				if (out_tile_index) *out_tile_index = get_map_tile(i_x, i_y, layer);
 				break;
@@ -573,25 +593,88 @@ queue_person_script(person_t* person, lstring_t* script, bool is_immediate)
 }
 
 void
-render_persons(int layer, bool is_flipped, int cam_x, int cam_y)
+get_person_render_stats(int* out_num_drawn, int* out_num_culled)
 {
+	// stats are for the last complete frame
+	if (out_num_drawn) *out_num_drawn = s_last_num_drawn;
+	if (out_num_culled) *out_num_culled = s_last_num_culled;
+}
+
+void
+get_person_update_stats(int* out_num_updated, int* out_num_skipped)
+{
+	// stats are for the last call to update_persons()
+	if (out_num_updated) *out_num_updated = s_last_num_updated;
+	if (out_num_skipped) *out_num_skipped = s_last_num_skipped;
+}
+
+void
+render_persons(int layer, bool is_flipped, int cam_x, int cam_y, int wrap_w, int wrap_h)
+{
+	// note: if wrap_w and wrap_h are nonzero, the layer repeats and each
+	//       person is drawn once for every copy of the layer it would be
+	//       visible in. persons whose sprites wouldn't touch the screen at all
+	//       aren't drawn.
+	
+	rect_t       base;
+	double       center_x, center_y;
+	int          first_x, first_y;
+	int          frame_w, frame_h;
+	int          last_x, last_y;
+	int          max_w, max_h;
 	person_t*    person;
+	double       radius;
 	spriteset_t* sprite;
-	int          w, h;
 	double       x, y;
-	int          i;
+	
+	int i, i_x, i_y;
 
 	for (i = 0; i < s_num_persons; ++i) {
 		person = s_persons[i];
 		if (!person->is_visible || person->layer != layer)
 			continue;
 		sprite = person->sprite;
-		get_sprite_size(sprite, &w, &h);
 		get_person_xy(person, &x, &y, true);
 		x -= cam_x - person->x_offset;
 		y -= cam_y - person->y_offset;
-		draw_sprite(sprite, person->mask, is_flipped, person->theta, person->scale_x, person->scale_y,
-			person->direction, x, y, person->frame);
+		
+		// find a circle the sprite is sure to fit in, however it's scaled or
+		// rotated. frames are drawn around their own center, so that's where
+		// the circle goes, but it's sized for the largest frame. this is
+		// deliberately generous: drawing a sprite that turns out to be
+		// offscreen is much cheaper than popping one that isn't.
+		if (!get_sprite_frame_size(sprite, person->direction, person->frame, &frame_w, &frame_h))
+			continue;
+		get_sprite_max_size(sprite, &max_w, &max_h);
+		base = get_sprite_base(sprite);
+		center_x = x - (base.x1 + base.x2) / 2 + frame_w / 2.0;
+		center_y = y - (is_flipped ? 0 : (base.y1 + base.y2) / 2) + frame_h / 2.0;
+		radius = hypot(max_w * fabs(person->scale_x), max_h * fabs(person->scale_y));
+		if (wrap_w > 0) {
+			first_x = ceil((-radius - center_x) / wrap_w);
+			last_x = floor((g_res_x + radius - center_x) / wrap_w);
+		}
+		else {
+			first_x = 0;
+			last_x = center_x + radius > 0 && center_x - radius < g_res_x ? 0 : -1;
+		}
+		if (wrap_h > 0) {
+			first_y = ceil((-radius - center_y) / wrap_h);
+			last_y = floor((g_res_y + radius - center_y) / wrap_h);
+		}
+		else {
+			first_y = 0;
+			last_y = center_y + radius > 0 && center_y - radius < g_res_y ? 0 : -1;
+		}
+		if (first_x > last_x || first_y > last_y) {
+			++s_num_culled;
+			continue;
+		}
+		for (i_y = first_y; i_y <= last_y; ++i_y) for (i_x = first_x; i_x <= last_x; ++i_x) {
+			draw_sprite(sprite, person->mask, is_flipped, person->theta, person->scale_x, person->scale_y,
+				person->direction, x + i_x * wrap_w, y + i_y * wrap_h, person->frame);
+			++s_num_drawn;
+		}
 	}
 }
 
@@ -617,6 +700,7 @@ reset_persons(bool keep_existing)
 		}
 		else {
 			call_person_script(person, PERSON_SCRIPT_ON_DESTROY, true);
+			detach_person(person);
 			free_person(person);
 			--s_num_persons;
 			for (j = i; j < s_num_persons; ++j) s_persons[j] = s_persons[j + 1];
@@ -651,15 +735,41 @@ talk_person(const person_t* person)
 void
 update_persons(void)
 {
-	bool is_sort_needed = false;
+	bool         is_sort_needed = false;
+	int          num_steps;
+	person_t*    person;
+	unsigned int person_id;
 	
-	int i;
+	int i, i_step;
 
+	// a new frame is starting, so roll over the render stats
+	s_last_num_culled = s_num_culled;
+	s_last_num_drawn = s_num_drawn;
+	s_num_culled = 0;
+	s_num_drawn = 0;
+	
+	s_last_num_skipped = 0;
+	s_last_num_updated = 0;
 	for (i = 0; i < s_num_persons; ++i) {
-		if (s_persons[i]->leader != NULL)
+		person = s_persons[i];
+		if (person->leader != NULL)
 			continue;  // skip followers for now
-		update_person(s_persons[i]);
-		is_sort_needed |= has_person_moved(s_persons[i]);
+		if ((num_steps = get_update_steps(person)) == 0) {
+			++s_last_num_skipped;
+			continue;
+		}
+		
+		// a generator script may destroy the person, so check after every step
+		person_id = person->id;
+		for (i_step = 0; i_step < num_steps; ++i_step) {
+			update_person(person);
+			if (!does_person_exist(person_id))
+				break;
+			is_sort_needed |= has_person_moved(person);
+		}
+		++s_last_num_updated;
+		if (i_step < num_steps)
+			--i;  // the next person has moved into this slot
 	}
 	if (is_sort_needed) sort_persons();
 }
@@ -791,6 +901,37 @@ free_person(person_t* person)
 	free(person);
 }
 
+static int
+get_update_steps(person_t* person)
+{
+	// returns the number of times a person should be updated this frame.
+	// persons with a reduced policy are updated every few frames when they're
+	// out of range of both the camera and the input person; if catch-up is
+	// enabled the frames they missed are then all run at once.
+	int       cam_x, cam_y;
+	person_t* input_person;
+	bool      is_in_range;
+	double    radius;
+
+	if (person->update_policy == PERSON_UPDATE_ALWAYS)
+		return 1;
+	get_map_camera_xy(&cam_x, &cam_y);
+	input_person = get_map_input_person();
+	radius = person->update_radius;
+	is_in_range = hypot(person->x - cam_x, person->y - cam_y) <= radius
+		|| (input_person != NULL && hypot(person->x - input_person->x, person->y - input_person->y) <= radius);
+	if (is_in_range || person == input_person) {
+		person->update_frames = 0;
+		return 1;
+	}
+	if (person->update_policy == PERSON_UPDATE_SUSPEND)
+		return 0;
+	if (++person->update_frames < person->update_interval)
+		return 0;
+	person->update_frames = 0;
+	return person->update_catch_up ? person->update_interval : 1;
+}
+
 static void
 record_step(person_t* person)
 {
@@ -980,6 +1121,7 @@ init_persons_api(void)
 	register_api_function(g_duk, NULL, "SetPersonSpeed", js_SetPersonSpeed);
 	register_api_function(g_duk, NULL, "SetPersonSpeedXY", js_SetPersonSpeedXY);
 	register_api_function(g_duk, NULL, "SetPersonSpriteset", js_SetPersonSpriteset);
+	register_api_function(g_duk, NULL, "SetPersonUpdatePolicy", js_SetPersonUpdatePolicy);
 	register_api_function(g_duk, NULL, "SetPersonValue", js_SetPersonValue);
 	register_api_function(g_duk, NULL, "SetPersonVisible", js_SetPersonVisible);
 	register_api_function(g_duk, NULL, "SetPersonX", js_SetPersonX);
@@ -1002,6 +1144,11 @@ init_persons_api(void)
 	register_api_const(g_duk, "SCRIPT_ON_ACTIVATE_TALK", PERSON_SCRIPT_ON_TALK);
 	register_api_const(g_duk, "SCRIPT_COMMAND_GENERATOR", PERSON_SCRIPT_GENERATOR);
 
+	// person update policies
+	register_api_const(g_duk, "UPDATE_ALWAYS", PERSON_UPDATE_ALWAYS);
+	register_api_const(g_duk, "UPDATE_REDUCED", PERSON_UPDATE_REDUCED);
+	register_api_const(g_duk, "UPDATE_SUSPEND", PERSON_UPDATE_SUSPEND);
+
 	// person movement commands
 	register_api_const(g_duk, "COMMAND_WAIT", COMMAND_WAIT);
 	register_api_const(g_duk, "COMMAND_ANIMATE", COMMAND_ANIMATE);
@@ -1889,6 +2036,34 @@ js_SetPersonSpriteset(duk_context* ctx)
 	return 0;
 }
 
+static duk_ret_t
+js_SetPersonUpdatePolicy(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	const char* name = duk_require_string(ctx, 0);
+	int policy = duk_require_int(ctx, 1);
+	double radius = n_args >= 3 ? duk_require_number(ctx, 2) : fmax(g_res_x, g_res_y);
+	int interval = n_args >= 4 ? duk_require_int(ctx, 3) : 4;
+	bool catch_up = n_args >= 5 ? duk_require_boolean(ctx, 4) : false;
+
+	person_t* person;
+
+	if ((person = find_person(name)) == NULL)
+		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "SetPersonUpdatePolicy(): Person '%s' doesn't exist", name);
+	if (policy < PERSON_UPDATE_ALWAYS || policy > PERSON_UPDATE_SUSPEND)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "SetPersonUpdatePolicy(): Invalid update policy constant");
+	if (radius < 0.0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "SetPersonUpdatePolicy(): Radius must not be negative (%g)", radius);
+	if (interval <= 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "SetPersonUpdatePolicy(): Interval must be greater than zero (%i)", interval);
+	person->update_policy = policy;
+	person->update_radius = radius;
+	person->update_interval = interval;
+	person->update_catch_up = catch_up;
+	person->update_frames = 0;
+	return 0;
+}
+
 static duk_ret_t
 js_SetPersonValue(duk_context* ctx)
 {
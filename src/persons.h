@@ -35,8 +35,10 @@ extern bool         call_person_script         (const person_t* person, int type
 extern bool         compile_person_script      (person_t* person, int type, const lstring_t* codestring);
 extern person_t*    find_person                (const char* name);
 extern bool         queue_person_command       (person_t* person, int command, bool is_immediate);
+extern void         get_person_render_stats    (int* out_num_drawn, int* out_num_culled);
+extern void         get_person_update_stats    (int* out_num_updated, int* out_num_skipped);
 extern void         reset_persons              (bool keep_existing);
-extern void         render_persons             (int layer, bool is_flipped, int cam_x, int cam_y);
+extern void         render_persons             (int layer, bool is_flipped, int cam_x, int cam_y, int wrap_w, int wrap_h);
 extern void         talk_person                (const person_t* person);
 extern void         update_persons             (void);
 
@@ -75,4 +77,11 @@ enum person_script_type
 	PERSON_SCRIPT_MAX
 };
 
+enum person_update_policy
+{
+	PERSON_UPDATE_ALWAYS,
+	PERSON_UPDATE_REDUCED,
+	PERSON_UPDATE_SUSPEND
+};
+
 #endif // MINISPHERE__PERSONS_H__INCLUDED
@@ -0,0 +1,203 @@
+#include "minisphere.h"
+#include "color.h"
+
+#include "pixels.h"
+
+// SIMD paths are selected at compile time. the vector kernels assume a
+// little-endian layout (R in the low byte of each 32-bit pixel), which holds
+// for every target that has SSE2 or AVX2.
+#if defined(__AVX2__)
+#define PIXELS_USE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXELS_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+static uint8_t transform_value (int n, int k_r, int k_g, int k_b, uint8_t r, uint8_t g, uint8_t b);
+
+#ifdef PIXELS_USE_SSE2
+static __m128i transform_sse2 (__m128 r, __m128 g, __m128 b, int n, int k_r, int k_g, int k_b);
+#endif
+#ifdef PIXELS_USE_AVX2
+static __m256i transform_avx2 (__m256 r, __m256 g, __m256 b, int n, int k_r, int k_g, int k_b);
+#endif
+
+void
+lookup_pixels(void* data, int pitch, int width, int height, const uint8_t red_lu[256], const uint8_t green_lu[256], const uint8_t blue_lu[256], const uint8_t alpha_lu[256])
+{
+	// note: neither SSE2 nor AVX2 can gather bytes, so table lookups stay
+	//       scalar. walking the rows in order is what matters here.
+	uint8_t* pixel;
+	uint8_t* row;
+
+	int i_x, i_y;
+
+	for (i_y = 0; i_y < height; ++i_y) {
+		row = (uint8_t*)data + i_y * pitch;
+		for (i_x = 0; i_x < width; ++i_x) {
+			pixel = row + i_x * 4;
+			pixel[0] = red_lu[pixel[0]];
+			pixel[1] = green_lu[pixel[1]];
+			pixel[2] = blue_lu[pixel[2]];
+			pixel[3] = alpha_lu[pixel[3]];
+		}
+	}
+}
+
+void
+replace_pixels(void* data, int pitch, int width, int height, color_t color, color_t new_color)
+{
+	uint32_t  key;
+	uint32_t  new_value;
+	uint32_t* pixel;
+	uint8_t*  row;
+
+	int i_x, i_y;
+
+	// color_t is laid out in the same byte order as ABGR_8888, so the two
+	// colors can be compared and stored as whole pixels.
+	memcpy(&key, &color, sizeof(uint32_t));
+	memcpy(&new_value, &new_color, sizeof(uint32_t));
+	for (i_y = 0; i_y < height; ++i_y) {
+		row = (uint8_t*)data + i_y * pitch;
+		i_x = 0;
+#ifdef PIXELS_USE_AVX2
+		{
+			__m256i key_vec = _mm256_set1_epi32((int)key);
+			__m256i new_vec = _mm256_set1_epi32((int)new_value);
+			for (; i_x + 8 <= width; i_x += 8) {
+				__m256i* p_vec = (__m256i*)(row + i_x * 4);
+				__m256i  pixels = _mm256_loadu_si256(p_vec);
+				__m256i  match = _mm256_cmpeq_epi32(pixels, key_vec);
+				_mm256_storeu_si256(p_vec, _mm256_blendv_epi8(pixels, new_vec, match));
+			}
+		}
+#endif
+#ifdef PIXELS_USE_SSE2
+		{
+			__m128i key_vec = _mm_set1_epi32((int)key);
+			__m128i new_vec = _mm_set1_epi32((int)new_value);
+			for (; i_x + 4 <= width; i_x += 4) {
+				__m128i* p_vec = (__m128i*)(row + i_x * 4);
+				__m128i  pixels = _mm_loadu_si128(p_vec);
+				__m128i  match = _mm_cmpeq_epi32(pixels, key_vec);
+				_mm_storeu_si128(p_vec, _mm_or_si128(_mm_and_si128(match, new_vec), _mm_andnot_si128(match, pixels)));
+			}
+		}
+#endif
+		for (; i_x < width; ++i_x) {
+			pixel = (uint32_t*)(row + i_x * 4);
+			if (*pixel == key)
+				*pixel = new_value;
+		}
+	}
+}
+
+void
+transform_pixels(void* data, int pitch, int width, int height, const colormatrix_t* matrix)
+{
+	uint8_t* pixel;
+	uint8_t  r, g, b;
+	uint8_t* row;
+
+	int i_x, i_y;
+
+	for (i_y = 0; i_y < height; ++i_y) {
+		row = (uint8_t*)data + i_y * pitch;
+		i_x = 0;
+#ifdef PIXELS_USE_AVX2
+		for (; i_x + 8 <= width; i_x += 8) {
+			__m256i* p_vec = (__m256i*)(row + i_x * 4);
+			__m256i  pixels = _mm256_loadu_si256(p_vec);
+			__m256i  mask = _mm256_set1_epi32(0xFF);
+			__m256   in_r = _mm256_cvtepi32_ps(_mm256_and_si256(pixels, mask));
+			__m256   in_g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask));
+			__m256   in_b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask));
+			__m256i  out_r = transform_avx2(in_r, in_g, in_b, matrix->rn, matrix->rr, matrix->rg, matrix->rb);
+			__m256i  out_g = transform_avx2(in_r, in_g, in_b, matrix->gn, matrix->gr, matrix->gg, matrix->gb);
+			__m256i  out_b = transform_avx2(in_r, in_g, in_b, matrix->bn, matrix->br, matrix->bg, matrix->bb);
+			pixels = _mm256_and_si256(pixels, _mm256_set1_epi32((int)0xFF000000));
+			pixels = _mm256_or_si256(pixels, out_r);
+			pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(out_g, 8));
+			pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(out_b, 16));
+			_mm256_storeu_si256(p_vec, pixels);
+		}
+#endif
+#ifdef PIXELS_USE_SSE2
+		for (; i_x + 4 <= width; i_x += 4) {
+			__m128i* p_vec = (__m128i*)(row + i_x * 4);
+			__m128i  pixels = _mm_loadu_si128(p_vec);
+			__m128i  mask = _mm_set1_epi32(0xFF);
+			__m128   in_r = _mm_cvtepi32_ps(_mm_and_si128(pixels, mask));
+			__m128   in_g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), mask));
+			__m128   in_b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), mask));
+			__m128i  out_r = transform_sse2(in_r, in_g, in_b, matrix->rn, matrix->rr, matrix->rg, matrix->rb);
+			__m128i  out_g = transform_sse2(in_r, in_g, in_b, matrix->gn, matrix->gr, matrix->gg, matrix->gb);
+			__m128i  out_b = transform_sse2(in_r, in_g, in_b, matrix->bn, matrix->br, matrix->bg, matrix->bb);
+			pixels = _mm_and_si128(pixels, _mm_set1_epi32((int)0xFF000000));
+			pixels = _mm_or_si128(pixels, out_r);
+			pixels = _mm_or_si128(pixels, _mm_slli_epi32(out_g, 8));
+			pixels = _mm_or_si128(pixels, _mm_slli_epi32(out_b, 16));
+			_mm_storeu_si128(p_vec, pixels);
+		}
+#endif
+		for (; i_x < width; ++i_x) {
+			pixel = row + i_x * 4;
+			r = pixel[0]; g = pixel[1]; b = pixel[2];
+			pixel[0] = transform_value(matrix->rn, matrix->rr, matrix->rg, matrix->rb, r, g, b);
+			pixel[1] = transform_value(matrix->gn, matrix->gr, matrix->gg, matrix->gb, r, g, b);
+			pixel[2] = transform_value(matrix->bn, matrix->br, matrix->bg, matrix->bb, r, g, b);
+		}
+	}
+}
+
+static uint8_t
+transform_value(int n, int k_r, int k_g, int k_b, uint8_t r, uint8_t g, uint8_t b)
+{
+	float sum;
+	int   value;
+
+	// math is done in single precision to match the SIMD paths bit-for-bit
+	sum = (float)(k_r * r + k_g * g + k_b * b);
+	value = n + (int)(sum / 255.0f);
+	return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+#ifdef PIXELS_USE_SSE2
+static __m128i
+transform_sse2(__m128 r, __m128 g, __m128 b, int n, int k_r, int k_g, int k_b)
+{
+	__m128i out_of_range;
+	__m128  sum;
+	__m128i value;
+
+	sum = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps((float)k_r)), _mm_mul_ps(g, _mm_set1_ps((float)k_g))),
+		_mm_mul_ps(b, _mm_set1_ps((float)k_b)));
+	value = _mm_add_epi32(_mm_set1_epi32(n), _mm_cvttps_epi32(_mm_div_ps(sum, _mm_set1_ps(255.0f))));
+
+	// SSE2 has no 32-bit min/max, so clamp to [0,255] with compare masks
+	value = _mm_andnot_si128(_mm_cmplt_epi32(value, _mm_setzero_si128()), value);
+	out_of_range = _mm_cmpgt_epi32(value, _mm_set1_epi32(255));
+	return _mm_or_si128(
+		_mm_and_si128(out_of_range, _mm_set1_epi32(255)),
+		_mm_andnot_si128(out_of_range, value));
+}
+#endif
+
+#ifdef PIXELS_USE_AVX2
+static __m256i
+transform_avx2(__m256 r, __m256 g, __m256 b, int n, int k_r, int k_g, int k_b)
+{
+	__m256  sum;
+	__m256i value;
+
+	sum = _mm256_add_ps(
+		_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps((float)k_r)), _mm256_mul_ps(g, _mm256_set1_ps((float)k_g))),
+		_mm256_mul_ps(b, _mm256_set1_ps((float)k_b)));
+	value = _mm256_add_epi32(_mm256_set1_epi32(n), _mm256_cvttps_epi32(_mm256_div_ps(sum, _mm256_set1_ps(255.0f))));
+	return _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+#endif
@@ -0,0 +1,13 @@
+#ifndef MINISPHERE__PIXELS_H__INCLUDED
+#define MINISPHERE__PIXELS_H__INCLUDED
+
+// pixel kernels operate on raw ABGR_8888 pixel data as returned by
+// al_lock_bitmap(). `data` points to the top-left pixel of the region to
+// process and `pitch` is the distance in bytes between rows (which may be
+// negative for OpenGL bitmaps).
+
+extern void lookup_pixels    (void* data, int pitch, int width, int height, const uint8_t red_lu[256], const uint8_t green_lu[256], const uint8_t blue_lu[256], const uint8_t alpha_lu[256]);
+extern void replace_pixels   (void* data, int pitch, int width, int height, color_t color, color_t new_color);
+extern void transform_pixels (void* data, int pitch, int width, int height, const colormatrix_t* matrix);
+
+#endif // MINISPHERE__PIXELS_H__INCLUDED
@@ -0,0 +1,185 @@
+#include "minisphere.h"
+
+#include "pool.h"
+
+// note: small blocks come from per-size-class pools instead of malloc().
+//       each pool carves fixed-size blocks out of 64 KiB chunks and keeps
+//       freed ones on a free list, so allocating or freeing a small block
+//       is a couple of pointer moves and blocks of one size never fragment
+//       the space for another. chunks are only given back by free_pools(),
+//       once the heap that was using them is gone. anything bigger than the
+//       largest class goes straight to malloc().
+//
+//       callers pass in the block size on free and realloc; the engine's
+//       Duktape hooks already track it, so blocks don't need a header of
+//       their own.
+
+#define CHUNK_SIZE  65536
+#define CHUNK_ALIGN 16
+#define MAX_POOLED  512
+#define NUM_CLASSES 16
+
+struct chunk
+{
+	struct chunk* next;
+};
+
+struct free_block
+{
+	struct free_block* next;
+};
+
+struct pool
+{
+	struct chunk*      chunks;
+	struct free_block* free_list;
+	uint8_t*           next_block;
+	uint8_t*           end_block;
+	unsigned int       num_allocs;
+	int                num_chunks;
+	int                num_live;
+	int                peak_live;
+};
+
+static struct pool* get_pool (size_t size);
+
+// size classes are 16 bytes apart up to 128, then a little coarser. index
+// the table with the size in 16-byte units, rounded up.
+static const size_t BLOCK_SIZES[NUM_CLASSES] =
+{
+	16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512
+};
+
+static const uint8_t CLASS_OF[MAX_POOLED / 16 + 1] =
+{
+	0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+	12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15
+};
+
+static unsigned int s_large_allocs = 0;
+static int          s_large_live = 0;
+static int          s_large_peak = 0;
+static struct pool  s_pools[NUM_CLASSES];
+
+void*
+pool_alloc(size_t size)
+{
+	size_t             block_size;
+	struct chunk*      chunk;
+	struct free_block* block;
+	struct pool*       pool;
+
+	if (!(pool = get_pool(size))) {
+		++s_large_allocs;
+		if (++s_large_live > s_large_peak)
+			s_large_peak = s_large_live;
+		return malloc(size);
+	}
+	block_size = BLOCK_SIZES[pool - s_pools];
+	if ((block = pool->free_list) != NULL)
+		pool->free_list = block->next;
+	else {
+		if (pool->next_block == NULL || pool->next_block + block_size > pool->end_block) {
+			if (!(chunk = malloc(CHUNK_SIZE)))
+				return NULL;
+			chunk->next = pool->chunks;
+			pool->chunks = chunk;
+			pool->next_block = (uint8_t*)chunk + CHUNK_ALIGN;
+			pool->end_block = (uint8_t*)chunk + CHUNK_SIZE;
+			++pool->num_chunks;
+		}
+		block = (struct free_block*)pool->next_block;
+		pool->next_block += block_size;
+	}
+	++pool->num_allocs;
+	if (++pool->num_live > pool->peak_live)
+		pool->peak_live = pool->num_live;
+	return block;
+}
+
+void*
+pool_realloc(void* ptr, size_t old_size, size_t new_size)
+{
+	struct pool* new_pool;
+	void*        new_ptr;
+	struct pool* old_pool;
+
+	if (ptr == NULL)
+		return pool_alloc(new_size);
+	old_pool = get_pool(old_size);
+	new_pool = get_pool(new_size);
+	if (old_pool == NULL && new_pool == NULL)
+		return realloc(ptr, new_size);
+	if (old_pool == new_pool)
+		return ptr;  // still fits in the same size class
+	if (!(new_ptr = pool_alloc(new_size)))
+		return NULL;
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+	pool_free(ptr, old_size);
+	return new_ptr;
+}
+
+void
+pool_free(void* ptr, size_t size)
+{
+	struct free_block* block;
+	struct pool*       pool;
+
+	if (ptr == NULL)
+		return;
+	if (!(pool = get_pool(size))) {
+		--s_large_live;
+		free(ptr);
+		return;
+	}
+	block = ptr;
+	block->next = pool->free_list;
+	pool->free_list = block;
+	--pool->num_live;
+}
+
+void
+free_pools(void)
+{
+	struct chunk* chunk;
+	struct pool*  pool;
+
+	int i;
+
+	for (i = 0; i < NUM_CLASSES; ++i) {
+		pool = &s_pools[i];
+		while (pool->chunks != NULL) {
+			chunk = pool->chunks;
+			pool->chunks = chunk->next;
+			free(chunk);
+		}
+		memset(pool, 0, sizeof(struct pool));
+	}
+	s_large_allocs = 0;
+	s_large_live = s_large_peak = 0;
+}
+
+void
+print_pool_stats(void)
+{
+	struct pool* pool;
+
+	int i;
+
+	printf("Heap allocator statistics\n");
+	printf("  %6s %12s %8s %8s %7s\n", "size", "allocs", "live", "peak", "chunks");
+	for (i = 0; i < NUM_CLASSES; ++i) {
+		pool = &s_pools[i];
+		printf("  %6i %12u %8i %8i %7i\n", (int)BLOCK_SIZES[i],
+			pool->num_allocs, pool->num_live, pool->peak_live, pool->num_chunks);
+	}
+	printf("  %6s %12u %8i %8i %7s\n", ">512", s_large_allocs, s_large_live, s_large_peak, "-");
+}
+
+static struct pool*
+get_pool(size_t size)
+{
+	if (size == 0 || size > MAX_POOLED)
+		return NULL;
+	return &s_pools[CLASS_OF[(size + 15) / 16]];
+}
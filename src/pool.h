@@ -0,0 +1,10 @@
+#ifndef MINISPHERE__POOL_H__INCLUDED
+#define MINISPHERE__POOL_H__INCLUDED
+
+extern void* pool_alloc       (size_t size);
+extern void* pool_realloc     (void* ptr, size_t old_size, size_t new_size);
+extern void  pool_free        (void* ptr, size_t size);
+extern void  free_pools       (void);
+extern void  print_pool_stats (void);
+
+#endif // MINISPHERE__POOL_H__INCLUDED
@@ -1,6 +1,7 @@
 #include "minisphere.h"
 #include "api.h"
 #include "color.h"
+#include "render.h"
 
 #include "primitives.h"
 
@@ -20,6 +21,10 @@ static duk_ret_t js_Rectangle              (duk_context* ctx);
 static duk_ret_t js_RoundRectangle         (duk_context* ctx);
 static duk_ret_t js_Triangle               (duk_context* ctx);
 
+static void   batch_filled_rect  (float x1, float y1, float x2, float y2, ALLEGRO_COLOR color);
+static float* duk_require_points (duk_context* ctx, duk_idx_t index, size_t num_points);
+static void   set_vertex         (ALLEGRO_VERTEX* vertex, float x, float y, ALLEGRO_COLOR color);
+
 enum line_series_type
 {
 	LINE_MULTIPLE,
@@ -88,7 +93,7 @@ js_ApplyColorMask(duk_context* ctx)
 	rect_w = al_get_display_width(g_display);
 	rect_h = al_get_display_height(g_display);
 	if (!is_skipped_frame())
-		al_draw_filled_rectangle(0, 0, rect_w, rect_h, nativecolor(color));
+		batch_filled_rect(0, 0, rect_w, rect_h, nativecolor(color));
 	return 0;
 }
 
@@ -106,6 +111,7 @@ js_GradientCircle(duk_context* ctx)
 	inner_color = duk_require_sphere_color(ctx, 3);
 	outer_color = duk_require_sphere_color(ctx, 4);
 	// TODO: actually draw a gradient circle instead of a solid one
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_filled_circle(x, y, radius, nativecolor(inner_color));
 	return 0;
@@ -123,15 +129,18 @@ js_GradientRectangle(duk_context* ctx)
 	color_t color_lr = duk_require_sphere_color(ctx, 6);
 	color_t color_ll = duk_require_sphere_color(ctx, 7);
 
-	if (!is_skipped_frame()) {
-		ALLEGRO_VERTEX verts[] = {
-			{ x1, y1, 0, 0, 0, nativecolor(color_ul) },
-			{ x2, y1, 0, 0, 0, nativecolor(color_ur) },
-			{ x1, y2, 0, 0, 0, nativecolor(color_ll) },
-			{ x2, y2, 0, 0, 0, nativecolor(color_lr) }
-		};
-		al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
-	}
+	ALLEGRO_VERTEX* v;
+
+	if (is_skipped_frame() || !(v = alloc_render_vertices(ALLEGRO_PRIM_TRIANGLE_LIST, 6)))
+		return 0;
+	
+	// same split as the triangle strip this used to be drawn with
+	set_vertex(&v[0], x1, y1, nativecolor(color_ul));
+	set_vertex(&v[1], x2, y1, nativecolor(color_ur));
+	set_vertex(&v[2], x1, y2, nativecolor(color_ll));
+	v[3] = v[1];
+	v[4] = v[2];
+	set_vertex(&v[5], x2, y2, nativecolor(color_lr));
 	return 0;
 }
 
@@ -144,8 +153,26 @@ js_Line(duk_context* ctx)
 	int y2 = duk_require_int(ctx, 3);
 	color_t color = duk_require_sphere_color(ctx, 4);
 
-	if (!is_skipped_frame())
-		al_draw_line(x1, y1, x2, y2, nativecolor(color), 1);
+	float           length;
+	float           tx, ty;
+	ALLEGRO_VERTEX* v;
+	ALLEGRO_COLOR   vtx_color;
+
+	// a 1-pixel-wide quad, built the same way al_draw_line() does it
+	length = hypotf(x2 - x1, y2 - y1);
+	if (length == 0.0 || is_skipped_frame())
+		return 0;
+	if (!(v = alloc_render_vertices(ALLEGRO_PRIM_TRIANGLE_LIST, 6)))
+		return 0;
+	tx = 0.5 * (y2 - y1) / length;
+	ty = 0.5 * -(x2 - x1) / length;
+	vtx_color = nativecolor(color);
+	set_vertex(&v[0], x1 + tx, y1 + ty, vtx_color);
+	set_vertex(&v[1], x1 - tx, y1 - ty, vtx_color);
+	set_vertex(&v[2], x2 - tx, y2 - ty, vtx_color);
+	v[3] = v[0];
+	v[4] = v[2];
+	set_vertex(&v[5], x2 + tx, y2 + ty, vtx_color);
 	return 0;
 }
 
@@ -157,8 +184,10 @@ js_LineSeries(duk_context* ctx)
 	color_t color = duk_require_sphere_color(ctx, 1);
 	int type = n_args >= 3 ? duk_require_int(ctx, 2) : LINE_MULTIPLE;
 
+	int             num_lines;
 	size_t          num_points;
-	int             x, y;
+	float*          points;
+	float           x, y;
 	ALLEGRO_VERTEX* vertices;
 	ALLEGRO_COLOR   vtx_color;
 
@@ -166,28 +195,38 @@ js_LineSeries(duk_context* ctx)
 
 	if (!duk_is_array(ctx, 0))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "LineSeries(): First argument must be an array");
-	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, 0); duk_pop(ctx);
+	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, -1); duk_pop(ctx);
 	if (num_points < 2)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "LineSeries(): Two or more vertices required");
-	if (num_points > INT_MAX)
+	if (num_points > INT_MAX / 2)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "LineSeries(): Too many vertices");
-	if ((vertices = calloc(num_points, sizeof(ALLEGRO_VERTEX))) == NULL)
+	if (is_skipped_frame())
+		return 0;
+	
+	// everything is batched as a line list, so strips and loops are split
+	// into separate segments.
+	num_lines = type == LINE_STRIP ? (int)num_points - 1
+		: type == LINE_LOOP ? (int)num_points
+		: (int)num_points / 2;
+	points = duk_require_points(ctx, 0, num_points);
+	if (!(vertices = alloc_render_vertices(ALLEGRO_PRIM_LINE_LIST, num_lines * 2)))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "LineSeries(): Failed to allocate vertex buffer");
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
-		duk_get_prop_index(ctx, 0, (duk_uarridx_t)i);
-		duk_get_prop_string(ctx, 0, "x"); x = duk_require_int(ctx, -1); duk_pop(ctx);
-		duk_get_prop_string(ctx, 0, "y"); y = duk_require_int(ctx, -1); duk_pop(ctx);
-		duk_pop(ctx);
-		vertices[i].x = x + 0.5; vertices[i].y = y + 0.5;
-		vertices[i].color = vtx_color;
+		x = points[i * 2];
+		y = points[i * 2 + 1];
+		if (type == LINE_STRIP || type == LINE_LOOP) {
+			// each point ends one segment and starts the next
+			if (i > 0)
+				set_vertex(&vertices[i * 2 - 1], x + 0.5, y + 0.5, vtx_color);
+			if ((int)i < num_lines)
+				set_vertex(&vertices[i * 2], x + 0.5, y + 0.5, vtx_color);
+			if (i == 0 && type == LINE_LOOP)
+				set_vertex(&vertices[num_lines * 2 - 1], x + 0.5, y + 0.5, vtx_color);
+		}
+		else if ((int)i < num_lines * 2)
+			set_vertex(&vertices[i], x + 0.5, y + 0.5, vtx_color);
 	}
-	al_draw_prim(vertices, NULL, NULL, 0, (int)num_points,
-		type == LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
-			: type == LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
-			: ALLEGRO_PRIM_LINE_LIST
-		);
-	free(vertices);
 	return 0;
 }
 
@@ -205,6 +244,7 @@ js_OutlinedCircle(duk_context* ctx)
 	radius = duk_to_int(ctx, 2);
 	color = duk_require_sphere_color(ctx, 3);
 	if (n_args >= 5) antialiased = duk_require_boolean(ctx, 4);
+	reset_render_state();
 	if (!is_skipped_frame()) al_draw_circle(x, y, radius, nativecolor(color), 1);
 	return 0;
 }
@@ -223,8 +263,43 @@ js_OutlinedRectangle(duk_context* ctx)
 	y2 = y1 + duk_to_int(ctx, 3) - 1;
 	color = duk_require_sphere_color(ctx, 4);
 	int thickness = n_args >= 6 ? duk_to_int(ctx, 5) : 1;
-	if (!is_skipped_frame())
+
+	ALLEGRO_VERTEX  strip[10];
+	float           t;
+	ALLEGRO_VERTEX* v;
+	ALLEGRO_COLOR   vtx_color;
+
+	int i;
+	
+	if (is_skipped_frame())
+		return 0;
+	if (thickness <= 0) {
+		reset_render_state();
 		al_draw_rectangle(x1, y1, x2, y2, nativecolor(color), thickness);
+		return 0;
+	}
+	
+	// al_draw_rectangle() draws a 10-vertex triangle strip; unroll it into a
+	// list so that it can be batched
+	if (!(v = alloc_render_vertices(ALLEGRO_PRIM_TRIANGLE_LIST, 24)))
+		return 0;
+	t = thickness / 2.0;
+	vtx_color = nativecolor(color);
+	set_vertex(&strip[0], x1 - t, y1 - t, vtx_color);
+	set_vertex(&strip[1], x1 + t, y1 + t, vtx_color);
+	set_vertex(&strip[2], x2 + t, y1 - t, vtx_color);
+	set_vertex(&strip[3], x2 - t, y1 + t, vtx_color);
+	set_vertex(&strip[4], x2 + t, y2 + t, vtx_color);
+	set_vertex(&strip[5], x2 - t, y2 - t, vtx_color);
+	set_vertex(&strip[6], x1 - t, y2 + t, vtx_color);
+	set_vertex(&strip[7], x1 + t, y2 - t, vtx_color);
+	strip[8] = strip[0];
+	strip[9] = strip[1];
+	for (i = 0; i < 8; ++i) {
+		v[i * 3] = strip[i];
+		v[i * 3 + 1] = strip[i + 1];
+		v[i * 3 + 2] = strip[i + 2];
+	}
 	return 0;
 }
 
@@ -240,6 +315,7 @@ js_OutlinedRoundRectangle(duk_context* ctx)
 	color_t color = duk_require_sphere_color(ctx, 5);
 	int thickness = n_args >= 7 ? duk_require_int(ctx, 6) : 1;
 
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_rounded_rectangle(x, y, x + w - 1, y + h - 1, radius, radius, nativecolor(color), thickness);
 	return 0;
@@ -252,8 +328,10 @@ js_Point(duk_context* ctx)
 	float y = duk_require_int(ctx, 1) + 0.5;
 	color_t color = duk_require_sphere_color(ctx, 2);
 	
-	if (!is_skipped_frame())
-		al_draw_pixel(x, y, nativecolor(color));
+	ALLEGRO_VERTEX* v;
+	
+	if (!is_skipped_frame() && (v = alloc_render_vertices(ALLEGRO_PRIM_POINT_LIST, 1)))
+		set_vertex(v, x, y, nativecolor(color));
 	return 0;
 }
 
@@ -264,7 +342,7 @@ js_PointSeries(duk_context* ctx)
 	color_t color = duk_require_sphere_color(ctx, 1);
 
 	size_t          num_points;
-	int             x, y;
+	float*          points;
 	ALLEGRO_VERTEX* vertices;
 	ALLEGRO_COLOR   vtx_color;
 
@@ -272,24 +350,19 @@ js_PointSeries(duk_context* ctx)
 
 	if (!duk_is_array(ctx, 0))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "PointSeries(): First argument must be an array");
-	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, 0); duk_pop(ctx);
+	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, -1); duk_pop(ctx);
 	if (num_points < 1)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "PointSeries(): One or more vertices required");
 	if (num_points > INT_MAX)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "PointSeries(): Too many vertices");
-	if ((vertices = calloc(num_points, sizeof(ALLEGRO_VERTEX))) == NULL)
+	if (is_skipped_frame())
+		return 0;
+	points = duk_require_points(ctx, 0, num_points);
+	if (!(vertices = alloc_render_vertices(ALLEGRO_PRIM_POINT_LIST, (int)num_points)))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "PointSeries(): Failed to allocate vertex buffer");
 	vtx_color = nativecolor(color);
-	for (i = 0; i < num_points; ++i) {
-		duk_get_prop_index(ctx, 0, (duk_uarridx_t)i);
-		duk_get_prop_string(ctx, 0, "x"); x = duk_require_int(ctx, -1); duk_pop(ctx);
-		duk_get_prop_string(ctx, 0, "y"); y = duk_require_int(ctx, -1); duk_pop(ctx);
-		duk_pop(ctx);
-		vertices[i].x = x + 0.5; vertices[i].y = y + 0.5;
-		vertices[i].color = vtx_color;
-	}
-	al_draw_prim(vertices, NULL, NULL, 0, (int)num_points, ALLEGRO_PRIM_POINT_LIST);
-	free(vertices);
+	for (i = 0; i < num_points; ++i)
+		set_vertex(&vertices[i], points[i * 2] + 0.5, points[i * 2 + 1] + 0.5, vtx_color);
 	return 0;
 }
 
@@ -303,7 +376,7 @@ js_Rectangle(duk_context* ctx)
 	color_t color = duk_require_sphere_color(ctx, 4);
 
 	if (!is_skipped_frame())
-		al_draw_filled_rectangle(x, y, x + w, y + h, nativecolor(color));
+		batch_filled_rect(x, y, x + w, y + h, nativecolor(color));
 	return 0;
 }
 
@@ -317,6 +390,7 @@ js_RoundRectangle(duk_context* ctx)
 	float radius = duk_require_number(ctx, 4);
 	color_t color = duk_require_sphere_color(ctx, 5);
 
+	reset_render_state();
 	if (!is_skipped_frame())
 		al_draw_filled_rounded_rectangle(x, y, x + w, y + h, radius, radius, nativecolor(color));
 	return 0;
@@ -333,7 +407,60 @@ js_Triangle(duk_context* ctx)
 	int y3 = duk_require_int(ctx, 5);
 	color_t color = duk_require_sphere_color(ctx, 6);
 
-	if (!is_skipped_frame())
-		al_draw_filled_triangle(x1, y1, x2, y2, x3, y3, nativecolor(color));
+	ALLEGRO_VERTEX* v;
+	ALLEGRO_COLOR   vtx_color;
+
+	if (is_skipped_frame() || !(v = alloc_render_vertices(ALLEGRO_PRIM_TRIANGLE_LIST, 3)))
+		return 0;
+	vtx_color = nativecolor(color);
+	set_vertex(&v[0], x1, y1, vtx_color);
+	set_vertex(&v[1], x2, y2, vtx_color);
+	set_vertex(&v[2], x3, y3, vtx_color);
 	return 0;
 }
+
+static void
+batch_filled_rect(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color)
+{
+	ALLEGRO_VERTEX* v;
+
+	// two triangles split along the same diagonal as al_draw_filled_rectangle()
+	if (!(v = alloc_render_vertices(ALLEGRO_PRIM_TRIANGLE_LIST, 6)))
+		return;
+	set_vertex(&v[0], x1, y1, color);
+	set_vertex(&v[1], x1, y2, color);
+	set_vertex(&v[2], x2, y2, color);
+	v[3] = v[0];
+	v[4] = v[2];
+	set_vertex(&v[5], x2, y1, color);
+}
+
+static float*
+duk_require_points(duk_context* ctx, duk_idx_t index, size_t num_points)
+{
+	float* points;
+
+	size_t i;
+
+	// points are read out in full before any vertices are taken from the
+	// render batch: the x and y properties may be getters, which can draw
+	// and so flush or grow the batch. the buffer is left on the stack, so
+	// it's cleaned up along with everything else if a point is invalid.
+	index = duk_require_normalize_index(ctx, index);
+	points = duk_push_fixed_buffer(ctx, num_points * 2 * sizeof(float));
+	for (i = 0; i < num_points; ++i) {
+		duk_get_prop_index(ctx, index, (duk_uarridx_t)i);
+		duk_get_prop_string(ctx, -1, "x"); points[i * 2] = duk_require_int(ctx, -1); duk_pop(ctx);
+		duk_get_prop_string(ctx, -1, "y"); points[i * 2 + 1] = duk_require_int(ctx, -1); duk_pop(ctx);
+		duk_pop(ctx);
+	}
+	return points;
+}
+
+static void
+set_vertex(ALLEGRO_VERTEX* vertex, float x, float y, ALLEGRO_COLOR color)
+{
+	vertex->x = x; vertex->y = y; vertex->z = 0;
+	vertex->u = 0; vertex->v = 0;
+	vertex->color = color;
+}
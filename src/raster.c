@@ -0,0 +1,289 @@
+#include "minisphere.h"
+#include "color.h"
+#include "image.h"
+#include "surface.h"
+
+#include "raster.h"
+
+static void   blend_pixel (uint32_t* pixel, color_t color, int blend_mode);
+static void   blend_span  (uint32_t* row, int width, int x1, int x2, color_t color, int blend_mode);
+static rect_t clip_rect   (rect_t rect, int width, int height);
+static void   fill_rect   (uint32_t* pixels, int width, rect_t rect, color_t color, int blend_mode);
+static int    span_width  (int radius, int dist_y);
+
+void
+plot_circle(image_t* image, int x, int y, int radius, color_t color, bool is_filled, int blend_mode)
+{
+	rect_t    bounds;
+	int       dist_y;
+	int       inner_w, outer_w;
+	uint32_t* pixels;
+	uint32_t* row;
+	int       width, height;
+
+	int i_y;
+
+	if (radius < 0 || !(pixels = lock_image_pixels(image)))
+		return;
+	width = get_image_width(image);
+	height = get_image_height(image);
+	bounds = clip_rect(new_rect(x - radius, y - radius, x + radius + 1, y + radius + 1), width, height);
+	for (i_y = bounds.y1; i_y < bounds.y2; ++i_y) {
+		row = pixels + i_y * width;
+		dist_y = i_y - y;
+		outer_w = span_width(radius, dist_y);
+		inner_w = !is_filled && abs(dist_y) < radius
+			? span_width(radius - 1, dist_y) : -1;
+		if (inner_w < 0)
+			blend_span(row, width, x - outer_w, x + outer_w + 1, color, blend_mode);
+		else {
+			blend_span(row, width, x - outer_w, x - inner_w, color, blend_mode);
+			blend_span(row, width, x + inner_w + 1, x + outer_w + 1, color, blend_mode);
+		}
+	}
+	unlock_image_pixels(image, bounds);
+}
+
+void
+plot_gradient_rect(image_t* image, int x, int y, int width, int height, color_t color_ul, color_t color_ur, color_t color_lr, color_t color_ll, int blend_mode)
+{
+	rect_t    bounds;
+	float     frac_x, frac_y;
+	color_t   left, right;
+	uint32_t* pixels;
+	uint32_t* row;
+
+	int i_x, i_y;
+
+	if (width <= 0 || height <= 0 || !(pixels = lock_image_pixels(image)))
+		return;
+	bounds = clip_rect(new_rect(x, y, x + width, y + height), get_image_width(image), get_image_height(image));
+	for (i_y = bounds.y1; i_y < bounds.y2; ++i_y) {
+		// sample at pixel centers, like the GPU does when interpolating vertex colors
+		frac_y = (i_y - y + 0.5f) / height;
+		left = blend_colors(color_ul, color_ll, 1.0f - frac_y, frac_y);
+		right = blend_colors(color_ur, color_lr, 1.0f - frac_y, frac_y);
+		row = pixels + i_y * get_image_width(image);
+		for (i_x = bounds.x1; i_x < bounds.x2; ++i_x) {
+			frac_x = (i_x - x + 0.5f) / width;
+			blend_pixel(&row[i_x], blend_colors(left, right, 1.0f - frac_x, frac_x), blend_mode);
+		}
+	}
+	unlock_image_pixels(image, bounds);
+}
+
+void
+plot_image(image_t* image, image_t* src_image, int x, int y, color_t mask, int blend_mode)
+{
+	rect_t    bounds;
+	color_t   color;
+	bool      is_masked;
+	uint32_t* pixels;
+	uint32_t* src_pixels;
+	uint32_t* src_row;
+	uint32_t* row;
+	int       src_w, src_h;
+	int       width;
+
+	int i_x, i_y;
+
+	if (!(src_pixels = lock_image_pixels(src_image)) || !(pixels = lock_image_pixels(image)))
+		return;
+	width = get_image_width(image);
+	src_w = get_image_width(src_image);
+	src_h = get_image_height(src_image);
+	is_masked = mask.r != 255 || mask.g != 255 || mask.b != 255 || mask.alpha != 255;
+	bounds = clip_rect(new_rect(x, y, x + src_w, y + src_h), width, get_image_height(image));
+	for (i_y = bounds.y1; i_y < bounds.y2; ++i_y) {
+		row = pixels + i_y * width;
+		src_row = src_pixels + (i_y - y) * src_w - x;
+		if (blend_mode == BLEND_REPLACE && !is_masked) {
+			memmove(row + bounds.x1, src_row + bounds.x1, (bounds.x2 - bounds.x1) * 4);
+			continue;
+		}
+		for (i_x = bounds.x1; i_x < bounds.x2; ++i_x) {
+			memcpy(&color, &src_row[i_x], sizeof(uint32_t));
+			if (is_masked) {
+				color.r = (color.r * mask.r + 127) / 255;
+				color.g = (color.g * mask.g + 127) / 255;
+				color.b = (color.b * mask.b + 127) / 255;
+				color.alpha = (color.alpha * mask.alpha + 127) / 255;
+			}
+			blend_pixel(&row[i_x], color, blend_mode);
+		}
+	}
+	unlock_image_pixels(src_image, new_rect(0, 0, 0, 0));
+	unlock_image_pixels(image, bounds);
+}
+
+void
+plot_line(image_t* image, int x1, int y1, int x2, int y2, color_t color, int blend_mode)
+{
+	rect_t    bounds;
+	int       delta_x, delta_y;
+	int       error, error_2;
+	uint32_t* pixels;
+	int       step_x, step_y;
+	int       width, height;
+
+	if (!(pixels = lock_image_pixels(image)))
+		return;
+	width = get_image_width(image);
+	height = get_image_height(image);
+	bounds = clip_rect(new_rect(fmin(x1, x2), fmin(y1, y2), fmax(x1, x2) + 1, fmax(y1, y2) + 1), width, height);
+	delta_x = abs(x2 - x1); step_x = x1 < x2 ? 1 : -1;
+	delta_y = -abs(y2 - y1); step_y = y1 < y2 ? 1 : -1;
+	error = delta_x + delta_y;
+	while (true) {
+		if (x1 >= 0 && y1 >= 0 && x1 < width && y1 < height)
+			blend_pixel(pixels + x1 + y1 * width, color, blend_mode);
+		if (x1 == x2 && y1 == y2)
+			break;
+		error_2 = error * 2;
+		if (error_2 >= delta_y) { error += delta_y; x1 += step_x; }
+		if (error_2 <= delta_x) { error += delta_x; y1 += step_y; }
+	}
+	unlock_image_pixels(image, bounds);
+}
+
+void
+plot_outline_rect(image_t* image, int x, int y, int width, int height, int thickness, color_t color, int blend_mode)
+{
+	int       image_w, image_h;
+	uint32_t* pixels;
+	rect_t    rect;
+
+	if (width <= 0 || height <= 0 || thickness <= 0 || !(pixels = lock_image_pixels(image)))
+		return;
+	image_w = get_image_width(image);
+	image_h = get_image_height(image);
+	rect = new_rect(x, y, x + width, y + height);
+	if (thickness * 2 >= width || thickness * 2 >= height)
+		fill_rect(pixels, image_w, clip_rect(rect, image_w, image_h), color, blend_mode);
+	else {
+		// the four sides are split so that no pixel is blended twice
+		fill_rect(pixels, image_w, clip_rect(new_rect(x, y, x + width, y + thickness), image_w, image_h), color, blend_mode);
+		fill_rect(pixels, image_w, clip_rect(new_rect(x, y + height - thickness, x + width, y + height), image_w, image_h), color, blend_mode);
+		fill_rect(pixels, image_w, clip_rect(new_rect(x, y + thickness, x + thickness, y + height - thickness), image_w, image_h), color, blend_mode);
+		fill_rect(pixels, image_w, clip_rect(new_rect(x + width - thickness, y + thickness, x + width, y + height - thickness), image_w, image_h), color, blend_mode);
+	}
+	unlock_image_pixels(image, clip_rect(rect, image_w, image_h));
+}
+
+void
+plot_point(image_t* image, int x, int y, color_t color, int blend_mode)
+{
+	uint32_t* pixels;
+	int       width;
+
+	if (x < 0 || y < 0 || x >= get_image_width(image) || y >= get_image_height(image))
+		return;
+	if (!(pixels = lock_image_pixels(image)))
+		return;
+	width = get_image_width(image);
+	blend_pixel(pixels + x + y * width, color, blend_mode);
+	unlock_image_pixels(image, new_rect(x, y, x + 1, y + 1));
+}
+
+void
+plot_rect(image_t* image, int x, int y, int width, int height, color_t color, int blend_mode)
+{
+	rect_t    bounds;
+	uint32_t* pixels;
+
+	if (!(pixels = lock_image_pixels(image)))
+		return;
+	bounds = clip_rect(new_rect(x, y, x + width, y + height), get_image_width(image), get_image_height(image));
+	fill_rect(pixels, get_image_width(image), bounds, color, blend_mode);
+	unlock_image_pixels(image, bounds);
+}
+
+static void
+blend_pixel(uint32_t* pixel, color_t color, int blend_mode)
+{
+	int      alpha, inv_alpha;
+	uint8_t* dest = (uint8_t*)pixel;
+	int      value;
+
+	// blend modes not listed here fall back to BLEND_BLEND, which is also what
+	// apply_blend_mode() does for hardware drawing.
+	switch (blend_mode) {
+	case BLEND_REPLACE:
+		memcpy(pixel, &color, sizeof(uint32_t));
+		break;
+	case BLEND_ADD:
+		value = dest[0] + color.r; dest[0] = value > 255 ? 255 : value;
+		value = dest[1] + color.g; dest[1] = value > 255 ? 255 : value;
+		value = dest[2] + color.b; dest[2] = value > 255 ? 255 : value;
+		value = dest[3] + color.alpha; dest[3] = value > 255 ? 255 : value;
+		break;
+	case BLEND_SUBTRACT:
+		value = dest[0] - color.r; dest[0] = value < 0 ? 0 : value;
+		value = dest[1] - color.g; dest[1] = value < 0 ? 0 : value;
+		value = dest[2] - color.b; dest[2] = value < 0 ? 0 : value;
+		value = dest[3] - color.alpha; dest[3] = value < 0 ? 0 : value;
+		break;
+	default:
+		// ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA, applied to all four channels
+		if (color.alpha == 255)
+			memcpy(pixel, &color, sizeof(uint32_t));
+		else if (color.alpha > 0) {
+			alpha = color.alpha;
+			inv_alpha = 255 - alpha;
+			dest[0] = (color.r * alpha + dest[0] * inv_alpha + 127) / 255;
+			dest[1] = (color.g * alpha + dest[1] * inv_alpha + 127) / 255;
+			dest[2] = (color.b * alpha + dest[2] * inv_alpha + 127) / 255;
+			dest[3] = (color.alpha * alpha + dest[3] * inv_alpha + 127) / 255;
+		}
+		break;
+	}
+}
+
+static void
+blend_span(uint32_t* row, int width, int x1, int x2, color_t color, int blend_mode)
+{
+	uint32_t value;
+
+	int i_x;
+
+	x1 = x1 < 0 ? 0 : x1;
+	x2 = x2 > width ? width : x2;
+	if (blend_mode == BLEND_REPLACE || (color.alpha == 255 && blend_mode != BLEND_ADD && blend_mode != BLEND_SUBTRACT)) {
+		memcpy(&value, &color, sizeof(uint32_t));
+		for (i_x = x1; i_x < x2; ++i_x)
+			row[i_x] = value;
+	}
+	else {
+		for (i_x = x1; i_x < x2; ++i_x)
+			blend_pixel(&row[i_x], color, blend_mode);
+	}
+}
+
+static rect_t
+clip_rect(rect_t rect, int width, int height)
+{
+	rect.x1 = fmax(rect.x1, 0);
+	rect.y1 = fmax(rect.y1, 0);
+	rect.x2 = fmin(rect.x2, width);
+	rect.y2 = fmin(rect.y2, height);
+	if (rect.x2 < rect.x1) rect.x2 = rect.x1;
+	if (rect.y2 < rect.y1) rect.y2 = rect.y1;
+	return rect;
+}
+
+static void
+fill_rect(uint32_t* pixels, int width, rect_t rect, color_t color, int blend_mode)
+{
+	int i_y;
+
+	for (i_y = rect.y1; i_y < rect.y2; ++i_y)
+		blend_span(pixels + i_y * width, width, rect.x1, rect.x2, color, blend_mode);
+}
+
+static int
+span_width(int radius, int dist_y)
+{
+	// half-width of a circle's span at a given distance from its center,
+	// measured to pixel centers so that the outline looks round
+	return sqrt((radius + 0.5) * (radius + 0.5) - dist_y * dist_y);
+}
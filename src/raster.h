@@ -0,0 +1,16 @@
+#ifndef MINISPHERE__RASTER_H__INCLUDED
+#define MINISPHERE__RASTER_H__INCLUDED
+
+// software rasterizer: these draw straight into an image's CPU-side pixels
+// using Surface blend modes. nothing touches the GPU until the image is
+// drawn or used as a render target.
+
+extern void plot_circle        (image_t* image, int x, int y, int radius, color_t color, bool is_filled, int blend_mode);
+extern void plot_gradient_rect (image_t* image, int x, int y, int width, int height, color_t color_ul, color_t color_ur, color_t color_lr, color_t color_ll, int blend_mode);
+extern void plot_image         (image_t* image, image_t* src_image, int x, int y, color_t mask, int blend_mode);
+extern void plot_line          (image_t* image, int x1, int y1, int x2, int y2, color_t color, int blend_mode);
+extern void plot_outline_rect  (image_t* image, int x, int y, int width, int height, int thickness, color_t color, int blend_mode);
+extern void plot_point         (image_t* image, int x, int y, color_t color, int blend_mode);
+extern void plot_rect          (image_t* image, int x, int y, int width, int height, color_t color, int blend_mode);
+
+#endif // MINISPHERE__RASTER_H__INCLUDED
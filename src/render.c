@@ -0,0 +1,141 @@
+#include "minisphere.h"
+
+#include "render.h"
+
+// note: drawing to a Surface or other offscreen bitmap changes the render
+//       target and often the blender. rather than switching back after every
+//       such operation, the old state is left in place and only put back by
+//       reset_render_state() once something is drawn to the screen again. a
+//       loop drawing into the same bitmap therefore only switches once.
+
+// note: untextured primitives drawn to the screen aren't drawn right away.
+//       their vertices are collected into a batch which is drawn in a single
+//       al_draw_prim() call once something else needs the GPU: a change of
+//       target, blender or primitive type, any call to reset_render_state()
+//       (which every non-batched draw makes first), or the end of the frame.
+
+static ALLEGRO_VERTEX* s_batch            = NULL;
+static int             s_batch_size       = 0;
+static int             s_batch_type       = ALLEGRO_PRIM_TRIANGLE_LIST;
+static int             s_num_batch_verts  = 0;
+static int             s_num_blenders     = 0;
+static int             s_num_flushes      = 0;
+static int             s_num_prims        = 0;
+static int             s_num_targets      = 0;
+static int             s_last_num_blenders = 0;
+static int             s_last_num_flushes  = 0;
+static int             s_last_num_prims    = 0;
+static int             s_last_num_targets  = 0;
+
+void
+initialize_render(void)
+{
+	printf("Initializing render state\n");
+	s_num_batch_verts = 0;
+	s_num_blenders = s_num_flushes = s_num_prims = s_num_targets = 0;
+	s_last_num_blenders = s_last_num_flushes = s_last_num_prims = s_last_num_targets = 0;
+}
+
+void
+shutdown_render(void)
+{
+	printf("Shutting down render state\n");
+	free(s_batch);
+	s_batch = NULL;
+	s_batch_size = 0;
+	s_num_batch_verts = 0;
+}
+
+void
+get_render_stats(int* out_num_targets, int* out_num_blenders, int* out_num_prims, int* out_num_flushes)
+{
+	// stats are for the last complete frame
+	if (out_num_targets) *out_num_targets = s_last_num_targets;
+	if (out_num_blenders) *out_num_blenders = s_last_num_blenders;
+	if (out_num_prims) *out_num_prims = s_last_num_prims;
+	if (out_num_flushes) *out_num_flushes = s_last_num_flushes;
+}
+
+void
+set_render_blender(int op, int src, int dest)
+{
+	int old_op, old_src, old_dest;
+
+	al_get_blender(&old_op, &old_src, &old_dest);
+	if (op == old_op && src == old_src && dest == old_dest)
+		return;
+	flush_render_batch();
+	al_set_blender(op, src, dest);
+	++s_num_blenders;
+}
+
+void
+set_render_target(ALLEGRO_BITMAP* bitmap)
+{
+	if (al_get_target_bitmap() == bitmap)
+		return;
+	flush_render_batch();
+	al_set_target_bitmap(bitmap);
+	++s_num_targets;
+}
+
+ALLEGRO_VERTEX*
+alloc_render_vertices(int prim_type, int num_vertices)
+{
+	ALLEGRO_VERTEX* new_batch;
+	int             new_size;
+	ALLEGRO_VERTEX* vertices;
+
+	set_render_target(al_get_backbuffer(g_display));
+	set_render_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
+	if (prim_type != s_batch_type)
+		flush_render_batch();
+	if (s_num_batch_verts + num_vertices > s_batch_size) {
+		// the batch buffer is kept between frames, so after the first few
+		// frames this practically never happens.
+		new_size = s_batch_size > 0 ? s_batch_size : 256;
+		while (new_size < s_num_batch_verts + num_vertices)
+			new_size *= 2;
+		if (!(new_batch = realloc(s_batch, new_size * sizeof(ALLEGRO_VERTEX))))
+			return NULL;
+		s_batch = new_batch;
+		s_batch_size = new_size;
+	}
+	vertices = s_batch + s_num_batch_verts;
+	s_num_batch_verts += num_vertices;
+	s_batch_type = prim_type;
+	++s_num_prims;
+	return vertices;
+}
+
+void
+end_render_frame(void)
+{
+	reset_render_state();
+	s_last_num_blenders = s_num_blenders;
+	s_last_num_flushes = s_num_flushes;
+	s_last_num_prims = s_num_prims;
+	s_last_num_targets = s_num_targets;
+	s_num_blenders = 0;
+	s_num_flushes = 0;
+	s_num_prims = 0;
+	s_num_targets = 0;
+}
+
+void
+flush_render_batch(void)
+{
+	if (s_num_batch_verts == 0)
+		return;
+	al_draw_prim(s_batch, NULL, NULL, 0, s_num_batch_verts, s_batch_type);
+	s_num_batch_verts = 0;
+	++s_num_flushes;
+}
+
+void
+reset_render_state(void)
+{
+	flush_render_batch();
+	set_render_target(al_get_backbuffer(g_display));
+	set_render_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
+}
@@ -0,0 +1,15 @@
+#ifndef MINISPHERE__RENDER_H__INCLUDED
+#define MINISPHERE__RENDER_H__INCLUDED
+
+extern void initialize_render (void);
+extern void shutdown_render   (void);
+
+extern void            get_render_stats      (int* out_num_targets, int* out_num_blenders, int* out_num_prims, int* out_num_flushes);
+extern void            set_render_blender    (int op, int src, int dest);
+extern void            set_render_target     (ALLEGRO_BITMAP* bitmap);
+extern ALLEGRO_VERTEX* alloc_render_vertices (int prim_type, int num_vertices);
+extern void            end_render_frame      (void);
+extern void            flush_render_batch    (void);
+extern void            reset_render_state    (void);
+
+#endif // MINISPHERE__RENDER_H__INCLUDED
@@ -0,0 +1,328 @@
+#include "minisphere.h"
+#include "api.h"
+#include "bytearray.h"
+#include "color.h"
+#include "image.h"
+#include "render.h"
+
+#include "spritebatch.h"
+
+// note: a SpriteBatch draws any number of copies of one image, or of parts
+//       of it when the image is an atlas, in a single draw call. scripts
+//       hand over the whole list of sprites at once, either as a flat array
+//       of numbers or packed into a ByteArray, and the vertices are built
+//       here rather than each sprite being its own blit call. the vertex
+//       array is kept between draws, so once it's grown to fit the largest
+//       list drawn, building a frame doesn't allocate.
+
+#define SPRITE_FIELDS  9
+#define SPRITE_BYTES   (SPRITE_FIELDS * 4)
+
+static duk_ret_t js_new_SpriteBatch       (duk_context* ctx);
+static duk_ret_t js_SpriteBatch_finalize  (duk_context* ctx);
+static duk_ret_t js_SpriteBatch_get_image (duk_context* ctx);
+static duk_ret_t js_SpriteBatch_set_image (duk_context* ctx);
+static duk_ret_t js_SpriteBatch_draw      (duk_context* ctx);
+
+static float    read_float_le  (const uint8_t* p);
+static uint32_t read_uint32_le (const uint8_t* p);
+
+struct spritebatch
+{
+	unsigned int    refcount;
+	image_t*        image;
+	int             max_vertices;
+	int             num_vertices;
+	ALLEGRO_VERTEX* vertices;
+};
+
+spritebatch_t*
+new_spritebatch(image_t* image)
+{
+	spritebatch_t* batch;
+
+	if (!(batch = calloc(1, sizeof(spritebatch_t))))
+		return NULL;
+	batch->image = ref_image(image);
+	return ref_spritebatch(batch);
+}
+
+spritebatch_t*
+ref_spritebatch(spritebatch_t* batch)
+{
+	if (batch != NULL)
+		++batch->refcount;
+	return batch;
+}
+
+void
+free_spritebatch(spritebatch_t* batch)
+{
+	if (batch == NULL || --batch->refcount > 0)
+		return;
+	free_image(batch->image);
+	free(batch->vertices);
+	free(batch);
+}
+
+image_t*
+get_spritebatch_image(const spritebatch_t* batch)
+{
+	return batch->image;
+}
+
+int
+get_spritebatch_length(const spritebatch_t* batch)
+{
+	return batch->num_vertices / 6;
+}
+
+void
+set_spritebatch_image(spritebatch_t* batch, image_t* image)
+{
+	image_t* old_image;
+
+	old_image = batch->image;
+	batch->image = ref_image(image);
+	free_image(old_image);
+}
+
+bool
+add_sprite(spritebatch_t* batch, const sprite_t* sprite)
+{
+	float           cos_angle, sin_angle;
+	ALLEGRO_COLOR   color;
+	float           cx, cy;
+	float           dx[4], dy[4];
+	float           h_half, w_half;
+	int             new_max;
+	ALLEGRO_VERTEX* new_vertices;
+	float           src_w, src_h;
+	float           u1, v1, u2, v2;
+	ALLEGRO_VERTEX* v;
+
+	int i;
+
+	if (batch->num_vertices + 6 > batch->max_vertices) {
+		new_max = batch->max_vertices > 0 ? batch->max_vertices * 2 : 6 * 64;
+		if (!(new_vertices = realloc(batch->vertices, new_max * sizeof(ALLEGRO_VERTEX))))
+			return false;
+		batch->vertices = new_vertices;
+		batch->max_vertices = new_max;
+	}
+
+	// a source size of zero means the whole image
+	src_w = sprite->src_width > 0.0 ? sprite->src_width
+		: batch->image != NULL ? get_image_width(batch->image) : 0;
+	src_h = sprite->src_height > 0.0 ? sprite->src_height
+		: batch->image != NULL ? get_image_height(batch->image) : 0;
+	u1 = sprite->src_x; u2 = sprite->src_x + src_w;
+	v1 = sprite->src_y; v2 = sprite->src_y + src_h;
+
+	// (x, y) is the top left of the scaled sprite, which is rotated about its
+	// center. with no scaling or rotation, this matches Image:blit().
+	w_half = src_w * sprite->scale / 2;
+	h_half = src_h * sprite->scale / 2;
+	cx = sprite->x + w_half;
+	cy = sprite->y + h_half;
+	cos_angle = sprite->angle != 0.0 ? cos(sprite->angle) : 1.0;
+	sin_angle = sprite->angle != 0.0 ? sin(sprite->angle) : 0.0;
+	dx[0] = -w_half; dy[0] = -h_half;
+	dx[1] = w_half; dy[1] = -h_half;
+	dx[2] = -w_half; dy[2] = h_half;
+	dx[3] = w_half; dy[3] = h_half;
+	color = nativecolor(sprite->color);
+	v = batch->vertices + batch->num_vertices;
+	for (i = 0; i < 4; ++i) {
+		v[i].x = cx + dx[i] * cos_angle - dy[i] * sin_angle;
+		v[i].y = cy + dx[i] * sin_angle + dy[i] * cos_angle;
+		v[i].z = 0;
+		v[i].u = i % 2 == 0 ? u1 : u2;
+		v[i].v = i < 2 ? v1 : v2;
+		v[i].color = color;
+	}
+
+	// corners are top left, top right, bottom left, bottom right; turn them
+	// into two triangles
+	v[4] = v[1];
+	v[5] = v[3];
+	v[3] = v[2];
+	batch->num_vertices += 6;
+	return true;
+}
+
+void
+clear_spritebatch(spritebatch_t* batch)
+{
+	batch->num_vertices = 0;
+}
+
+void
+draw_spritebatch(spritebatch_t* batch)
+{
+	if (batch->num_vertices == 0 || batch->image == NULL)
+		return;
+	al_draw_prim(batch->vertices, NULL, get_image_bitmap(batch->image),
+		0, batch->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+}
+
+static float
+read_float_le(const uint8_t* p)
+{
+	float    value;
+	uint32_t bits;
+
+	bits = read_uint32_le(p);
+	memcpy(&value, &bits, sizeof(float));
+	return value;
+}
+
+static uint32_t
+read_uint32_le(const uint8_t* p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void
+init_spritebatch_api(void)
+{
+	register_api_ctor(g_duk, "SpriteBatch", js_new_SpriteBatch, js_SpriteBatch_finalize);
+	register_api_prop(g_duk, "SpriteBatch", "image", js_SpriteBatch_get_image, js_SpriteBatch_set_image);
+	register_api_function(g_duk, "SpriteBatch", "draw", js_SpriteBatch_draw);
+}
+
+static duk_ret_t
+js_new_SpriteBatch(duk_context* ctx)
+{
+	image_t* image = duk_require_sphere_image(ctx, 0);
+
+	spritebatch_t* batch;
+
+	if (!(batch = new_spritebatch(image)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "SpriteBatch(): Failed to create sprite batch");
+	duk_push_sphere_obj(ctx, "SpriteBatch", batch);
+	return 1;
+}
+
+static duk_ret_t
+js_SpriteBatch_finalize(duk_context* ctx)
+{
+	spritebatch_t* batch;
+
+	batch = duk_require_sphere_obj(ctx, 0, "SpriteBatch");
+	free_spritebatch(batch);
+	return 0;
+}
+
+static duk_ret_t
+js_SpriteBatch_get_image(duk_context* ctx)
+{
+	spritebatch_t* batch;
+
+	duk_push_this(ctx);
+	batch = duk_require_sphere_obj(ctx, -1, "SpriteBatch");
+	duk_pop(ctx);
+	duk_push_sphere_image(ctx, get_spritebatch_image(batch));
+	return 1;
+}
+
+static duk_ret_t
+js_SpriteBatch_set_image(duk_context* ctx)
+{
+	image_t* image = duk_require_sphere_image(ctx, 0);
+
+	spritebatch_t* batch;
+
+	duk_push_this(ctx);
+	batch = duk_require_sphere_obj(ctx, -1, "SpriteBatch");
+	duk_pop(ctx);
+	set_spritebatch_image(batch, image);
+	return 0;
+}
+
+static duk_ret_t
+js_SpriteBatch_draw(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	bool is_packed = duk_is_sphere_obj(ctx, 0, "ByteArray");
+
+	bytearray_t*   array;
+	spritebatch_t* batch;
+	const uint8_t* buffer;
+	uint32_t       color_bits;
+	int            count;
+	int            max_count;
+	const uint8_t* p;
+	sprite_t       sprite;
+	duk_idx_t      stack_idx;
+
+	int i, j;
+
+	duk_push_this(ctx);
+	batch = duk_require_sphere_obj(ctx, -1, "SpriteBatch");
+	duk_pop(ctx);
+	if (is_packed) {
+		array = duk_require_sphere_bytearray(ctx, 0);
+		max_count = get_bytearray_size(array) / SPRITE_BYTES;
+	}
+	else {
+		duk_require_object_coercible(ctx, 0);
+		if (!duk_is_array(ctx, 0))
+			duk_error_ni(ctx, -1, DUK_ERR_TYPE_ERROR, "SpriteBatch:draw(): First argument must be an array or ByteArray");
+		max_count = (int)(duk_get_length(ctx, 0) / SPRITE_FIELDS);
+	}
+	count = n_args >= 2 ? duk_require_int(ctx, 1) : max_count;
+	if (count < 0 || count > max_count)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "SpriteBatch:draw(): Sprite count out of range (%i, max %i)", count, max_count);
+	if (is_skipped_frame())
+		return 0;
+
+	clear_spritebatch(batch);
+	if (is_packed) {
+		// packed sprites are 9 little-endian 32-bit fields: the color is
+		// 4 bytes of R, G, B, A and everything else is a float
+		buffer = get_bytearray_buffer(array);
+		for (i = 0; i < count; ++i) {
+			p = buffer + i * SPRITE_BYTES;
+			sprite.x = read_float_le(p);
+			sprite.y = read_float_le(p + 4);
+			sprite.scale = read_float_le(p + 8);
+			sprite.angle = read_float_le(p + 12);
+			sprite.color = rgba(p[16], p[17], p[18], p[19]);
+			sprite.src_x = read_float_le(p + 20);
+			sprite.src_y = read_float_le(p + 24);
+			sprite.src_width = read_float_le(p + 28);
+			sprite.src_height = read_float_le(p + 32);
+			if (!add_sprite(batch, &sprite))
+				duk_error_ni(ctx, -1, DUK_ERR_ERROR, "SpriteBatch:draw(): Vertex allocation failure");
+		}
+	}
+	else {
+		// the color can be a Color object or a number, 0xRRGGBBAA
+		for (i = 0; i < count; ++i) {
+			stack_idx = duk_get_top(ctx);
+			for (j = 0; j < SPRITE_FIELDS; ++j)
+				duk_get_prop_index(ctx, 0, i * SPRITE_FIELDS + j);
+			sprite.x = duk_require_number(ctx, stack_idx);
+			sprite.y = duk_require_number(ctx, stack_idx + 1);
+			sprite.scale = duk_require_number(ctx, stack_idx + 2);
+			sprite.angle = duk_require_number(ctx, stack_idx + 3);
+			if (duk_is_number(ctx, stack_idx + 4)) {
+				color_bits = duk_to_uint32(ctx, stack_idx + 4);
+				sprite.color = rgba(color_bits >> 24, color_bits >> 16, color_bits >> 8, color_bits);
+			}
+			else
+				sprite.color = duk_require_sphere_color(ctx, stack_idx + 4);
+			sprite.src_x = duk_require_number(ctx, stack_idx + 5);
+			sprite.src_y = duk_require_number(ctx, stack_idx + 6);
+			sprite.src_width = duk_require_number(ctx, stack_idx + 7);
+			sprite.src_height = duk_require_number(ctx, stack_idx + 8);
+			duk_pop_n(ctx, SPRITE_FIELDS);
+			if (!add_sprite(batch, &sprite))
+				duk_error_ni(ctx, -1, DUK_ERR_ERROR, "SpriteBatch:draw(): Vertex allocation failure");
+		}
+	}
+	reset_render_state();
+	draw_spritebatch(batch);
+	return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef MINISPHERE__SPRITEBATCH_H__INCLUDED
+#define MINISPHERE__SPRITEBATCH_H__INCLUDED
+
+#include "color.h"
+#include "image.h"
+
+typedef struct spritebatch spritebatch_t;
+typedef struct sprite      sprite_t;
+
+struct sprite
+{
+	float   x, y;
+	float   scale;
+	float   angle;
+	color_t color;
+	float   src_x, src_y;
+	float   src_width, src_height;
+};
+
+extern spritebatch_t* new_spritebatch        (image_t* image);
+extern spritebatch_t* ref_spritebatch        (spritebatch_t* batch);
+extern void           free_spritebatch       (spritebatch_t* batch);
+extern image_t*       get_spritebatch_image  (const spritebatch_t* batch);
+extern int            get_spritebatch_length (const spritebatch_t* batch);
+extern void           set_spritebatch_image  (spritebatch_t* batch, image_t* image);
+extern bool           add_sprite             (spritebatch_t* batch, const sprite_t* sprite);
+extern void           clear_spritebatch      (spritebatch_t* batch);
+extern void           draw_spritebatch       (spritebatch_t* batch);
+
+extern void init_spritebatch_api (void);
+
+#endif // MINISPHERE__SPRITEBATCH_H__INCLUDED
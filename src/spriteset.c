@@ -1,5 +1,6 @@
 #include "minisphere.h"
 #include "api.h"
+#include "atlas.h"
 #include "image.h"
 
 #include "spriteset.h"
@@ -59,6 +60,22 @@ static duk_ret_t js_Spriteset_set_image    (duk_context* ctx);
 
 static const spriteset_pose_t* find_sprite_pose (const spriteset_t* spriteset, const char* pose_name);
 
+static atlas_t* s_atlas = NULL;
+
+void
+initialize_spritesets(void)
+{
+	printf("Initializing spriteset manager\n");
+}
+
+void
+shutdown_spritesets(void)
+{
+	printf("Shutting down spriteset manager\n");
+	free_atlas(s_atlas);
+	s_atlas = NULL;
+}
+
 spriteset_t*
 clone_spriteset(const spriteset_t* spriteset)
 {
@@ -71,6 +88,8 @@ clone_spriteset(const spriteset_t* spriteset)
 	clone->base = spriteset->base;
 	clone->num_images = spriteset->num_images;
 	clone->num_poses = spriteset->num_poses;
+	clone->max_width = spriteset->max_width;
+	clone->max_height = spriteset->max_height;
 	clone->images = calloc(clone->num_images, sizeof(image_t*));
 	clone->poses = calloc(clone->num_poses, sizeof(spriteset_pose_t));
 	if (clone->images == NULL || clone->poses == NULL) goto on_error;
@@ -127,6 +146,10 @@ load_spriteset(const char* path)
 	long                v2_data_offset;
 	int                 i, j;
 
+	// frames from all spritesets are packed into shared atlas pages, so that
+	// a map full of persons can be drawn in a handful of batches.
+	if (s_atlas == NULL && !(s_atlas = create_atlas(1024, 1024)))
+		return NULL;
 	if ((spriteset = calloc(1, sizeof(spriteset_t))) == NULL) goto on_error;
 	if (!(file = fopen(path, "rb"))) goto on_error;
 	if (fread(&rss, sizeof(struct rss_header), 1, file) != 1)
@@ -145,8 +168,9 @@ load_spriteset(const char* path)
 			spriteset->poses[i].name = lstring_from_cstr(def_dir_names[i]);
 		if ((spriteset->images = calloc(spriteset->num_images, sizeof(image_t*))) == NULL)
 			goto on_error;
+		reserve_atlas_space(s_atlas, rss.frame_width, rss.frame_height, spriteset->num_images);
 		for (i = 0; i < spriteset->num_images; ++i) {
-			if ((spriteset->images[i] = read_image(file, rss.frame_width, rss.frame_height)) == NULL)
+			if ((spriteset->images[i] = read_atlas_image(s_atlas, file, rss.frame_width, rss.frame_height)) == NULL)
 				goto on_error;
 		}
 		for (i = 0; i < spriteset->num_poses; ++i) {
@@ -178,6 +202,9 @@ load_spriteset(const char* path)
 			for (j = 0; j < dir_v2.num_frames; ++j) {  // skip over frame and image data
 				if (fread(&frame_v2, sizeof(struct rss_frame_v2), 1, file) != 1)
 					goto on_error;
+				reserve_atlas_space(s_atlas,
+					rss.frame_width != 0 ? rss.frame_width : frame_v2.width,
+					rss.frame_height != 0 ? rss.frame_height : frame_v2.height, 1);
 				skip_size = (rss.frame_width != 0 ? rss.frame_width : frame_v2.width)
 					* (rss.frame_height != 0 ? rss.frame_height : frame_v2.height)
 					* 4;
@@ -196,9 +223,11 @@ load_spriteset(const char* path)
 			for (j = 0; j < dir_v2.num_frames; ++j) {
 				if (fread(&frame_v2, sizeof(struct rss_frame_v2), 1, file) != 1)
 					goto on_error;
-				spriteset->images[image_index] = read_image(file,
+				spriteset->images[image_index] = read_atlas_image(s_atlas, file,
 					rss.frame_width != 0 ? rss.frame_width : frame_v2.width,
 					rss.frame_height != 0 ? rss.frame_height : frame_v2.height);
+				if (spriteset->images[image_index] == NULL)
+					goto on_error;
 				spriteset->poses[i].frames[j].image_idx = image_index;
 				spriteset->poses[i].frames[j].delay = frame_v2.delay;
 				++image_index;
@@ -212,8 +241,9 @@ load_spriteset(const char* path)
 			goto on_error;
 		if ((spriteset->poses = calloc(spriteset->num_poses, sizeof(spriteset_pose_t))) == NULL)
 			goto on_error;
+		reserve_atlas_space(s_atlas, rss.frame_width, rss.frame_height, rss.num_images);
 		for (i = 0; i < rss.num_images; ++i) {
-			if ((spriteset->images[i] = read_image(file, rss.frame_width, rss.frame_height)) == NULL)
+			if ((spriteset->images[i] = read_atlas_image(s_atlas, file, rss.frame_width, rss.frame_height)) == NULL)
 				goto on_error;
 		}
 		for (i = 0; i < rss.num_directions; ++i) {
@@ -236,6 +266,14 @@ load_spriteset(const char* path)
 	}
 	fclose(file);
 	
+	// RSSv2 frames can differ in size, so the first frame isn't always the
+	// biggest one. the largest is found once here, as the map engine needs
+	// it for every person it renders.
+	for (i = 0; i < spriteset->num_images; ++i) {
+		spriteset->max_width = fmax(spriteset->max_width, get_image_width(spriteset->images[i]));
+		spriteset->max_height = fmax(spriteset->max_height, get_image_height(spriteset->images[i]));
+	}
+	
 	// get spriteset path relative to game directory
 	base_path = get_asset_path("~/", NULL, false);
 	path += strstr(path, base_path) ? strlen(base_path) : 0;
@@ -249,6 +287,11 @@ load_spriteset(const char* path)
 on_error:
 	if (file != NULL) fclose(file);
 	if (spriteset != NULL) {
+		if (spriteset->images != NULL) {
+			for (i = 0; i < spriteset->num_images; ++i)
+				free_image(spriteset->images[i]);
+			free(spriteset->images);
+		}
 		if (spriteset->poses != NULL) {
 			for (i = 0; i < spriteset->num_poses; ++i) {
 				free_lstring(spriteset->poses[i].name);
@@ -305,6 +348,28 @@ get_sprite_frame_delay(const spriteset_t* spriteset, const char* pose_name, int
 	return pose->frames[frame_index].delay;
 }
 
+bool
+get_sprite_frame_size(const spriteset_t* spriteset, const char* pose_name, int frame_index, int* out_width, int* out_height)
+{
+	const spriteset_pose_t* pose;
+	image_t*                image;
+
+	if ((pose = find_sprite_pose(spriteset, pose_name)) == NULL)
+		return false;
+	frame_index %= pose->num_frames;
+	image = spriteset->images[pose->frames[frame_index].image_idx];
+	if (out_width) *out_width = get_image_width(image);
+	if (out_height) *out_height = get_image_height(image);
+	return true;
+}
+
+void
+get_sprite_max_size(const spriteset_t* spriteset, int* out_width, int* out_height)
+{
+	if (out_width) *out_width = spriteset->max_width;
+	if (out_height) *out_height = spriteset->max_height;
+}
+
 void
 get_sprite_size(const spriteset_t* spriteset, int* out_width, int* out_height)
 {
@@ -340,13 +405,17 @@ get_spriteset_pose_info(const spriteset_t* spriteset, const char* pose_name, int
 }
 
 void
-set_spriteset_image(const spriteset_t* spriteset, int image_index, image_t* image)
+set_spriteset_image(spriteset_t* spriteset, int image_index, image_t* image)
 {
 	image_t* old_image;
 	
 	old_image = spriteset->images[image_index];
 	spriteset->images[image_index] = ref_image(image);
 	free_image(old_image);
+
+	// the size is only used as a bound, so it's fine if it doesn't shrink
+	spriteset->max_width = fmax(spriteset->max_width, get_image_width(image));
+	spriteset->max_height = fmax(spriteset->max_height, get_image_height(image));
 }
 
 void
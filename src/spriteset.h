@@ -28,16 +28,23 @@ struct spriteset
 	lstring_t*       filename;
 	int              num_images;
 	int              num_poses;
+	int              max_width;
+	int              max_height;
 	image_t*         *images;
 	spriteset_pose_t *poses;
 };
 
+extern void initialize_spritesets (void);
+extern void shutdown_spritesets   (void);
+
 extern spriteset_t* clone_spriteset         (const spriteset_t* spriteset);
 extern spriteset_t* load_spriteset          (const char* path);
 extern spriteset_t* ref_spriteset           (spriteset_t* spriteset);
 extern void         free_spriteset          (spriteset_t* spriteset);
 extern rect_t       get_sprite_base         (const spriteset_t* spriteset);
 extern int          get_sprite_frame_delay  (const spriteset_t* spriteset, const char* pose_name, int frame_index);
+extern bool         get_sprite_frame_size   (const spriteset_t* spriteset, const char* pose_name, int frame_index, int* out_width, int* out_height);
+extern void         get_sprite_max_size     (const spriteset_t* spriteset, int* out_width, int* out_height);
 extern void         get_sprite_size         (const spriteset_t* spriteset, int* out_width, int* out_height);
 extern void         get_spriteset_info      (const spriteset_t* spriteset, int* out_num_images, int* out_num_poses);
 extern bool         get_spriteset_pose_info (const spriteset_t* spriteset, const char* pose_name, int* out_num_frames);
@@ -2,13 +2,14 @@
 #include "api.h"
 #include "color.h"
 #include "image.h"
+#include "raster.h"
+#include "render.h"
 
 #include "surface.h"
 
 static void duk_require_rgba_lut (duk_context* ctx, duk_idx_t index, uint8_t *out_lut);
 
 static void apply_blend_mode (int blend_mode);
-static void reset_blender    (void);
 
 static duk_ret_t js_GrabSurface               (duk_context* ctx);
 static duk_ret_t js_CreateSurface             (duk_context* ctx);
@@ -22,6 +23,7 @@ static duk_ret_t js_Surface_getPixel          (duk_context* ctx);
 static duk_ret_t js_Surface_setAlpha          (duk_context* ctx);
 static duk_ret_t js_Surface_setBlendMode      (duk_context* ctx);
 static duk_ret_t js_Surface_setPixel          (duk_context* ctx);
+static duk_ret_t js_Surface_applyColorFX      (duk_context* ctx);
 static duk_ret_t js_Surface_applyLookup       (duk_context* ctx);
 static duk_ret_t js_Surface_blit              (duk_context* ctx);
 static duk_ret_t js_Surface_blitMaskSurface   (duk_context* ctx);
@@ -30,10 +32,12 @@ static duk_ret_t js_Surface_clone             (duk_context* ctx);
 static duk_ret_t js_Surface_cloneSection      (duk_context* ctx);
 static duk_ret_t js_Surface_createImage       (duk_context* ctx);
 static duk_ret_t js_Surface_drawText          (duk_context* ctx);
+static duk_ret_t js_Surface_filledCircle      (duk_context* ctx);
 static duk_ret_t js_Surface_flipHorizontally  (duk_context* ctx);
 static duk_ret_t js_Surface_flipVertically    (duk_context* ctx);
 static duk_ret_t js_Surface_gradientRectangle (duk_context* ctx);
 static duk_ret_t js_Surface_line              (duk_context* ctx);
+static duk_ret_t js_Surface_outlinedCircle    (duk_context* ctx);
 static duk_ret_t js_Surface_outlinedRectangle (duk_context* ctx);
 static duk_ret_t js_Surface_pointSeries       (duk_context* ctx);
 static duk_ret_t js_Surface_rotate            (duk_context* ctx);
@@ -70,6 +74,7 @@ init_surface_api(void)
 	register_api_function(g_duk, "Surface", "setAlpha", js_Surface_setAlpha);
 	register_api_function(g_duk, "Surface", "setBlendMode", js_Surface_setBlendMode);
 	register_api_function(g_duk, "Surface", "setPixel", js_Surface_setPixel);
+	register_api_function(g_duk, "Surface", "applyColorFX", js_Surface_applyColorFX);
 	register_api_function(g_duk, "Surface", "applyLookup", js_Surface_applyLookup);
 	register_api_function(g_duk, "Surface", "blit", js_Surface_blit);
 	register_api_function(g_duk, "Surface", "blitMaskSurface", js_Surface_blitMaskSurface);
@@ -78,10 +83,12 @@ init_surface_api(void)
 	register_api_function(g_duk, "Surface", "cloneSection", js_Surface_cloneSection);
 	register_api_function(g_duk, "Surface", "createImage", js_Surface_createImage);
 	register_api_function(g_duk, "Surface", "drawText", js_Surface_drawText);
+	register_api_function(g_duk, "Surface", "filledCircle", js_Surface_filledCircle);
 	register_api_function(g_duk, "Surface", "flipHorizontally", js_Surface_flipHorizontally);
 	register_api_function(g_duk, "Surface", "flipVertically", js_Surface_flipVertically);
 	register_api_function(g_duk, "Surface", "gradientRectangle", js_Surface_gradientRectangle);
 	register_api_function(g_duk, "Surface", "line", js_Surface_line);
+	register_api_function(g_duk, "Surface", "outlinedCircle", js_Surface_outlinedCircle);
 	register_api_function(g_duk, "Surface", "outlinedRectangle", js_Surface_outlinedRectangle);
 	register_api_function(g_duk, "Surface", "pointSeries", js_Surface_pointSeries);
 	register_api_function(g_duk, "Surface", "rotate", js_Surface_rotate);
@@ -126,26 +133,20 @@ apply_blend_mode(int blend_mode)
 {
 	switch (blend_mode) {
 	case BLEND_BLEND:
-		al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
+		set_render_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
 		break;
 	case BLEND_REPLACE:
-		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+		set_render_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
 		break;
 	case BLEND_ADD:
-		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
+		set_render_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
 		break;
 	case BLEND_SUBTRACT:
-		al_set_blender(ALLEGRO_DEST_MINUS_SRC, ALLEGRO_ONE, ALLEGRO_ONE);
+		set_render_blender(ALLEGRO_DEST_MINUS_SRC, ALLEGRO_ONE, ALLEGRO_ONE);
 		break;
 	}
 }
 
-static void
-reset_blender(void)
-{
-	al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
-}
-
 static duk_ret_t
 js_GrabSurface(duk_context* ctx)
 {
@@ -156,15 +157,22 @@ js_GrabSurface(duk_context* ctx)
 
 	ALLEGRO_BITMAP* backbuffer;
 	image_t*        image;
+	ALLEGRO_BITMAP* target;
 
 	backbuffer = al_get_backbuffer(g_display);
 	if ((image = create_image(w, h)) == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GrabSurface(): Failed to create surface bitmap");
-	al_set_target_bitmap(get_image_bitmap(image));
+	if (!(target = get_image_target(image))) {
+		free_image(image);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GrabSurface(): Failed to upload surface to GPU");
+	}
+	set_render_target(target);
+	apply_blend_mode(BLEND_BLEND);
 	al_draw_bitmap_region(backbuffer, x, y, w, h, 0, 0, 0x0);
-	al_set_target_backbuffer(g_display);
-	if (!rescale_image(image, g_res_x, g_res_y))
+	if (!rescale_image(image, g_res_x, g_res_y)) {
+		free_image(image);
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "GrabSurface(): Failed to rescale grabbed image");
+	}
 	duk_push_sphere_surface(ctx, image);
 	free_image(image);
 	return 1;
@@ -207,7 +215,7 @@ js_new_Surface(duk_context* ctx)
 		width = duk_require_int(ctx, 0);
 		height = duk_require_int(ctx, 1);
 		fill_color = n_args >= 3 ? duk_require_sphere_color(ctx, 2) : rgba(0, 0, 0, 255);
-		if (!(image = create_image(width, height)))
+		if (!(image = create_soft_image(width, height)))
 			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface(): Failed to create new surface");
 		fill_image(image, fill_color);
 	}
@@ -303,6 +311,25 @@ js_Surface_getPixel(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_Surface_applyColorFX(duk_context* ctx)
+{
+	int x = duk_require_int(ctx, 0);
+	int y = duk_require_int(ctx, 1);
+	int w = duk_require_int(ctx, 2);
+	int h = duk_require_int(ctx, 3);
+	colormatrix_t matrix = duk_require_sphere_colormatrix(ctx, 4);
+
+	image_t* image;
+
+	duk_push_this(ctx);
+	image = duk_require_sphere_surface(ctx, -1);
+	duk_pop(ctx);
+	if (!apply_image_colormat(image, x, y, w, h, matrix))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:applyColorFX(): Failed to apply color transformation");
+	return 0;
+}
+
 static duk_ret_t
 js_Surface_applyLookup(duk_context* ctx)
 {
@@ -336,6 +363,7 @@ js_Surface_blit(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_pop(ctx);
+	reset_render_state();
 	if (!is_skipped_frame()) al_draw_bitmap(get_image_bitmap(image), x, y, 0x0);
 	return 0;
 }
@@ -355,11 +383,7 @@ js_Surface_blitMaskSurface(duk_context* ctx)
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
-	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
-	al_draw_tinted_bitmap(get_image_bitmap(src_image), nativecolor(mask), x, y, 0x0);
-	al_set_target_backbuffer(g_display);
-	reset_blender();
+	plot_image(image, src_image, x, y, mask, blend_mode);
 	return 0;
 }
 
@@ -377,11 +401,7 @@ js_Surface_blitSurface(duk_context* ctx)
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
-	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
-	al_draw_bitmap(get_image_bitmap(src_image), x, y, 0x0);
-	al_set_target_backbuffer(g_display);
-	reset_blender();
+	plot_image(image, src_image, x, y, rgba(255, 255, 255, 255), blend_mode);
 	return 0;
 }
 
@@ -415,11 +435,9 @@ js_Surface_cloneSection(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_pop(ctx);
-	if ((new_image = create_image(w, h)) == NULL)
+	if ((new_image = create_soft_image(w, h)) == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:cloneSection() - Failed to create new surface");
-	al_set_target_bitmap(get_image_bitmap(new_image));
-	al_draw_bitmap_region(get_image_bitmap(image), x, y, w, h, 0, 0, 0x0);
-	al_set_target_backbuffer(g_display);
+	plot_image(new_image, image, -x, -y, rgba(255, 255, 255, 255), BLEND_REPLACE);
 	duk_push_sphere_surface(ctx, new_image);
 	free_image(new_image);
 	return 1;
@@ -449,20 +467,40 @@ js_Surface_drawText(duk_context* ctx)
 	int y = duk_require_int(ctx, 2);
 	const char* text = duk_to_string(ctx, 3);
 	
-	int      blend_mode;
-	color_t  color;
-	image_t* image;
+	int             blend_mode;
+	color_t         color;
+	image_t*        image;
+	ALLEGRO_BITMAP* target;
 
 	duk_push_this(ctx);
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
 	duk_get_prop_string(ctx, 0, "\xFF" "color_mask"); color = duk_require_sphere_color(ctx, -1); duk_pop(ctx);
+	if (!(target = get_image_target(image)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:drawText(): Failed to upload surface to GPU");
+	set_render_target(target);
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
 	draw_text(font, color, x, y, TEXT_ALIGN_LEFT, text);
-	al_set_target_backbuffer(g_display);
-	reset_blender();
+	return 0;
+}
+
+static duk_ret_t
+js_Surface_filledCircle(duk_context* ctx)
+{
+	int x = duk_require_int(ctx, 0);
+	int y = duk_require_int(ctx, 1);
+	int radius = duk_require_int(ctx, 2);
+	color_t color = duk_require_sphere_color(ctx, 3);
+
+	int      blend_mode;
+	image_t* image;
+
+	duk_push_this(ctx);
+	image = duk_require_sphere_surface(ctx, -1);
+	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
+	duk_pop(ctx);
+	plot_circle(image, x, y, radius, color, true, blend_mode);
 	return 0;
 }
 
@@ -493,10 +531,10 @@ js_Surface_flipVertically(duk_context* ctx)
 static duk_ret_t
 js_Surface_gradientRectangle(duk_context* ctx)
 {
-	int x1 = duk_require_int(ctx, 0);
-	int y1 = duk_require_int(ctx, 1);
-	int x2 = x1 + duk_require_int(ctx, 2);
-	int y2 = y1 + duk_require_int(ctx, 3);
+	int x = duk_require_int(ctx, 0);
+	int y = duk_require_int(ctx, 1);
+	int w = duk_require_int(ctx, 2);
+	int h = duk_require_int(ctx, 3);
 	color_t color_ul = duk_require_sphere_color(ctx, 4);
 	color_t color_ur = duk_require_sphere_color(ctx, 5);
 	color_t color_lr = duk_require_sphere_color(ctx, 6);
@@ -509,18 +547,7 @@ js_Surface_gradientRectangle(duk_context* ctx)
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
-	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
-	
-	ALLEGRO_VERTEX verts[] = {
-		{ x1, y1, 0, 0, 0, nativecolor(color_ul) },
-		{ x2, y1, 0, 0, 0, nativecolor(color_ur) },
-		{ x1, y2, 0, 0, 0, nativecolor(color_ll) },
-		{ x2, y2, 0, 0, 0, nativecolor(color_lr) }
-	};
-	al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
-	al_set_target_backbuffer(g_display);
-	reset_blender();
+	plot_gradient_rect(image, x, y, w, h, color_ul, color_ur, color_lr, color_ll, blend_mode);
 	return 0;
 }
 
@@ -540,11 +567,26 @@ js_Surface_line(duk_context* ctx)
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
-	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
-	al_draw_line(x1, y1, x2, y2, nativecolor(color), 1);
-	al_set_target_backbuffer(g_display);
-	reset_blender();
+	plot_line(image, x1, y1, x2, y2, color, blend_mode);
+	return 0;
+}
+
+static duk_ret_t
+js_Surface_outlinedCircle(duk_context* ctx)
+{
+	int x = duk_require_int(ctx, 0);
+	int y = duk_require_int(ctx, 1);
+	int radius = duk_require_int(ctx, 2);
+	color_t color = duk_require_sphere_color(ctx, 3);
+
+	int      blend_mode;
+	image_t* image;
+
+	duk_push_this(ctx);
+	image = duk_require_sphere_surface(ctx, -1);
+	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
+	duk_pop(ctx);
+	plot_circle(image, x, y, radius, color, false, blend_mode);
 	return 0;
 }
 
@@ -554,12 +596,10 @@ js_Surface_pointSeries(duk_context* ctx)
 	duk_require_object_coercible(ctx, 0);
 	color_t color = duk_require_sphere_color(ctx, 1);
 	
-	int             blend_mode;
-	image_t*        image;
-	size_t          num_points;
-	int             x, y;
-	ALLEGRO_VERTEX* vertices;
-	ALLEGRO_COLOR   vtx_color;
+	int      blend_mode;
+	image_t* image;
+	size_t   num_points;
+	int      x, y;
 
 	unsigned int i;
 
@@ -569,26 +609,16 @@ js_Surface_pointSeries(duk_context* ctx)
 	duk_pop(ctx);
 	if (!duk_is_array(ctx, 0))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:pointSeries(): First argument must be an array");
-	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, 0); duk_pop(ctx);
+	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, -1); duk_pop(ctx);
 	if (num_points > INT_MAX)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Surface:pointSeries(): Too many vertices (%u)", num_points);
-	if ((vertices = calloc(num_points, sizeof(ALLEGRO_VERTEX))) == NULL)
-		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:pointSeries(): Failed to allocate vertex buffer");
-	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		duk_get_prop_index(ctx, 0, i);
-		duk_get_prop_string(ctx, 0, "x"); x = duk_require_int(ctx, -1); duk_pop(ctx);
-		duk_get_prop_string(ctx, 0, "y"); y = duk_require_int(ctx, -1); duk_pop(ctx);
+		duk_get_prop_string(ctx, -1, "x"); x = duk_require_int(ctx, -1); duk_pop(ctx);
+		duk_get_prop_string(ctx, -1, "y"); y = duk_require_int(ctx, -1); duk_pop(ctx);
 		duk_pop(ctx);
-		vertices[i].x = x; vertices[i].y = y;
-		vertices[i].color = vtx_color;
+		plot_point(image, x, y, color, blend_mode);
 	}
-	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
-	al_draw_prim(vertices, NULL, NULL, 0, (int)num_points, ALLEGRO_PRIM_POINT_LIST);
-	al_set_target_backbuffer(g_display);
-	reset_blender();
-	free(vertices);
 	return 0;
 }
 
@@ -596,10 +626,10 @@ static duk_ret_t
 js_Surface_outlinedRectangle(duk_context* ctx)
 {
 	int n_args = duk_get_top(ctx);
-	float x1 = duk_require_int(ctx, 0) + 0.5;
-	float y1 = duk_require_int(ctx, 1) + 0.5;
-	float x2 = x1 + duk_require_int(ctx, 2);
-	float y2 = y1 + duk_require_int(ctx, 3);
+	int x = duk_require_int(ctx, 0);
+	int y = duk_require_int(ctx, 1);
+	int w = duk_require_int(ctx, 2);
+	int h = duk_require_int(ctx, 3);
 	color_t color = duk_require_sphere_color(ctx, 4);
 	int thickness = n_args >= 6 ? duk_to_int(ctx, 5) : 1;
 
@@ -610,11 +640,7 @@ js_Surface_outlinedRectangle(duk_context* ctx)
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
-	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
-	al_draw_rectangle(x1, y1, x2, y2, nativecolor(color), thickness);
-	al_set_target_backbuffer(g_display);
-	reset_blender();
+	plot_outline_rect(image, x, y, w, h, thickness, color, blend_mode);
 	return 0;
 }
 
@@ -657,10 +683,12 @@ js_Surface_rotate(duk_context* ctx)
 	float angle = duk_require_number(ctx, 0);
 	bool want_resize = n_args >= 2 ? duk_require_boolean(ctx, 1) : true;
 	
-	image_t* image;
-	image_t* new_image;
-	int      new_w, new_h;
-	int      w, h;
+	ALLEGRO_BITMAP* bitmap;
+	image_t*        image;
+	image_t*        new_image;
+	int             new_w, new_h;
+	ALLEGRO_BITMAP* target;
+	int             w, h;
 
 	duk_push_this(ctx);
 	image = duk_require_sphere_surface(ctx, -1);
@@ -672,9 +700,13 @@ js_Surface_rotate(duk_context* ctx)
 	}
 	if ((new_image = create_image(new_w, new_h)) == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:rotate() - Failed to create new surface bitmap");
-	al_set_target_bitmap(get_image_bitmap(new_image));
-	al_draw_rotated_bitmap(get_image_bitmap(image), (float)w / 2, (float)h / 2, (float)new_w / 2, (float)new_h / 2, angle, 0x0);
-	al_set_target_backbuffer(g_display);
+	if (!(bitmap = get_image_bitmap(image)) || !(target = get_image_target(new_image))) {
+		free_image(new_image);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:rotate() - Failed to upload surface to GPU");
+	}
+	set_render_target(target);
+	apply_blend_mode(BLEND_BLEND);
+	al_draw_rotated_bitmap(bitmap, (float)w / 2, (float)h / 2, (float)new_w / 2, (float)new_h / 2, angle, 0x0);
 	
 	// free old image and replace internal image pointer
 	// at one time this was an acceptable thing to do; now it's just a hack
@@ -700,11 +732,7 @@ js_Surface_rectangle(duk_context* ctx)
 	image = duk_require_sphere_surface(ctx, -1);
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode"); blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
-	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
-	al_draw_filled_rectangle(x, y, x + w, y + h, nativecolor(color));
-	al_set_target_backbuffer(g_display);
-	reset_blender();
+	plot_rect(image, x, y, w, h, color, blend_mode);
 	return 0;
 }
 
@@ -0,0 +1,551 @@
+#include "minisphere.h"
+#include "api.h"
+
+#include "task.h"
+
+// note: a task is a Duktape coroutine (Duktape.Thread) driven from here.
+//       ready tasks sit in a priority queue and are resumed once per frame
+//       by flip_screen(), highest priority first and round-robin within a
+//       priority. sleeping tasks sit in a second queue ordered by wake time
+//       and waiting tasks aren't queued at all until their event is raised,
+//       so a task that's blocked costs nothing per frame.
+//
+//       Duktape 1.x only allows a thread to be resumed or yielded from
+//       script code, so the actual resume() and yield() calls are made by a
+//       few helper functions compiled at startup. a task yields a request
+//       object telling the scheduler what to do with it until next time.
+
+#define TASK_READY    0
+#define TASK_RUNNING  1
+#define TASK_SLEEPING 2
+#define TASK_WAITING  3
+#define TASK_DEAD     4
+
+#define REQUEST_YIELD 1
+#define REQUEST_SLEEP 2
+#define REQUEST_WAIT  3
+
+static duk_ret_t js_CreateTask     (duk_context* ctx);
+static duk_ret_t js_DoesTaskExist  (duk_context* ctx);
+static duk_ret_t js_GetCurrentTask (duk_context* ctx);
+static duk_ret_t js_GetTaskCPUTime (duk_context* ctx);
+static duk_ret_t js_KillTask       (duk_context* ctx);
+static duk_ret_t js_RaiseTaskEvent (duk_context* ctx);
+
+struct task
+{
+	unsigned int id;
+	double       cpu_time;
+	char*        event;
+	bool         is_queued;
+	int          priority;
+	unsigned int serial;
+	int          state;
+	double       wake_time;
+};
+
+struct task_queue
+{
+	int           count;
+	bool          (*goes_before)(const struct task* a, const struct task* b);
+	struct task** items;
+	int           max;
+};
+
+static void         destroy_task (struct task* task);
+static struct task* find_task    (unsigned int id);
+static bool         make_ready   (struct task* task, struct task_queue* queue);
+static struct task* pop_task     (struct task_queue* queue);
+static bool         push_task    (struct task_queue* queue, struct task* task);
+static bool         resume_task  (struct task* task);
+static void         run_tasks    (struct task_queue* queue);
+static bool         runs_before  (const struct task* a, const struct task* b);
+static int          wake_tasks   (duk_context* ctx, const char* name, duk_idx_t value_index, bool run_now);
+static bool         wakes_before (const struct task* a, const struct task* b);
+
+static const char* const s_helpers_js =
+	"(function(global) {\n"
+	"	var done = {};\n"
+	"	global.TaskYield = function() { Duktape.Thread.yield({ op: 1 }); };\n"
+	"	global.TaskSleep = function(ms) { Duktape.Thread.yield({ op: 2, ms: ms }); };\n"
+	"	global.TaskWait = function(event) { return Duktape.Thread.yield({ op: 3, event: String(event) }); };\n"
+	"	return {\n"
+	"		create: function(fn) { return new Duktape.Thread(function() { fn(); return done; }); },\n"
+	"		resume: function(thread, value) {\n"
+	"			var result = Duktape.Thread.resume(thread, value);\n"
+	"			return result !== done ? result : undefined;\n"
+	"		},\n"
+	"	};\n"
+	"})(this);";
+
+static struct task**     s_batch = NULL;
+static int               s_batch_len = 0;
+static int               s_batch_pos = 0;
+static int               s_max_batch = 0;
+static int               s_max_tasks = 0;
+static struct task*      s_current = NULL;
+static unsigned int      s_next_id = 1;
+static unsigned int      s_next_serial = 0;
+static int               s_num_tasks = 0;
+static struct task_queue s_ready = { 0, runs_before };
+static struct task_queue s_sleeping = { 0, wakes_before };
+static struct task**     s_tasks = NULL;
+static struct task_queue s_woken = { 0, runs_before };
+
+void
+initialize_tasks(void)
+{
+	printf("Initializing task scheduler\n");
+	s_current = NULL;
+	s_num_tasks = 0;
+	s_ready.count = s_sleeping.count = s_woken.count = 0;
+}
+
+void
+shutdown_tasks(void)
+{
+	struct task* task;
+
+	printf("Shutting down task scheduler\n");
+	while (s_num_tasks > 0)
+		destroy_task(s_tasks[s_num_tasks - 1]);
+	while (s_ready.count > 0) {
+		task = pop_task(&s_ready);
+		free(task);
+	}
+	while (s_sleeping.count > 0) {
+		task = pop_task(&s_sleeping);
+		free(task);
+	}
+	while (s_woken.count > 0) {
+		task = pop_task(&s_woken);
+		free(task);
+	}
+	free(s_ready.items); s_ready.items = NULL; s_ready.max = 0;
+	free(s_sleeping.items); s_sleeping.items = NULL; s_sleeping.max = 0;
+	free(s_woken.items); s_woken.items = NULL; s_woken.max = 0;
+	free(s_batch); s_batch = NULL; s_max_batch = 0;
+	free(s_tasks); s_tasks = NULL; s_max_tasks = 0;
+	duk_push_global_stash(g_duk);
+	duk_del_prop_string(g_duk, -1, "tasks");
+	duk_pop(g_duk);
+}
+
+int
+get_task_count(void)
+{
+	return s_num_tasks;
+}
+
+int
+raise_task_event(const char* name, bool run_now)
+{
+	int num_woken;
+
+	duk_push_undefined(g_duk);
+	num_woken = wake_tasks(g_duk, name, -1, run_now);
+	duk_pop(g_duk);
+	return num_woken;
+}
+
+void
+update_tasks(void)
+{
+	double       now;
+	struct task* task;
+
+	if (s_current != NULL)
+		return;  // a task called FlipScreen(), the scheduler isn't re-entrant
+	now = al_get_time();
+	while (s_sleeping.count > 0 && s_sleeping.items[0]->wake_time <= now) {
+		task = pop_task(&s_sleeping);
+		task->is_queued = false;
+		if (task->state == TASK_DEAD)
+			free(task);
+		else
+			make_ready(task, &s_ready);
+	}
+	run_tasks(&s_ready);
+}
+
+static void
+destroy_task(struct task* task)
+{
+	int i;
+
+	for (i = 0; i < s_num_tasks; ++i) {
+		if (s_tasks[i] == task) {
+			s_tasks[i] = s_tasks[--s_num_tasks];
+			break;
+		}
+	}
+	duk_push_global_stash(g_duk);
+	if (duk_get_prop_string(g_duk, -1, "tasks"))
+		duk_del_prop_index(g_duk, -1, task->id);
+	duk_pop_2(g_duk);
+	free(task->event);
+	task->event = NULL;
+	task->state = TASK_DEAD;
+
+	// tasks still in a queue are freed when they come out of it
+	if (!task->is_queued && task != s_current)
+		free(task);
+}
+
+static struct task*
+find_task(unsigned int id)
+{
+	int i;
+
+	for (i = 0; i < s_num_tasks; ++i) {
+		if (s_tasks[i]->id == id)
+			return s_tasks[i];
+	}
+	return NULL;
+}
+
+static bool
+make_ready(struct task* task, struct task_queue* queue)
+{
+	task->state = TASK_READY;
+	task->serial = s_next_serial++;
+	if (!push_task(queue, task)) {
+		destroy_task(task);
+		return false;
+	}
+	return true;
+}
+
+static struct task*
+pop_task(struct task_queue* queue)
+{
+	int          child;
+	struct task* last;
+	struct task* top;
+
+	int i;
+
+	top = queue->items[0];
+	last = queue->items[--queue->count];
+	i = 0;
+	while ((child = i * 2 + 1) < queue->count) {
+		if (child + 1 < queue->count && queue->goes_before(queue->items[child + 1], queue->items[child]))
+			++child;
+		if (!queue->goes_before(queue->items[child], last))
+			break;
+		queue->items[i] = queue->items[child];
+		i = child;
+	}
+	if (queue->count > 0)
+		queue->items[i] = last;
+	return top;
+}
+
+static bool
+push_task(struct task_queue* queue, struct task* task)
+{
+	int           new_max;
+	struct task** new_items;
+	int           parent;
+
+	int i;
+
+	if (queue->count >= queue->max) {
+		new_max = queue->max > 0 ? queue->max * 2 : 16;
+		if (!(new_items = realloc(queue->items, new_max * sizeof(struct task*))))
+			return false;
+		queue->items = new_items;
+		queue->max = new_max;
+	}
+	i = queue->count++;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!queue->goes_before(task, queue->items[parent]))
+			break;
+		queue->items[i] = queue->items[parent];
+		i = parent;
+	}
+	queue->items[i] = task;
+	task->is_queued = true;
+	return true;
+}
+
+static bool
+resume_task(struct task* task)
+{
+	int    op;
+	double start_time;
+
+	duk_push_global_stash(g_duk);
+	duk_get_prop_string(g_duk, -1, "tasks");
+	duk_get_prop_index(g_duk, -1, task->id);
+	duk_get_prop_string(g_duk, -3, "taskResume");
+	duk_get_prop_string(g_duk, -2, "thread");
+	duk_get_prop_string(g_duk, -3, "value");
+	duk_del_prop_string(g_duk, -4, "value");
+	s_current = task;
+	task->state = TASK_RUNNING;
+	start_time = al_get_time();
+	if (duk_pcall(g_duk, 2) != DUK_EXEC_SUCCESS) {
+		// leave the error on the stack for the caller to rethrow
+		s_current = NULL;
+		task->cpu_time += al_get_time() - start_time;
+		if (task->state == TASK_DEAD)
+			free(task);
+		else
+			destroy_task(task);
+		duk_insert(g_duk, -4);
+		duk_pop_3(g_duk);
+		return false;
+	}
+	s_current = NULL;
+	task->cpu_time += al_get_time() - start_time;
+	if (task->state == TASK_DEAD)  // task killed itself
+		free(task);
+	else if (duk_is_undefined(g_duk, -1))  // task finished
+		destroy_task(task);
+	else {
+		duk_get_prop_string(g_duk, -1, "op");
+		op = duk_to_int(g_duk, -1);
+		duk_pop(g_duk);
+		if (op == REQUEST_SLEEP) {
+			duk_get_prop_string(g_duk, -1, "ms");
+			task->state = TASK_SLEEPING;
+			task->wake_time = al_get_time() + fmax(duk_to_number(g_duk, -1), 0.0) / 1000.0;
+			task->serial = s_next_serial++;
+			duk_pop(g_duk);
+			if (!push_task(&s_sleeping, task))
+				destroy_task(task);
+		}
+		else if (op == REQUEST_WAIT) {
+			duk_get_prop_string(g_duk, -1, "event");
+			task->state = TASK_WAITING;
+			task->event = strdup(duk_safe_to_string(g_duk, -1));
+			duk_pop(g_duk);
+			if (task->event == NULL)
+				destroy_task(task);
+		}
+		else
+			make_ready(task, &s_ready);
+	}
+	duk_pop_n(g_duk, 4);
+	return true;
+}
+
+static void
+run_tasks(struct task_queue* queue)
+{
+	struct task** new_batch;
+	struct task*  task;
+
+	if (s_current != NULL)
+		return;
+
+	// take the whole queue up front so a task that yields goes back in line
+	// for the next frame instead of running again right away
+	if (queue->count > s_max_batch) {
+		if (!(new_batch = realloc(s_batch, queue->count * sizeof(struct task*))))
+			return;
+		s_batch = new_batch;
+		s_max_batch = queue->count;
+	}
+	s_batch_len = 0;
+	while (queue->count > 0) {
+		task = pop_task(queue);
+		if (task->state != TASK_DEAD)
+			s_batch[s_batch_len++] = task;
+		else
+			free(task);
+	}
+	for (s_batch_pos = 0; s_batch_pos < s_batch_len; ++s_batch_pos) {
+		task = s_batch[s_batch_pos];
+		task->is_queued = false;
+		if (task->state == TASK_DEAD)
+			free(task);
+		else if (!resume_task(task)) {
+			// put the rest back before passing the error on
+			while (++s_batch_pos < s_batch_len) {
+				task = s_batch[s_batch_pos];
+				task->is_queued = false;
+				if (task->state == TASK_DEAD)
+					free(task);
+				else if (!push_task(&s_ready, task))
+					destroy_task(task);
+			}
+			s_batch_len = 0;
+			duk_throw(g_duk);
+		}
+	}
+	s_batch_len = 0;
+}
+
+static bool
+runs_before(const struct task* a, const struct task* b)
+{
+	return a->priority > b->priority
+		|| (a->priority == b->priority && a->serial < b->serial);
+}
+
+static int
+wake_tasks(duk_context* ctx, const char* name, duk_idx_t value_index, bool run_now)
+{
+	int                num_woken = 0;
+	struct task_queue* queue;
+	struct task*       task;
+
+	int i;
+
+	// tasks woken to run right away are queued separately. the queue is kept
+	// in module state because a task that throws unwinds straight through
+	// here, so anything allocated locally would leak.
+	value_index = duk_require_normalize_index(ctx, value_index);
+	queue = run_now && s_current == NULL ? &s_woken : &s_ready;
+	duk_push_global_stash(ctx);
+	duk_get_prop_string(ctx, -1, "tasks");
+	for (i = 0; i < s_num_tasks; ++i) {
+		task = s_tasks[i];
+		if (task->state != TASK_WAITING || strcmp(task->event, name) != 0)
+			continue;
+		duk_get_prop_index(ctx, -1, task->id);
+		duk_dup(ctx, value_index);
+		duk_put_prop_string(ctx, -2, "value");
+		duk_pop(ctx);
+		free(task->event);
+		task->event = NULL;
+		if (make_ready(task, queue))
+			++num_woken;
+		else
+			--i;  // destroying the task moved another one into its place
+	}
+	duk_pop_2(ctx);
+	if (queue == &s_woken) {
+		run_tasks(&s_woken);
+		while (s_woken.count > 0)  // only if the batch couldn't be allocated
+			push_task(&s_ready, pop_task(&s_woken));
+	}
+	return num_woken;
+}
+
+static bool
+wakes_before(const struct task* a, const struct task* b)
+{
+	return a->wake_time < b->wake_time
+		|| (a->wake_time == b->wake_time && a->serial < b->serial);
+}
+
+void
+init_task_api(void)
+{
+	duk_push_global_stash(g_duk);
+	duk_eval_string(g_duk, s_helpers_js);
+	duk_get_prop_string(g_duk, -1, "create");
+	duk_put_prop_string(g_duk, -3, "taskCreate");
+	duk_get_prop_string(g_duk, -1, "resume");
+	duk_put_prop_string(g_duk, -3, "taskResume");
+	duk_pop(g_duk);
+	duk_push_object(g_duk);
+	duk_put_prop_string(g_duk, -2, "tasks");
+	duk_pop(g_duk);
+
+	register_api_function(g_duk, NULL, "CreateTask", js_CreateTask);
+	register_api_function(g_duk, NULL, "DoesTaskExist", js_DoesTaskExist);
+	register_api_function(g_duk, NULL, "GetCurrentTask", js_GetCurrentTask);
+	register_api_function(g_duk, NULL, "GetTaskCPUTime", js_GetTaskCPUTime);
+	register_api_function(g_duk, NULL, "KillTask", js_KillTask);
+	register_api_function(g_duk, NULL, "RaiseTaskEvent", js_RaiseTaskEvent);
+}
+
+static duk_ret_t
+js_CreateTask(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	int priority = n_args >= 2 ? duk_require_int(ctx, 1) : 0;
+
+	struct task** new_tasks;
+	int           new_max;
+	struct task*  task;
+
+	if (!duk_is_callable(ctx, 0))
+		duk_error_ni(ctx, -1, DUK_ERR_TYPE_ERROR, "CreateTask(): Task must be a function");
+	if (s_num_tasks >= s_max_tasks) {
+		new_max = s_max_tasks > 0 ? s_max_tasks * 2 : 16;
+		if (!(new_tasks = realloc(s_tasks, new_max * sizeof(struct task*))))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "CreateTask(): Failed to allocate task list");
+		s_tasks = new_tasks;
+		s_max_tasks = new_max;
+	}
+	if (!(task = calloc(1, sizeof(struct task))))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "CreateTask(): Failed to create task");
+	task->id = s_next_id++;
+	task->priority = priority;
+
+	// stash the coroutine so it doesn't get garbage collected
+	duk_push_global_stash(ctx);
+	duk_get_prop_string(ctx, -1, "tasks");
+	duk_push_object(ctx);
+	duk_get_prop_string(ctx, -3, "taskCreate");
+	duk_dup(ctx, 0);
+	duk_call(ctx, 1);
+	duk_put_prop_string(ctx, -2, "thread");
+	duk_put_prop_index(ctx, -2, task->id);
+	duk_pop_2(ctx);
+	s_tasks[s_num_tasks++] = task;
+	if (!make_ready(task, &s_ready))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "CreateTask(): Failed to schedule task");
+	duk_push_uint(ctx, task->id);
+	return 1;
+}
+
+static duk_ret_t
+js_DoesTaskExist(duk_context* ctx)
+{
+	unsigned int id = duk_require_uint(ctx, 0);
+
+	duk_push_boolean(ctx, find_task(id) != NULL);
+	return 1;
+}
+
+static duk_ret_t
+js_GetCurrentTask(duk_context* ctx)
+{
+	duk_push_uint(ctx, s_current != NULL ? s_current->id : 0);
+	return 1;
+}
+
+static duk_ret_t
+js_GetTaskCPUTime(duk_context* ctx)
+{
+	unsigned int id = duk_require_uint(ctx, 0);
+
+	struct task* task;
+
+	if (!(task = find_task(id)))
+		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "GetTaskCPUTime(): Task %u doesn't exist", id);
+	duk_push_number(ctx, task->cpu_time * 1000.0);
+	return 1;
+}
+
+static duk_ret_t
+js_KillTask(duk_context* ctx)
+{
+	unsigned int id = duk_require_uint(ctx, 0);
+
+	struct task* task;
+
+	if (!(task = find_task(id)))
+		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "KillTask(): Task %u doesn't exist", id);
+	destroy_task(task);
+	return 0;
+}
+
+static duk_ret_t
+js_RaiseTaskEvent(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	const char* name = duk_to_string(ctx, 0);
+
+	if (n_args < 2)
+		duk_push_undefined(ctx);
+	duk_push_int(ctx, wake_tasks(ctx, name, 1, false));
+	return 1;
+}
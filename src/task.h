@@ -0,0 +1,12 @@
+#ifndef MINISPHERE__TASK_H__INCLUDED
+#define MINISPHERE__TASK_H__INCLUDED
+
+extern void initialize_tasks (void);
+extern void shutdown_tasks   (void);
+extern int  get_task_count   (void);
+extern int  raise_task_event (const char* name, bool run_now);
+extern void update_tasks     (void);
+
+extern void init_task_api (void);
+
+#endif // MINISPHERE__TASK_H__INCLUDED
@@ -7,6 +7,7 @@
 struct tileset
 {
 	int         width, height;
+	int         num_pages;
 	int         num_tiles;
 	struct tile *tiles;
 };
@@ -17,10 +18,12 @@ struct tile
 	int        animate_index;
 	int        frames_left;
 	image_t*   image;
+	int        page;
 	int        delay;
 	int        next_index;
 	int        num_obs_lines;
 	obsmap_t*  obsmap;
+	int        passability;
 };
 
 #pragma pack(push, 1)
@@ -53,26 +56,36 @@ struct rts_tile_header
 #pragma pack(pop)
 
 tileset_t*
-load_tileset(const char* path)
+load_tileset(const char* path, const int* tile_order, int order_len)
 {
 	FILE*      file;
 	tileset_t* tileset;
 
 	if ((file = fopen(path, "rb")) == NULL) return NULL;
-	tileset = read_tileset(file);
+	tileset = read_tileset(file, tile_order, order_len);
 	fclose(file);
 	return tileset;
 }
 
 tileset_t*
-read_tileset(FILE* file)
+read_tileset(FILE* file, const int* tile_order, int order_len)
 {
-	image_t*               atlas = NULL;
-	int                    atlas_w, atlas_h;
+	// note: tiles are packed into as few atlas pages as the maximum texture
+	//       size allows. `tile_order` lists tile indices which are likely to be
+	//       drawn together (e.g. in order of first appearance on the map); these
+	//       are placed first so that they end up sharing pages. any tiles not
+	//       listed follow in index order.
+	
 	long                   file_pos;
+	int                    max_size;
+	int                    n_per_page;
+	int                    n_rows;
 	int                    n_tiles_per_row;
+	int                    next_slot;
+	image_t**              pages = NULL;
 	struct rts_header      rts;
 	rect_t                 segment;
+	int*                   slots = NULL;
 	struct rts_tile_header tilehdr;
 	struct tile*           tiles = NULL;
 	tileset_t*             tileset = NULL;
@@ -91,16 +104,40 @@ read_tileset(FILE* file)
 	if (rts.tile_bpp != 32) goto on_error;
 	if (!(tiles = calloc(rts.num_tiles, sizeof(struct tile)))) goto on_error;
 	
-	// prepare the tile atlas
-	n_tiles_per_row = ceil(sqrt(rts.num_tiles));
-	atlas_w = rts.tile_width * n_tiles_per_row;
-	atlas_h = rts.tile_height * n_tiles_per_row;
-	if (!(atlas = create_image(atlas_w, atlas_h))) goto on_error;
+	// assign each tile a slot in the atlas
+	if (!(slots = malloc(rts.num_tiles * sizeof(int)))) goto on_error;
+	for (i = 0; i < rts.num_tiles; ++i)
+		slots[i] = -1;
+	next_slot = 0;
+	for (i = 0; i < order_len; ++i) {
+		j = tile_order[i];
+		if (j >= 0 && j < rts.num_tiles && slots[j] == -1)
+			slots[j] = next_slot++;
+	}
+	for (i = 0; i < rts.num_tiles; ++i)
+		if (slots[i] == -1) slots[i] = next_slot++;
+	
+	// prepare the atlas pages. a single page is kept square as before; only
+	// tilesets which wouldn't fit into one texture are split up.
+	max_size = al_get_display_option(g_display, ALLEGRO_MAX_BITMAP_SIZE);
+	if (max_size <= 0) max_size = INT_MAX;
+	n_tiles_per_row = fmax(fmin(ceil(sqrt(rts.num_tiles)), max_size / rts.tile_width), 1);
+	n_rows = ceil((double)rts.num_tiles / n_tiles_per_row);
+	n_per_page = fmax(fmin(n_rows, max_size / rts.tile_height), 1) * n_tiles_per_row;
+	tileset->num_pages = (rts.num_tiles + n_per_page - 1) / n_per_page;
+	if (!(pages = calloc(tileset->num_pages, sizeof(image_t*)))) goto on_error;
+	for (i = 0; i < tileset->num_pages; ++i) {
+		n_rows = ceil((double)fmin(rts.num_tiles - i * n_per_page, n_per_page) / n_tiles_per_row);
+		if (!(pages[i] = create_image(rts.tile_width * n_tiles_per_row, rts.tile_height * n_rows)))
+			goto on_error;
+	}
 
 	// read in tile bitmaps
 	for (i = 0; i < rts.num_tiles; ++i) {
-		tiles[i].image = read_subimage(file, atlas,
-			i % n_tiles_per_row * rts.tile_width, i / n_tiles_per_row * rts.tile_height,
+		j = slots[i] % n_per_page;
+		tiles[i].page = slots[i] / n_per_page;
+		tiles[i].image = read_subimage(file, pages[tiles[i].page],
+			j % n_tiles_per_row * rts.tile_width, j / n_tiles_per_row * rts.tile_height,
 			rts.tile_width, rts.tile_height);
 		if (tiles[i].image == NULL) goto on_error;
 	}
@@ -132,10 +169,14 @@ read_tileset(FILE* file)
 				goto on_error;
 			}
 		}
+		tiles[i].passability = get_obsmap_passability(tiles[i].obsmap);
 	}
 
 	// wrap things up
-	free_image(atlas);
+	for (i = 0; i < tileset->num_pages; ++i)
+		free_image(pages[i]);
+	free(pages);
+	free(slots);
 	tileset->width = rts.tile_width;
 	tileset->height = rts.tile_height;
 	tileset->num_tiles = rts.num_tiles;
@@ -150,9 +191,14 @@ on_error:  // oh no!
 			free_obsmap(tiles[i].obsmap);
 			free_image(tiles[i].image);
 		}
-		free(tileset->tiles);
+		free(tiles);
+	}
+	if (pages != NULL) {
+		for (i = 0; i < tileset->num_pages; ++i)
+			free_image(pages[i]);
+		free(pages);
 	}
-	free_image(atlas);
+	free(slots);
 	free(tileset);
 	return NULL;
 }
@@ -205,6 +251,17 @@ get_tile_name(const tileset_t* tileset, int tile_index)
 	return tileset->tiles[tile_index].name;
 }
 
+int
+get_tile_page(const tileset_t* tileset, int tile_index)
+{
+	// tiles replaced with SetTileImage() aren't part of the atlas and are
+	// reported as being on page -1.
+	if (tile_index < 0)
+		return -1;
+	tile_index = tileset->tiles[tile_index].animate_index;
+	return tileset->tiles[tile_index].page;
+}
+
 const obsmap_t*
 get_tile_obsmap(const tileset_t* tileset, int tile_index)
 {
@@ -214,6 +271,15 @@ get_tile_obsmap(const tileset_t* tileset, int tile_index)
 		return NULL;
 }
 
+int
+get_tile_passability(const tileset_t* tileset, int tile_index)
+{
+	if (tile_index >= 0)
+		return tileset->tiles[tile_index].passability;
+	else
+		return PASS_OPEN;
+}
+
 void
 get_tile_size(const tileset_t* tileset, int* out_w, int* out_h)
 {
@@ -221,6 +287,12 @@ get_tile_size(const tileset_t* tileset, int* out_w, int* out_h)
 	*out_h = tileset->height;
 }
 
+int
+get_tileset_page_count(const tileset_t* tileset)
+{
+	return tileset->num_pages;
+}
+
 void
 set_next_tile(tileset_t* tileset, int tile_index, int next_index)
 {
@@ -240,6 +312,7 @@ set_tile_image(tileset_t* tileset, int tile_index, image_t* image)
 	
 	old_image = tileset->tiles[tile_index].image;
 	tileset->tiles[tile_index].image = ref_image(image);
+	tileset->tiles[tile_index].page = -1;
 	free_image(old_image);
 }
 
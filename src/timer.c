@@ -0,0 +1,443 @@
+#include "minisphere.h"
+#include "api.h"
+
+#include "timer.h"
+
+// note: timers are kept in a hierarchical timing wheel. the root level has
+//       one slot per tick for the next 256 ticks; each higher level has 64
+//       slots covering 64 times the span of the level below. a timer goes
+//       into the lowest level that can hold its deadline and is moved down
+//       a level ("cascaded") when the wheel gets close enough, so adding and
+//       cancelling a timer is O(1) no matter how many there are. timers that
+//       come due on the same tick fire in the order they were added, the same
+//       as the old delay script queue.
+
+#define ROOT_BITS   8
+#define LEVEL_BITS  6
+#define NUM_LEVELS  4
+#define ROOT_SLOTS  (1 << ROOT_BITS)
+#define LEVEL_SLOTS (1 << LEVEL_BITS)
+#define NUM_SLOTS   (ROOT_SLOTS + (NUM_LEVELS - 1) * LEVEL_SLOTS)
+#define MAX_SPAN    ((int64_t)1 << (ROOT_BITS + (NUM_LEVELS - 1) * LEVEL_BITS))
+
+// timer IDs are the timer's index in the low 20 bits, a generation count in
+// the next 11 and the wheel's ID flag in the top bit, so a stale ID can't
+// cancel a timer that reused its slot.
+#define INDEX_BITS 20
+#define INDEX_MASK ((1U << INDEX_BITS) - 1)
+#define GEN_MASK   0x7FFU
+
+#define SLOT_FREE   -1
+#define SLOT_DUE    -2
+#define SLOT_FIRING -3
+
+static duk_ret_t js_ClearTimer  (duk_context* ctx);
+static duk_ret_t js_SetInterval (duk_context* ctx);
+static duk_ret_t js_SetTimeout  (duk_context* ctx);
+
+struct timer
+{
+	unsigned int id;
+	int64_t      deadline;
+	int64_t      interval;
+	int          next;
+	int          prev;
+	script_t*    script;
+	unsigned int serial;
+	int          slot;
+};
+
+struct due_timer
+{
+	unsigned int id;
+	int          index;
+	unsigned int serial;
+};
+
+struct timer_wheel
+{
+	int64_t           current;
+	struct due_timer* due;
+	int               free_list;
+	int               heads[NUM_SLOTS];
+	unsigned int      id_flag;
+	bool              is_advancing;
+	int               max_due;
+	int               max_timers;
+	unsigned int      next_serial;
+	int               num_timers;
+	struct timer*     timers;
+};
+
+static int  compare_due_timers (const void* a, const void* b);
+static void cascade_slot       (timer_wheel_t* wheel, int slot);
+static void link_timer         (timer_wheel_t* wheel, int index);
+static void release_timer      (timer_wheel_t* wheel, int index);
+static void unlink_timer       (timer_wheel_t* wheel, int index);
+static void start_timer        (duk_context* ctx, const char* func_name, bool is_interval);
+
+static int64_t        s_frames = 0;
+static timer_wheel_t* s_frame_timers = NULL;
+static timer_wheel_t* s_ms_timers = NULL;
+
+void
+initialize_timers(void)
+{
+	printf("Initializing timers\n");
+	s_frames = 0;
+	s_frame_timers = create_timer_wheel(0x0, 0);
+	s_ms_timers = create_timer_wheel(1U << 31, al_get_time() * 1000);
+}
+
+void
+shutdown_timers(void)
+{
+	printf("Shutting down timers\n");
+	free_timer_wheel(s_frame_timers);
+	free_timer_wheel(s_ms_timers);
+}
+
+void
+update_timers(void)
+{
+	// called once per frame from flip_screen()
+	advance_timer_wheel(s_frame_timers, s_frames++);
+	advance_timer_wheel(s_ms_timers, al_get_time() * 1000);
+}
+
+timer_wheel_t*
+create_timer_wheel(unsigned int id_flag, int64_t now)
+{
+	timer_wheel_t* wheel;
+
+	int i;
+
+	if (!(wheel = calloc(1, sizeof(timer_wheel_t))))
+		return NULL;
+	for (i = 0; i < NUM_SLOTS; ++i)
+		wheel->heads[i] = -1;
+	wheel->current = now;
+	wheel->free_list = -1;
+	wheel->id_flag = id_flag;
+	return wheel;
+}
+
+void
+free_timer_wheel(timer_wheel_t* wheel)
+{
+	if (wheel == NULL)
+		return;
+	clear_timers(wheel);
+	free(wheel->due);
+	free(wheel->timers);
+	free(wheel);
+}
+
+int
+get_timer_count(const timer_wheel_t* wheel)
+{
+	return wheel->num_timers;
+}
+
+unsigned int
+add_timer(timer_wheel_t* wheel, int64_t delay, int64_t interval, script_t* script)
+{
+	// the timer takes ownership of the script. returns 0 on failure.
+	int           index;
+	unsigned int  generation;
+	int           new_size;
+	struct timer* new_timers;
+	struct timer* timer;
+
+	int i;
+
+	if (wheel->free_list < 0) {
+		new_size = wheel->max_timers > 0 ? wheel->max_timers * 2 : 16;
+		if (new_size > INDEX_MASK + 1 || !(new_timers = realloc(wheel->timers, new_size * sizeof(struct timer))))
+			return 0;
+		for (i = new_size - 1; i >= wheel->max_timers; --i) {
+			new_timers[i].id = 0;
+			new_timers[i].slot = SLOT_FREE;
+			new_timers[i].next = wheel->free_list;
+			wheel->free_list = i;
+		}
+		wheel->timers = new_timers;
+		wheel->max_timers = new_size;
+	}
+	index = wheel->free_list;
+	timer = &wheel->timers[index];
+	wheel->free_list = timer->next;
+	generation = ((timer->id >> INDEX_BITS) & GEN_MASK) % GEN_MASK + 1;
+	timer->id = wheel->id_flag | generation << INDEX_BITS | index;
+	timer->deadline = wheel->current + (delay > 0 ? delay : 0);
+	timer->interval = interval;
+	timer->script = script;
+	timer->serial = wheel->next_serial++;
+	link_timer(wheel, index);
+	++wheel->num_timers;
+	return timer->id;
+}
+
+void
+advance_timer_wheel(timer_wheel_t* wheel, int64_t now)
+{
+	// fires every timer due up to and including tick `now`. timers added by
+	// a firing script with no delay still fire on the same tick.
+	struct due_timer* due;
+	int               index;
+	int               level_idx;
+	int               new_size;
+	int               num_due;
+	int               slot;
+	int64_t           tick;
+	struct timer*     timer;
+
+	int i, i_level;
+
+	if (wheel->is_advancing)
+		return;  // a timer script flipped the screen
+	wheel->is_advancing = true;
+	while (wheel->current <= now) {
+		if (wheel->num_timers == 0) {
+			wheel->current = now + 1;
+			break;
+		}
+		tick = wheel->current;
+		if ((tick & (ROOT_SLOTS - 1)) == 0) {
+			for (i_level = 1; i_level < NUM_LEVELS; ++i_level) {
+				level_idx = (tick >> (ROOT_BITS + (i_level - 1) * LEVEL_BITS)) & (LEVEL_SLOTS - 1);
+				cascade_slot(wheel, ROOT_SLOTS + (i_level - 1) * LEVEL_SLOTS + level_idx);
+				if (level_idx != 0) break;
+			}
+		}
+		slot = tick & (ROOT_SLOTS - 1);
+		while (wheel->heads[slot] >= 0) {
+			num_due = 0;
+			for (index = wheel->heads[slot]; index >= 0; index = wheel->timers[index].next) {
+				if (num_due >= wheel->max_due) {
+					new_size = (num_due + 1) * 2;
+					if (!(due = realloc(wheel->due, new_size * sizeof(struct due_timer))))
+						break;
+					wheel->due = due;
+					wheel->max_due = new_size;
+				}
+				wheel->due[num_due].id = wheel->timers[index].id;
+				wheel->due[num_due].index = index;
+				wheel->due[num_due].serial = wheel->timers[index].serial;
+				++num_due;
+			}
+			for (i = 0; i < num_due; ++i)
+				unlink_timer(wheel, wheel->due[i].index);
+			for (i = 0; i < num_due; ++i)
+				wheel->timers[wheel->due[i].index].slot = SLOT_DUE;
+			qsort(wheel->due, num_due, sizeof(struct due_timer), compare_due_timers);
+			for (i = 0; i < num_due; ++i) {
+				// an earlier script may have cancelled this timer
+				index = wheel->due[i].index;
+				timer = &wheel->timers[index];
+				if (timer->id != wheel->due[i].id || timer->slot != SLOT_DUE)
+					continue;
+				timer->slot = SLOT_FIRING;
+				run_script(timer->script, false);
+				timer = &wheel->timers[index];  // array may have been reallocated
+				if (timer->interval > 0) {
+					timer->deadline = tick + timer->interval;
+					timer->serial = wheel->next_serial++;
+					link_timer(wheel, index);
+				}
+				else {
+					release_timer(wheel, index);
+				}
+			}
+		}
+		++wheel->current;
+	}
+	wheel->is_advancing = false;
+}
+
+bool
+cancel_timer(timer_wheel_t* wheel, unsigned int id)
+{
+	int           index;
+	struct timer* timer;
+
+	index = id & INDEX_MASK;
+	if (index >= wheel->max_timers)
+		return false;
+	timer = &wheel->timers[index];
+	if (timer->id != id || timer->slot == SLOT_FREE)
+		return false;
+	if (timer->slot == SLOT_FIRING)
+		timer->interval = 0;  // released once its script returns
+	else {
+		if (timer->slot >= 0)
+			unlink_timer(wheel, index);
+		release_timer(wheel, index);
+	}
+	return true;
+}
+
+void
+clear_timers(timer_wheel_t* wheel)
+{
+	int i;
+
+	for (i = 0; i < wheel->max_timers; ++i) {
+		if (wheel->timers[i].slot != SLOT_FREE)
+			cancel_timer(wheel, wheel->timers[i].id);
+	}
+}
+
+static int
+compare_due_timers(const void* a, const void* b)
+{
+	unsigned int serial_a = ((const struct due_timer*)a)->serial;
+	unsigned int serial_b = ((const struct due_timer*)b)->serial;
+
+	return serial_a < serial_b ? -1 : serial_a > serial_b ? 1 : 0;
+}
+
+static void
+cascade_slot(timer_wheel_t* wheel, int slot)
+{
+	int index;
+	int next;
+
+	index = wheel->heads[slot];
+	wheel->heads[slot] = -1;
+	while (index >= 0) {
+		next = wheel->timers[index].next;
+		link_timer(wheel, index);
+		index = next;
+	}
+}
+
+static void
+link_timer(timer_wheel_t* wheel, int index)
+{
+	int64_t       deadline;
+	int64_t       delta;
+	int           shift;
+	int           slot;
+	struct timer* timer;
+
+	int i_level;
+
+	timer = &wheel->timers[index];
+	deadline = timer->deadline;
+	delta = deadline - wheel->current;
+	if (delta < ROOT_SLOTS)
+		slot = (delta < 0 ? wheel->current : deadline) & (ROOT_SLOTS - 1);
+	else {
+		// timers too far out for the top level wait in its last slot and get
+		// put back there every time it cascades until they're in range
+		if (delta >= MAX_SPAN)
+			deadline = wheel->current + MAX_SPAN - 1;
+		for (i_level = 1; i_level < NUM_LEVELS - 1; ++i_level) {
+			if (delta < (int64_t)1 << (ROOT_BITS + i_level * LEVEL_BITS))
+				break;
+		}
+		shift = ROOT_BITS + (i_level - 1) * LEVEL_BITS;
+		slot = ROOT_SLOTS + (i_level - 1) * LEVEL_SLOTS + ((deadline >> shift) & (LEVEL_SLOTS - 1));
+	}
+	timer->slot = slot;
+	timer->prev = -1;
+	timer->next = wheel->heads[slot];
+	if (timer->next >= 0)
+		wheel->timers[timer->next].prev = index;
+	wheel->heads[slot] = index;
+}
+
+static void
+release_timer(timer_wheel_t* wheel, int index)
+{
+	struct timer* timer;
+
+	timer = &wheel->timers[index];
+	free_script(timer->script);
+	timer->script = NULL;
+	timer->slot = SLOT_FREE;
+	timer->next = wheel->free_list;
+	wheel->free_list = index;
+	--wheel->num_timers;
+}
+
+static void
+unlink_timer(timer_wheel_t* wheel, int index)
+{
+	struct timer* timer;
+
+	timer = &wheel->timers[index];
+	if (timer->prev >= 0)
+		wheel->timers[timer->prev].next = timer->next;
+	else
+		wheel->heads[timer->slot] = timer->next;
+	if (timer->next >= 0)
+		wheel->timers[timer->next].prev = timer->prev;
+	timer->prev = timer->next = -1;
+}
+
+void
+init_timer_api(void)
+{
+	register_api_function(g_duk, NULL, "ClearTimer", js_ClearTimer);
+	register_api_function(g_duk, NULL, "SetInterval", js_SetInterval);
+	register_api_function(g_duk, NULL, "SetTimeout", js_SetTimeout);
+}
+
+static void
+start_timer(duk_context* ctx, const char* func_name, bool is_interval)
+{
+	int n_args = duk_get_top(ctx);
+	script_t* script = duk_require_sphere_script(ctx, 0, is_interval ? "[interval script]" : "[timeout script]");
+	int delay = duk_require_int(ctx, 1);
+	bool in_frames = n_args >= 3 ? duk_require_boolean(ctx, 2) : false;
+
+	unsigned int   id;
+	int64_t        lag = 0;
+	timer_wheel_t* wheel;
+
+	if (delay < 0 || (is_interval && delay == 0)) {
+		free_script(script);
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "%s(): Delay must be %s (%i)", func_name,
+			is_interval ? "greater than zero" : "non-negative", delay);
+	}
+
+	// the millisecond wheel only catches up with the clock once per frame,
+	// so mid-frame it can be behind by as much as a frame. count the delay
+	// from the clock, or the timer would fire early.
+	wheel = in_frames ? s_frame_timers : s_ms_timers;
+	if (!in_frames)
+		lag = fmax((int64_t)(al_get_time() * 1000) + 1 - wheel->current, 0);
+
+	// a delay of N means the Nth frame (or millisecond) from now, and the
+	// wheel is already on the next one
+	if (!(id = add_timer(wheel, lag + delay - 1, is_interval ? delay : 0, script))) {
+		free_script(script);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "%s(): Failed to create timer", func_name);
+	}
+	duk_push_uint(ctx, id);
+}
+
+static duk_ret_t
+js_ClearTimer(duk_context* ctx)
+{
+	unsigned int id = duk_require_uint(ctx, 0);
+
+	duk_push_boolean(ctx, cancel_timer(s_ms_timers, id) || cancel_timer(s_frame_timers, id));
+	return 1;
+}
+
+static duk_ret_t
+js_SetInterval(duk_context* ctx)
+{
+	start_timer(ctx, "SetInterval", true);
+	return 1;
+}
+
+static duk_ret_t
+js_SetTimeout(duk_context* ctx)
+{
+	start_timer(ctx, "SetTimeout", false);
+	return 1;
+}
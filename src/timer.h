@@ -0,0 +1,20 @@
+#ifndef MINISPHERE__TIMER_H__INCLUDED
+#define MINISPHERE__TIMER_H__INCLUDED
+
+typedef struct timer_wheel timer_wheel_t;
+
+extern void initialize_timers (void);
+extern void shutdown_timers   (void);
+extern void update_timers     (void);
+
+extern timer_wheel_t* create_timer_wheel  (unsigned int id_flag, int64_t now);
+extern void           free_timer_wheel    (timer_wheel_t* wheel);
+extern int            get_timer_count     (const timer_wheel_t* wheel);
+extern unsigned int   add_timer           (timer_wheel_t* wheel, int64_t delay, int64_t interval, script_t* script);
+extern void           advance_timer_wheel (timer_wheel_t* wheel, int64_t now);
+extern bool           cancel_timer        (timer_wheel_t* wheel, unsigned int id);
+extern void           clear_timers        (timer_wheel_t* wheel);
+
+extern void init_timer_api (void);
+
+#endif // MINISPHERE__TIMER_H__INCLUDED
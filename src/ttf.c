@@ -0,0 +1,484 @@
+#include "minisphere.h"
+#include "color.h"
+#include "render.h"
+
+#include "ttf.h"
+
+// note: a TrueType font can cover tens of thousands of characters (CJK fonts
+//       especially), far too many to rasterize up front the way an RFN font
+//       is loaded. glyphs are instead rasterized the first time they're
+//       drawn, into fixed-size cells on a few shared atlas pages, and drawn
+//       from there as textured quads, one al_draw_prim() call per page per
+//       string.
+//
+//       once every cell on every page is in use, a new glyph takes over the
+//       cell of the one drawn least recently. glyphs used by the string
+//       being drawn are never evicted to make room for others in the same
+//       string; if a single string has more distinct characters than there
+//       are cells, it's handed to Allegro to draw directly instead.
+//
+//       advance widths are cached separately and never evicted, so measuring
+//       and wrapping text doesn't rasterize anything.
+
+#define PAGE_SIZE 512
+#define MAX_PAGES 4
+
+struct ttf
+{
+	ALLEGRO_FONT*       font;
+	int                 height;
+	int                 ascii_widths[128];
+	int                 max_advances;
+	int                 num_advances;
+	struct ttf_advance* advances;
+	int                 cell_w, cell_h;
+	int                 cells_per_page;
+	int                 page_cols;
+	int                 page_w, page_h;
+	int                 num_pages;
+	ALLEGRO_BITMAP*     pages[MAX_PAGES];
+	int                 max_cells;
+	int                 num_cells;
+	struct ttf_cell*    cells;
+	int                 num_buckets;
+	struct ttf_cell**   buckets;
+	struct ttf_cell*    lru_head;
+	struct ttf_cell*    lru_tail;
+	unsigned int        draw_id;
+	int64_t             num_hits;
+	int64_t             num_misses;
+	int64_t             num_evictions;
+};
+
+struct ttf_advance
+{
+	int32_t codepoint;
+	int     width;
+};
+
+struct ttf_cell
+{
+	int32_t          codepoint;
+	int              page;
+	int              x, y;
+	int              width;
+	unsigned int     draw_id;
+	struct ttf_cell* hash_next;
+	struct ttf_cell* lru_prev;
+	struct ttf_cell* lru_next;
+};
+
+struct glyph_ref
+{
+	struct ttf_cell* cell;
+	float            x;
+};
+
+static int32_t          decode_utf8      (const char* text, int* out_length);
+static int              get_advance      (ttf_t* ttf, int32_t codepoint);
+static uint32_t         hash_codepoint   (int32_t codepoint);
+static struct ttf_cell* lookup_glyph     (ttf_t* ttf, int32_t codepoint);
+static int              measure_glyph    (const ttf_t* ttf, int32_t codepoint);
+static void             rasterize_glyph  (ttf_t* ttf, struct ttf_cell* cell);
+static void             unlink_lru       (ttf_t* ttf, struct ttf_cell* cell);
+
+static int               s_max_refs = 0;
+static int               s_max_verts = 0;
+static struct glyph_ref* s_refs = NULL;
+static ALLEGRO_VERTEX*   s_verts = NULL;
+
+void
+shutdown_ttf(void)
+{
+	free(s_refs);
+	free(s_verts);
+	s_refs = NULL;
+	s_verts = NULL;
+	s_max_refs = s_max_verts = 0;
+}
+
+ttf_t*
+load_ttf(const char* path, int size)
+{
+	int    max_width = 0;
+	ttf_t* ttf = NULL;
+
+	int i;
+
+	if (!(ttf = calloc(1, sizeof(ttf_t)))) goto on_error;
+	if (!(ttf->font = al_load_ttf_font(path, size, 0x0)))
+		goto on_error;
+	ttf->height = al_get_font_line_height(ttf->font);
+	for (i = 0; i < 128; ++i) {
+		ttf->ascii_widths[i] = i >= 32 ? measure_glyph(ttf, i) : 0;
+		max_width = fmax(max_width, ttf->ascii_widths[i]);
+	}
+
+	// cells are sized for the widest ASCII glyph or a full-width (square)
+	// one, whichever is bigger. anything wider is clipped.
+	ttf->cell_w = fmax(max_width, ttf->height);
+	ttf->cell_h = ttf->height;
+	ttf->page_w = fmax(PAGE_SIZE, ttf->cell_w);
+	ttf->page_h = fmax(PAGE_SIZE, ttf->cell_h);
+	ttf->page_cols = ttf->page_w / ttf->cell_w;
+	ttf->cells_per_page = ttf->page_cols * (ttf->page_h / ttf->cell_h);
+	ttf->max_cells = ttf->cells_per_page * MAX_PAGES;
+	ttf->num_buckets = 64;
+	while (ttf->num_buckets < ttf->max_cells)
+		ttf->num_buckets *= 2;
+	ttf->max_advances = 256;
+	if (!(ttf->cells = calloc(ttf->max_cells, sizeof(struct ttf_cell)))) goto on_error;
+	if (!(ttf->buckets = calloc(ttf->num_buckets, sizeof(struct ttf_cell*)))) goto on_error;
+	if (!(ttf->advances = calloc(ttf->max_advances, sizeof(struct ttf_advance)))) goto on_error;
+	return ttf;
+
+on_error:
+	if (ttf != NULL) {
+		if (ttf->font != NULL) al_destroy_font(ttf->font);
+		free(ttf->buckets);
+		free(ttf->cells);
+		free(ttf);
+	}
+	return NULL;
+}
+
+void
+free_ttf(ttf_t* ttf)
+{
+	int i;
+
+	if (ttf == NULL)
+		return;
+	for (i = 0; i < ttf->num_pages; ++i)
+		al_destroy_bitmap(ttf->pages[i]);
+	al_destroy_font(ttf->font);
+	free(ttf->advances);
+	free(ttf->buckets);
+	free(ttf->cells);
+	free(ttf);
+}
+
+int
+get_ttf_line_height(const ttf_t* ttf)
+{
+	return ttf->height;
+}
+
+void
+get_ttf_stats(const ttf_t* ttf, ttf_stats_t* out_stats)
+{
+	out_stats->hits = ttf->num_hits;
+	out_stats->misses = ttf->num_misses;
+	out_stats->evictions = ttf->num_evictions;
+	out_stats->num_glyphs = ttf->num_cells;
+	out_stats->num_pages = ttf->num_pages;
+}
+
+int
+read_ttf_char(ttf_t* ttf, const char* text, int* inout_width)
+{
+	int32_t cp;
+	int     length;
+
+	cp = decode_utf8(text, &length);
+	*inout_width += get_advance(ttf, cp);
+	return length;
+}
+
+void
+draw_ttf_text(ttf_t* ttf, color_t color, int x, int y, const char* text)
+{
+	struct ttf_cell*  cell;
+	int32_t           cp;
+	int               length;
+	size_t            max_glyphs;
+	int               new_max;
+	struct glyph_ref* new_refs;
+	ALLEGRO_VERTEX*   new_verts;
+	int               num_refs;
+	int               num_verts;
+	const char*       p;
+	float             pen_x;
+	ALLEGRO_COLOR     vertex_color;
+	ALLEGRO_VERTEX*   v;
+	float             x1, y1;
+	float             u0, v0, u1, v1;
+
+	int i, page;
+
+	// every character takes at least one byte, so the length of the string
+	// bounds the number of glyphs
+	if ((max_glyphs = strlen(text)) == 0)
+		return;
+	if (max_glyphs > (size_t)s_max_refs) {
+		new_max = max_glyphs;
+		if (!(new_refs = realloc(s_refs, new_max * sizeof(struct glyph_ref))))
+			return;
+		s_refs = new_refs;
+		s_max_refs = new_max;
+	}
+	if (max_glyphs * 6 > (size_t)s_max_verts) {
+		new_max = max_glyphs * 6;
+		if (!(new_verts = realloc(s_verts, new_max * sizeof(ALLEGRO_VERTEX))))
+			return;
+		s_verts = new_verts;
+		s_max_verts = new_max;
+	}
+
+	// pass 1: find (or rasterize) every glyph in the string. this may switch
+	// render targets, so it's all done before anything is drawn.
+	if (++ttf->draw_id == 0)
+		++ttf->draw_id;
+	num_refs = 0;
+	pen_x = x;
+	p = text;
+	while (*p != '\0') {
+		cp = decode_utf8(p, &length);
+		p += length;
+		if (cp != ' ') {
+			if (!(cell = lookup_glyph(ttf, cp))) {
+				al_draw_text(ttf->font, nativecolor(color), x, y, 0x0, text);
+				return;
+			}
+			s_refs[num_refs].cell = cell;
+			s_refs[num_refs].x = pen_x;
+			++num_refs;
+		}
+		pen_x += get_advance(ttf, cp);
+	}
+
+	// pass 2: draw the glyphs, one batch per atlas page. most strings only
+	// touch one page.
+	vertex_color = nativecolor(color);
+	flush_render_batch();
+	for (page = 0; page < ttf->num_pages; ++page) {
+		v = s_verts;
+		for (i = 0; i < num_refs; ++i) {
+			cell = s_refs[i].cell;
+			if (cell->page != page)
+				continue;
+			x1 = s_refs[i].x + cell->width; y1 = y + ttf->cell_h;
+			u0 = cell->x; u1 = u0 + cell->width;
+			v0 = cell->y; v1 = v0 + ttf->cell_h;
+			v[0].x = s_refs[i].x; v[0].y = y; v[0].u = u0; v[0].v = v0;
+			v[1].x = x1; v[1].y = y; v[1].u = u1; v[1].v = v0;
+			v[2].x = s_refs[i].x; v[2].y = y1; v[2].u = u0; v[2].v = v1;
+			v[3] = v[1];
+			v[4].x = x1; v[4].y = y1; v[4].u = u1; v[4].v = v1;
+			v[5] = v[2];
+			v[0].z = v[1].z = v[2].z = v[3].z = v[4].z = v[5].z = 0.0;
+			v[0].color = v[1].color = v[2].color = v[3].color = v[4].color = v[5].color = vertex_color;
+			v += 6;
+		}
+		if ((num_verts = v - s_verts) > 0)
+			al_draw_prim(s_verts, NULL, ttf->pages[page], 0, num_verts, ALLEGRO_PRIM_TRIANGLE_LIST);
+	}
+}
+
+static int32_t
+decode_utf8(const char* text, int* out_length)
+{
+	int32_t        cp;
+	int            length;
+	int32_t        low;
+	int            low_length;
+	const uint8_t* p;
+
+	int i;
+
+	p = (const uint8_t*)text;
+	if (p[0] < 0x80) {
+		*out_length = 1;
+		return p[0];
+	}
+	else if ((p[0] & 0xE0) == 0xC0) { length = 2; cp = p[0] & 0x1F; }
+	else if ((p[0] & 0xF0) == 0xE0) { length = 3; cp = p[0] & 0x0F; }
+	else if ((p[0] & 0xF8) == 0xF0) { length = 4; cp = p[0] & 0x07; }
+	else
+		goto on_error;
+	for (i = 1; i < length; ++i) {
+		if ((p[i] & 0xC0) != 0x80)  // also catches the terminator
+			goto on_error;
+		cp = cp << 6 | (p[i] & 0x3F);
+	}
+	*out_length = length;
+
+	// Duktape strings are CESU-8, which encodes characters outside the BMP
+	// as a surrogate pair with each half encoded separately
+	if (cp >= 0xD800 && cp <= 0xDBFF) {
+		low = decode_utf8(text + length, &low_length);
+		if (low >= 0xDC00 && low <= 0xDFFF) {
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+			*out_length += low_length;
+		}
+	}
+	return cp;
+
+on_error:
+	*out_length = 1;
+	return 0xFFFD;
+}
+
+static int
+get_advance(ttf_t* ttf, int32_t codepoint)
+{
+	struct ttf_advance* entry;
+	int                 mask;
+	int                 new_max;
+	struct ttf_advance* new_table;
+	int                 width;
+
+	int i, j;
+
+	if (codepoint < 128)
+		return ttf->ascii_widths[codepoint];
+	mask = ttf->max_advances - 1;
+	i = hash_codepoint(codepoint) & mask;
+	while (ttf->advances[i].codepoint != 0) {
+		if (ttf->advances[i].codepoint == codepoint)
+			return ttf->advances[i].width;
+		i = (i + 1) & mask;
+	}
+	width = measure_glyph(ttf, codepoint);
+	if ((ttf->num_advances + 1) * 2 > ttf->max_advances) {
+		// keep the table at most half full so probes stay short. if it
+		// can't grow, the width just isn't cached.
+		new_max = ttf->max_advances * 2;
+		if (!(new_table = calloc(new_max, sizeof(struct ttf_advance))))
+			return width;
+		for (i = 0; i < ttf->max_advances; ++i) {
+			if ((entry = &ttf->advances[i])->codepoint == 0)
+				continue;
+			j = hash_codepoint(entry->codepoint) & (new_max - 1);
+			while (new_table[j].codepoint != 0)
+				j = (j + 1) & (new_max - 1);
+			new_table[j] = *entry;
+		}
+		free(ttf->advances);
+		ttf->advances = new_table;
+		ttf->max_advances = new_max;
+		mask = new_max - 1;
+		i = hash_codepoint(codepoint) & mask;
+		while (ttf->advances[i].codepoint != 0)
+			i = (i + 1) & mask;
+	}
+	ttf->advances[i].codepoint = codepoint;
+	ttf->advances[i].width = width;
+	++ttf->num_advances;
+	return width;
+}
+
+static uint32_t
+hash_codepoint(int32_t codepoint)
+{
+	return (uint32_t)codepoint * 2654435761U;
+}
+
+static struct ttf_cell*
+lookup_glyph(ttf_t* ttf, int32_t codepoint)
+{
+	struct ttf_cell*  cell;
+	struct ttf_cell** link;
+	int               index;
+
+	link = &ttf->buckets[hash_codepoint(codepoint) & (ttf->num_buckets - 1)];
+	for (cell = *link; cell != NULL; cell = cell->hash_next) {
+		if (cell->codepoint == codepoint) {
+			++ttf->num_hits;
+			unlink_lru(ttf, cell);
+			goto use_cell;
+		}
+	}
+
+	++ttf->num_misses;
+	if (ttf->num_cells < ttf->max_cells) {
+		index = ttf->num_cells % ttf->cells_per_page;
+		if (index == 0) {
+			if (!(ttf->pages[ttf->num_pages] = al_create_bitmap(ttf->page_w, ttf->page_h)))
+				return NULL;
+			++ttf->num_pages;
+		}
+		cell = &ttf->cells[ttf->num_cells++];
+		cell->page = ttf->num_pages - 1;
+		cell->x = index % ttf->page_cols * ttf->cell_w;
+		cell->y = index / ttf->page_cols * ttf->cell_h;
+	}
+	else {
+		// every cell is taken: evict the least recently drawn glyph, unless
+		// it's in the string being drawn right now
+		cell = ttf->lru_tail;
+		if (cell->draw_id == ttf->draw_id)
+			return NULL;
+		for (link = &ttf->buckets[hash_codepoint(cell->codepoint) & (ttf->num_buckets - 1)];
+			*link != cell; link = &(*link)->hash_next);
+		*link = cell->hash_next;
+		unlink_lru(ttf, cell);
+		++ttf->num_evictions;
+	}
+	cell->codepoint = codepoint;
+	cell->width = fmin(get_advance(ttf, codepoint), ttf->cell_w);
+	rasterize_glyph(ttf, cell);
+	link = &ttf->buckets[hash_codepoint(codepoint) & (ttf->num_buckets - 1)];
+	cell->hash_next = *link;
+	*link = cell;
+
+use_cell:
+	cell->draw_id = ttf->draw_id;
+	cell->lru_prev = NULL;
+	cell->lru_next = ttf->lru_head;
+	if (ttf->lru_head != NULL)
+		ttf->lru_head->lru_prev = cell;
+	else
+		ttf->lru_tail = cell;
+	ttf->lru_head = cell;
+	return cell;
+}
+
+static int
+measure_glyph(const ttf_t* ttf, int32_t codepoint)
+{
+	char              buffer[4];
+	ALLEGRO_USTR_INFO info;
+	size_t            length;
+
+	length = al_utf8_encode(buffer, codepoint);
+	return al_get_ustr_width(ttf->font, al_ref_buffer(&info, buffer, length));
+}
+
+static void
+rasterize_glyph(ttf_t* ttf, struct ttf_cell* cell)
+{
+	char              buffer[4];
+	ALLEGRO_USTR_INFO info;
+	size_t            length;
+	ALLEGRO_STATE     old_state;
+	ALLEGRO_TRANSFORM transform;
+
+	// the glyph is copied into the cell as-is (white, with coverage in the
+	// alpha channel) so the vertex color can tint it like an RFN glyph
+	flush_render_batch();
+	al_store_state(&old_state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_TRANSFORM | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(ttf->pages[cell->page]);
+	al_identity_transform(&transform);
+	al_use_transform(&transform);
+	al_set_clipping_rectangle(cell->x, cell->y, ttf->cell_w, ttf->cell_h);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+	length = al_utf8_encode(buffer, cell->codepoint);
+	al_draw_ustr(ttf->font, al_map_rgba(255, 255, 255, 255), cell->x, cell->y, 0x0,
+		al_ref_buffer(&info, buffer, length));
+	al_restore_state(&old_state);
+}
+
+static void
+unlink_lru(ttf_t* ttf, struct ttf_cell* cell)
+{
+	if (cell->lru_prev != NULL)
+		cell->lru_prev->lru_next = cell->lru_next;
+	else
+		ttf->lru_head = cell->lru_next;
+	if (cell->lru_next != NULL)
+		cell->lru_next->lru_prev = cell->lru_prev;
+	else
+		ttf->lru_tail = cell->lru_prev;
+}
@@ -0,0 +1,25 @@
+#ifndef MINISPHERE__TTF_H__INCLUDED
+#define MINISPHERE__TTF_H__INCLUDED
+
+#include "color.h"
+
+typedef struct ttf ttf_t;
+
+typedef struct ttf_stats
+{
+	int64_t hits;
+	int64_t misses;
+	int64_t evictions;
+	int     num_glyphs;
+	int     num_pages;
+} ttf_stats_t;
+
+extern void   shutdown_ttf        (void);
+extern ttf_t* load_ttf            (const char* path, int size);
+extern void   free_ttf            (ttf_t* ttf);
+extern int    get_ttf_line_height (const ttf_t* ttf);
+extern void   get_ttf_stats       (const ttf_t* ttf, ttf_stats_t* out_stats);
+extern int    read_ttf_char       (ttf_t* ttf, const char* text, int* inout_width);
+extern void   draw_ttf_text       (ttf_t* ttf, color_t color, int x, int y, const char* text);
+
+#endif // MINISPHERE__TTF_H__INCLUDED
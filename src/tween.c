@@ -0,0 +1,706 @@
+#include "minisphere.h"
+#include "api.h"
+#include "color.h"
+#include "galileo.h"
+#include "persons.h"
+#include "sound.h"
+
+#include "tween.h"
+
+// note: a tween moves one property of a native object (a person, a Galileo
+//       group or a sound) from wherever it is when the tween starts to a
+//       given value over a number of frames. running tweens are stepped
+//       natively once per frame, so scripts only hear about one when it
+//       finishes and calls back. tweens can be chained: when one finishes,
+//       the one set as its successor is started, which together with start
+//       delays is enough to build a timeline.
+//
+//       tweens are stepped by the map engine update while it's running, so
+//       that persons move in step with the rest of the map, and otherwise
+//       at the end of every frame in flip_screen(). either way each frame
+//       only steps them once.
+
+static duk_ret_t js_GetNumTweens     (duk_context* ctx);
+static duk_ret_t js_new_Tween        (duk_context* ctx);
+static duk_ret_t js_Tween_finalize   (duk_context* ctx);
+static duk_ret_t js_Tween_get_delay  (duk_context* ctx);
+static duk_ret_t js_Tween_get_running (duk_context* ctx);
+static duk_ret_t js_Tween_set_delay  (duk_context* ctx);
+static duk_ret_t js_Tween_onFinish   (duk_context* ctx);
+static duk_ret_t js_Tween_start      (duk_context* ctx);
+static duk_ret_t js_Tween_stop       (duk_context* ctx);
+static duk_ret_t js_Tween_then       (duk_context* ctx);
+
+static double   apply_easing   (tween_ease_t easing, double t);
+static int      get_tween_prop (const tween_t* tween, float out_value[4]);
+static tween_t* new_tween      (int target_type, tween_prop_t property, const float value[4], int frames, tween_ease_t easing);
+static void     put_tween_prop (tween_t* tween, const float value[4]);
+static void     remove_tween   (int index);
+
+enum tween_target
+{
+	TARGET_PERSON,
+	TARGET_GROUP,
+	TARGET_SOUND
+};
+
+struct tween
+{
+	unsigned int refcount;
+	int          target_type;
+	char*        person_name;
+	person_t*    person;
+	group_t*     group;
+	sound_t*     sound;
+	tween_prop_t property;
+	tween_ease_t easing;
+	int          num_channels;
+	float        start[4];
+	float        end[4];
+	int          delay;
+	int          delay_left;
+	int          frames;
+	int          frame;
+	bool         is_running;
+	tween_t*     next;
+	script_t*    script;
+};
+
+static const char* const s_prop_names[TWEEN_PROP_MAX] =
+{
+	"x", "y", "angle", "scaleX", "scaleY", "mask", "rotX", "rotY", "volume", "pan"
+};
+
+static bool      s_is_updated = false;
+static int       s_max_tweens = 0;
+static int       s_num_tweens = 0;
+static tween_t** s_tweens = NULL;
+
+void
+initialize_tweens(void)
+{
+	printf("Initializing tween manager\n");
+	s_tweens = NULL;
+	s_max_tweens = s_num_tweens = 0;
+	s_is_updated = false;
+}
+
+void
+shutdown_tweens(void)
+{
+	printf("Shutting down tween manager\n");
+	while (s_num_tweens > 0)
+		stop_tween(s_tweens[0]);
+	free(s_tweens);
+	s_tweens = NULL;
+	s_max_tweens = 0;
+}
+
+tween_t*
+new_person_tween(const char* person_name, tween_prop_t property, const float value[4], int frames, tween_ease_t easing)
+{
+	tween_t* tween;
+
+	if (property != TWEEN_X && property != TWEEN_Y && property != TWEEN_ANGLE
+		&& property != TWEEN_SCALE_X && property != TWEEN_SCALE_Y && property != TWEEN_MASK)
+	{
+		return NULL;
+	}
+	if (!(tween = new_tween(TARGET_PERSON, property, value, frames, easing)))
+		return NULL;
+	if (!(tween->person_name = strdup(person_name))) {
+		free_tween(tween);
+		return NULL;
+	}
+	return tween;
+}
+
+tween_t*
+new_group_tween(group_t* group, tween_prop_t property, const float value[4], int frames, tween_ease_t easing)
+{
+	tween_t* tween;
+
+	if (property != TWEEN_X && property != TWEEN_Y && property != TWEEN_ANGLE
+		&& property != TWEEN_ROT_X && property != TWEEN_ROT_Y)
+	{
+		return NULL;
+	}
+	if (!(tween = new_tween(TARGET_GROUP, property, value, frames, easing)))
+		return NULL;
+	tween->group = ref_group(group);
+	return tween;
+}
+
+tween_t*
+new_sound_tween(sound_t* sound, tween_prop_t property, const float value[4], int frames, tween_ease_t easing)
+{
+	tween_t* tween;
+
+	if (property != TWEEN_VOLUME && property != TWEEN_PAN)
+		return NULL;
+	if (!(tween = new_tween(TARGET_SOUND, property, value, frames, easing)))
+		return NULL;
+	tween->sound = ref_sound(sound);
+	return tween;
+}
+
+tween_t*
+ref_tween(tween_t* tween)
+{
+	if (tween != NULL)
+		++tween->refcount;
+	return tween;
+}
+
+void
+free_tween(tween_t* tween)
+{
+	if (tween == NULL || --tween->refcount > 0)
+		return;
+	free(tween->person_name);
+	free_group(tween->group);
+	if (tween->sound != NULL)
+		free_sound(tween->sound);
+	free_tween(tween->next);
+	free_script(tween->script);
+	free(tween);
+}
+
+bool
+is_tween_running(const tween_t* tween)
+{
+	return tween->is_running;
+}
+
+int
+get_tween_count(void)
+{
+	return s_num_tweens;
+}
+
+int
+get_tween_delay(const tween_t* tween)
+{
+	return tween->delay;
+}
+
+void
+set_tween_delay(tween_t* tween, int frames)
+{
+	tween->delay = frames;
+}
+
+bool
+set_tween_next(tween_t* tween, tween_t* next)
+{
+	tween_t* old_next;
+	tween_t* link;
+
+	// tweens hold references to their successors, so a chain leading back
+	// to this tween would never be freed
+	for (link = next; link != NULL; link = link->next) {
+		if (link == tween)
+			return false;
+	}
+	old_next = tween->next;
+	tween->next = ref_tween(next);
+	free_tween(old_next);
+	return true;
+}
+
+void
+set_tween_script(tween_t* tween, script_t* script)
+{
+	free_script(tween->script);
+	tween->script = script;
+}
+
+bool
+start_tween(tween_t* tween)
+{
+	tween_t** new_list;
+	int       new_max;
+
+	// persons are looked up by name when the tween starts, so a tween can
+	// be set up before the person it moves exists
+	if (tween->target_type == TARGET_PERSON) {
+		if (!(tween->person = find_person(tween->person_name)))
+			return false;
+	}
+	if (!tween->is_running) {
+		if (s_num_tweens + 1 > s_max_tweens) {
+			new_max = (s_num_tweens + 1) * 2;
+			if (!(new_list = realloc(s_tweens, new_max * sizeof(tween_t*))))
+				return false;
+			s_tweens = new_list;
+			s_max_tweens = new_max;
+		}
+		s_tweens[s_num_tweens++] = ref_tween(tween);
+		tween->is_running = true;
+	}
+	tween->delay_left = tween->delay;
+	tween->frame = 0;
+	return true;
+}
+
+void
+stop_tween(tween_t* tween)
+{
+	int i;
+
+	for (i = 0; i < s_num_tweens; ++i) {
+		if (s_tweens[i] == tween) {
+			remove_tween(i);
+			return;
+		}
+	}
+}
+
+void
+detach_person_tweens(const person_t* person)
+{
+	int i;
+
+	for (i = 0; i < s_num_tweens; ++i) {
+		if (s_tweens[i]->person == person)
+			remove_tween(i--);
+	}
+}
+
+void
+end_tween_frame(void)
+{
+	if (!s_is_updated)
+		update_tweens();
+	s_is_updated = false;
+}
+
+void
+update_tweens(void)
+{
+	tween_t** finished;
+	int       num_finished = 0;
+	double    t;
+	tween_t*  tween;
+	float     value[4];
+
+	int i, j;
+
+	if (s_is_updated)
+		return;
+	s_is_updated = true;
+	if (s_num_tweens == 0)
+		return;
+
+	// finished tweens are set aside and only called back once every tween
+	// has been stepped: a callback is free to start and stop tweens,
+	// or even to flip the screen
+	if (!(finished = malloc(s_num_tweens * sizeof(tween_t*))))
+		return;
+	for (i = 0; i < s_num_tweens; ++i) {
+		tween = s_tweens[i];
+		if (tween->delay_left > 0) {
+			--tween->delay_left;
+			continue;
+		}
+		if (tween->frame == 0)
+			get_tween_prop(tween, tween->start);
+		++tween->frame;
+		t = tween->frames > 0 ? fmin((double)tween->frame / tween->frames, 1.0) : 1.0;
+		t = apply_easing(tween->easing, t);
+		for (j = 0; j < tween->num_channels; ++j)
+			value[j] = tween->start[j] + (tween->end[j] - tween->start[j]) * t;
+		put_tween_prop(tween, value);
+		if (tween->frame >= tween->frames)
+			finished[num_finished++] = ref_tween(tween);
+	}
+	for (i = 0; i < num_finished; ++i)
+		stop_tween(finished[i]);
+	for (i = 0; i < num_finished; ++i) {
+		tween = finished[i];
+		if (tween->next != NULL)
+			start_tween(tween->next);
+		run_script(tween->script, false);
+		free_tween(tween);
+	}
+	free(finished);
+}
+
+static double
+apply_easing(tween_ease_t easing, double t)
+{
+	double u;
+
+	switch (easing) {
+	case EASE_IN_QUAD: return t * t;
+	case EASE_OUT_QUAD: return t * (2 - t);
+	case EASE_IN_OUT_QUAD: return t < 0.5 ? 2 * t * t : -1 + (4 - 2 * t) * t;
+	case EASE_IN_CUBIC: return t * t * t;
+	case EASE_OUT_CUBIC: u = t - 1; return u * u * u + 1;
+	case EASE_IN_OUT_CUBIC:
+		u = 2 * t - 2;
+		return t < 0.5 ? 4 * t * t * t : u * u * u / 2 + 1;
+	case EASE_IN_SINE: return 1 - cos(t * M_PI_2);
+	case EASE_OUT_SINE: return sin(t * M_PI_2);
+	case EASE_IN_OUT_SINE: return (1 - cos(t * M_PI)) / 2;
+	case EASE_OUT_BACK:
+		u = t - 1;
+		return u * u * (2.70158 * u + 1.70158) + 1;
+	case EASE_OUT_BOUNCE:
+		if (t < 1 / 2.75)
+			return 7.5625 * t * t;
+		else if (t < 2 / 2.75) {
+			u = t - 1.5 / 2.75;
+			return 7.5625 * u * u + 0.75;
+		}
+		else if (t < 2.5 / 2.75) {
+			u = t - 2.25 / 2.75;
+			return 7.5625 * u * u + 0.9375;
+		}
+		else {
+			u = t - 2.625 / 2.75;
+			return 7.5625 * u * u + 0.984375;
+		}
+	default: return t;
+	}
+}
+
+static int
+get_tween_prop(const tween_t* tween, float out_value[4])
+{
+	int     layer;
+	color_t mask;
+	double  x, y;
+	float   x_f, y_f;
+
+	switch (tween->target_type) {
+	case TARGET_PERSON:
+		switch (tween->property) {
+		case TWEEN_X:
+		case TWEEN_Y:
+			get_person_xyz(tween->person, &x, &y, &layer, false);
+			out_value[0] = tween->property == TWEEN_X ? x : y;
+			return 1;
+		case TWEEN_ANGLE:
+			out_value[0] = get_person_angle(tween->person);
+			return 1;
+		case TWEEN_SCALE_X:
+		case TWEEN_SCALE_Y:
+			get_person_scale(tween->person, &x, &y);
+			out_value[0] = tween->property == TWEEN_SCALE_X ? x : y;
+			return 1;
+		case TWEEN_MASK:
+			mask = get_person_mask(tween->person);
+			out_value[0] = mask.r; out_value[1] = mask.g;
+			out_value[2] = mask.b; out_value[3] = mask.alpha;
+			return 4;
+		default:
+			return 0;
+		}
+	case TARGET_GROUP:
+		switch (tween->property) {
+		case TWEEN_X:
+		case TWEEN_Y:
+			get_group_xy(tween->group, &x_f, &y_f);
+			out_value[0] = tween->property == TWEEN_X ? x_f : y_f;
+			return 1;
+		case TWEEN_ROT_X:
+		case TWEEN_ROT_Y:
+			get_group_rot_xy(tween->group, &x_f, &y_f);
+			out_value[0] = tween->property == TWEEN_ROT_X ? x_f : y_f;
+			return 1;
+		case TWEEN_ANGLE:
+			out_value[0] = get_group_angle(tween->group);
+			return 1;
+		default:
+			return 0;
+		}
+	case TARGET_SOUND:
+		out_value[0] = tween->property == TWEEN_VOLUME
+			? get_sound_gain(tween->sound)
+			: get_sound_pan(tween->sound);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static tween_t*
+new_tween(int target_type, tween_prop_t property, const float value[4], int frames, tween_ease_t easing)
+{
+	tween_t* tween;
+
+	if (!(tween = calloc(1, sizeof(tween_t))))
+		return NULL;
+	tween->target_type = target_type;
+	tween->property = property;
+	tween->easing = easing;
+	tween->frames = frames;
+	tween->num_channels = property == TWEEN_MASK ? 4 : 1;
+	memcpy(tween->end, value, tween->num_channels * sizeof(float));
+	return ref_tween(tween);
+}
+
+static void
+put_tween_prop(tween_t* tween, const float value[4])
+{
+	int    layer;
+	double x, y;
+	float  x_f, y_f;
+
+	switch (tween->target_type) {
+	case TARGET_PERSON:
+		switch (tween->property) {
+		case TWEEN_X:
+		case TWEEN_Y:
+			get_person_xyz(tween->person, &x, &y, &layer, false);
+			if (tween->property == TWEEN_X) x = value[0];
+			else y = value[0];
+			set_person_xyz(tween->person, x, y, layer);
+			break;
+		case TWEEN_ANGLE:
+			set_person_angle(tween->person, value[0]);
+			break;
+		case TWEEN_SCALE_X:
+		case TWEEN_SCALE_Y:
+			get_person_scale(tween->person, &x, &y);
+			if (tween->property == TWEEN_SCALE_X) x = value[0];
+			else y = value[0];
+			set_person_scale(tween->person, x, y);
+			break;
+		case TWEEN_MASK:
+			set_person_mask(tween->person, rgba(
+				fmin(fmax(value[0] + 0.5, 0), 255), fmin(fmax(value[1] + 0.5, 0), 255),
+				fmin(fmax(value[2] + 0.5, 0), 255), fmin(fmax(value[3] + 0.5, 0), 255)));
+			break;
+		default:
+			break;
+		}
+		break;
+	case TARGET_GROUP:
+		switch (tween->property) {
+		case TWEEN_X:
+		case TWEEN_Y:
+			get_group_xy(tween->group, &x_f, &y_f);
+			if (tween->property == TWEEN_X) x_f = value[0];
+			else y_f = value[0];
+			set_group_xy(tween->group, x_f, y_f);
+			break;
+		case TWEEN_ROT_X:
+		case TWEEN_ROT_Y:
+			get_group_rot_xy(tween->group, &x_f, &y_f);
+			if (tween->property == TWEEN_ROT_X) x_f = value[0];
+			else y_f = value[0];
+			set_group_rot_xy(tween->group, x_f, y_f);
+			break;
+		case TWEEN_ANGLE:
+			set_group_angle(tween->group, value[0]);
+			break;
+		default:
+			break;
+		}
+		break;
+	case TARGET_SOUND:
+		if (tween->property == TWEEN_VOLUME)
+			set_sound_gain(tween->sound, value[0]);
+		else
+			set_sound_pan(tween->sound, value[0]);
+		break;
+	}
+}
+
+static void
+remove_tween(int index)
+{
+	tween_t* tween;
+
+	int i;
+
+	tween = s_tweens[index];
+	for (i = index; i < s_num_tweens - 1; ++i)
+		s_tweens[i] = s_tweens[i + 1];
+	--s_num_tweens;
+	tween->is_running = false;
+	if (tween->target_type == TARGET_PERSON)
+		tween->person = NULL;
+	free_tween(tween);
+}
+
+void
+init_tween_api(void)
+{
+	register_api_const(g_duk, "EASE_LINEAR", EASE_LINEAR);
+	register_api_const(g_duk, "EASE_IN_QUAD", EASE_IN_QUAD);
+	register_api_const(g_duk, "EASE_OUT_QUAD", EASE_OUT_QUAD);
+	register_api_const(g_duk, "EASE_IN_OUT_QUAD", EASE_IN_OUT_QUAD);
+	register_api_const(g_duk, "EASE_IN_CUBIC", EASE_IN_CUBIC);
+	register_api_const(g_duk, "EASE_OUT_CUBIC", EASE_OUT_CUBIC);
+	register_api_const(g_duk, "EASE_IN_OUT_CUBIC", EASE_IN_OUT_CUBIC);
+	register_api_const(g_duk, "EASE_IN_SINE", EASE_IN_SINE);
+	register_api_const(g_duk, "EASE_OUT_SINE", EASE_OUT_SINE);
+	register_api_const(g_duk, "EASE_IN_OUT_SINE", EASE_IN_OUT_SINE);
+	register_api_const(g_duk, "EASE_OUT_BACK", EASE_OUT_BACK);
+	register_api_const(g_duk, "EASE_OUT_BOUNCE", EASE_OUT_BOUNCE);
+	register_api_function(g_duk, NULL, "GetNumTweens", js_GetNumTweens);
+	register_api_ctor(g_duk, "Tween", js_new_Tween, js_Tween_finalize);
+	register_api_prop(g_duk, "Tween", "delay", js_Tween_get_delay, js_Tween_set_delay);
+	register_api_prop(g_duk, "Tween", "running", js_Tween_get_running, NULL);
+	register_api_function(g_duk, "Tween", "onFinish", js_Tween_onFinish);
+	register_api_function(g_duk, "Tween", "start", js_Tween_start);
+	register_api_function(g_duk, "Tween", "stop", js_Tween_stop);
+	register_api_function(g_duk, "Tween", "then", js_Tween_then);
+}
+
+static duk_ret_t
+js_GetNumTweens(duk_context* ctx)
+{
+	duk_push_int(ctx, get_tween_count());
+	return 1;
+}
+
+static duk_ret_t
+js_new_Tween(duk_context* ctx)
+{
+	int n_args = duk_get_top(ctx);
+	const char* prop_name = duk_require_string(ctx, 1);
+	int frames = duk_require_int(ctx, 3);
+	int easing = n_args >= 5 ? duk_require_int(ctx, 4) : EASE_LINEAR;
+
+	color_t      color;
+	tween_prop_t property;
+	tween_t*     tween;
+	float        value[4];
+
+	for (property = 0; property < TWEEN_PROP_MAX; ++property) {
+		if (strcmp(prop_name, s_prop_names[property]) == 0)
+			break;
+	}
+	if (property >= TWEEN_PROP_MAX)
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Tween(): Unknown property '%s'", prop_name);
+	if (frames < 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Tween(): Frame count can't be negative (%i)", frames);
+	if (easing < 0 || easing >= EASE_MAX)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Tween(): Invalid easing constant");
+	if (property == TWEEN_MASK) {
+		color = duk_require_sphere_color(ctx, 2);
+		value[0] = color.r; value[1] = color.g;
+		value[2] = color.b; value[3] = color.alpha;
+	}
+	else
+		value[0] = duk_require_number(ctx, 2);
+	if (duk_is_string(ctx, 0))
+		tween = new_person_tween(duk_get_string(ctx, 0), property, value, frames, easing);
+	else if (duk_is_sphere_obj(ctx, 0, "Group"))
+		tween = new_group_tween(duk_require_sphere_obj(ctx, 0, "Group"), property, value, frames, easing);
+	else if (duk_is_sphere_obj(ctx, 0, "Sound"))
+		tween = new_sound_tween(duk_require_sphere_obj(ctx, 0, "Sound"), property, value, frames, easing);
+	else
+		duk_error_ni(ctx, -1, DUK_ERR_TYPE_ERROR, "Tween(): Target must be a person name, Group or Sound");
+	if (tween == NULL)
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Tween(): Can't tween '%s' of this target", prop_name);
+	duk_push_sphere_obj(ctx, "Tween", tween);
+	return 1;
+}
+
+static duk_ret_t
+js_Tween_finalize(duk_context* ctx)
+{
+	tween_t* tween;
+
+	tween = duk_require_sphere_obj(ctx, 0, "Tween");
+	free_tween(tween);
+	return 0;
+}
+
+static duk_ret_t
+js_Tween_get_delay(duk_context* ctx)
+{
+	tween_t* tween;
+
+	duk_push_this(ctx);
+	tween = duk_require_sphere_obj(ctx, -1, "Tween");
+	duk_pop(ctx);
+	duk_push_int(ctx, get_tween_delay(tween));
+	return 1;
+}
+
+static duk_ret_t
+js_Tween_get_running(duk_context* ctx)
+{
+	tween_t* tween;
+
+	duk_push_this(ctx);
+	tween = duk_require_sphere_obj(ctx, -1, "Tween");
+	duk_pop(ctx);
+	duk_push_boolean(ctx, is_tween_running(tween));
+	return 1;
+}
+
+static duk_ret_t
+js_Tween_set_delay(duk_context* ctx)
+{
+	int frames = duk_require_int(ctx, 0);
+
+	tween_t* tween;
+
+	duk_push_this(ctx);
+	tween = duk_require_sphere_obj(ctx, -1, "Tween");
+	duk_pop(ctx);
+	if (frames < 0)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Tween:delay: Delay can't be negative (%i)", frames);
+	set_tween_delay(tween, frames);
+	return 0;
+}
+
+static duk_ret_t
+js_Tween_onFinish(duk_context* ctx)
+{
+	script_t* script = duk_require_sphere_script(ctx, 0, "[tween callback]");
+
+	tween_t* tween;
+
+	duk_push_this(ctx);
+	tween = duk_require_sphere_obj(ctx, -1, "Tween");
+	set_tween_script(tween, script);
+	return 1;
+}
+
+static duk_ret_t
+js_Tween_start(duk_context* ctx)
+{
+	tween_t* tween;
+
+	duk_push_this(ctx);
+	tween = duk_require_sphere_obj(ctx, -1, "Tween");
+	if (!start_tween(tween))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Tween:start(): Failed to start tween (does the person exist?)");
+	return 1;
+}
+
+static duk_ret_t
+js_Tween_stop(duk_context* ctx)
+{
+	tween_t* tween;
+
+	duk_push_this(ctx);
+	tween = duk_require_sphere_obj(ctx, -1, "Tween");
+	duk_pop(ctx);
+	stop_tween(tween);
+	return 0;
+}
+
+static duk_ret_t
+js_Tween_then(duk_context* ctx)
+{
+	tween_t* next = duk_require_sphere_obj(ctx, 0, "Tween");
+
+	tween_t* tween;
+
+	duk_push_this(ctx);
+	tween = duk_require_sphere_obj(ctx, -1, "Tween");
+	duk_pop(ctx);
+	if (!set_tween_next(tween, next))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Tween:then(): Tween can't follow itself, directly or through a chain");
+	duk_dup(ctx, 0);
+	return 1;
+}
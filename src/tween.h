@@ -0,0 +1,66 @@
+#ifndef MINISPHERE__TWEEN_H__INCLUDED
+#define MINISPHERE__TWEEN_H__INCLUDED
+
+#include "galileo.h"
+#include "persons.h"
+#include "sound.h"
+
+typedef struct tween tween_t;
+
+typedef enum tween_ease tween_ease_t;
+typedef enum tween_prop tween_prop_t;
+
+extern void     initialize_tweens    (void);
+extern void     shutdown_tweens      (void);
+extern tween_t* new_person_tween     (const char* person_name, tween_prop_t property, const float value[4], int frames, tween_ease_t easing);
+extern tween_t* new_group_tween      (group_t* group, tween_prop_t property, const float value[4], int frames, tween_ease_t easing);
+extern tween_t* new_sound_tween      (sound_t* sound, tween_prop_t property, const float value[4], int frames, tween_ease_t easing);
+extern tween_t* ref_tween            (tween_t* tween);
+extern void     free_tween           (tween_t* tween);
+extern bool     is_tween_running     (const tween_t* tween);
+extern int      get_tween_count      (void);
+extern int      get_tween_delay      (const tween_t* tween);
+extern void     set_tween_delay      (tween_t* tween, int frames);
+extern bool     set_tween_next       (tween_t* tween, tween_t* next);
+extern void     set_tween_script     (tween_t* tween, script_t* script);
+extern bool     start_tween          (tween_t* tween);
+extern void     stop_tween           (tween_t* tween);
+extern void     detach_person_tweens (const person_t* person);
+extern void     end_tween_frame      (void);
+extern void     update_tweens        (void);
+
+extern void init_tween_api (void);
+
+enum tween_ease
+{
+	EASE_LINEAR,
+	EASE_IN_QUAD,
+	EASE_OUT_QUAD,
+	EASE_IN_OUT_QUAD,
+	EASE_IN_CUBIC,
+	EASE_OUT_CUBIC,
+	EASE_IN_OUT_CUBIC,
+	EASE_IN_SINE,
+	EASE_OUT_SINE,
+	EASE_IN_OUT_SINE,
+	EASE_OUT_BACK,
+	EASE_OUT_BOUNCE,
+	EASE_MAX
+};
+
+enum tween_prop
+{
+	TWEEN_X,
+	TWEEN_Y,
+	TWEEN_ANGLE,
+	TWEEN_SCALE_X,
+	TWEEN_SCALE_Y,
+	TWEEN_MASK,
+	TWEEN_ROT_X,
+	TWEEN_ROT_Y,
+	TWEEN_VOLUME,
+	TWEEN_PAN,
+	TWEEN_PROP_MAX
+};
+
+#endif // MINISPHERE__TWEEN_H__INCLUDED
@@ -2,6 +2,7 @@
 #include "api.h"
 #include "color.h"
 #include "image.h"
+#include "render.h"
 
 #include "windowstyle.h"
 
@@ -14,6 +15,27 @@ static duk_ret_t js_WindowStyle_set_colorMask (duk_context* ctx);
 static duk_ret_t js_WindowStyle_toString      (duk_context* ctx);
 static duk_ret_t js_WindowStyle_drawWindow    (duk_context* ctx);
 
+// note: a window is nine slices, most of them tiled, which would take nine
+//       draw calls (more for a big tiled background) if drawn as separate
+//       images. instead, the slices are copied side by side into one atlas
+//       when the windowstyle is loaded and every tile of every slice becomes
+//       a quad in a single vertex list, drawn with one al_draw_prim() call.
+//       the atlas can't wrap texture coordinates the way a lone image can,
+//       so tiles are laid out one by one, with the last in each row and
+//       column cut short.
+//
+//       menus draw the same few windows every frame, so the vertices for the
+//       last several sizes and masks used with each windowstyle are kept and
+//       reused, positioned by the transform.
+
+#define WINDOW_CACHE_SIZE 8
+
+static bool                 build_window_atlas (windowstyle_t* winstyle);
+static struct window_cache* get_window_mesh    (windowstyle_t* winstyle, color_t mask, int width, int height);
+static ALLEGRO_VERTEX*      add_quad           (ALLEGRO_VERTEX* v, ALLEGRO_COLOR color, float x, float y, float width, float height, float u, float v0, float u_size, float v_size);
+static ALLEGRO_VERTEX*      add_slice_tiles    (const windowstyle_t* winstyle, int slice, ALLEGRO_COLOR color, ALLEGRO_VERTEX* v, int x, int y, int width, int height);
+static int                  count_slice_tiles  (const windowstyle_t* winstyle, int slice, int width, int height);
+
 static windowstyle_t* s_sys_winstyle = NULL;
 
 enum wstyle_bg_type
@@ -25,11 +47,24 @@ enum wstyle_bg_type
 	WSTYLE_BG_STRETCH_GRADIENT
 };
 
+struct window_cache
+{
+	int             width, height;
+	color_t         mask;
+	unsigned int    last_used;
+	int             num_vertices;
+	ALLEGRO_VERTEX* vertices;
+};
+
 struct windowstyle
 {
-	int      refcount;
-	int      bg_style;
-	image_t* images[9];
+	int                 refcount;
+	int                 bg_style;
+	image_t*            images[9];
+	image_t*            atlas;
+	int                 atlas_x[9];
+	unsigned int        cache_clock;
+	struct window_cache cache[WINDOW_CACHE_SIZE];
 };
 
 #pragma pack(push, 1)
@@ -86,6 +121,7 @@ load_windowstyle(const char* path)
 	}
 	fclose(file);
 	winstyle->bg_style = rws.background_mode;
+	build_window_atlas(winstyle);
 	return ref_windowstyle(winstyle);
 
 on_error:
@@ -115,16 +151,35 @@ free_windowstyle(windowstyle_t* winstyle)
 	for (i = 0; i < 9; ++i) {
 		free_image(winstyle->images[i]);
 	}
+	for (i = 0; i < WINDOW_CACHE_SIZE; ++i)
+		free(winstyle->cache[i].vertices);
+	free_image(winstyle->atlas);
 	free(winstyle);
 }
 
 void
 draw_window(windowstyle_t* winstyle, color_t mask, int x, int y, int width, int height)
 {
-	int             w[9], h[9];
+	struct window_cache* mesh;
+	ALLEGRO_TRANSFORM    old_transform;
+	ALLEGRO_TRANSFORM    transform;
+	int                  w[9], h[9];
 	
 	int i;
 	
+	if (winstyle->atlas != NULL && (mesh = get_window_mesh(winstyle, mask, width, height))) {
+		if (mesh->num_vertices == 0)
+			return;
+		al_copy_transform(&old_transform, al_get_current_transform());
+		al_identity_transform(&transform);
+		al_translate_transform(&transform, x, y);
+		al_compose_transform(&transform, &old_transform);
+		al_use_transform(&transform);
+		al_draw_prim(mesh->vertices, NULL, get_image_bitmap(winstyle->atlas), 0, mesh->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+		al_use_transform(&old_transform);
+		return;
+	}
+	
 	// 0 - upper left
 	// 1 - top
 	// 2 - upper right
@@ -158,6 +213,165 @@ draw_window(windowstyle_t* winstyle, color_t mask, int x, int y, int width, int
 	draw_image_tiled_masked(winstyle->images[7], mask, x - w[7], y, w[7], height);
 }
 
+static bool
+build_window_atlas(windowstyle_t* winstyle)
+{
+	image_t*      atlas;
+	int           atlas_w = 0, atlas_h = 0;
+	ALLEGRO_STATE old_state;
+	int           x;
+
+	int i;
+
+	for (i = 0; i < 9; ++i) {
+		atlas_w += get_image_width(winstyle->images[i]);
+		atlas_h = fmax(atlas_h, get_image_height(winstyle->images[i]));
+	}
+	if (atlas_w == 0 || atlas_h == 0)
+		return false;
+	if (!(atlas = create_image(atlas_w, atlas_h)))
+		return false;
+	flush_render_batch();
+	al_store_state(&old_state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_TRANSFORM | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(get_image_bitmap(atlas));
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+	x = 0;
+	for (i = 0; i < 9; ++i) {
+		al_draw_bitmap(get_image_bitmap(winstyle->images[i]), x, 0, 0x0);
+		winstyle->atlas_x[i] = x;
+		x += get_image_width(winstyle->images[i]);
+	}
+	al_restore_state(&old_state);
+	winstyle->atlas = atlas;
+	return true;
+}
+
+static struct window_cache*
+get_window_mesh(windowstyle_t* winstyle, color_t mask, int width, int height)
+{
+	ALLEGRO_COLOR        color;
+	struct window_cache* entry;
+	int                  max_vertices;
+	ALLEGRO_VERTEX*      new_vertices;
+	ALLEGRO_VERTEX*      v;
+	struct window_cache* victim;
+	int                  w[9], h[9];
+
+	int i;
+
+	victim = &winstyle->cache[0];
+	for (i = 0; i < WINDOW_CACHE_SIZE; ++i) {
+		entry = &winstyle->cache[i];
+		if (entry->vertices != NULL && entry->width == width && entry->height == height
+			&& entry->mask.r == mask.r && entry->mask.g == mask.g && entry->mask.b == mask.b
+			&& entry->mask.alpha == mask.alpha)
+		{
+			entry->last_used = winstyle->cache_clock++;
+			return entry;
+		}
+		if (entry->vertices == NULL || (victim->vertices != NULL && entry->last_used < victim->last_used))
+			victim = entry;
+	}
+
+	for (i = 0; i < 9; ++i) {
+		w[i] = get_image_width(winstyle->images[i]);
+		h[i] = get_image_height(winstyle->images[i]);
+	}
+	max_vertices = count_slice_tiles(winstyle, 1, width, h[1])
+		+ count_slice_tiles(winstyle, 3, w[3], height)
+		+ count_slice_tiles(winstyle, 5, width, h[5])
+		+ count_slice_tiles(winstyle, 7, w[7], height)
+		+ 4 * 6 + 6;
+	if (winstyle->bg_style == WSTYLE_BG_TILE)
+		max_vertices += count_slice_tiles(winstyle, 8, width, height);
+	if (!(new_vertices = realloc(victim->vertices, max_vertices * sizeof(ALLEGRO_VERTEX))))
+		return NULL;
+	victim->vertices = new_vertices;
+
+	// same order as the slices would be drawn one by one: background first,
+	// then corners, then edges
+	color = nativecolor(mask);
+	v = victim->vertices;
+	switch (winstyle->bg_style) {
+	case WSTYLE_BG_TILE:
+		v = add_slice_tiles(winstyle, 8, color, v, 0, 0, width, height);
+		break;
+	case WSTYLE_BG_STRETCH:
+		if (width > 0 && height > 0)
+			v = add_quad(v, color, 0, 0, width, height, winstyle->atlas_x[8], 0, w[8], h[8]);
+		break;
+	}
+	v = add_slice_tiles(winstyle, 0, color, v, -w[0], -h[0], w[0], h[0]);
+	v = add_slice_tiles(winstyle, 2, color, v, width, -h[2], w[2], h[2]);
+	v = add_slice_tiles(winstyle, 4, color, v, width, height, w[4], h[4]);
+	v = add_slice_tiles(winstyle, 6, color, v, -w[6], height, w[6], h[6]);
+	v = add_slice_tiles(winstyle, 1, color, v, 0, -h[1], width, h[1]);
+	v = add_slice_tiles(winstyle, 3, color, v, width, 0, w[3], height);
+	v = add_slice_tiles(winstyle, 5, color, v, 0, height, width, h[5]);
+	v = add_slice_tiles(winstyle, 7, color, v, -w[7], 0, w[7], height);
+	victim->num_vertices = v - victim->vertices;
+	victim->width = width;
+	victim->height = height;
+	victim->mask = mask;
+	victim->last_used = winstyle->cache_clock++;
+	return victim;
+}
+
+static ALLEGRO_VERTEX*
+add_quad(ALLEGRO_VERTEX* v, ALLEGRO_COLOR color, float x, float y, float width, float height, float u, float v0, float u_size, float v_size)
+{
+	float x1, y1;
+	float u1, v1;
+
+	x1 = x + width; y1 = y + height;
+	u1 = u + u_size; v1 = v0 + v_size;
+	v[0].x = x; v[0].y = y; v[0].u = u; v[0].v = v0;
+	v[1].x = x1; v[1].y = y; v[1].u = u1; v[1].v = v0;
+	v[2].x = x; v[2].y = y1; v[2].u = u; v[2].v = v1;
+	v[3] = v[1];
+	v[4].x = x1; v[4].y = y1; v[4].u = u1; v[4].v = v1;
+	v[5] = v[2];
+	v[0].z = v[1].z = v[2].z = v[3].z = v[4].z = v[5].z = 0.0;
+	v[0].color = v[1].color = v[2].color = v[3].color = v[4].color = v[5].color = color;
+	return v + 6;
+}
+
+static ALLEGRO_VERTEX*
+add_slice_tiles(const windowstyle_t* winstyle, int slice, ALLEGRO_COLOR color, ALLEGRO_VERTEX* v, int x, int y, int width, int height)
+{
+	int tile_w, tile_h;
+	int w, h;
+
+	int i_x, i_y;
+
+	w = get_image_width(winstyle->images[slice]);
+	h = get_image_height(winstyle->images[slice]);
+	if (w <= 0 || h <= 0)
+		return v;
+	for (i_y = 0; i_y < height; i_y += h) {
+		for (i_x = 0; i_x < width; i_x += w) {
+			tile_w = fmin(w, width - i_x);
+			tile_h = fmin(h, height - i_y);
+			v = add_quad(v, color, x + i_x, y + i_y, tile_w, tile_h,
+				winstyle->atlas_x[slice], 0, tile_w, tile_h);
+		}
+	}
+	return v;
+}
+
+static int
+count_slice_tiles(const windowstyle_t* winstyle, int slice, int width, int height)
+{
+	int w, h;
+
+	w = get_image_width(winstyle->images[slice]);
+	h = get_image_height(winstyle->images[slice]);
+	if (w <= 0 || h <= 0 || width <= 0 || height <= 0)
+		return 0;
+	return ((width + w - 1) / w) * ((height + h - 1) / h) * 6;
+}
+
 void
 init_windowstyle_api(void)
 {
@@ -282,6 +496,7 @@ js_WindowStyle_drawWindow(duk_context* ctx)
 	winstyle = duk_require_sphere_obj(ctx, -1, "WindowStyle");
 	duk_get_prop_string(ctx, -1, "\xFF" "color_mask"); mask = duk_require_sphere_color(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	reset_render_state();
 	draw_window(winstyle, mask, x, y, w, h);
 	return 0;
 }